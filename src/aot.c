@@ -0,0 +1,776 @@
+// Scrap is a project that allows anyone to build software using simple, block based interface.
+//
+// Copyright (C) 2024-2026 Grisshink
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+// Ahead-of-time translator from bytecode into C.
+//
+// All bytecode is translated into a single C function which accepts the position to start executing from,
+// every label becomes a C label and all jumps become gotos, so C compiler is free to optimize loops as a whole.
+// IR_CALL is translated into recursive call of this function, same as in interpreter.
+//
+// Operand stack is mapped onto C locals (slots) while it's provable what they hold, that is inside straight
+// runs of code between labels, jumps and calls. Slots are flushed onto the exec stack before any instruction
+// the translator cannot follow statically and before anything that may trigger garbage collection,
+// as collector does not know about values held in C locals.
+
+#include "aot.h"
+#include "std.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+
+#define AOT_MAX_SLOTS 64
+#define AOT_IMMEDIATE(i) (((size_t)bc->code.items[(i) + 1] << 16) | ((size_t)bc->code.items[(i) + 2] << 8) | (size_t)bc->code.items[(i) + 3])
+
+typedef enum {
+    AOT_SLOT_INT,
+    AOT_SLOT_FLOAT,
+    AOT_SLOT_BOOL,
+    AOT_SLOT_VALUE, // IrValue of type unknown at translation time
+} AotSlotType;
+
+typedef struct {
+    FILE* out;
+    IrBytecode* bc;
+    IrConstValue* consts;
+
+    AotSlotType slots[AOT_MAX_SLOTS];
+    size_t slots_size;
+    size_t slots_max;
+
+    bool* is_label;
+    bool uses_dispatch;
+    bool uses_list;
+    bool uses_func;
+
+    const char* symbols[256];
+    size_t symbols_size;
+
+    char* error;
+    size_t error_len;
+} AotTranslator;
+
+static const char slot_prefix[] = { 'i', 'f', 'b', 'v' };
+
+static const char* op_names[IR_LAST] = {
+    [IR_EQ] = "IR_EQ",
+    [IR_NEQ] = "IR_NEQ",
+    [IR_ITOA] = "IR_ITOA",
+    [IR_FTOA] = "IR_FTOA",
+    [IR_BTOA] = "IR_BTOA",
+    [IR_NTOA] = "IR_NTOA",
+    [IR_LTOA] = "IR_LTOA",
+    [IR_ATOI] = "IR_ATOI",
+    [IR_ATOF] = "IR_ATOF",
+    [IR_ATOB] = "IR_ATOB",
+    [IR_TOI] = "IR_TOI",
+    [IR_TOF] = "IR_TOF",
+    [IR_TOB] = "IR_TOB",
+    [IR_TOA] = "IR_TOA",
+    [IR_TOL] = "IR_TOL",
+    [IR_TYPEOF] = "IR_TYPEOF",
+    [IR_ADDL] = "IR_ADDL",
+    [IR_INDEXL] = "IR_INDEXL",
+    [IR_SETL] = "IR_SETL",
+    [IR_INSERTL] = "IR_INSERTL",
+    [IR_DELL] = "IR_DELL",
+    [IR_LENL] = "IR_LENL",
+};
+
+static IrValueType op_immediate_type(IrOpcode op) {
+    switch (op) {
+    case IR_PUSHF: return IR_TYPE_FLOAT;
+    case IR_PUSHB: return IR_TYPE_BOOL;
+    case IR_PUSHL:
+    case IR_PUSHA:
+        return IR_TYPE_LIST;
+    case IR_PUSHFN:
+    case IR_RUN:
+        return IR_TYPE_FUNC;
+    case IR_PUSHLB:
+    case IR_JMP:
+    case IR_IF:
+    case IR_IFNOT:
+    case IR_CALL:
+        return IR_TYPE_LABEL;
+    case IR_CALLX:
+        return IR_TYPE_IMPORT;
+    default: return IR_TYPE_INT;
+    }
+}
+
+static bool aot_verify(AotTranslator* aot) {
+    IrBytecode* bc = aot->bc;
+    size_t consts_size = bc->pool->list.size;
+    bool* is_start = calloc(bc->code.size + 1, sizeof(bool));
+    bool ok = false;
+
+    for (size_t i = 0; i < bc->code.size; i++) {
+        is_start[i] = true;
+
+        IrOpcode op = bc->code.items[i];
+        if (op <= IR_ILLEGAL || op >= IR_LAST) {
+            snprintf(aot->error, aot->error_len, "Illegal op %d at position %zu", op, i);
+            goto verify_return;
+        }
+        if (!ir_op_has_immediate(op)) continue;
+
+        if (i + 3 >= bc->code.size) {
+            snprintf(aot->error, aot->error_len, "Truncated instruction at position %zu", i);
+            goto verify_return;
+        }
+
+        size_t id = AOT_IMMEDIATE(i);
+        if (id >= consts_size) {
+            snprintf(aot->error, aot->error_len, "Constant %zu at position %zu is out of range", id, i);
+            goto verify_return;
+        }
+        IrValueType type = aot->consts[id].type;
+        // Interpreter treats list and string constants the same way
+        if (type == IR_TYPE_STRING && op_immediate_type(op) == IR_TYPE_LIST) type = IR_TYPE_LIST;
+        if (type != op_immediate_type(op)) {
+            snprintf(aot->error, aot->error_len, "Constant %zu at position %zu has invalid type", id, i);
+            goto verify_return;
+        }
+        if (op_immediate_type(op) == IR_TYPE_LABEL) {
+            if (aot->consts[id].as.label_val.pos > bc->code.size) {
+                snprintf(aot->error, aot->error_len, "Label \"%s\" points outside of bytecode", aot->consts[id].as.label_val.name);
+                goto verify_return;
+            }
+            aot->is_label[aot->consts[id].as.label_val.pos] = true;
+        }
+        if (op == IR_RUN && !aot->consts[id].as.func_val.hint) {
+            snprintf(aot->error, aot->error_len, "Function at position %zu has no name", i);
+            goto verify_return;
+        }
+        i += 3;
+    }
+    is_start[bc->code.size] = true;
+
+    for (size_t i = 0; i < bc->labels.size; i++) {
+        if (bc->labels.items[i] >= consts_size || aot->consts[bc->labels.items[i]].type != IR_TYPE_LABEL) {
+            snprintf(aot->error, aot->error_len, "Bytecode label %zu is not a label constant", i);
+            goto verify_return;
+        }
+        IrLabel* label = &aot->consts[bc->labels.items[i]].as.label_val;
+        if (label->pos > bc->code.size) {
+            snprintf(aot->error, aot->error_len, "Label \"%s\" points outside of bytecode", label->name);
+            goto verify_return;
+        }
+        aot->is_label[label->pos] = true;
+    }
+
+    for (size_t i = 0; i <= bc->code.size; i++) {
+        if (aot->is_label[i] && !is_start[i]) {
+            snprintf(aot->error, aot->error_len, "Label at position %zu points inside of instruction", i);
+            goto verify_return;
+        }
+    }
+
+    ok = true;
+
+verify_return:
+    free(is_start);
+    return ok;
+}
+
+static void aot_emit_slot(AotTranslator* aot, size_t slot) {
+    fprintf(aot->out, "%c%zu", slot_prefix[aot->slots[slot]], slot);
+}
+
+// Emits expression that reads slot as specified type
+static void aot_emit_slot_as(AotTranslator* aot, size_t slot, AotSlotType type) {
+    static const char* value_fields[] = { "int_val", "float_val", "bool_val" };
+    static const char* casts[] = { "(int64_t)", "(double)", "(bool)" };
+
+    if (aot->slots[slot] == type) {
+        aot_emit_slot(aot, slot);
+    } else if (aot->slots[slot] == AOT_SLOT_VALUE) {
+        aot_emit_slot(aot, slot);
+        fprintf(aot->out, ".as.%s", value_fields[type]);
+    } else {
+        fprintf(aot->out, "%s", casts[type]);
+        aot_emit_slot(aot, slot);
+    }
+}
+
+// Emits expression that converts slot into IrValue
+static void aot_emit_slot_value(AotTranslator* aot, size_t slot) {
+    switch (aot->slots[slot]) {
+    case AOT_SLOT_INT:   fprintf(aot->out, "(IrValue) { .type = IR_TYPE_INT, .as.int_val = "); break;
+    case AOT_SLOT_FLOAT: fprintf(aot->out, "(IrValue) { .type = IR_TYPE_FLOAT, .as.float_val = "); break;
+    case AOT_SLOT_BOOL:  fprintf(aot->out, "(IrValue) { .type = IR_TYPE_BOOL, .as.bool_val = "); break;
+    case AOT_SLOT_VALUE:
+        aot_emit_slot(aot, slot);
+        return;
+    }
+    aot_emit_slot(aot, slot);
+    fprintf(aot->out, " }");
+}
+
+// Pushes all slots onto the exec stack
+static void aot_flush(AotTranslator* aot) {
+    static const char* push_funcs[] = { "exec_push_int", "exec_push_float", "exec_push_bool", "exec_push_value" };
+
+    for (size_t i = 0; i < aot->slots_size; i++) {
+        fprintf(aot->out, "    %s(exec, ", push_funcs[aot->slots[i]]);
+        aot_emit_slot(aot, i);
+        fprintf(aot->out, ");\n");
+    }
+    aot->slots_size = 0;
+}
+
+// Allocates new slot on top of the stack and emits assignment to it. Caller should emit the value and ";\n" after that
+static size_t aot_push_slot(AotTranslator* aot, AotSlotType type) {
+    if (aot->slots_size >= AOT_MAX_SLOTS) aot_flush(aot);
+
+    size_t slot = aot->slots_size++;
+    aot->slots[slot] = type;
+    if (aot->slots_size > aot->slots_max) aot->slots_max = aot->slots_size;
+
+    fprintf(aot->out, "    ");
+    aot_emit_slot(aot, slot);
+    fprintf(aot->out, " = ");
+    return slot;
+}
+
+// Makes sure top count values of the stack are in slots, popping missing ones from the exec stack.
+// types contains expected types of these values from the bottom to the top
+static void aot_pull(AotTranslator* aot, size_t count, const AotSlotType* types) {
+    static const char* pop_funcs[] = { "exec_pop_int", "exec_pop_float", "exec_pop_bool", "exec_pop_value" };
+
+    if (aot->slots_size >= count) return;
+    size_t missing = count - aot->slots_size;
+
+    for (size_t i = aot->slots_size; i > 0; i--) {
+        aot->slots[i - 1 + missing] = aot->slots[i - 1];
+        fprintf(aot->out, "    ");
+        aot_emit_slot(aot, i - 1 + missing);
+        fprintf(aot->out, " = ");
+        aot_emit_slot(aot, i - 1);
+        fprintf(aot->out, ";\n");
+    }
+
+    for (size_t i = missing; i > 0; i--) {
+        aot->slots[i - 1] = types[i - 1];
+        fprintf(aot->out, "    ");
+        aot_emit_slot(aot, i - 1);
+        fprintf(aot->out, " = %s(exec);\n", pop_funcs[types[i - 1]]);
+    }
+
+    aot->slots_size = count;
+    if (aot->slots_size > aot->slots_max) aot->slots_max = aot->slots_size;
+}
+
+static void aot_binary(AotTranslator* aot, AotSlotType in_type, AotSlotType out_type, const char* fmt_start, const char* fmt_mid, const char* fmt_end) {
+    AotSlotType types[2] = { in_type, in_type };
+    aot_pull(aot, 2, types);
+
+    size_t left = aot->slots_size - 2, right = aot->slots_size - 1;
+    AotSlotType left_type = aot->slots[left];
+
+    aot->slots[left] = out_type;
+    fprintf(aot->out, "    ");
+    aot_emit_slot(aot, left);
+    aot->slots[left] = left_type;
+
+    fprintf(aot->out, " = %s", fmt_start);
+    aot_emit_slot_as(aot, left, in_type);
+    fprintf(aot->out, "%s", fmt_mid);
+    aot_emit_slot_as(aot, right, in_type);
+    fprintf(aot->out, "%s;\n", fmt_end);
+
+    aot->slots[left] = out_type;
+    aot->slots_size--;
+}
+
+static void aot_unary(AotTranslator* aot, AotSlotType in_type, AotSlotType out_type, const char* fmt_start, const char* fmt_end) {
+    aot_pull(aot, 1, &in_type);
+
+    size_t slot = aot->slots_size - 1;
+    AotSlotType slot_type = aot->slots[slot];
+
+    aot->slots[slot] = out_type;
+    fprintf(aot->out, "    ");
+    aot_emit_slot(aot, slot);
+    aot->slots[slot] = slot_type;
+
+    fprintf(aot->out, " = %s", fmt_start);
+    aot_emit_slot_as(aot, slot, in_type);
+    fprintf(aot->out, "%s;\n", fmt_end);
+
+    aot->slots[slot] = out_type;
+}
+
+static void aot_exec_op(AotTranslator* aot, IrOpcode op) {
+    aot_flush(aot);
+    fprintf(aot->out, "    if (!exec_op(exec, %s)) goto fail;\n", op_names[op]);
+}
+
+// Same fuel metering as in the interpreter, so translated programs can be interrupted and limited too
+static void aot_use_fuel(AotTranslator* aot, const char* indent) {
+    fprintf(aot->out, "%sif (!exec_use_fuel(exec)) goto fail;\n", indent);
+}
+
+static void aot_add_symbol(AotTranslator* aot, const char* symbol) {
+    for (size_t i = 0; i < aot->symbols_size; i++) {
+        if (!strcmp(aot->symbols[i], symbol)) return;
+    }
+    if (aot->symbols_size < sizeof(aot->symbols) / sizeof(aot->symbols[0])) aot->symbols[aot->symbols_size++] = symbol;
+}
+
+static void aot_translate_op(AotTranslator* aot, size_t i) {
+    IrBytecode* bc = aot->bc;
+    IrOpcode op = bc->code.items[i];
+    size_t id = ir_op_has_immediate(op) ? AOT_IMMEDIATE(i) : 0;
+    IrConstValue* value = &aot->consts[id];
+    size_t slot;
+
+    static_assert(IR_LAST == 83, "Exhaustive opcode in aot_translate_op");
+    switch (op) {
+    case IR_PUSHN:
+        aot_push_slot(aot, AOT_SLOT_VALUE);
+        fprintf(aot->out, "(IrValue) {0};\n");
+        break;
+    case IR_PUSHI:
+        aot_push_slot(aot, AOT_SLOT_INT);
+        if (value->as.int_val == INT64_MIN) {
+            fprintf(aot->out, "INT64_MIN;\n");
+        } else {
+            fprintf(aot->out, "INT64_C(%" PRId64 ");\n", value->as.int_val);
+        }
+        break;
+    case IR_PUSHF:
+        aot_push_slot(aot, AOT_SLOT_FLOAT);
+        if (isfinite(value->as.float_val)) {
+            fprintf(aot->out, "%a;\n", value->as.float_val);
+        } else {
+            fprintf(aot->out, "consts[%zu].as.float_val;\n", id);
+        }
+        break;
+    case IR_PUSHB:
+        aot_push_slot(aot, AOT_SLOT_BOOL);
+        fprintf(aot->out, "%s;\n", value->as.bool_val ? "true" : "false");
+        break;
+    case IR_PUSHL:
+    case IR_PUSHA:
+        if (value->as.list_val) {
+            aot_push_slot(aot, AOT_SLOT_VALUE);
+            fprintf(aot->out, "(IrValue) { .type = %s, .as.list_val = consts[%zu].as.list_val };\n", op == IR_PUSHL ? "IR_TYPE_LIST" : "IR_TYPE_STRING", id);
+        } else {
+            // Allocation may run the garbage collector
+            aot_flush(aot);
+            aot->uses_list = true;
+            fprintf(aot->out, "    list = exec_list_new(exec);\n");
+            fprintf(aot->out, "    if (!list) goto fail;\n");
+            fprintf(aot->out, "    %s(exec, list);\n", op == IR_PUSHL ? "exec_push_list" : "exec_push_list_string");
+        }
+        break;
+    case IR_PUSHLB:
+        aot_push_slot(aot, AOT_SLOT_VALUE);
+        fprintf(aot->out, "(IrValue) { .type = IR_TYPE_LABEL, .as.label_val = %zu };\n", value->as.label_val.pos);
+        break;
+    case IR_PUSHFN:
+        aot_push_slot(aot, AOT_SLOT_VALUE);
+        fprintf(aot->out, "(IrValue) { .type = IR_TYPE_FUNC, .as.func_val = consts[%zu].as.func_val.ptr };\n", id);
+        break;
+    case IR_POP:
+        if (aot->slots_size > 0) {
+            aot->slots_size--;
+        } else {
+            fprintf(aot->out, "    exec_pop_value(exec);\n");
+        }
+        break;
+    case IR_POPC: ;
+        size_t count = value->as.int_val;
+        size_t slots_count = count < aot->slots_size ? count : aot->slots_size;
+        aot->slots_size -= slots_count;
+        if (count > slots_count) fprintf(aot->out, "    exec_pop_multiple(exec, %zu);\n", count - slots_count);
+        break;
+    case IR_DUP:
+        if (aot->slots_size > 0 && aot->slots_size < AOT_MAX_SLOTS) {
+            size_t top = aot->slots_size - 1;
+            aot_push_slot(aot, aot->slots[top]);
+            aot_emit_slot(aot, top);
+            fprintf(aot->out, ";\n");
+        } else {
+            aot_flush(aot);
+            fprintf(aot->out, "    exec_dup_value(exec);\n");
+        }
+        break;
+    case IR_LOAD:
+        aot_push_slot(aot, AOT_SLOT_VALUE);
+        fprintf(aot->out, "exec_load_variable(exec, %" PRId64 ");\n", value->as.int_val);
+        break;
+    case IR_GLOAD:
+        aot_push_slot(aot, AOT_SLOT_VALUE);
+        fprintf(aot->out, "exec_load_global(exec, %" PRId64 ");\n", value->as.int_val);
+        break;
+    case IR_STORE:
+    case IR_GSTORE:
+        fprintf(aot->out, "    %s(exec, %" PRId64 ", ", op == IR_STORE ? "exec_store_variable" : "exec_store_global", value->as.int_val);
+        if (aot->slots_size > 0) {
+            aot_emit_slot_value(aot, aot->slots_size - 1);
+            aot->slots_size--;
+        } else {
+            fprintf(aot->out, "exec_pop_value(exec)");
+        }
+        fprintf(aot->out, ");\n");
+        break;
+
+    case IR_ADDI: aot_binary(aot, AOT_SLOT_INT, AOT_SLOT_INT, "", " + ", ""); break;
+    case IR_SUBI: aot_binary(aot, AOT_SLOT_INT, AOT_SLOT_INT, "", " - ", ""); break;
+    case IR_MULI: aot_binary(aot, AOT_SLOT_INT, AOT_SLOT_INT, "", " * ", ""); break;
+    case IR_DIVI: aot_binary(aot, AOT_SLOT_INT, AOT_SLOT_INT, "", " / ", ""); break;
+    case IR_MODI: aot_binary(aot, AOT_SLOT_INT, AOT_SLOT_INT, "", " % ", ""); break;
+    case IR_POWI: aot_binary(aot, AOT_SLOT_INT, AOT_SLOT_INT, "ir_int_pow(", ", ", ")"); break;
+    case IR_NOTI: aot_unary(aot, AOT_SLOT_INT, AOT_SLOT_INT, "~", ""); break;
+    case IR_ANDI: aot_binary(aot, AOT_SLOT_INT, AOT_SLOT_INT, "", " & ", ""); break;
+    case IR_ORI:  aot_binary(aot, AOT_SLOT_INT, AOT_SLOT_INT, "", " | ", ""); break;
+    case IR_XORI: aot_binary(aot, AOT_SLOT_INT, AOT_SLOT_INT, "", " ^ ", ""); break;
+
+    case IR_ADDF: aot_binary(aot, AOT_SLOT_FLOAT, AOT_SLOT_FLOAT, "", " + ", ""); break;
+    case IR_SUBF: aot_binary(aot, AOT_SLOT_FLOAT, AOT_SLOT_FLOAT, "", " - ", ""); break;
+    case IR_MULF: aot_binary(aot, AOT_SLOT_FLOAT, AOT_SLOT_FLOAT, "", " * ", ""); break;
+    case IR_DIVF: aot_binary(aot, AOT_SLOT_FLOAT, AOT_SLOT_FLOAT, "", " / ", ""); break;
+    case IR_MODF: aot_binary(aot, AOT_SLOT_FLOAT, AOT_SLOT_FLOAT, "fmod(", ", ", ")"); break;
+    case IR_POWF: aot_binary(aot, AOT_SLOT_FLOAT, AOT_SLOT_FLOAT, "pow(", ", ", ")"); break;
+
+    case IR_NOT: aot_unary(aot, AOT_SLOT_BOOL, AOT_SLOT_BOOL, "!", ""); break;
+    case IR_AND: aot_binary(aot, AOT_SLOT_BOOL, AOT_SLOT_BOOL, "", " && ", ""); break;
+    case IR_OR:  aot_binary(aot, AOT_SLOT_BOOL, AOT_SLOT_BOOL, "", " || ", ""); break;
+    case IR_XOR: aot_binary(aot, AOT_SLOT_BOOL, AOT_SLOT_BOOL, "", " != ", ""); break;
+
+    case IR_LESSI:   aot_binary(aot, AOT_SLOT_INT, AOT_SLOT_BOOL, "", " < ", ""); break;
+    case IR_MOREI:   aot_binary(aot, AOT_SLOT_INT, AOT_SLOT_BOOL, "", " > ", ""); break;
+    case IR_LESSEQI: aot_binary(aot, AOT_SLOT_INT, AOT_SLOT_BOOL, "", " <= ", ""); break;
+    case IR_MOREEQI: aot_binary(aot, AOT_SLOT_INT, AOT_SLOT_BOOL, "", " >= ", ""); break;
+    case IR_LESSF:   aot_binary(aot, AOT_SLOT_FLOAT, AOT_SLOT_BOOL, "", " < ", ""); break;
+    case IR_MOREF:   aot_binary(aot, AOT_SLOT_FLOAT, AOT_SLOT_BOOL, "", " > ", ""); break;
+    case IR_LESSEQF: aot_binary(aot, AOT_SLOT_FLOAT, AOT_SLOT_BOOL, "", " <= ", ""); break;
+    case IR_MOREEQF: aot_binary(aot, AOT_SLOT_FLOAT, AOT_SLOT_BOOL, "", " >= ", ""); break;
+
+    case IR_EQ:
+    case IR_NEQ:
+        // Values of different types are never equal, so only comparisons of known scalar types can be inlined
+        if (aot->slots_size >= 2 &&
+            aot->slots[aot->slots_size - 1] != AOT_SLOT_VALUE &&
+            aot->slots[aot->slots_size - 1] == aot->slots[aot->slots_size - 2])
+        {
+            AotSlotType type = aot->slots[aot->slots_size - 1];
+            aot_binary(aot, type, AOT_SLOT_BOOL, "", op == IR_EQ ? " == " : " != ", "");
+        } else {
+            aot_exec_op(aot, op);
+        }
+        break;
+
+    case IR_ITOF: aot_unary(aot, AOT_SLOT_INT, AOT_SLOT_FLOAT, "(double)", ""); break;
+    case IR_ITOB: aot_unary(aot, AOT_SLOT_INT, AOT_SLOT_BOOL, "", " != 0"); break;
+    case IR_FTOI: aot_unary(aot, AOT_SLOT_FLOAT, AOT_SLOT_INT, "(int64_t)", ""); break;
+    case IR_FTOB: aot_unary(aot, AOT_SLOT_FLOAT, AOT_SLOT_BOOL, "", " != 0"); break;
+    case IR_BTOI: aot_unary(aot, AOT_SLOT_BOOL, AOT_SLOT_INT, "(int64_t)", ""); break;
+    case IR_BTOF: aot_unary(aot, AOT_SLOT_BOOL, AOT_SLOT_FLOAT, "(double)", ""); break;
+
+    case IR_TOI:
+    case IR_TOF:
+    case IR_TOB:
+        if (aot->slots_size > 0 && aot->slots[aot->slots_size - 1] != AOT_SLOT_VALUE) {
+            AotSlotType type = aot->slots[aot->slots_size - 1];
+            AotSlotType out_type = op == IR_TOI ? AOT_SLOT_INT : op == IR_TOF ? AOT_SLOT_FLOAT : AOT_SLOT_BOOL;
+            if (out_type == AOT_SLOT_BOOL && type != AOT_SLOT_BOOL) {
+                aot_unary(aot, type, out_type, "", " != 0");
+            } else {
+                aot_unary(aot, type, out_type, out_type == AOT_SLOT_INT ? "(int64_t)" : out_type == AOT_SLOT_FLOAT ? "(double)" : "", "");
+            }
+        } else if (aot->slots_size > 0) {
+            // Value is most likely already of the needed type, so check for that before doing full conversion.
+            // Conversions to scalar types never allocate, so other slots can stay as they are
+            static const char* value_types[] = { "IR_TYPE_INT", "IR_TYPE_FLOAT", "IR_TYPE_BOOL" };
+            static const char* pop_funcs[] = { "exec_pop_int", "exec_pop_float", "exec_pop_bool" };
+            AotSlotType out_type = op == IR_TOI ? AOT_SLOT_INT : op == IR_TOF ? AOT_SLOT_FLOAT : AOT_SLOT_BOOL;
+
+            slot = aot->slots_size - 1;
+            fprintf(aot->out, "    if (v%zu.type == %s) {\n", slot, value_types[out_type]);
+            fprintf(aot->out, "        %c%zu = ", slot_prefix[out_type], slot);
+            aot_emit_slot_as(aot, slot, out_type);
+            fprintf(aot->out, ";\n");
+            fprintf(aot->out, "    } else {\n");
+            fprintf(aot->out, "        exec_push_value(exec, v%zu);\n", slot);
+            fprintf(aot->out, "        if (!exec_op(exec, %s)) goto fail;\n", op_names[op]);
+            fprintf(aot->out, "        %c%zu = %s(exec);\n", slot_prefix[out_type], slot, pop_funcs[out_type]);
+            fprintf(aot->out, "    }\n");
+            aot->slots[slot] = out_type;
+        } else {
+            aot_exec_op(aot, op);
+        }
+        break;
+
+    case IR_ITOA:
+    case IR_FTOA:
+    case IR_BTOA:
+    case IR_NTOA:
+    case IR_LTOA:
+    case IR_ATOI:
+    case IR_ATOF:
+    case IR_ATOB:
+    case IR_TOA:
+    case IR_TOL:
+    case IR_TYPEOF:
+    case IR_ADDL:
+    case IR_INDEXL:
+    case IR_SETL:
+    case IR_INSERTL:
+    case IR_DELL:
+    case IR_LENL:
+        aot_exec_op(aot, op);
+        break;
+
+    case IR_JMP:
+        aot_flush(aot);
+        if (value->as.label_val.pos <= i) aot_use_fuel(aot, "    ");
+        fprintf(aot->out, "    goto L_%zu;\n", value->as.label_val.pos);
+        break;
+    case IR_IF:
+    case IR_IFNOT:
+        if (aot->slots_size > 0) {
+            slot = --aot->slots_size;
+            aot_flush(aot);
+            fprintf(aot->out, "    if (%s", op == IR_IF ? "" : "!");
+            aot_emit_slot_as(aot, slot, AOT_SLOT_BOOL);
+            fprintf(aot->out, ") {\n");
+        } else {
+            fprintf(aot->out, "    if (%sexec_pop_bool(exec)) {\n", op == IR_IF ? "" : "!");
+        }
+        if (value->as.label_val.pos <= i) aot_use_fuel(aot, "        ");
+        fprintf(aot->out, "        goto L_%zu;\n", value->as.label_val.pos);
+        fprintf(aot->out, "    }\n");
+        break;
+    case IR_CALL:
+        aot_flush(aot);
+        aot_use_fuel(aot, "    ");
+        fprintf(aot->out, "    if (!aot_run(exec, bc, %zu)) goto fail;\n", value->as.label_val.pos);
+        break;
+    case IR_CALLX:
+        // Imported modules are not translated, so they run in the interpreter
+        aot_flush(aot);
+        aot_use_fuel(aot, "    ");
+        fprintf(aot->out, "    if (!exec_call_import(exec, &consts[%zu].as.import_val)) goto fail;\n", id);
+        break;
+    case IR_RUN: ;
+        aot_flush(aot);
+        const char* symbol = std_function_symbol(value->as.func_val.hint);
+        if (symbol) {
+            aot_add_symbol(aot, symbol);
+            fprintf(aot->out, "    if (!%s(exec)) {\n", symbol);
+            fprintf(aot->out, "        exec_set_function_error(exec, &consts[%zu].as.func_val);\n", id);
+            fprintf(aot->out, "        goto fail;\n");
+            fprintf(aot->out, "    }\n");
+        } else {
+            fprintf(aot->out, "    if (!exec_run_function(exec, &consts[%zu].as.func_val)) goto fail;\n", id);
+        }
+        break;
+    case IR_DYNJMP:
+        aot_flush(aot);
+        aot->uses_dispatch = true;
+        fprintf(aot->out, "    pos = exec_pop_label(exec);\n");
+        fprintf(aot->out, "    if (pos <= %zu && !exec_use_fuel(exec)) goto fail;\n", i);
+        fprintf(aot->out, "    goto dispatch;\n");
+        break;
+    case IR_DYNIF:
+        aot_flush(aot);
+        aot->uses_dispatch = true;
+        fprintf(aot->out, "    pos = exec_pop_label(exec);\n");
+        fprintf(aot->out, "    if (exec_pop_bool(exec)) {\n");
+        fprintf(aot->out, "        if (pos <= %zu && !exec_use_fuel(exec)) goto fail;\n", i);
+        fprintf(aot->out, "        goto dispatch;\n");
+        fprintf(aot->out, "    }\n");
+        break;
+    case IR_DYNCALL:
+        aot_flush(aot);
+        aot_use_fuel(aot, "    ");
+        fprintf(aot->out, "    if (!aot_run(exec, bc, exec_pop_label(exec))) goto fail;\n");
+        break;
+    case IR_DYNRUN:
+        aot_flush(aot);
+        aot->uses_func = true;
+        fprintf(aot->out, "    func = exec_pop_func(exec);\n");
+        fprintf(aot->out, "    if (!func) {\n");
+        fprintf(aot->out, "        exec_set_error(exec, \"Resolving funcs in dynrun instruction is not allowed\");\n");
+        fprintf(aot->out, "        goto fail;\n");
+        fprintf(aot->out, "    }\n");
+        fprintf(aot->out, "    if (!func(exec)) goto fail;\n");
+        break;
+    case IR_RET:
+        aot_flush(aot);
+        fprintf(aot->out, "    goto done;\n");
+        break;
+    case IR_ILLEGAL:
+    case IR_LAST:
+        // Rejected by aot_verify
+        break;
+    }
+}
+
+static bool aot_copy_file(FILE* src, FILE* dst) {
+    char buf[4096];
+    size_t read_size;
+
+    rewind(src);
+    while ((read_size = fread(buf, 1, sizeof(buf), src)) > 0) {
+        if (fwrite(buf, 1, read_size, dst) != read_size) return false;
+    }
+    return !ferror(src);
+}
+
+static bool aot_translate_loaded(AotTranslator* aot, FILE* out, const unsigned char* data, size_t data_size) {
+    IrBytecode* bc = aot->bc;
+
+    // Function body is translated first, as locals and forward declarations depend on it
+    FILE* body = tmpfile();
+    if (!body) {
+        snprintf(aot->error, aot->error_len, "Failed to create temporary file");
+        return false;
+    }
+
+    aot->out = body;
+    for (size_t i = 0; i < bc->code.size; i++) {
+        if (aot->is_label[i]) {
+            aot_flush(aot);
+            fprintf(body, "L_%zu:;\n", i);
+        }
+        aot_translate_op(aot, i);
+        if (ir_op_has_immediate(bc->code.items[i])) i += 3;
+    }
+    aot_flush(aot);
+    if (aot->is_label[bc->code.size]) fprintf(body, "L_%zu:;\n", bc->code.size);
+
+    fprintf(out, "// Generated by Scrap ahead-of-time compiler. Do not edit\n\n");
+    fprintf(out, "#include <stdint.h>\n");
+    fprintf(out, "#include <math.h>\n\n");
+    fprintf(out, "#include \"scrap_ir.h\"\n");
+    fprintf(out, "#include \"runtime.h\"\n\n");
+
+    for (size_t i = 0; i < aot->symbols_size; i++) fprintf(out, "bool %s(IrExec* exec);\n", aot->symbols[i]);
+    if (aot->symbols_size > 0) fprintf(out, "\n");
+
+    fprintf(out, "static const unsigned char aot_bytecode[%zu] = {", data_size);
+    for (size_t i = 0; i < data_size; i++) {
+        if (i % 16 == 0) fprintf(out, "\n   ");
+        fprintf(out, " 0x%02x,", data[i]);
+    }
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "static bool aot_run(IrExec* exec, IrBytecode* bc, size_t pos) {\n");
+    fprintf(out, "    bool return_val = true;\n");
+    fprintf(out, "    IrConstValue* consts = bc->pool->list.items;\n");
+    fprintf(out, "    (void) consts;\n");
+    if (aot->uses_list) fprintf(out, "    IrList* list;\n");
+    if (aot->uses_func) fprintf(out, "    IrRunFunction func;\n");
+    for (size_t i = 0; i < aot->slots_max; i++) {
+        fprintf(out, "    int64_t i%zu; double f%zu; bool b%zu; IrValue v%zu;\n", i, i, i, i);
+        fprintf(out, "    (void) i%zu; (void) f%zu; (void) b%zu; (void) v%zu;\n", i, i, i, i);
+    }
+    fprintf(out, "\n    exec_push_variable_stack(exec);\n\n");
+
+    if (aot->uses_dispatch) fprintf(out, "dispatch:\n");
+    fprintf(out, "    switch (pos) {\n");
+    for (size_t i = 0; i <= bc->code.size; i++) {
+        if (aot->is_label[i]) fprintf(out, "    case %zu: goto L_%zu;\n", i, i);
+    }
+    fprintf(out, "    default:\n");
+    fprintf(out, "        exec_set_error(exec, \"Jump to position %%zu which is not a label\", pos);\n");
+    fprintf(out, "        goto fail;\n");
+    fprintf(out, "    }\n\n");
+
+    bool ok = aot_copy_file(body, out);
+    fclose(body);
+    if (!ok) {
+        snprintf(aot->error, aot->error_len, "Failed to write translated code");
+        return false;
+    }
+
+    fprintf(out, "\ndone:\n");
+    fprintf(out, "    exec_pop_variable_stack(exec);\n");
+    fprintf(out, "    return return_val;\n\n");
+    fprintf(out, "fail:\n");
+    fprintf(out, "    return_val = false;\n");
+    fprintf(out, "    goto done;\n");
+    fprintf(out, "}\n\n");
+
+    fprintf(out, "int main(void) {\n");
+    fprintf(out, "    return runtime_run_native(aot_bytecode, sizeof(aot_bytecode), %zu, aot_run);\n", bc->pool->list.size);
+    fprintf(out, "}\n");
+
+    if (ferror(out)) {
+        snprintf(aot->error, aot->error_len, "Failed to write translated code");
+        return false;
+    }
+    return true;
+}
+
+bool aot_translate(IrBytecode* bc, FILE* out, char* error, size_t error_len) {
+    // Program loads embedded bytecode at startup to get the constant pool, so the code is translated
+    // from the loaded copy of the bytecode to make sure constant indices match the ones at runtime
+    FILE* save = tmpfile();
+    if (!save) {
+        snprintf(error, error_len, "Failed to create temporary file");
+        return false;
+    }
+    if (!bytecode_save_file(bc, save)) {
+        snprintf(error, error_len, "Failed to save bytecode");
+        fclose(save);
+        return false;
+    }
+
+    long data_size = ftell(save);
+    unsigned char* data = malloc(data_size);
+    rewind(save);
+    bool ok = fread(data, 1, data_size, save) == (size_t)data_size;
+    fclose(save);
+    if (!ok) {
+        snprintf(error, error_len, "Failed to save bytecode");
+        free(data);
+        return false;
+    }
+
+    IrBytecodePool* pool = bytecode_pool_new(NULL);
+    IrBytecode loaded_bc;
+    if (!bytecode_load_memory(pool, &loaded_bc, data, data_size)) {
+        snprintf(error, error_len, "Failed to load bytecode");
+        bytecode_pool_free(pool);
+        free(data);
+        return false;
+    }
+
+    AotTranslator aot = {0};
+    aot.bc = &loaded_bc;
+    aot.consts = pool->list.items;
+    aot.is_label = calloc(loaded_bc.code.size + 1, sizeof(bool));
+    aot.error = error;
+    aot.error_len = error_len;
+
+    ok = aot_verify(&aot) && aot_translate_loaded(&aot, out, data, data_size);
+
+    free(aot.is_label);
+    bytecode_pool_free(pool);
+    free(data);
+    return ok;
+}
@@ -0,0 +1,36 @@
+// Scrap is a project that allows anyone to build software using simple, block based interface.
+//
+// Copyright (C) 2024-2026 Grisshink
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#ifndef SCRAP_AOT_H
+#define SCRAP_AOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "scrap_ir.h"
+
+// Translates bytecode into C source of a standalone program and writes it into out.
+// The bytecode is verified before translation, error is set if it is malformed.
+// Resulting program includes scrap_ir.h and runtime.h and needs to be linked against
+// the runtime library (libscrapruntime.a) together with its dependencies
+bool aot_translate(IrBytecode* bc, FILE* out, char* error, size_t error_len);
+
+#endif // SCRAP_AOT_H
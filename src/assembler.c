@@ -0,0 +1,634 @@
+// Scrap is a project that allows anyone to build software using simple, block based interface.
+//
+// Copyright (C) 2024-2026 Grisshink
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+
+// Assembler of textual bytecode (See assembler.h). Every line is assembled on its own, labels can be used
+// before they are defined, since label constants are looked up by name and their position is filled in
+// once the definition is reached.
+
+#include "assembler.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define ASM_TOKEN_SIZE 128
+#define ASM_NO_POS ((size_t)-1)
+
+typedef enum {
+    ASM_OPERAND_NONE = 0,
+    ASM_OPERAND_INT,
+    ASM_OPERAND_FLOAT,
+    ASM_OPERAND_BOOL,
+    ASM_OPERAND_LIST,
+    ASM_OPERAND_LABEL,
+    ASM_OPERAND_FUNC,
+    ASM_OPERAND_IMPORT,
+} AsmOperand;
+
+typedef struct {
+    const char* name;
+    AsmOperand operand;
+} AsmOpcode;
+
+typedef struct {
+    const char** items;
+    size_t size, capacity;
+} AsmNameList;
+
+typedef struct {
+    IrBytecodePool* pool;
+    IrBytecode* bc;
+    AsmNameList exports;
+
+    const char* source_name;
+    size_t line;
+    char* pos; // Position within the current line, lines are null terminated
+
+    char* error;
+    size_t error_len;
+} Assembler;
+
+// Names should stay the same as in bytecode_print
+static const AsmOpcode asm_opcodes[IR_LAST] = {
+    [IR_ILLEGAL] = { "inval",   ASM_OPERAND_NONE },
+    [IR_PUSHN]   = { "pushn",   ASM_OPERAND_NONE },
+    [IR_PUSHI]   = { "pushi",   ASM_OPERAND_INT },
+    [IR_PUSHF]   = { "pushf",   ASM_OPERAND_FLOAT },
+    [IR_PUSHB]   = { "pushb",   ASM_OPERAND_BOOL },
+    [IR_PUSHL]   = { "pushl",   ASM_OPERAND_LIST },
+    [IR_PUSHA]   = { "pusha",   ASM_OPERAND_LIST },
+    [IR_PUSHLB]  = { "pushlb",  ASM_OPERAND_LABEL },
+    [IR_PUSHFN]  = { "pushfn",  ASM_OPERAND_FUNC },
+    [IR_POP]     = { "pop",     ASM_OPERAND_NONE },
+    [IR_POPC]    = { "popc",    ASM_OPERAND_INT },
+    [IR_DUP]     = { "dup",     ASM_OPERAND_NONE },
+    [IR_LOAD]    = { "load",    ASM_OPERAND_INT },
+    [IR_STORE]   = { "store",   ASM_OPERAND_INT },
+    [IR_GLOAD]   = { "gload",   ASM_OPERAND_INT },
+    [IR_GSTORE]  = { "gstore",  ASM_OPERAND_INT },
+    [IR_ADDI]    = { "addi",    ASM_OPERAND_NONE },
+    [IR_SUBI]    = { "subi",    ASM_OPERAND_NONE },
+    [IR_MULI]    = { "muli",    ASM_OPERAND_NONE },
+    [IR_DIVI]    = { "divi",    ASM_OPERAND_NONE },
+    [IR_MODI]    = { "modi",    ASM_OPERAND_NONE },
+    [IR_POWI]    = { "powi",    ASM_OPERAND_NONE },
+    [IR_NOTI]    = { "noti",    ASM_OPERAND_NONE },
+    [IR_ANDI]    = { "andi",    ASM_OPERAND_NONE },
+    [IR_ORI]     = { "ori",     ASM_OPERAND_NONE },
+    [IR_XORI]    = { "xori",    ASM_OPERAND_NONE },
+    [IR_ADDF]    = { "addf",    ASM_OPERAND_NONE },
+    [IR_SUBF]    = { "subf",    ASM_OPERAND_NONE },
+    [IR_MULF]    = { "mulf",    ASM_OPERAND_NONE },
+    [IR_DIVF]    = { "divf",    ASM_OPERAND_NONE },
+    [IR_MODF]    = { "modf",    ASM_OPERAND_NONE },
+    [IR_POWF]    = { "powf",    ASM_OPERAND_NONE },
+    [IR_NOT]     = { "not",     ASM_OPERAND_NONE },
+    [IR_AND]     = { "and",     ASM_OPERAND_NONE },
+    [IR_OR]      = { "or",      ASM_OPERAND_NONE },
+    [IR_XOR]     = { "xor",     ASM_OPERAND_NONE },
+    [IR_LESSI]   = { "lessi",   ASM_OPERAND_NONE },
+    [IR_MOREI]   = { "morei",   ASM_OPERAND_NONE },
+    [IR_LESSF]   = { "lessf",   ASM_OPERAND_NONE },
+    [IR_MOREF]   = { "moref",   ASM_OPERAND_NONE },
+    [IR_LESSEQI] = { "lesseqi", ASM_OPERAND_NONE },
+    [IR_MOREEQI] = { "moreeqi", ASM_OPERAND_NONE },
+    [IR_LESSEQF] = { "lesseqf", ASM_OPERAND_NONE },
+    [IR_MOREEQF] = { "moreeqf", ASM_OPERAND_NONE },
+    [IR_EQ]      = { "eq",      ASM_OPERAND_NONE },
+    [IR_NEQ]     = { "neq",     ASM_OPERAND_NONE },
+    [IR_ITOF]    = { "itof",    ASM_OPERAND_NONE },
+    [IR_ITOB]    = { "itob",    ASM_OPERAND_NONE },
+    [IR_ITOA]    = { "itoa",    ASM_OPERAND_NONE },
+    [IR_FTOI]    = { "ftoi",    ASM_OPERAND_NONE },
+    [IR_FTOB]    = { "ftob",    ASM_OPERAND_NONE },
+    [IR_FTOA]    = { "ftoa",    ASM_OPERAND_NONE },
+    [IR_BTOI]    = { "btoi",    ASM_OPERAND_NONE },
+    [IR_BTOF]    = { "btof",    ASM_OPERAND_NONE },
+    [IR_BTOA]    = { "btoa",    ASM_OPERAND_NONE },
+    [IR_ATOI]    = { "atoi",    ASM_OPERAND_NONE },
+    [IR_ATOF]    = { "atof",    ASM_OPERAND_NONE },
+    [IR_ATOB]    = { "atob",    ASM_OPERAND_NONE },
+    [IR_LTOA]    = { "ltoa",    ASM_OPERAND_NONE },
+    [IR_NTOA]    = { "ntoa",    ASM_OPERAND_NONE },
+    [IR_TOI]     = { "toi",     ASM_OPERAND_NONE },
+    [IR_TOF]     = { "tof",     ASM_OPERAND_NONE },
+    [IR_TOB]     = { "tob",     ASM_OPERAND_NONE },
+    [IR_TOA]     = { "toa",     ASM_OPERAND_NONE },
+    [IR_TOL]     = { "tol",     ASM_OPERAND_NONE },
+    [IR_TYPEOF]  = { "typeof",  ASM_OPERAND_NONE },
+    [IR_ADDL]    = { "addl",    ASM_OPERAND_NONE },
+    [IR_INDEXL]  = { "indexl",  ASM_OPERAND_NONE },
+    [IR_SETL]    = { "setl",    ASM_OPERAND_NONE },
+    [IR_INSERTL] = { "insertl", ASM_OPERAND_NONE },
+    [IR_DELL]    = { "dell",    ASM_OPERAND_NONE },
+    [IR_LENL]    = { "lenl",    ASM_OPERAND_NONE },
+    [IR_JMP]     = { "jmp",     ASM_OPERAND_LABEL },
+    [IR_IF]      = { "if",      ASM_OPERAND_LABEL },
+    [IR_IFNOT]   = { "ifnot",   ASM_OPERAND_LABEL },
+    [IR_CALL]    = { "call",    ASM_OPERAND_LABEL },
+    [IR_RUN]     = { "run",     ASM_OPERAND_FUNC },
+    [IR_DYNJMP]  = { "dynjmp",  ASM_OPERAND_NONE },
+    [IR_DYNIF]   = { "dynif",   ASM_OPERAND_NONE },
+    [IR_DYNCALL] = { "dyncall", ASM_OPERAND_NONE },
+    [IR_DYNRUN]  = { "dynrun",  ASM_OPERAND_NONE },
+    [IR_RET]     = { "ret",     ASM_OPERAND_NONE },
+    [IR_CALLX]   = { "callx",   ASM_OPERAND_IMPORT },
+};
+
+static bool asm_error(Assembler* as, const char* fmt, ...) {
+    // Errors found after reading the whole source are not tied to any line
+    int len = as->line > 0 ? snprintf(as->error, as->error_len, "%s:%zu: ", as->source_name, as->line)
+                           : snprintf(as->error, as->error_len, "%s: ", as->source_name);
+    if (len < 0 || (size_t)len >= as->error_len) return false;
+
+    va_list va;
+    va_start(va, fmt);
+    vsnprintf(as->error + len, as->error_len - len, fmt, va);
+    va_end(va);
+    return false;
+}
+
+static void asm_skip_space(Assembler* as) {
+    while (*as->pos == ' ' || *as->pos == '\t' || *as->pos == '\r') as->pos++;
+}
+
+static bool asm_is_name_char(char ch) {
+    return (unsigned char)ch > ' ' && !strchr("<>:;\"\\,[]()", ch);
+}
+
+static bool asm_expect(Assembler* as, char ch) {
+    asm_skip_space(as);
+    if (*as->pos != ch) return asm_error(as, "Expected '%c'", ch);
+    as->pos++;
+    return true;
+}
+
+// Reads the plain word at the current position into buf
+static bool asm_read_word(Assembler* as, char* buf, size_t buf_size) {
+    asm_skip_space(as);
+    size_t len = 0;
+    while (asm_is_name_char(*as->pos)) {
+        if (len + 1 >= buf_size) return asm_error(as, "Token is too long");
+        buf[len++] = *as->pos++;
+    }
+    buf[len] = 0;
+    if (len == 0) return asm_error(as, "Expected a value");
+    return true;
+}
+
+static int asm_encode_utf8(int64_t codepoint, char* out) {
+    if (codepoint < 0x80) {
+        out[0] = codepoint;
+        return 1;
+    } else if (codepoint < 0x800) {
+        out[0] = 0xc0 | (codepoint >> 6);
+        out[1] = 0x80 | (codepoint & 0x3f);
+        return 2;
+    } else if (codepoint < 0x10000) {
+        out[0] = 0xe0 | (codepoint >> 12);
+        out[1] = 0x80 | ((codepoint >> 6) & 0x3f);
+        out[2] = 0x80 | (codepoint & 0x3f);
+        return 3;
+    }
+    out[0] = 0xf0 | ((codepoint >> 18) & 0x07);
+    out[1] = 0x80 | ((codepoint >> 12) & 0x3f);
+    out[2] = 0x80 | ((codepoint >> 6) & 0x3f);
+    out[3] = 0x80 | (codepoint & 0x3f);
+    return 4;
+}
+
+// Reads one character of quoted string. Escaped characters are returned as codepoints.
+// Raw bytes are decoded from UTF-8 if decode_utf8 is set, otherwise they are returned as is
+static bool asm_read_char(Assembler* as, int64_t* codepoint, bool* escaped, bool decode_utf8) {
+    unsigned char ch = *as->pos;
+    if (ch == 0) return asm_error(as, "Unterminated string");
+
+    *escaped = ch == '\\';
+    if (ch == '\\') {
+        as->pos++;
+        switch (*as->pos++) {
+        case '"': *codepoint = '"'; return true;
+        case '\\': *codepoint = '\\'; return true;
+        case 'n': *codepoint = '\n'; return true;
+        case 't': *codepoint = '\t'; return true;
+        case 'r': *codepoint = '\r'; return true;
+        case 'u': ;
+            if (*as->pos++ != '{') return asm_error(as, "Expected '{' after \\u");
+            char* end;
+            errno = 0;
+            *codepoint = (int64_t)strtoull(as->pos, &end, 16);
+            if (end == as->pos || *end != '}' || errno) return asm_error(as, "Invalid \\u escape");
+            as->pos = end + 1;
+            return true;
+        default:
+            return asm_error(as, "Unknown escape sequence");
+        }
+    }
+
+    as->pos++;
+    if (!decode_utf8 || ch < 0x80) {
+        *codepoint = ch;
+        return true;
+    }
+
+    int extra = ch >= 0xf0 ? 3 : ch >= 0xe0 ? 2 : ch >= 0xc0 ? 1 : 0;
+    int64_t value = ch & (0x3f >> extra);
+    for (int i = 0; i < extra; i++) {
+        if (((unsigned char)*as->pos & 0xc0) != 0x80) return asm_error(as, "Invalid UTF-8 sequence in string");
+        value = (value << 6) | (*as->pos++ & 0x3f);
+    }
+    *codepoint = extra ? value : '?';
+    return true;
+}
+
+// Reads plain or quoted name and copies it into the pool arena
+static const char* asm_read_name(Assembler* as) {
+    asm_skip_space(as);
+
+    if (*as->pos != '"') {
+        char* start = as->pos;
+        while (asm_is_name_char(*as->pos)) as->pos++;
+        if (as->pos == start) {
+            asm_error(as, "Expected a name");
+            return NULL;
+        }
+
+        size_t len = as->pos - start;
+        char* name = ir_arena_alloc(as->pool->arena, len + 1);
+        memcpy(name, start, len);
+        name[len] = 0;
+        return name;
+    }
+
+    as->pos++;
+    // Escaped characters never take more bytes than the escape sequence itself, so the rest of the line is enough
+    char* name = ir_arena_alloc(as->pool->arena, strlen(as->pos) + 1);
+
+    size_t len = 0;
+    while (*as->pos != '"') {
+        int64_t codepoint = 0;
+        bool escaped;
+        if (!asm_read_char(as, &codepoint, &escaped, false)) return NULL;
+        if (escaped) {
+            len += asm_encode_utf8(codepoint, name + len);
+        } else {
+            name[len++] = codepoint;
+        }
+    }
+    as->pos++;
+    name[len] = 0;
+    return name;
+}
+
+static IrList* asm_read_string(Assembler* as) {
+    if (!asm_expect(as, '"')) return NULL;
+
+    IrList* list = bytecode_const_list_new(as->pool);
+    while (*as->pos != '"') {
+        int64_t codepoint = 0;
+        bool escaped;
+        if (!asm_read_char(as, &codepoint, &escaped, true)) return NULL;
+        bytecode_const_string_append(as->pool, list, codepoint);
+    }
+    as->pos++;
+    return list;
+}
+
+static bool asm_read_int(Assembler* as, int64_t* value) {
+    char buf[ASM_TOKEN_SIZE];
+    if (!asm_read_word(as, buf, sizeof(buf))) return false;
+
+    char* end;
+    errno = 0;
+    *value = strtoll(buf, &end, 10);
+    if (*end != 0 || errno) return asm_error(as, "Invalid integer \"%s\"", buf);
+    return true;
+}
+
+static bool asm_read_float(Assembler* as, double* value) {
+    char buf[ASM_TOKEN_SIZE];
+    if (!asm_read_word(as, buf, sizeof(buf))) return false;
+
+    char* end;
+    *value = strtod(buf, &end);
+    if (*end != 0) return asm_error(as, "Invalid float \"%s\"", buf);
+    return true;
+}
+
+static bool asm_read_bool(Assembler* as, bool* value) {
+    char buf[ASM_TOKEN_SIZE];
+    if (!asm_read_word(as, buf, sizeof(buf))) return false;
+
+    if (!strcmp(buf, "true")) {
+        *value = true;
+    } else if (!strcmp(buf, "false")) {
+        *value = false;
+    } else {
+        return asm_error(as, "Invalid bool \"%s\"", buf);
+    }
+    return true;
+}
+
+static IrList* asm_read_list(Assembler* as);
+
+static bool asm_read_list_value(Assembler* as, IrValue* value) {
+    asm_skip_space(as);
+
+    if (*as->pos == '"') {
+        value->type = IR_TYPE_STRING;
+        value->as.list_val = asm_read_string(as);
+        return value->as.list_val != NULL;
+    }
+    if (*as->pos == '[') {
+        value->type = IR_TYPE_LIST;
+        value->as.list_val = asm_read_list(as);
+        return value->as.list_val != NULL;
+    }
+
+    char buf[ASM_TOKEN_SIZE];
+    if (!asm_read_word(as, buf, sizeof(buf))) return false;
+
+    if (!strcmp(buf, "nothing")) {
+        value->type = IR_TYPE_NOTHING;
+    } else if (!strcmp(buf, "true") || !strcmp(buf, "false")) {
+        value->type = IR_TYPE_BOOL;
+        value->as.bool_val = buf[0] == 't';
+    } else if (!strcmp(buf, "byte")) {
+        int64_t byte;
+        if (!asm_expect(as, '(')) return false;
+        if (!asm_read_int(as, &byte)) return false;
+        if (!asm_expect(as, ')')) return false;
+        if (byte < 0 || byte > 255) return asm_error(as, "Byte value %lld is out of range", (long long)byte);
+        value->type = IR_TYPE_BYTE;
+        value->as.byte_val = byte;
+    } else if (strpbrk(buf, ".eEin")) {
+        char* end;
+        value->type = IR_TYPE_FLOAT;
+        value->as.float_val = strtod(buf, &end);
+        if (*end != 0) return asm_error(as, "Invalid float \"%s\"", buf);
+    } else {
+        char* end;
+        errno = 0;
+        value->type = IR_TYPE_INT;
+        value->as.int_val = strtoll(buf, &end, 10);
+        if (*end != 0 || errno) return asm_error(as, "Invalid list value \"%s\"", buf);
+    }
+    return true;
+}
+
+static IrList* asm_read_list(Assembler* as) {
+    if (!asm_expect(as, '[')) return NULL;
+
+    IrList* list = bytecode_const_list_new(as->pool);
+    asm_skip_space(as);
+    if (*as->pos == ']') {
+        as->pos++;
+        return list;
+    }
+
+    while (true) {
+        IrValue value;
+        if (!asm_read_list_value(as, &value)) return NULL;
+        bytecode_const_list_append(as->pool, list, value);
+
+        asm_skip_space(as);
+        if (*as->pos == ']') break;
+        if (*as->pos != ',') {
+            asm_error(as, "Expected ',' or ']' in list");
+            return NULL;
+        }
+        as->pos++;
+    }
+    as->pos++;
+    return list;
+}
+
+static ConstId asm_get_label(Assembler* as, const char* name) {
+    IrConstValue label = {
+        .type = IR_TYPE_LABEL,
+        .as.label_val = { .pos = ASM_NO_POS, .name = name },
+    };
+
+    size_t id = bytecode_pool_get(as->pool, label);
+    if (id != (size_t)-1) return id;
+    return bytecode_pool_insert(as->pool, label);
+}
+
+static bool asm_define_label(Assembler* as, const char* name) {
+    ConstId id = asm_get_label(as, name);
+    IrLabel* label = &as->pool->list.items[id].as.label_val;
+    if (label->pos != ASM_NO_POS) return asm_error(as, "Label \"%s\" is already defined", name);
+
+    label->pos = as->bc->code.size;
+    ir_arena_append(as->pool->arena, as->bc->labels, id);
+    return true;
+}
+
+static bool asm_operand(Assembler* as, IrOpcode op) {
+    int64_t int_val;
+    double float_val;
+    bool bool_val = false;
+    const char* name;
+
+    switch (asm_opcodes[op].operand) {
+    case ASM_OPERAND_NONE:
+        bytecode_push_op(as->bc, op);
+        return true;
+    case ASM_OPERAND_INT:
+        if (!asm_read_int(as, &int_val)) return false;
+        bytecode_push_op_int(as->bc, op, int_val);
+        return true;
+    case ASM_OPERAND_FLOAT:
+        if (!asm_read_float(as, &float_val)) return false;
+        bytecode_push_op_float(as->bc, op, float_val);
+        return true;
+    case ASM_OPERAND_BOOL:
+        if (!asm_read_bool(as, &bool_val)) return false;
+        bytecode_push_op_bool(as->bc, op, bool_val);
+        return true;
+    case ASM_OPERAND_LIST:
+        asm_skip_space(as);
+        if (*as->pos == '"') {
+            IrList* list = asm_read_string(as);
+            if (!list) return false;
+            bytecode_push_op_list_string(as->bc, op, list);
+        } else if (*as->pos == '[') {
+            IrList* list = asm_read_list(as);
+            if (!list) return false;
+            bytecode_push_op_list(as->bc, op, list);
+        } else {
+            // Without operand the list is created when the instruction runs
+            bytecode_push_op_list(as->bc, op, NULL);
+        }
+        return true;
+    case ASM_OPERAND_LABEL:
+        if (!asm_expect(as, '<')) return false;
+        if (!(name = asm_read_name(as))) return false;
+        if (!asm_expect(as, '>')) return false;
+        bytecode_push_op_label(as->bc, op, asm_get_label(as, name));
+        return true;
+    case ASM_OPERAND_FUNC:
+        if (!(name = asm_read_name(as))) return false;
+        if (!strcmp(name, "inval")) return asm_error(as, "Function without a name cannot be assembled");
+        bytecode_push_op_func(as->bc, op, ir_func_by_hint(name));
+        return true;
+    case ASM_OPERAND_IMPORT: ;
+        const char* module;
+        if (!asm_expect(as, '<')) return false;
+        if (!(module = asm_read_name(as))) return false;
+        if (!asm_expect(as, ':')) return false;
+        if (!(name = asm_read_name(as))) return false;
+        if (!asm_expect(as, '>')) return false;
+        bytecode_push_op_import(as->bc, op, module, name);
+        return true;
+    }
+    return asm_error(as, "Unknown operand");
+}
+
+static bool asm_line(Assembler* as) {
+    asm_skip_space(as);
+    if (*as->pos == 0 || *as->pos == ';') return true;
+
+    if (*as->pos == '.') {
+        char directive[ASM_TOKEN_SIZE];
+        as->pos++;
+        if (!asm_read_word(as, directive, sizeof(directive))) return false;
+        if (strcmp(directive, "export")) return asm_error(as, "Unknown directive \".%s\"", directive);
+
+        const char* name = asm_read_name(as);
+        if (!name) return false;
+        ir_arena_append(as->pool->arena, as->exports, name);
+    } else {
+        bool quoted = *as->pos == '"';
+        const char* name = asm_read_name(as);
+        if (!name) return false;
+
+        asm_skip_space(as);
+        if (*as->pos == ':') {
+            as->pos++;
+            if (!asm_define_label(as, name)) return false;
+        } else {
+            IrOpcode op = IR_LAST;
+            for (int i = 0; i < IR_LAST && !quoted; i++) {
+                if (asm_opcodes[i].name && !strcmp(asm_opcodes[i].name, name)) {
+                    op = i;
+                    break;
+                }
+            }
+            if (op == IR_LAST) return asm_error(as, "Unknown instruction \"%s\"", name);
+            if (!asm_operand(as, op)) return false;
+        }
+    }
+
+    asm_skip_space(as);
+    if (*as->pos != 0 && *as->pos != ';') return asm_error(as, "Unexpected text at the end of line");
+    return true;
+}
+
+static bool asm_finish(Assembler* as) {
+    as->line = 0;
+    for (size_t i = 0; i < as->pool->list.size; i++) {
+        IrConstValue* value = &as->pool->list.items[i];
+        if (value->type != IR_TYPE_LABEL || value->as.label_val.pos != ASM_NO_POS) continue;
+        return asm_error(as, "Label \"%s\" is used but never defined", value->as.label_val.name);
+    }
+
+    for (size_t i = 0; i < as->exports.size; i++) {
+        IrConstValue label = {
+            .type = IR_TYPE_LABEL,
+            .as.label_val.name = as->exports.items[i],
+        };
+        size_t id = bytecode_pool_get(as->pool, label);
+        if (id == (size_t)-1) return asm_error(as, "Exported label \"%s\" is not defined", as->exports.items[i]);
+        bytecode_export_label(as->bc, id);
+    }
+    return true;
+}
+
+bool asm_assemble(IrBytecodePool* pool, IrBytecode* bc, const char* source, size_t source_size, const char* source_name, char* error, size_t error_len) {
+    // Lines are split in place, so the source is copied to be modified
+    char* text = malloc(source_size + 1);
+    memcpy(text, source, source_size);
+    text[source_size] = 0;
+
+    *bc = bytecode_new(NULL, pool);
+    Assembler as = {
+        .pool = pool,
+        .bc = bc,
+        .exports = {0},
+        .source_name = source_name,
+        .line = 0,
+        .error = error,
+        .error_len = error_len,
+    };
+
+    bool ok = true;
+    char* line = text;
+    while (ok && line < text + source_size) {
+        char* line_end = strchr(line, '\n');
+        if (line_end) *line_end = 0;
+
+        as.line++;
+        as.pos = line;
+        ok = asm_line(&as);
+
+        if (!line_end) break;
+        line = line_end + 1;
+    }
+    if (ok) ok = asm_finish(&as);
+
+    free(text);
+    return ok;
+}
+
+bool asm_assemble_file(IrBytecodePool* pool, IrBytecode* bc, const char* path, char* error, size_t error_len) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        snprintf(error, error_len, "%s: %s", path, strerror(errno));
+        return false;
+    }
+
+    char* source = NULL;
+    size_t source_size = 0, source_capacity = 0;
+    char buf[4096];
+    size_t read_size;
+    while ((read_size = fread(buf, 1, sizeof(buf), f)) > 0) {
+        if (source_size + read_size > source_capacity) {
+            source_capacity = (source_size + read_size) * 2;
+            source = realloc(source, source_capacity);
+        }
+        memcpy(source + source_size, buf, read_size);
+        source_size += read_size;
+    }
+
+    if (ferror(f)) {
+        snprintf(error, error_len, "%s: %s", path, strerror(errno));
+        fclose(f);
+        free(source);
+        return false;
+    }
+    fclose(f);
+
+    bool ok = asm_assemble(pool, bc, source ? source : "", source_size, path, error, error_len);
+    free(source);
+    return ok;
+}
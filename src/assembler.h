@@ -0,0 +1,52 @@
+// Scrap is a project that allows anyone to build software using simple, block based interface.
+//
+// Copyright (C) 2024-2026 Grisshink
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+
+#ifndef SCRAP_ASSEMBLER_H
+#define SCRAP_ASSEMBLER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "scrap_ir.h"
+
+// Assembles bytecode from text in the format printed by bytecode_print (.scra files). Assembling printed bytecode
+// gives back the same code, except that constants may be numbered differently, and printing assembled code
+// gives back the same text.
+//
+// Format overview:
+//
+//     ; Comment
+//     .export NAME            -- Export label, so it can be called from other modules
+//     NAME:                   -- Label at the current position
+//         pushi 42            -- Instructions are named the same as in bytecode_print
+//         pushf 1.5
+//         pusha "text\n"      -- Strings support \" \\ \n \t \r and \u{HEX} escapes
+//         pushl [1, 2.0, true, nothing, byte(7), "str", [3]]
+//         jmp <NAME>
+//         callx <MODULE:NAME>
+//         run "std_term_print_str"
+//
+// Names with spaces or special characters are written in quotes, for example "my block": and call <"my block">.
+// Bytecode is allocated in pool. On failure error is set to the message with the line number.
+bool asm_assemble(IrBytecodePool* pool, IrBytecode* bc, const char* source, size_t source_size, const char* source_name, char* error, size_t error_len);
+bool asm_assemble_file(IrBytecodePool* pool, IrBytecode* bc, const char* path, char* error, size_t error_len);
+
+#endif // SCRAP_ASSEMBLER_H
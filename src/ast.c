@@ -454,6 +454,21 @@ void blockchain_free(BlockChain* chain) {
     free(chain);
 }
 
+static void block_walk(Block* block, BlockVisitor visit, void* data) {
+    visit(block, data);
+    if (block->arguments) {
+        for (size_t i = 0; i < vector_size(block->arguments); i++) {
+            if (block->arguments[i].type == ARGUMENT_BLOCK) block_walk(block->arguments[i].data.block, visit, data);
+        }
+    }
+    if (block->contents) blockchain_walk(block->contents, visit, data);
+    if (block->controlend_contents) blockchain_walk(block->controlend_contents, visit, data);
+}
+
+void blockchain_walk(BlockChain* chain, BlockVisitor visit, void* data) {
+    for (Block* iter = chain->start; iter; iter = iter->next) block_walk(iter, visit, data);
+}
+
 void argument_set_block(Argument* arg, Block* block) {
     if (arg->type == ARGUMENT_VALUE) value_free(&arg->data.value);
     arg->type = ARGUMENT_BLOCK;
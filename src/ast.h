@@ -55,6 +55,7 @@ typedef struct RootBlockChain RootBlockChain;
 typedef struct Value Value;
 
 typedef char** (*ListAccessor)(Block* block, size_t* list_len);
+typedef void (*BlockVisitor)(Block* block, void* data);
 
 struct BlockdefColor {
     unsigned char r, g, b, a;
@@ -244,6 +245,9 @@ BlockChain* blockchain_copy(BlockChain* chain, Block* pos);
 void blockchain_insert(BlockChain* dst, BlockChain* src, Block* pos);
 BlockChain* blockchain_detach(BlockChain* chain, Block* start, Block* end);
 void blockchain_free(BlockChain* chain);
+// Calls visit on every block of the chain and on blocks nested in them. Every block is visited before blocks
+// in its arguments, then its contents and control end contents, and only then the next block of the chain
+void blockchain_walk(BlockChain* chain, BlockVisitor visit, void* data);
 
 Block* block_new(Blockdef* blockdef);
 Block* block_copy(Block* block, BlockParent parent);
@@ -0,0 +1,309 @@
+// Scrap is a project that allows anyone to build software using simple, block based interface.
+//
+// Copyright (C) 2024-2026 Grisshink
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+
+#include "batch.h"
+#include "scrap_vm.h"
+#include "std.h"
+#include "thread.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <locale.h>
+
+#ifdef _WIN32
+#define BATCH_NULL_DEVICE "NUL"
+#else
+#define BATCH_NULL_DEVICE "/dev/null"
+#endif
+
+#define BATCH_LINE_SIZE 4096
+#define BATCH_ERROR_SIZE 256
+// Time limit is checked every this many backward jumps and calls
+#define BATCH_FUEL_BUDGET 4096
+
+typedef enum {
+    BATCH_JOB_PENDING = 0,
+    BATCH_JOB_RUNNING,
+    BATCH_JOB_OK,
+    BATCH_JOB_ERROR,
+    BATCH_JOB_TIMEOUT,
+    BATCH_JOB_LOAD_ERROR,
+} BatchJobStatus;
+
+typedef struct {
+    char* bytecode_path;
+    char* input_path;
+    char* output_path;
+
+    BatchJobStatus status;
+    Timer timer;
+    double time_limit; // In microseconds, 0 if there is no limit
+    bool timed_out;
+    double time_taken; // In microseconds
+    size_t heap_size;
+    char error[BATCH_ERROR_SIZE];
+} BatchJob;
+
+typedef struct {
+    BatchJob* jobs;
+    size_t jobs_count, jobs_capacity;
+    size_t next_job;
+    size_t memory_limit;
+    Mutex lock; // Guards next_job, every job is only accessed by the worker which took it
+} Batch;
+
+static const char* batch_status_names[] = {
+    [BATCH_JOB_PENDING]    = "pending",
+    [BATCH_JOB_RUNNING]    = "running",
+    [BATCH_JOB_OK]         = "ok",
+    [BATCH_JOB_ERROR]      = "error",
+    [BATCH_JOB_TIMEOUT]    = "timeout",
+    [BATCH_JOB_LOAD_ERROR] = "load error",
+};
+
+static char* batch_string_new(const char* str, size_t len) {
+    char* out = malloc(len + 1);
+    memcpy(out, str, len);
+    out[len] = 0;
+    return out;
+}
+
+// Splits line into whitespace separated words, returns number of words found
+static int batch_split_line(char* line, char** words, int max_words) {
+    int count = 0;
+    char* str = line;
+    while (*str && count < max_words) {
+        while (*str == ' ' || *str == '\t' || *str == '\r' || *str == '\n') str++;
+        if (!*str) break;
+
+        words[count++] = str;
+        while (*str && *str != ' ' && *str != '\t' && *str != '\r' && *str != '\n') str++;
+        if (*str) *str++ = 0;
+    }
+    return count;
+}
+
+static bool batch_load_list(Batch* batch, const char* list_path, double time_limit) {
+    FILE* f = fopen(list_path, "r");
+    if (!f) {
+        printf("Failed to open %s: %s\n", list_path, strerror(errno));
+        return false;
+    }
+
+    char line[BATCH_LINE_SIZE];
+    while (fgets(line, sizeof(line), f)) {
+        char* words[4];
+        int words_count = batch_split_line(line, words, 4);
+        if (words_count == 0 || words[0][0] == '#') continue;
+        if (words_count > 3) {
+            printf("Too many paths in %s, expected BYTECODE_PATH [INPUT_PATH [OUTPUT_PATH]]\n", list_path);
+            fclose(f);
+            return false;
+        }
+
+        if (batch->jobs_count >= batch->jobs_capacity) {
+            batch->jobs_capacity = batch->jobs_capacity ? batch->jobs_capacity * 2 : 16;
+            batch->jobs = realloc(batch->jobs, sizeof(BatchJob) * batch->jobs_capacity);
+        }
+
+        BatchJob* job = &batch->jobs[batch->jobs_count++];
+        memset(job, 0, sizeof(*job));
+        job->time_limit = time_limit * 1e+6;
+        job->bytecode_path = batch_string_new(words[0], strlen(words[0]));
+        const char* input_path = words_count > 1 ? words[1] : BATCH_NULL_DEVICE;
+        job->input_path = batch_string_new(input_path, strlen(input_path));
+        if (words_count > 2) {
+            job->output_path = batch_string_new(words[2], strlen(words[2]));
+        } else {
+            size_t path_len = strlen(words[0]);
+            job->output_path = malloc(path_len + sizeof(".out"));
+            memcpy(job->output_path, words[0], path_len);
+            memcpy(job->output_path + path_len, ".out", sizeof(".out"));
+        }
+    }
+
+    fclose(f);
+    return true;
+}
+
+static void batch_free(Batch* batch) {
+    for (size_t i = 0; i < batch->jobs_count; i++) {
+        free(batch->jobs[i].bytecode_path);
+        free(batch->jobs[i].input_path);
+        free(batch->jobs[i].output_path);
+    }
+    free(batch->jobs);
+    mutex_free(&batch->lock);
+}
+
+// Checks the time limit of the job every time the program runs out of fuel
+static bool batch_fuel_handler(IrExec* exec) {
+    BatchJob* job = scrap_vm_get_user_data(scrap_vm_from_exec(exec));
+    if (job->time_limit <= 0 || end_timer(job->timer) < job->time_limit) return true;
+
+    job->timed_out = true;
+    exec_set_error(exec, "Time limit of %.2fs exceeded", job->time_limit / 1e+6);
+    return false;
+}
+
+static void batch_run_job(Batch* batch, BatchJob* job) {
+    FILE* input = fopen(job->input_path, "r");
+    if (!input) {
+        snprintf(job->error, BATCH_ERROR_SIZE, "Failed to open %s: %s", job->input_path, strerror(errno));
+        job->status = BATCH_JOB_LOAD_ERROR;
+        return;
+    }
+
+    FILE* output = fopen(job->output_path, "w");
+    if (!output) {
+        snprintf(job->error, BATCH_ERROR_SIZE, "Failed to create %s: %s", job->output_path, strerror(errno));
+        job->status = BATCH_JOB_LOAD_ERROR;
+        fclose(input);
+        return;
+    }
+
+    ScrapVm* vm = scrap_vm_new(0, batch->memory_limit);
+    if (!vm) {
+        snprintf(job->error, BATCH_ERROR_SIZE, "Failed to create VM instance");
+        job->status = BATCH_JOB_LOAD_ERROR;
+        fclose(input);
+        fclose(output);
+        return;
+    }
+    scrap_vm_set_io(vm, input, output);
+    scrap_vm_set_user_data(vm, job);
+    scrap_vm_set_fuel_handler(vm, batch_fuel_handler, BATCH_FUEL_BUDGET);
+
+    if (!scrap_vm_load_file(vm, job->bytecode_path)) {
+        snprintf(job->error, BATCH_ERROR_SIZE, "%s", scrap_vm_last_error(vm));
+        job->status = BATCH_JOB_LOAD_ERROR;
+    } else {
+        job->timer = start_timer(job->bytecode_path);
+        bool ok = scrap_vm_run(vm, NULL);
+        job->time_taken = end_timer(job->timer);
+
+        job->heap_size = scrap_vm_exec(vm)->heap.mem_max;
+        if (ok) {
+            job->status = BATCH_JOB_OK;
+        } else {
+            snprintf(job->error, BATCH_ERROR_SIZE, "%s", scrap_vm_last_error(vm));
+            job->status = job->timed_out ? BATCH_JOB_TIMEOUT : BATCH_JOB_ERROR;
+        }
+    }
+
+    scrap_vm_free(vm);
+    fclose(input);
+    if (fclose(output) && job->status == BATCH_JOB_OK) {
+        snprintf(job->error, BATCH_ERROR_SIZE, "Failed to write %s: %s", job->output_path, strerror(errno));
+        job->status = BATCH_JOB_ERROR;
+    }
+}
+
+static bool batch_worker(void* data) {
+    Batch* batch = data;
+
+    while (true) {
+        mutex_lock(&batch->lock);
+        if (batch->next_job >= batch->jobs_count) {
+            mutex_unlock(&batch->lock);
+            break;
+        }
+        BatchJob* job = &batch->jobs[batch->next_job++];
+        job->status = BATCH_JOB_RUNNING;
+        mutex_unlock(&batch->lock);
+
+        batch_run_job(batch, job);
+    }
+
+    return true;
+}
+
+static void batch_print_summary(Batch* batch, int jobs, double wall_time) {
+    size_t status_counts[BATCH_JOB_LOAD_ERROR + 1] = {0};
+
+    printf("%-10s %12s %12s  %s\n", "STATUS", "TIME", "HEAP", "PROGRAM");
+    for (size_t i = 0; i < batch->jobs_count; i++) {
+        BatchJob* job = &batch->jobs[i];
+        status_counts[job->status]++;
+
+        printf("%-10s %10.2fms %10.2fMiB  %s\n", batch_status_names[job->status], job->time_taken / 1000.0, job->heap_size / (1024.0 * 1024.0), job->bytecode_path);
+        if (job->error[0]) printf("%-10s %s\n", "", job->error);
+    }
+
+    printf(
+        "\nRan %zu programs in %.2fs using %d jobs: %zu ok, %zu failed, %zu timed out, %zu not loaded\n",
+        batch->jobs_count,
+        wall_time / 1e+6,
+        jobs,
+        status_counts[BATCH_JOB_OK],
+        status_counts[BATCH_JOB_ERROR],
+        status_counts[BATCH_JOB_TIMEOUT],
+        status_counts[BATCH_JOB_LOAD_ERROR]
+    );
+}
+
+int batch_run(const char* list_path, int jobs, double time_limit, size_t memory_limit) {
+    // See runtime_new
+    setlocale(LC_CTYPE, "");
+    std_init();
+
+    Batch batch = {0};
+    batch.memory_limit = memory_limit;
+    batch.lock = mutex_new();
+
+    if (!batch_load_list(&batch, list_path, time_limit)) {
+        batch_free(&batch);
+        return 1;
+    }
+
+    if (jobs < 1) jobs = 1;
+    if ((size_t)jobs > batch.jobs_count) jobs = batch.jobs_count > 0 ? batch.jobs_count : 1;
+
+    Timer timer = start_timer("batch");
+    Thread* threads = malloc(sizeof(Thread) * jobs);
+    int threads_count = 0;
+    for (int i = 0; i < jobs; i++) {
+        threads[threads_count] = thread_new(batch_worker, NULL);
+        if (!thread_start(&threads[threads_count], &batch)) {
+            printf("Failed to start worker thread\n");
+            break;
+        }
+        threads_count++;
+    }
+
+    // Still run the jobs on this thread so that the batch does not hang
+    if (threads_count == 0) batch_worker(&batch);
+    for (int i = 0; i < threads_count; i++) thread_join(&threads[i]);
+    free(threads);
+
+    batch_print_summary(&batch, threads_count > 0 ? threads_count : 1, end_timer(timer));
+
+    int ret = 0;
+    for (size_t i = 0; i < batch.jobs_count; i++) {
+        if (batch.jobs[i].status != BATCH_JOB_OK) ret = 1;
+    }
+
+    batch_free(&batch);
+    return ret;
+}
@@ -0,0 +1,36 @@
+// Scrap is a project that allows anyone to build software using simple, block based interface.
+//
+// Copyright (C) 2024-2026 Grisshink
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+
+#ifndef SCRAP_BATCH_H
+#define SCRAP_BATCH_H
+
+#include <stddef.h>
+
+// Runs every program listed in the file at list_path in this process, using `jobs` worker threads.
+// Each line of the list is `BYTECODE_PATH [INPUT_PATH [OUTPUT_PATH]]`, empty lines and lines starting with '#'
+// are skipped. Programs read their input from INPUT_PATH (nothing by default) and write their output
+// to OUTPUT_PATH (BYTECODE_PATH with .out appended by default).
+// Every program runs in its own ScrapVm which is interrupted after time_limit seconds (0 for no limit)
+// and whose heap is limited to memory_limit bytes (0 for the default limit).
+// Prints summary of all runs and returns exit code, which is nonzero if any of the programs failed
+int batch_run(const char* list_path, int jobs, double time_limit, size_t memory_limit);
+
+#endif // SCRAP_BATCH_H
@@ -79,6 +79,8 @@ typedef struct {
 
 typedef struct {
     ConstId label;
+    const char* name;
+    const char* module; // Module the function is imported from, NULL if it's compiled together with the project
     IrBytecode bc;
     size_t arg_count;
     CustomFunctionArgumentTypeList arg_types;
@@ -115,11 +117,7 @@ Value string_to_bc(Compiler* compiler, char* str) {
     int codepoint_size = 0;
     for (char* ch = str; *ch; ch += codepoint_size) {
         int codepoint = GetCodepointNext(ch, &codepoint_size);
-
-        bytecode_const_list_append(compiler->bc_pool, list, (IrValue) {
-            .type = IR_TYPE_INT,
-            .as.int_val = codepoint,
-        });
+        bytecode_const_string_append(compiler->bc_pool, list, codepoint);
     }
 
     bytecode_push_op_list_string(&bc, IR_PUSHA, list);
@@ -1329,11 +1327,24 @@ Value block_define_block(Compiler* compiler, Block* block, Block** next_block, B
             return DATA_ERROR;
         }
 
+        const char* module = NULL;
+        for (size_t i = 0; i < compiler->modules_count; i++) {
+            if (!bytecode_find_export(&compiler->modules[i], func_name)) continue;
+            module = compiler->modules[i].name;
+            break;
+        }
+
         IrBytecode bc = EMPTY_BYTECODE;
-        ConstId label = bytecode_push_label(&bc, func_name);
+        ConstId label = (size_t)-1;
+        if (!module) {
+            label = bytecode_push_label(&bc, func_name);
+            bytecode_export_label(&bc, label);
+        }
 
         CustomFunctionData* block_data = ir_arena_alloc(compiler->arena, sizeof(CustomFunctionData));
         block_data->label = label;
+        block_data->name = func_name;
+        block_data->module = module;
         block_data->bc = bc;
         block_data->arg_types = (CustomFunctionArgumentTypeList) {0};
 
@@ -1348,6 +1359,9 @@ Value block_define_block(Compiler* compiler, Block* block, Block** next_block, B
 
         compiler_object_info_insert(compiler, blockdef, block_data);
 
+        // Function body is already compiled into the module
+        if (module) return DATA_NULL;
+
         vector_add(&compiler->chains_to_compile, block->parent.as.chain);
         return DATA_NULL;
     } else if (prev_block == NULL) {
@@ -2227,16 +2241,9 @@ Value block_letter_in(Compiler* compiler, Block* block, Block** next_block, Bloc
     str = cast_to_bc_string(compiler, str);
     if (str.type == DATA_TYPE_ERROR) return DATA_ERROR;
 
-    IrBytecode bc = EMPTY_BYTECODE;
-
-    bytecode_push_op_list(&bc, IR_PUSHA, NULL);
-    bytecode_push_op(&bc, IR_DUP);
-
-    bytecode_join(&bc, &str.data.chunk_val.bc);
+    IrBytecode bc = str.data.chunk_val.bc;
     bytecode_join(&bc, &ind.data.chunk_val.bc);
-
-    bytecode_push_op(&bc, IR_INDEXL);
-    bytecode_push_op(&bc, IR_ADDL);
+    bytecode_push_op_func(&bc, IR_RUN, ir_func_by_hint("std_string_letter_in"));
     return DATA_CHUNK(DATA_TYPE_STRING, bc);
 }
 
@@ -2309,11 +2316,8 @@ Value block_chr(Compiler* compiler, Block* block, Block** next_block, Block* pre
     if (int_val.type == DATA_TYPE_ERROR) return DATA_ERROR;
 
     if (int_val.type == DATA_TYPE_CHUNK) {
-        IrBytecode bc = EMPTY_BYTECODE;
-        bytecode_push_op_list(&bc, IR_PUSHA, NULL);
-        bytecode_push_op(&bc, IR_DUP);
-        bytecode_join(&bc, &int_val.data.chunk_val.bc);
-        bytecode_push_op(&bc, IR_ADDL);
+        IrBytecode bc = int_val.data.chunk_val.bc;
+        bytecode_push_op_func(&bc, IR_RUN, ir_func_by_hint("std_string_chr"));
         return DATA_CHUNK(DATA_TYPE_STRING, bc);
     } else {
         return DATA_STRING(ir_arena_sprintf(compiler->arena, 16, "%lc", int_val.data.integer_val));
@@ -2607,6 +2611,22 @@ Value block_gc_collect(Compiler* compiler, Block* block, Block** next_block, Blo
     return DATA_CHUNK(DATA_TYPE_NULL, bc);
 }
 
+Value block_snapshot(Compiler* compiler, Block* block, Block** next_block, Block* prev_block) {
+    (void) block;
+    (void) next_block;
+    (void) prev_block;
+
+    // Resumed program continues right after the snapshot call
+    IrBytecode bc_label = EMPTY_BYTECODE;
+    ConstId label = bytecode_push_label(&bc_label, ir_arena_sprintf(compiler->arena, 32, "snapshot_%zu", compiler->label_counter++));
+
+    IrBytecode bc = EMPTY_BYTECODE;
+    bytecode_push_op_label(&bc, IR_PUSHLB, label);
+    bytecode_push_op_func(&bc, IR_RUN, ir_func_by_hint("std_snapshot"));
+    bytecode_join(&bc, &bc_label);
+    return DATA_CHUNK(DATA_TYPE_NULL, bc);
+}
+
 Value block_exec_custom(Compiler* compiler, Block* block, Block** next_block, Block* prev_block) {
     (void) next_block;
     (void) prev_block;
@@ -2626,7 +2646,11 @@ Value block_exec_custom(Compiler* compiler, Block* block, Block** next_block, Bl
         return DATA_ERROR;
     }
 
-    bytecode_push_op_label(&bc, IR_CALL, block_data->label);
+    if (block_data->module) {
+        bytecode_push_op_import(&bc, IR_CALLX, block_data->module, block_data->name);
+    } else {
+        bytecode_push_op_label(&bc, IR_CALL, block_data->label);
+    }
 
     return DATA_CHUNK(block->blockdef->return_type, bc);
 }
@@ -3041,6 +3065,11 @@ void register_blocks(Vm* vm) {
     blockdef_register(vm, sc_unix_time);
     block_category_add_blockdef(cat_misc, sc_unix_time);
 
+    Blockdef* sc_snapshot = blockdef_new("snapshot", BLOCKTYPE_NORMAL, (BlockdefColor) CATEGORY_MISC_COLOR, DATA_TYPE_NULL, block_snapshot);
+    blockdef_add_text(sc_snapshot, gettext("Snapshot here"));
+    blockdef_register(vm, sc_snapshot);
+    block_category_add_blockdef(cat_misc, sc_snapshot);
+
     block_category_add_label(cat_misc, gettext("Type casting"), (Color) CATEGORY_MISC_COLOR);
 
     Blockdef* sc_int = blockdef_new("convert_int", BLOCKTYPE_NORMAL, (BlockdefColor) CATEGORY_MISC_COLOR, DATA_TYPE_INTEGER, block_convert_int);
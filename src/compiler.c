@@ -21,6 +21,8 @@
 #include "scrap.h"
 #include "ast.h"
 #include "vec.h"
+#include "runtime.h"
+#include "aot.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -29,11 +31,15 @@
 #include <wchar.h>
 #include <assert.h>
 #include <math.h>
+#include <errno.h>
 
 #define KiB(n) ((size_t)(n) << 10)
 #define MiB(n) ((size_t)(n) << 20)
 #define GiB(n) ((size_t)(n) << 30)
 
+static void* object_pool_get(ObjectPool* pool, void* object);
+static size_t object_pool_insert(IrMemArena* arena, ObjectPool* pool, void* object, void* data);
+
 Compiler compiler_new(void) {
     Compiler compiler = {0};
     compiler.arena = ir_arena_new(GiB(1), MiB(1));
@@ -79,6 +85,11 @@ static RootBlockChain* find_root_blockchain(Compiler* compiler, BlockChain* chai
     return NULL;
 }
 
+static void compiler_number_block(Block* block, void* data) {
+    Compiler* compiler = data;
+    object_pool_insert(compiler->arena, &compiler->block_locations, block, (void*)compiler->block_locations.size);
+}
+
 bool compiler_compile(Compiler* compiler, RootBlockChain* code, IrBytecode* out_bytecode, CompilerError* error) {
     compiler->label_counter = 0;
     vector_clear(compiler->chains_to_compile);
@@ -87,6 +98,12 @@ bool compiler_compile(Compiler* compiler, RootBlockChain* code, IrBytecode* out_
 
     compiler->bytecode = bytecode_new("main", compiler->bc_pool);
 
+    // Blocks are numbered in the same order as the editor does when loading heap profile (See vm_load_heap_profile)
+    compiler->block_locations = (ObjectPool) {0};
+    for (size_t i = 0; i < vector_size(compiler->code); i++) {
+        blockchain_walk(compiler->code[i].chain, compiler_number_block, compiler);
+    }
+
     for (size_t i = 0; i < vector_size(compiler->code); i++) {
         assert(!CHAIN_EMPTY(compiler->code[i].chain));
         Block* block = compiler->code[i].chain->start;
@@ -154,6 +171,40 @@ bool compiler_compile(Compiler* compiler, RootBlockChain* code, IrBytecode* out_
     return true;
 }
 
+#ifndef _WIN32
+// Translates bytecode into C and compiles it with C compiler from project settings. Compiler output goes into the terminal
+static bool compiler_build_native(Compiler* compiler, IrBytecode* bytecode, const char* out_path, char* error, size_t error_len) {
+    char* c_path = ir_arena_sprintf(compiler->arena, 2048, "%s.c", out_path);
+
+    FILE* c_file = fopen(c_path, "w");
+    if (!c_file) {
+        snprintf(error, error_len, gettext("Failed to create %s: %s"), c_path, strerror(errno));
+        return false;
+    }
+
+    bool ok = aot_translate(bytecode, c_file, error, error_len);
+    if (fclose(c_file) && ok) {
+        snprintf(error, error_len, gettext("Failed to write %s: %s"), c_path, strerror(errno));
+        ok = false;
+    }
+    if (!ok) return false;
+
+    // Runtime library and its headers are installed into the shared directory (See install target in Makefile)
+    const char* shared_dir = get_shared_dir_path();
+    char* cmd = ir_arena_sprintf(
+        compiler->arena, 8192,
+        "%s -O2 -o \"%s\" \"%s\" -I\"%ssrc\" \"%s" RUNTIME_LIB_NAME "\" " RUNTIME_LIB_LDFLAGS,
+        project_config.linker_name, out_path, c_path, shared_dir, shared_dir
+    );
+    scrap_log(LOG_INFO, "[BUILD] %s", cmd);
+
+    if (!term_run_process(cmd, error, error_len)) return false;
+
+    remove(c_path);
+    return true;
+}
+#endif
+
 bool compiler_run(void* e) {
     bool return_val = false;
 
@@ -166,15 +217,73 @@ bool compiler_run(void* e) {
         goto thread_return;
     }
 
-    bytecode_save(&bytecode, "bytecode.scrb");
+    if (vm->build_executable) {
+#ifdef _WIN32
+        char* out_path = ir_arena_sprintf(compiler.arena, 2048, "%s.exe", project_config.executable_name);
+#else
+        char* out_path = project_config.executable_name;
+#endif
+
+#ifndef _WIN32
+        // Compile natively if C compiler is set, otherwise fall back to bundling bytecode with the runtime
+        if (*project_config.linker_name) {
+            if (!compiler_build_native(&compiler, &bytecode, out_path, vm->compiler_error.buf, vm->compiler_error.buf_size)) {
+                scrap_log(LOG_ERROR, "[BUILD] %s", vm->compiler_error.buf);
+                goto thread_return;
+            }
+
+            scrap_log(LOG_INFO, "[BUILD] Compiled native executable %s", out_path);
+            return_val = true;
+            goto thread_return;
+        }
+#endif
+
+        char* runtime_path = ir_arena_sprintf(compiler.arena, 2048, "%s" RUNTIME_EXE_NAME, GetApplicationDirectory());
+
+        if (!runtime_export(&bytecode, runtime_path, out_path, vm->compiler_error.buf, vm->compiler_error.buf_size)) {
+            scrap_log(LOG_ERROR, "[BUILD] %s", vm->compiler_error.buf);
+            goto thread_return;
+        }
+
+        scrap_log(LOG_INFO, "[BUILD] Exported executable to %s", out_path);
+        return_val = true;
+        goto thread_return;
+    }
+
+    if (!bytecode_save(&bytecode, "bytecode.scrb")) {
+        snprintf(vm->compiler_error.buf, vm->compiler_error.buf_size, gettext("Failed to write bytecode file"));
+        scrap_log(LOG_ERROR, "[COMPILER] %s", vm->compiler_error.buf);
+        goto thread_return;
+    }
+
+    RuntimeGcConfig gc = {
+        .heap_size = MiB(project_config.heap_size),
+        .heap_limit = MiB(project_config.heap_limit),
+        .growth_factor = project_config.gc_growth / 100.0,
+        .live_ratio = project_config.gc_live_ratio / 100.0,
+    };
+
+    // Profile of the previous run should not be shown if this one fails to write it
+    const char* heap_profile_path = vm->heap_profile ? HEAP_PROFILE_PATH : NULL;
+    if (heap_profile_path) remove(heap_profile_path);
 
 #ifdef _WIN32
-    char* cmd = ir_arena_sprintf(compiler.arena, 2048, "scrap.exe -run bytecode.scrb");
+    char* cmd = ir_arena_sprintf(compiler.arena, 2048, "scrap.exe -run bytecode.scrb -heap-size %d -heap-limit %d -gc-growth %g -gc-live-ratio %g%s",
 #else
-    char* cmd = ir_arena_sprintf(compiler.arena, 2048, "%sscrap -run bytecode.scrb", GetApplicationDirectory());
+    char* cmd = ir_arena_sprintf(compiler.arena, 2048, "%sscrap -run bytecode.scrb -heap-size %d -heap-limit %d -gc-growth %g -gc-live-ratio %g%s", GetApplicationDirectory(),
 #endif
+                                 project_config.heap_size, project_config.heap_limit, gc.growth_factor, gc.live_ratio,
+                                 heap_profile_path ? " -heap-profile " HEAP_PROFILE_PATH : "");
 
-    if (!term_run_process(cmd, vm->compiler_error.buf, vm->compiler_error.buf_size)) {
+    // Prefer already running zygote process if we have one, as it saves us from initializing the runtime from scratch
+    bool run_ok;
+    if (term.zygote_running) {
+        run_ok = term_run_zygote("bytecode.scrb", gc, heap_profile_path, vm->compiler_error.buf, vm->compiler_error.buf_size);
+    } else {
+        run_ok = term_run_process(cmd, vm->compiler_error.buf, vm->compiler_error.buf_size);
+    }
+
+    if (!run_ok) {
         scrap_log(LOG_ERROR, "[RUNTIME] %s", vm->compiler_error.buf);
         scrap_log(LOG_ERROR, "Runtime stage failed. Aborting runtime thread");
         goto thread_return;
@@ -256,6 +365,11 @@ Value compiler_evaluate_block(Compiler* compiler, Block* block, Block** next_blo
         }
     }
 
+    if (value.type == DATA_TYPE_CHUNK) {
+        void* location = object_pool_get(&compiler->block_locations, block);
+        if (location != OBJECT_NOT_FOUND) bytecode_set_location(&value.data.chunk_val.bc, (uintptr_t)location);
+    }
+
     return value;
 }
 
@@ -303,8 +417,7 @@ Value compiler_evaluate_chain(Compiler* compiler, BlockChain* chain) {
     compiler->current_chain = prev_chain;
     return DATA_CHUNK(bc_type, bc);
 }
-void* compiler_object_info_get(Compiler* compiler, void* object) {
-    ObjectPool* pool = &compiler->object_info;
+static void* object_pool_get(ObjectPool* pool, void* object) {
     if (pool->hash_table.capacity == 0) return OBJECT_NOT_FOUND;
 
     size_t hash = (size_t)object % pool->hash_table.capacity;
@@ -319,16 +432,14 @@ void* compiler_object_info_get(Compiler* compiler, void* object) {
     return pool->items[idx].data;
 }
 
-size_t compiler_object_info_insert(Compiler* compiler, void* object, void* data) {
-    ObjectPool* pool = &compiler->object_info;
-
+static size_t object_pool_insert(IrMemArena* arena, ObjectPool* pool, void* object, void* data) {
     if ((float)pool->hash_table.size / (float)pool->hash_table.capacity > 0.6 || pool->hash_table.capacity == 0) {
         size_t old_cap = pool->hash_table.capacity;
 
         if (pool->hash_table.capacity == 0) pool->hash_table.capacity = 1024;
         else pool->hash_table.capacity *= 2;
 
-        pool->hash_table.items = ir_arena_realloc(compiler->arena, pool->hash_table.items, old_cap, sizeof(*pool->hash_table.items) * pool->hash_table.capacity);
+        pool->hash_table.items = ir_arena_realloc(arena, pool->hash_table.items, old_cap, sizeof(*pool->hash_table.items) * pool->hash_table.capacity);
         // This sets all buckets in hash table to -1 (empty)
         memset(pool->hash_table.items, 0xff, sizeof(*pool->hash_table.items) * pool->hash_table.capacity);
 
@@ -362,10 +473,18 @@ size_t compiler_object_info_insert(Compiler* compiler, void* object, void* data)
     idx = pool->size;
     pool->hash_table.items[hash] = idx;
     pool->hash_table.size++;
-    ir_arena_append(compiler->arena, compiler->object_info, ((ObjectInfoMap) { object, data }));
+    ir_arena_append(arena, *pool, ((ObjectInfoMap) { object, data }));
     return idx;
 }
 
+void* compiler_object_info_get(Compiler* compiler, void* object) {
+    return object_pool_get(&compiler->object_info, object);
+}
+
+size_t compiler_object_info_insert(Compiler* compiler, void* object, void* data) {
+    return object_pool_insert(compiler->arena, &compiler->object_info, object, data);
+}
+
 ssize_t compiler_find_variable(Compiler* compiler, const char* name, bool* global) {
     for (ssize_t i = compiler->variables.size - 1; i >= 0; i--) {
         if (!strcmp(compiler->variables.items[i].name, name)) {
@@ -70,7 +70,13 @@ struct Compiler {
     IrBytecodePool* bc_pool;
     IrBytecode bytecode;
 
+    // Precompiled bytecode modules. Custom blocks exported from them are called through imports
+    // instead of being compiled into the project bytecode. Set by the caller, the compiler does not own them
+    IrBytecode* modules;
+    size_t modules_count;
+
     ObjectPool object_info;
+    ObjectPool block_locations; // Numbers of blocks used as source locations of their code (See bytecode_set_location)
     VariableList variables;
     VariableList global_variables;
 
@@ -113,6 +119,7 @@ Compiler compiler_new(void);
 bool compiler_run(void* e);
 void compiler_cleanup(void* e);
 void compiler_free(Compiler* compiler);
+bool compiler_compile(Compiler* compiler, RootBlockChain* code, IrBytecode* out_bytecode, CompilerError* error);
 Value compiler_evaluate_chain(Compiler* compiler, BlockChain* chain);
 Value compiler_evaluate_block(Compiler* compiler, Block* block, Block** next_block, Block* prev_block);
 Value compiler_evaluate_argument(Compiler* compiler, Argument* arg);
@@ -68,6 +68,9 @@
 #define CATEGORY_NOTHING_COLOR { 0x77, 0x77, 0x77, 0xff }
 
 #define UNIMPLEMENTED_BLOCK_COLOR { 0x66, 0x66, 0x66, 0xff }
+// Blocks holding the most memory in heap profile get this color
+#define HEAP_PROFILE_BLOCK_COLOR { 0xff, 0xee, 0x00, 0xff }
+#define HEAP_PROFILE_PATH "heap_profile.txt"
 
 #define MAX_ERROR_LEN 512
 
@@ -699,6 +699,15 @@ static void draw_block(Block* block, bool highlight, bool select, bool can_hover
     bool collision = ui.hover.editor.prev_block == block || highlight;
     Color color = CONVERT_COLOR(block->blockdef->color, Color);
     if (!block->blockdef->func) color = (Color) UNIMPLEMENTED_BLOCK_COLOR;
+    size_t heap_bytes = vm.heap_profile_max > 0 ? vm_get_heap_profile_bytes(block) : 0;
+    if (heap_bytes > 0) {
+        // Blocks holding more memory get closer to the profile color
+        Color heap_color = HEAP_PROFILE_BLOCK_COLOR;
+        float amount = 0.3 + 0.7 * (float)heap_bytes / (float)vm.heap_profile_max;
+        color.r += (heap_color.r - color.r) * amount;
+        color.g += (heap_color.g - color.g) * amount;
+        color.b += (heap_color.b - color.b) * amount;
+    }
     if (!thread_is_running(&vm.thread) && block == vm.compiler_error.block) {
         double animation = fmod(-GetTime(), 1.0) * 0.5 + 1.0;
         color = (Color) { 0xff * animation, 0x20 * animation, 0x20 * animation, 0xff };
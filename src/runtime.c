@@ -0,0 +1,490 @@
+// Scrap is a project that allows anyone to build software using simple, block based interface.
+//
+// Copyright (C) 2024-2026 Grisshink
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include "runtime.h"
+#include "std.h"
+#include "term.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <locale.h>
+#include <libintl.h>
+
+#ifndef _WIN32
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#endif
+
+#define KiB(n) ((size_t)(n) << 10)
+#define MiB(n) ((size_t)(n) << 20)
+#define GiB(n) ((size_t)(n) << 30)
+
+typedef struct {
+    IrBytecodePool* pool;
+    IrBytecodePool** module_pools;
+    size_t module_pools_count;
+    IrExec exec;
+    RuntimeGcConfig gc;
+} Runtime;
+
+static RuntimeGcConfig runtime_gc_config = {0};
+
+static const char* runtime_heap_profile_path = NULL;
+
+static RuntimeStatsFormat runtime_stats_format = RUNTIME_STATS_DEFAULT;
+static bool runtime_stats_opcodes = false;
+
+void runtime_set_gc_config(RuntimeGcConfig gc) {
+    runtime_gc_config = gc;
+}
+
+void runtime_set_heap_profile(const char* path) {
+    runtime_heap_profile_path = path;
+}
+
+static bool runtime_start_heap_profile(Runtime* runtime) {
+    const char* path = runtime_heap_profile_path ? runtime_heap_profile_path : getenv("SCRAP_HEAP_PROFILE");
+    if (!path || !*path) return true;
+    if (!exec_set_heap_profile(&runtime->exec, path)) {
+        printf("Heap profile error: %s\n", runtime->exec.last_error);
+        return false;
+    }
+    return true;
+}
+
+// Collecting the heap writes what the program still holds at the end into the profile
+static void runtime_finish_heap_profile(Runtime* runtime) {
+    if (runtime->exec.profile) exec_collect(&runtime->exec);
+}
+
+void runtime_set_stats(RuntimeStatsFormat format, bool opcodes) {
+    runtime_stats_format = format;
+    runtime_stats_opcodes = opcodes;
+}
+
+static RuntimeStatsFormat runtime_stats_format_resolve(void) {
+    if (runtime_stats_format != RUNTIME_STATS_DEFAULT) return runtime_stats_format;
+    const char* value = getenv("SCRAP_STATS");
+    if (!value || !*value || !strcmp(value, "0")) return RUNTIME_STATS_NONE;
+    return !strcmp(value, "json") ? RUNTIME_STATS_JSON : RUNTIME_STATS_TEXT;
+}
+
+static void runtime_write_stats(Runtime* runtime) {
+    RuntimeStatsFormat format = runtime_stats_format_resolve();
+    if (format == RUNTIME_STATS_NONE) return;
+    exec_write_stats(&runtime->exec, stderr, format == RUNTIME_STATS_JSON);
+}
+
+static size_t runtime_env_mib(const char* name) {
+    const char* value = getenv(name);
+    return value ? MiB(strtoull(value, NULL, 10)) : 0;
+}
+
+static double runtime_env_double(const char* name) {
+    const char* value = getenv(name);
+    return value ? strtod(value, NULL) : 0.0;
+}
+
+static RuntimeGcConfig runtime_gc_config_resolve(RuntimeGcConfig gc) {
+    if (gc.heap_size == 0) gc.heap_size = runtime_env_mib("SCRAP_HEAP_SIZE");
+    if (gc.heap_limit == 0) gc.heap_limit = runtime_env_mib("SCRAP_HEAP_LIMIT");
+    if (gc.growth_factor == 0.0) gc.growth_factor = runtime_env_double("SCRAP_GC_GROWTH");
+    if (gc.live_ratio == 0.0) gc.live_ratio = runtime_env_double("SCRAP_GC_LIVE_RATIO");
+
+    if (gc.heap_size == 0) gc.heap_size = MiB(1);
+    if (gc.heap_limit == 0) gc.heap_limit = GiB(1);
+    if (gc.heap_size > gc.heap_limit) gc.heap_size = gc.heap_limit;
+    // Growth factor and live ratio are checked by exec_set_gc_growth
+    return gc;
+}
+
+static bool runtime_exec_new(Runtime* runtime, RuntimeGcConfig gc) {
+    runtime->exec = exec_new(gc.heap_size, gc.heap_limit);
+    if (runtime->exec.last_error[0] != 0) {
+        printf("Exec create error: %s\n", runtime->exec.last_error);
+        return false;
+    }
+
+    exec_set_run_function_resolver(&runtime->exec, std_resolve_function);
+    exec_set_gc_threads(&runtime->exec, 0);
+    exec_set_huge_pages(&runtime->exec, true);
+    exec_set_gc_growth(&runtime->exec, gc.growth_factor, gc.live_ratio);
+    if (runtime_stats_format_resolve() != RUNTIME_STATS_NONE) {
+        const char* opcodes = getenv("SCRAP_STATS_OPCODES");
+        exec_enable_stats(&runtime->exec, runtime_stats_opcodes || (opcodes && *opcodes && strcmp(opcodes, "0")));
+    }
+    runtime->gc = gc;
+    return true;
+}
+
+static bool runtime_new(Runtime* runtime) {
+    // When starting the editor, GLFW internally sets LC_CTYPE locale to make %lc format options work properly,
+    // so we need to set it here explicitly
+    setlocale(LC_CTYPE, "");
+
+    IrMemArena* arena = ir_arena_new(GiB(1), KiB(512));
+    ir_arena_set_huge_pages(arena, true);
+    runtime->pool = bytecode_pool_new(arena);
+    runtime->module_pools = NULL;
+    runtime->module_pools_count = 0;
+
+    std_init();
+
+    if (!runtime_exec_new(runtime, runtime_gc_config_resolve(runtime_gc_config))) {
+        bytecode_pool_free(runtime->pool);
+        return false;
+    }
+    runtime->exec.context = std_context_new();
+    return true;
+}
+
+static void runtime_free(Runtime* runtime) {
+    bytecode_pool_free(runtime->pool);
+    for (size_t i = 0; i < runtime->module_pools_count; i++) bytecode_pool_free(runtime->module_pools[i]);
+    free(runtime->module_pools);
+    std_context_free(runtime->exec.context);
+    exec_free(&runtime->exec);
+}
+
+static int runtime_run(Runtime* runtime, IrBytecode bc, IrNativeFunction func) {
+    bc.name = "main";
+    exec_add_bytecode(&runtime->exec, bc);
+
+    if (!exec_link(&runtime->exec)) {
+        printf("Link error: %s\n", runtime->exec.last_error);
+        return 1;
+    }
+    if (!runtime_start_heap_profile(runtime)) return 1;
+
+    int ret = 0;
+    if (!exec_run_native(&runtime->exec, "main", "entry", func)) {
+        printf("Runtime error: %s\n", runtime->exec.last_error);
+        ret = 1;
+    }
+
+    runtime_finish_heap_profile(runtime);
+    runtime_write_stats(runtime);
+    return ret;
+}
+
+static char* runtime_module_name(IrMemArena* arena, const char* path) {
+    const char* name = path;
+    for (const char* str = path; *str; str++) {
+        if (*str == '/' || *str == '\\') name = str + 1;
+    }
+
+    const char* ext = strrchr(name, '.');
+    size_t name_len = ext && ext != name ? (size_t)(ext - name) : strlen(name);
+
+    char* out = ir_arena_alloc(arena, name_len + 1);
+    memcpy(out, name, name_len);
+    out[name_len] = 0;
+    return out;
+}
+
+bool runtime_load_module(IrBytecode* bc, const char* path) {
+    // Every bytecode file references constants by their index in the pool, so each module needs its own pool
+    IrBytecodePool* pool = bytecode_pool_new(NULL);
+    if (!bytecode_load(pool, bc, path)) {
+        bytecode_pool_free(pool);
+        return false;
+    }
+    bc->name = runtime_module_name(pool->arena, path);
+    return true;
+}
+
+static bool runtime_add_modules(Runtime* runtime, const char** module_paths, size_t modules_count) {
+    runtime->module_pools = malloc(sizeof(IrBytecodePool*) * modules_count);
+
+    for (size_t i = 0; i < modules_count; i++) {
+        IrBytecode bc;
+        if (!runtime_load_module(&bc, module_paths[i])) {
+            printf("Failed to load module %s\n", module_paths[i]);
+            return false;
+        }
+        runtime->module_pools[runtime->module_pools_count++] = bc.pool;
+        exec_add_bytecode(&runtime->exec, bc);
+    }
+    return true;
+}
+
+static int runtime_load_and_run(Runtime* runtime, const char* bc_path) {
+    IrBytecode bc;
+    if (!bytecode_load(runtime->pool, &bc, bc_path)) {
+        printf("Bytecode load error\n");
+        return 1;
+    }
+    return runtime_run(runtime, bc, exec_run_bytecode);
+}
+
+int runtime_run_file(const char* bc_path, const char** module_paths, size_t modules_count, const char* snapshot_path) {
+    Runtime runtime;
+    if (!runtime_new(&runtime)) return 1;
+    runtime.exec.snapshot_path = snapshot_path;
+
+    int ret = 1;
+    if (runtime_add_modules(&runtime, module_paths, modules_count)) ret = runtime_load_and_run(&runtime, bc_path);
+
+    runtime_free(&runtime);
+    return ret;
+}
+
+int runtime_resume_file(const char* snapshot_path) {
+    Runtime runtime;
+    if (!runtime_new(&runtime)) return 1;
+
+    int ret = 0;
+    IrBytecode bc;
+    size_t pos;
+    if (!exec_load_snapshot(&runtime.exec, runtime.pool, &bc, &pos, snapshot_path)) {
+        printf("Snapshot load error: %s\n", runtime.exec.last_error);
+        ret = 1;
+    } else if (!runtime_start_heap_profile(&runtime)) {
+        ret = 1;
+    } else {
+        bc.name = "main";
+        exec_add_bytecode(&runtime.exec, bc);
+        if (!exec_resume_bytecode(&runtime.exec, &runtime.exec.chunks.items[0], pos)) {
+            printf("Runtime error: %s\n", runtime.exec.last_error);
+            ret = 1;
+        }
+        runtime_finish_heap_profile(&runtime);
+        runtime_write_stats(&runtime);
+    }
+
+    runtime_free(&runtime);
+    return ret;
+}
+
+int runtime_run_memory(const void* data, size_t data_size) {
+    Runtime runtime;
+    if (!runtime_new(&runtime)) return 1;
+
+    int ret;
+    IrBytecode bc;
+    if (!bytecode_load_memory(runtime.pool, &bc, data, data_size)) {
+        printf("Bytecode load error\n");
+        ret = 1;
+    } else {
+        ret = runtime_run(&runtime, bc, exec_run_bytecode);
+    }
+
+    runtime_free(&runtime);
+    return ret;
+}
+
+int runtime_run_native(const void* data, size_t data_size, size_t const_count, IrNativeFunction func) {
+    Runtime runtime;
+    if (!runtime_new(&runtime)) return 1;
+
+    int ret;
+    IrBytecode bc;
+    if (!bytecode_load_memory(runtime.pool, &bc, data, data_size)) {
+        printf("Bytecode load error\n");
+        ret = 1;
+    } else if (runtime.pool->list.size != const_count) {
+        printf("Embedded bytecode does not match the compiled code\n");
+        ret = 1;
+    } else {
+        ret = runtime_run(&runtime, bc, func);
+    }
+
+    runtime_free(&runtime);
+    return ret;
+}
+
+static uint64_t trailer_get_size(RuntimeEmbedTrailer* trailer) {
+    uint64_t size = 0;
+    for (int i = 7; i >= 0; i--) size = (size << 8) | trailer->bytecode_size[i];
+    return size;
+}
+
+int runtime_run_embedded(const char* exe_path) {
+    FILE* f = fopen(exe_path, "rb");
+    if (!f) {
+        printf("Failed to open %s: %s\n", exe_path, strerror(errno));
+        return 1;
+    }
+
+    RuntimeEmbedTrailer trailer;
+    if (fseek(f, -(long)sizeof(trailer), SEEK_END) || fread(&trailer, sizeof(trailer), 1, f) != 1 || memcmp(trailer.magic, RUNTIME_EMBED_MAGIC, sizeof(trailer.magic))) {
+        printf("No bytecode is embedded in %s\n", exe_path);
+        fclose(f);
+        return 1;
+    }
+
+    // The size comes from the file itself, so it is checked against the file size before trusting it
+    long file_size = ftell(f);
+    uint64_t bytecode_size = trailer_get_size(&trailer);
+    if (file_size < 0 || bytecode_size == 0 || bytecode_size > (uint64_t)file_size - sizeof(trailer)) {
+        printf("Embedded bytecode in %s is corrupted\n", exe_path);
+        fclose(f);
+        return 1;
+    }
+
+    void* data = malloc(bytecode_size);
+    if (!data) {
+        printf("Failed to allocate %zu bytes for embedded bytecode\n", (size_t)bytecode_size);
+        fclose(f);
+        return 1;
+    }
+
+    if (fseek(f, -(long)(sizeof(trailer) + bytecode_size), SEEK_END) || fread(data, 1, bytecode_size, f) != bytecode_size) {
+        printf("Failed to read embedded bytecode\n");
+        free(data);
+        fclose(f);
+        return 1;
+    }
+    fclose(f);
+
+    int ret = runtime_run_memory(data, bytecode_size);
+    free(data);
+    return ret;
+}
+
+#ifndef _WIN32
+// Applies garbage collector settings requested for the run. Heap memory is reserved when exec is created,
+// so exec is created again if the heap size differs from the one zygote was started with
+static bool runtime_apply_gc_config(Runtime* runtime, RuntimeGcConfig gc) {
+    gc = runtime_gc_config_resolve(gc);
+    if (gc.heap_size == runtime->gc.heap_size && gc.heap_limit == runtime->gc.heap_limit) {
+        exec_set_gc_growth(&runtime->exec, gc.growth_factor, gc.live_ratio);
+        runtime->gc = gc;
+        return true;
+    }
+
+    void* context = runtime->exec.context;
+    exec_free(&runtime->exec);
+    if (!runtime_exec_new(runtime, gc)) return false;
+    runtime->exec.context = context;
+    return true;
+}
+
+// Zygote is a runtime process which is started once together with the editor terminal. It initializes
+// the runtime upfront and then forks a fresh copy of itself for every run request it receives from the
+// editor, so running the project skips process startup and runtime initialization entirely
+int runtime_start_zygote(int control_fd) {
+    // Terminal signals should only reach the running program, not the zygote itself
+    signal(SIGINT, SIG_IGN);
+    signal(SIGQUIT, SIG_IGN);
+
+    Runtime runtime;
+    if (!runtime_new(&runtime)) return 1;
+
+    int ready = 0;
+    if (send(control_fd, &ready, sizeof(ready), MSG_NOSIGNAL) != sizeof(ready)) {
+        runtime_free(&runtime);
+        return 1;
+    }
+
+    TermZygoteRequest request;
+    ssize_t request_size;
+    while ((request_size = recv(control_fd, &request, sizeof(request), 0)) != 0) {
+        if (request_size == -1) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (request_size != sizeof(request)) continue;
+        request.bytecode_path[TERM_ZYGOTE_PATH_SIZE - 1] = 0;
+        request.heap_profile_path[TERM_ZYGOTE_PATH_SIZE - 1] = 0;
+
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(control_fd);
+            signal(SIGINT, SIG_DFL);
+            signal(SIGQUIT, SIG_DFL);
+            std_reseed(runtime.exec.context);
+            if (!runtime_apply_gc_config(&runtime, request.gc)) exit(1);
+            runtime_set_heap_profile(*request.heap_profile_path ? request.heap_profile_path : NULL);
+            exit(runtime_load_and_run(&runtime, request.bytecode_path));
+        }
+
+        int reply = pid == -1 ? -errno : pid;
+        if (send(control_fd, &reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply)) break;
+        if (pid == -1) continue;
+
+        int status;
+        while (waitpid(pid, &status, 0) == -1 && errno == EINTR);
+        if (send(control_fd, &status, sizeof(status), MSG_NOSIGNAL) != sizeof(status)) break;
+    }
+
+    runtime_free(&runtime);
+    return 0;
+}
+#endif
+
+bool runtime_export(IrBytecode* bc, const char* runtime_path, const char* out_path, char* error, size_t error_len) {
+    FILE* runtime_file = fopen(runtime_path, "rb");
+    if (!runtime_file) {
+        snprintf(error, error_len, gettext("Failed to open runtime binary %s: %s"), runtime_path, strerror(errno));
+        return false;
+    }
+
+    FILE* out_file = fopen(out_path, "wb");
+    if (!out_file) {
+        snprintf(error, error_len, gettext("Failed to create %s: %s"), out_path, strerror(errno));
+        fclose(runtime_file);
+        return false;
+    }
+
+    bool ok = true;
+    char buf[4096];
+    size_t read_size;
+    while ((read_size = fread(buf, 1, sizeof(buf), runtime_file)) > 0) {
+        if (fwrite(buf, 1, read_size, out_file) != read_size) {
+            ok = false;
+            break;
+        }
+    }
+    if (ferror(runtime_file)) ok = false;
+    fclose(runtime_file);
+
+    long bytecode_start = ftell(out_file);
+    if (ok) ok = bytecode_save_file(bc, out_file);
+
+    if (ok) {
+        uint64_t bytecode_size = ftell(out_file) - bytecode_start;
+        RuntimeEmbedTrailer trailer;
+        for (int i = 0; i < 8; i++) trailer.bytecode_size[i] = (bytecode_size >> (i * 8)) & 0xff;
+        memcpy(trailer.magic, RUNTIME_EMBED_MAGIC, sizeof(trailer.magic));
+        ok = fwrite(&trailer, sizeof(trailer), 1, out_file) == 1;
+    }
+
+    if (fclose(out_file)) ok = false;
+    if (!ok) {
+        snprintf(error, error_len, gettext("Failed to write %s: %s"), out_path, strerror(errno));
+        return false;
+    }
+
+#ifndef _WIN32
+    if (chmod(out_path, 0755) == -1) {
+        snprintf(error, error_len, gettext("Failed to make %s executable: %s"), out_path, strerror(errno));
+        return false;
+    }
+#endif
+
+    return true;
+}
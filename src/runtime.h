@@ -0,0 +1,104 @@
+// Scrap is a project that allows anyone to build software using simple, block based interface.
+//
+// Copyright (C) 2024-2026 Grisshink
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#ifndef SCRAP_RUNTIME_H
+#define SCRAP_RUNTIME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "scrap_ir.h"
+
+#define RUNTIME_EMBED_MAGIC "SCRAPEXE"
+
+#ifdef _WIN32
+#define RUNTIME_EXE_NAME "scrap-runtime.exe"
+#else
+#define RUNTIME_EXE_NAME "scrap-runtime"
+#endif
+
+// Static library with the runtime which ahead-of-time compiled programs link against, and its dependencies
+#define RUNTIME_LIB_NAME "libscrapruntime.a"
+#ifdef __APPLE__
+#define RUNTIME_LIB_LDFLAGS "-lffi -lm -lpthread -lintl -rdynamic"
+#else
+#define RUNTIME_LIB_LDFLAGS "-lffi -lm -lpthread -ldl -rdynamic"
+#endif
+
+// Exported executables are made by appending bytecode to the standalone runtime binary followed by this trailer.
+// bytecode_size is stored in little endian byte order
+typedef struct {
+    uint8_t bytecode_size[8];
+    char magic[8];
+} RuntimeEmbedTrailer;
+
+// Garbage collector settings of the program (See exec_new and exec_set_gc_growth). Fields left at 0 are taken from
+// SCRAP_HEAP_SIZE and SCRAP_HEAP_LIMIT environment variables in MiB, SCRAP_GC_GROWTH and SCRAP_GC_LIVE_RATIO,
+// or get the default values if those are not set either
+typedef struct {
+    size_t heap_size; // Memory limit the heap starts with
+    size_t heap_limit; // Memory reserved for the heap, which it can never grow past
+    double growth_factor;
+    double live_ratio;
+} RuntimeGcConfig;
+
+// Sets garbage collector settings of all following runs in this process
+void runtime_set_gc_config(RuntimeGcConfig gc);
+
+// Writes heap profile of all following runs in this process to path (See exec_set_heap_profile). Live heap is also
+// written when the program ends. If path is NULL, SCRAP_HEAP_PROFILE environment variable is used instead
+void runtime_set_heap_profile(const char* path);
+
+typedef enum {
+    RUNTIME_STATS_DEFAULT, // Taken from SCRAP_STATS environment variable, which can be set to 1 or json
+    RUNTIME_STATS_NONE,
+    RUNTIME_STATS_TEXT,
+    RUNTIME_STATS_JSON,
+} RuntimeStatsFormat;
+
+// Writes counters of the work done by all following runs in this process to stderr when they end
+// (See exec_write_stats). Instructions by opcode are only counted if opcodes or SCRAP_STATS_OPCODES is set
+void runtime_set_stats(RuntimeStatsFormat format, bool opcodes);
+
+// Functions return exit code of the runtime process
+// Modules at module_paths are linked together with the bytecode before running (See exec_link)
+// If snapshot_path is not NULL, snapshot blocks in the program save its state there (See exec_save_snapshot)
+int runtime_run_file(const char* bc_path, const char** module_paths, size_t modules_count, const char* snapshot_path);
+// Continues running the program from snapshot saved by runtime_run_file
+int runtime_resume_file(const char* snapshot_path);
+int runtime_run_memory(const void* data, size_t data_size);
+// Runs bytecode embedded in the executable at exe_path
+int runtime_run_embedded(const char* exe_path);
+// Entry point of ahead-of-time compiled programs (See aot.c). Bytecode is still needed for its constant pool,
+// const_count is checked against loaded constants to make sure the bytecode is the one func was translated from
+int runtime_run_native(const void* data, size_t data_size, size_t const_count, IrNativeFunction func);
+#ifndef _WIN32
+int runtime_start_zygote(int control_fd);
+#endif
+
+// Loads precompiled bytecode module into its own pool, which is freed together with bc.pool.
+// Module is named after its file name without extension, which is what imports refer to
+bool runtime_load_module(IrBytecode* bc, const char* path);
+
+// Creates standalone executable at out_path by copying runtime binary and embedding bytecode into it
+bool runtime_export(IrBytecode* bc, const char* runtime_path, const char* out_path, char* error, size_t error_len);
+
+#endif // SCRAP_RUNTIME_H
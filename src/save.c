@@ -246,7 +246,12 @@ void project_config_free(ProjectConfig* config) {
 
 void project_config_set_default(ProjectConfig* config) {
     vector_set_string(&config->executable_name, "project");
-    vector_set_string(&config->linker_name, "ld");
+    vector_set_string(&config->linker_name, "cc");
+    config->heap_size = 1;
+    config->heap_limit = 1024;
+    config->gc_growth = 200;
+    config->gc_live_ratio = 50;
+    config->heap_profile = false;
 }
 
 void apply_config(Config* dst, Config* src) {
@@ -787,7 +792,6 @@ void collect_blockchain_constants(BlockChain* chain) {
 }
 
 void save_code(const char* file_path, ProjectConfig* config, RootBlockChain* code) {
-    (void) config;
     SaveData save = {0};
     ver = SCRAP_MAX_SAVE_VERSION;
     int chains_count = vector_size(code);
@@ -823,6 +827,15 @@ void save_code(const char* file_path, ProjectConfig* config, RootBlockChain* cod
     save_add_varint(&save, chains_count);
     for (int i = 0; i < chains_count; i++) save_root_blockchain(&save, &code[i]);
 
+    // Project config goes last, so that projects without some of its fields can still be loaded
+    save_add_array(&save, config->executable_name, strlen(config->executable_name) + 1, sizeof(config->executable_name[0]));
+    save_add_array(&save, config->linker_name, strlen(config->linker_name) + 1, sizeof(config->linker_name[0]));
+    save_add_varint(&save, config->heap_size);
+    save_add_varint(&save, config->heap_limit);
+    save_add_varint(&save, config->gc_growth);
+    save_add_varint(&save, config->gc_live_ratio);
+    save_add_varint(&save, config->heap_profile);
+
     SaveFileData(file_path, save.ptr, save.size);
     scrap_log(LOG_INFO, "%zu bytes written into %s", save.size, file_path);
 
@@ -1384,7 +1397,17 @@ RootBlockChain* load_code(const char* file_path, ProjectConfig* out_config) {
     if (executable_name) vector_set_string(&config.executable_name, executable_name);
 
     char* linker_name = save_read_array(&save, sizeof(char), &len);
-    if (linker_name) vector_set_string(&config.linker_name, linker_name);
+    // Older projects have "ld" as their linker, which was used to link object files produced by the LLVM backend.
+    // Native builds are done through the C compiler now, so replace the old default
+    if (linker_name && strcmp(linker_name, "ld")) vector_set_string(&config.linker_name, linker_name);
+
+    // Garbage collector settings were added later, so older projects keep the defaults
+    unsigned int gc_value;
+    if (save.size < save.capacity && save_read_varint(&save, &gc_value)) config.heap_size = gc_value;
+    if (save.size < save.capacity && save_read_varint(&save, &gc_value)) config.heap_limit = gc_value;
+    if (save.size < save.capacity && save_read_varint(&save, &gc_value)) config.gc_growth = gc_value;
+    if (save.size < save.capacity && save_read_varint(&save, &gc_value)) config.gc_live_ratio = gc_value;
+    if (save.size < save.capacity && save_read_varint(&save, &gc_value)) config.heap_profile = gc_value != 0;
 
     *out_config = config;
 
@@ -25,6 +25,10 @@
 #include "util.h"
 #include "rlgl.h"
 #include "std.h"
+#include "runtime.h"
+#include "aot.h"
+#include "batch.h"
+#include "assembler.h"
 
 #include <math.h>
 #include <libintl.h>
@@ -32,6 +36,8 @@
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
 
 #define KiB(n) ((size_t)(n) << 10)
 #define MiB(n) ((size_t)(n) << 20)
@@ -189,6 +195,9 @@ Image setup(void) {
     update_search();
 
     term_init(term_measure_text, &assets.fonts.font_mono, config.ui_size * 0.6);
+    if (!term_start_zygote(TextFormat("%sscrap", GetApplicationDirectory()))) {
+        scrap_log(LOG_INFO, "Zygote runtime process is not available, falling back to starting new process for every run");
+    }
 
     // This fixes incorrect texture coordinates in gradient shader
     Texture2D texture = {
@@ -327,53 +336,176 @@ void start_editor(void) {
     cleanup();
 }
 
-int start_runtime(char* bc_path) {
-    // When starting the editor, GLFW internally sets LC_CTYPE locale to make %lc format options work properly, 
-    // so we need to set it here explicitly
-    setlocale(LC_CTYPE, "");
+static void print_compiler_error(const char* project_path, RootBlockChain* code, CompilerError* error) {
+    fprintf(stderr, "%s: error: %s\n", project_path, error->buf);
+
+    if (error->block) {
+        fprintf(stderr, "    in block \"%s\"", error->block->blockdef->id);
+    } else {
+        fprintf(stderr, "    in unknown block");
+    }
+
+    for (size_t i = 0; i < vector_size(code); i++) {
+        if (&code[i] != error->root_blockchain) continue;
+        fprintf(stderr, " of block chain #%zu at (%d, %d)", i, code[i].x, code[i].y);
+        break;
+    }
+    fprintf(stderr, "\n");
+}
+
+// Compiles the project without opening the editor window. Used for precompiling projects from the command line
+int start_compiler(char* project_path, char* out_path, int opt_level, char** module_paths, size_t modules_count) {
+    // Scrap does not have optimization passes yet, but the option is kept so build scripts would not need to change later
+    (void) opt_level;
+
+    setlocale(LC_MESSAGES, "");
+    textdomain("scrap");
+    bindtextdomain("scrap", get_locale_path());
+
+    vm = vm_new();
+    register_blocks(&vm);
+
+    int ret = 1;
 
-    IrMemArena* arena = ir_arena_new(GiB(1), KiB(512));
-    IrBytecodePool* pool = bytecode_pool_new(arena);
-    IrBytecode bc;
+    IrBytecode* modules = malloc(sizeof(IrBytecode) * modules_count);
+    size_t loaded_modules = 0;
+    for (; loaded_modules < modules_count; loaded_modules++) {
+        if (!runtime_load_module(&modules[loaded_modules], module_paths[loaded_modules])) {
+            fprintf(stderr, "%s: error: Failed to load module\n", module_paths[loaded_modules]);
+            goto free_modules;
+        }
+    }
 
-    if (!bytecode_load(pool, &bc, bc_path)) {
-        printf("Bytecode load error\n");
-        bytecode_pool_free(pool);
-        return 1;
+    ProjectConfig config;
+    RootBlockChain* code = load_code(project_path, &config);
+    if (!code) {
+        fprintf(stderr, "%s: error: Failed to load project\n", project_path);
+        goto free_modules;
     }
-    bc.name = "main";
 
-    std_init();
+    Timer timer = start_timer("compile");
 
-    IrExec exec = exec_new(MiB(1), GiB(1));
-    if (exec.last_error[0] != 0) {
-        printf("Exec create error: %s\n", exec.last_error);
-        bytecode_pool_free(pool);
-        return 1;
+    Compiler compiler = compiler_new();
+    compiler.modules = modules;
+    compiler.modules_count = modules_count;
+    IrBytecode bytecode;
+    if (!compiler_compile(&compiler, code, &bytecode, &vm.compiler_error)) {
+        print_compiler_error(project_path, code, &vm.compiler_error);
+        goto free_compiler;
     }
 
-    exec_set_run_function_resolver(&exec, std_resolve_function);
-    exec_add_bytecode(&exec, bc);
+    size_t out_path_len = strlen(out_path);
+    if (out_path_len > 2 && !strcmp(out_path + out_path_len - 2, ".c")) {
+        FILE* out_file = fopen(out_path, "w");
+        if (!out_file) {
+            fprintf(stderr, "%s: error: Failed to create file: %s\n", out_path, strerror(errno));
+            goto free_compiler;
+        }
 
-    if (!exec_run(&exec, "main", "entry")) {
-        printf("Runtime error: %s\n", exec.last_error);
-        bytecode_pool_free(pool);
-        exec_free(&exec);
-        return 1;
+        char error[512];
+        bool ok = aot_translate(&bytecode, out_file, error, sizeof(error));
+        if (fclose(out_file) && ok) {
+            snprintf(error, sizeof(error), "%s", strerror(errno));
+            ok = false;
+        }
+        if (!ok) {
+            fprintf(stderr, "%s: error: Failed to translate bytecode into C: %s\n", out_path, error);
+            goto free_compiler;
+        }
+    } else if (!bytecode_save(&bytecode, out_path)) {
+        fprintf(stderr, "%s: error: Failed to write bytecode file: %s\n", out_path, strerror(errno));
+        goto free_compiler;
+    }
+
+    scrap_log(LOG_INFO, "Compiled %s into %s in %.3fms", project_path, out_path, end_timer(timer));
+    ret = 0;
+
+free_compiler:
+    compiler_free(&compiler);
+    for (size_t i = 0; i < vector_size(code); i++) blockchain_free(code[i].chain);
+    vector_free(code);
+    project_config_free(&config);
+free_modules:
+    for (size_t i = 0; i < loaded_modules; i++) bytecode_pool_free(modules[i].pool);
+    free(modules);
+    vm_free(&vm);
+    unregister_categories();
+    return ret;
+}
+
+// Assembles bytecode from text written in the format of bytecode_print (See assembler.h)
+int start_assembler(char* source_path, char* out_path) {
+    IrBytecodePool* pool = bytecode_pool_new(NULL);
+    IrBytecode bytecode;
+    int ret = 1;
+
+    char error[512];
+    if (!asm_assemble_file(pool, &bytecode, source_path, error, sizeof(error))) {
+        fprintf(stderr, "%s\n", error);
+    } else if (!bytecode_save(&bytecode, out_path)) {
+        fprintf(stderr, "%s: error: Failed to write bytecode file: %s\n", out_path, strerror(errno));
+    } else {
+        ret = 0;
     }
 
     bytecode_pool_free(pool);
-    exec_free(&exec);
-    return 0;
+    return ret;
+}
+
+// Prints bytecode in the format accepted by start_assembler
+int start_disassembler(char* bc_path) {
+    IrBytecodePool* pool = bytecode_pool_new(NULL);
+    IrBytecode bytecode;
+    int ret = 1;
+
+    if (!bytecode_load(pool, &bytecode, bc_path)) {
+        fprintf(stderr, "%s: error: Failed to load bytecode\n", bc_path);
+    } else {
+        bytecode_print(&bytecode);
+        ret = 0;
+    }
+
+    bytecode_pool_free(pool);
+    return ret;
 }
 
 void usage(char* exe_name) {
     init_console();
 
-    printf("Usage %s [-h] [-run BYTECODE_PATH]\n", exe_name);
+    printf("Usage %s [-h] [-run BYTECODE_PATH [MODULE_PATH...] [-snapshot SNAPSHOT_PATH]] [-run -resume SNAPSHOT_PATH] [-heap-size MIB] [-heap-limit MIB] [-gc-growth FACTOR] [-gc-live-ratio RATIO] [-heap-profile PROFILE_PATH] [-stats] [-stats-json] [-stats-opcodes] [-run-batch LIST_PATH [-jobs N] [-time-limit SECONDS] [-memory-limit MIB]] [-compile PROJECT_PATH [-o BYTECODE_PATH] [-O LEVEL] [-import MODULE_PATH...]] [-asm SOURCE_PATH [-o BYTECODE_PATH]] [-disasm BYTECODE_PATH]\n", exe_name);
     printf("Flags:\n");
-    printf("    -h                 -- Show help\n");
-    printf("    -run BYTECODE_PATH -- Run .scrb file at path\n");
+    printf("    -h                     -- Show help\n");
+    printf("    -run BYTECODE_PATH     -- Run .scrb file at path\n");
+    printf("                              Any following .scrb files are loaded as modules and linked with it\n");
+    printf("        -snapshot SNAPSHOT_PATH -- Save program state to file when it reaches \"Snapshot here\" block\n");
+    printf("        -resume SNAPSHOT_PATH -- Continue running the program from saved snapshot\n");
+    printf("        -heap-size MIB     -- Heap size the program starts with (default: 1, env: SCRAP_HEAP_SIZE)\n");
+    printf("        -heap-limit MIB    -- Heap size the program can not grow past (default: 1024, env: SCRAP_HEAP_LIMIT)\n");
+    printf("        -gc-growth FACTOR  -- How much the heap grows when it is full after garbage collection\n");
+    printf("                              (default: 2, env: SCRAP_GC_GROWTH)\n");
+    printf("        -gc-live-ratio RATIO -- Part of the heap live data may take before it is collected again. Lower values\n");
+    printf("                              mean less garbage collections but more memory (default: 0.5, env: SCRAP_GC_LIVE_RATIO)\n");
+    printf("        -heap-profile PROFILE_PATH -- Write live heap by allocating block to file after every full garbage\n");
+    printf("                              collection and at exit (env: SCRAP_HEAP_PROFILE)\n");
+    printf("        -stats             -- Print instructions, calls, allocations and garbage collections done by the program\n");
+    printf("                              to stderr when it ends (env: SCRAP_STATS=1)\n");
+    printf("        -stats-json        -- Same as -stats, but print them as JSON object (env: SCRAP_STATS=json)\n");
+    printf("        -stats-opcodes     -- Also count instructions by opcode (env: SCRAP_STATS_OPCODES=1)\n");
+    printf("    -run-batch LIST_PATH   -- Run every program in the list in one process and print summary of the runs\n");
+    printf("                              Each line of the list is BYTECODE_PATH [INPUT_PATH [OUTPUT_PATH]]\n");
+    printf("        -jobs N            -- Number of programs running at the same time (default: 1)\n");
+    printf("        -time-limit SECONDS -- Interrupt programs running longer than this (default: no limit)\n");
+    printf("        -memory-limit MIB  -- Heap size limit of every program in MiB (default: 1024)\n");
+    printf("    -compile PROJECT_PATH  -- Compile .scrp project into bytecode without opening the editor\n");
+    printf("        -o BYTECODE_PATH   -- Path to output .scrb file (default: bytecode.scrb).\n");
+    printf("                              Paths ending with .c produce C source to be linked with libscrapruntime.a\n");
+    printf("        -O LEVEL           -- Optimization level from 0 to 3 (default: 0). Accepted so build scripts\n");
+    printf("                              can pass it, but currently has no effect\n");
+    printf("        -import MODULE_PATH -- Call custom blocks exported from precompiled .scrb module instead of\n");
+    printf("                              compiling them. Module should be passed to -run when running the output\n");
+    printf("    -asm SOURCE_PATH       -- Assemble .scra text file into bytecode\n");
+    printf("        -o BYTECODE_PATH   -- Path to output .scrb file (default: bytecode.scrb)\n");
+    printf("    -disasm BYTECODE_PATH  -- Print .scrb file in the text format accepted by -asm\n");
 #ifdef _WIN32
     printf("Press enter to close");
     getchar();
@@ -392,12 +524,126 @@ int main(int argc, char** argv) {
     } else if (!strcmp(argv[1], "-run")) {
         if (argc < 3) usage(argv[0]);
 
-        int ret = start_runtime(argv[2]);
+        char* bc_path = NULL;
+        char* snapshot_path = NULL;
+        char* resume_path = NULL;
+        char** module_paths = malloc(sizeof(char*) * argc);
+        size_t modules_count = 0;
+        RuntimeGcConfig gc = {0};
+        RuntimeStatsFormat stats_format = RUNTIME_STATS_DEFAULT;
+        bool stats_opcodes = false;
+        for (int i = 2; i < argc; i++) {
+            char* end = "";
+            if (!strcmp(argv[i], "-snapshot") && i + 1 < argc) {
+                snapshot_path = argv[++i];
+            } else if (!strcmp(argv[i], "-resume") && i + 1 < argc) {
+                resume_path = argv[++i];
+            } else if (!strcmp(argv[i], "-heap-size") && i + 1 < argc) {
+                gc.heap_size = MiB(strtoul(argv[++i], &end, 10));
+            } else if (!strcmp(argv[i], "-heap-limit") && i + 1 < argc) {
+                gc.heap_limit = MiB(strtoul(argv[++i], &end, 10));
+            } else if (!strcmp(argv[i], "-gc-growth") && i + 1 < argc) {
+                gc.growth_factor = strtod(argv[++i], &end);
+            } else if (!strcmp(argv[i], "-gc-live-ratio") && i + 1 < argc) {
+                gc.live_ratio = strtod(argv[++i], &end);
+            } else if (!strcmp(argv[i], "-heap-profile") && i + 1 < argc) {
+                runtime_set_heap_profile(argv[++i]);
+            } else if (!strcmp(argv[i], "-stats")) {
+                stats_format = RUNTIME_STATS_TEXT;
+            } else if (!strcmp(argv[i], "-stats-json")) {
+                stats_format = RUNTIME_STATS_JSON;
+            } else if (!strcmp(argv[i], "-stats-opcodes")) {
+                stats_opcodes = true;
+                if (stats_format == RUNTIME_STATS_DEFAULT) stats_format = RUNTIME_STATS_TEXT;
+            } else if (!bc_path) {
+                bc_path = argv[i];
+            } else {
+                module_paths[modules_count++] = argv[i];
+            }
+            if (*end != 0) usage(argv[0]);
+        }
+        if (resume_path ? bc_path || snapshot_path : !bc_path) usage(argv[0]);
+        runtime_set_gc_config(gc);
+        runtime_set_stats(stats_format, stats_opcodes);
+
+        int ret;
+        if (resume_path) {
+            ret = runtime_resume_file(resume_path);
+        } else {
+            ret = runtime_run_file(bc_path, (const char**)module_paths, modules_count, snapshot_path);
+        }
+        free(module_paths);
 #ifdef _WIN32
         printf("Press enter to close");
         getchar();
 #endif
         return ret;
+    } else if (!strcmp(argv[1], "-run-batch")) {
+        if (argc < 3) usage(argv[0]);
+
+        int jobs = 1;
+        double time_limit = 0;
+        size_t memory_limit = 0;
+        for (int i = 3; i < argc; i++) {
+            char* end;
+            if (!strcmp(argv[i], "-jobs") && i + 1 < argc) {
+                jobs = strtol(argv[++i], &end, 10);
+            } else if (!strcmp(argv[i], "-time-limit") && i + 1 < argc) {
+                time_limit = strtod(argv[++i], &end);
+            } else if (!strcmp(argv[i], "-memory-limit") && i + 1 < argc) {
+                memory_limit = MiB(strtoul(argv[++i], &end, 10));
+            } else {
+                usage(argv[0]);
+            }
+            if (*end != 0) usage(argv[0]);
+        }
+
+        return batch_run(argv[2], jobs, time_limit, memory_limit);
+    } else if (!strcmp(argv[1], "-compile")) {
+        if (argc < 3) usage(argv[0]);
+
+        char* out_path = "bytecode.scrb";
+        int opt_level = 0;
+        char** module_paths = malloc(sizeof(char*) * argc);
+        size_t modules_count = 0;
+        for (int i = 3; i < argc; i++) {
+            if (!strcmp(argv[i], "-import") && i + 1 < argc) {
+                module_paths[modules_count++] = argv[++i];
+            } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+                out_path = argv[++i];
+            } else if (!strcmp(argv[i], "-O") && i + 1 < argc) {
+                char* end;
+                opt_level = strtol(argv[++i], &end, 10);
+                if (end == argv[i] || *end != 0 || opt_level < 0 || opt_level > 3) usage(argv[0]);
+            } else {
+                usage(argv[0]);
+            }
+        }
+
+        int ret = start_compiler(argv[2], out_path, opt_level, module_paths, modules_count);
+        free(module_paths);
+        return ret;
+    } else if (!strcmp(argv[1], "-asm")) {
+        if (argc < 3) usage(argv[0]);
+
+        char* out_path = "bytecode.scrb";
+        for (int i = 3; i < argc; i++) {
+            if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+                out_path = argv[++i];
+            } else {
+                usage(argv[0]);
+            }
+        }
+        return start_assembler(argv[2], out_path);
+    } else if (!strcmp(argv[1], "-disasm")) {
+        if (argc != 3) usage(argv[0]);
+        return start_disassembler(argv[2]);
+#ifndef _WIN32
+    } else if (!strcmp(argv[1], "-zygote")) {
+        // Internal flag, used by the editor to start warm runtime process. See term_start_zygote()
+        if (argc < 3) usage(argv[0]);
+        return runtime_start_zygote(atoi(argv[2]));
+#endif
     } else {
         usage(argv[0]);
     }
@@ -60,6 +60,12 @@ typedef struct {
 typedef struct {
     char* executable_name;
     char* linker_name;
+    // Garbage collector settings passed to the runtime (See RuntimeGcConfig)
+    int heap_size; // In MiB
+    int heap_limit; // In MiB
+    int gc_growth; // In percent
+    int gc_live_ratio; // In percent
+    bool heap_profile; // Write heap profile when running the project (See vm_load_heap_profile)
 } ProjectConfig;
 
 typedef bool (*ButtonClickHandler)(void);
@@ -381,6 +387,11 @@ typedef struct {
 #endif
 } UI;
 
+typedef struct {
+    Block* block;
+    size_t bytes; // Live memory allocated by the block
+} HeapProfileBlock;
+
 struct Vm {
     Blockdef** blockdefs;
 
@@ -391,6 +402,12 @@ struct Vm {
     char** error_lines;
 
     int start_timeout; // = -1;
+    bool build_executable; // Export standalone executable instead of running the code
+    bool heap_profile; // Whether the current run writes heap profile, taken from project config when it starts
+
+    // Blocks holding live memory at the biggest heap size the last profiled run reached, sorted by block
+    HeapProfileBlock* heap_profile_blocks;
+    size_t heap_profile_max; // Most memory held by a single block
 };
 
 extern Config config;
@@ -538,8 +555,11 @@ void unregister_categories(void);
 Vm vm_new(void);
 void vm_free(Vm* vm);
 bool vm_start(void);
+bool vm_build(void);
 bool vm_stop(void);
 void vm_handle_running_thread(void);
+void vm_load_heap_profile(const char* path);
+size_t vm_get_heap_profile_bytes(Block* block);
 
 void clear_compile_error(void);
 
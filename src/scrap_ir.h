@@ -24,9 +24,31 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <assert.h>
 
 #define IR_LAST_ERROR_SIZE 512
+// Number of backward jumps and calls between calls to the fuel handler by default (See exec_set_fuel_handler)
+#define IR_DEFAULT_FUEL 65536
+// Size of the nursery where new chunks are allocated (See IrExec). Each of the two survivor spaces has the same size
+#define IR_NURSERY_SIZE (256 * 1024)
+// Chunks at least this big are allocated in the large object space instead of the heap (See IrLargeObjects)
+#define IR_LARGE_OBJECT_SIZE (256 * 1024)
+// Memory of dead large chunks which is kept for new large chunks instead of being given back to the system right away
+#define IR_LARGE_OBJECT_CACHE_SIZE (4 * 1024 * 1024)
+// Arenas using huge pages only start using them after growing past this size (See ir_arena_set_huge_pages)
+#define IR_HUGE_PAGES_MIN_SIZE (32 * 1024 * 1024)
+#define IR_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+// Time in microseconds which incremental collection may take on every minor collection by default (See exec_set_gc_pause)
+#define IR_DEFAULT_GC_PAUSE 1000
+// Heap memory limit is multiplied by this when the heap is full after collection by default (See exec_set_gc_growth)
+#define IR_DEFAULT_GC_GROWTH 2.0
+// Part of the old generation which live data may take before the next full collection by default (See exec_set_gc_growth)
+#define IR_DEFAULT_GC_LIVE_RATIO 0.5
+// Location of code which does not come from any source (See bytecode_set_location)
+#define IR_NO_LOCATION UINT32_MAX
+// Heap profiler records at most this many allocation sites, as chunks keep their site in 24 bits
+#define IR_PROFILE_MAX_SITES (1 << 24)
 
 #ifdef DEBUG
 #define IR_ASSERT(val) assert(val)
@@ -43,6 +65,9 @@ typedef int IrLabelID;
 typedef size_t IrInstructionID;
 typedef bool (*IrRunFunction)(IrExec* exec);
 typedef IrRunFunction (*IrRunFunctionResolver)(IrExec* exec, const char* hint);
+// Called when exec runs out of fuel. Returning false stops the program, the handler should set the error
+// with exec_set_error in that case. Otherwise the program continues with the refilled fuel
+typedef bool (*IrFuelHandler)(IrExec* exec);
 
 typedef enum {
     IR_ILLEGAL = 0, // Illegal instruction
@@ -153,6 +178,7 @@ typedef enum {
     IR_DYNCALL, // Same as IR_CALL, but take label from stack
     IR_DYNRUN, // Same as IR_RUN, but take func from stack
     IR_RET,  // Return from function
+    IR_CALLX, // Call label exported by other bytecode chunk, label is taken from import constant resolved by exec_link
 
     IR_LAST,
 } IrOpcode;
@@ -167,10 +193,30 @@ typedef struct {
     const char* name;
 } IrLabel;
 
+// Reference to label exported from other bytecode chunk.
+// chunk and pos are filled in by exec_link and are set to (size_t)-1 until then
 typedef struct {
-    IrValue* items;
+    const char* module;
+    const char* label;
+    size_t chunk, pos;
+} IrImport;
+
+// Header of lists and strings. Strings do not hold values, their characters are packed into chars instead,
+// one byte per character while all codepoints fit into a byte, or 4 bytes per character if the string is wide
+typedef struct {
+    union {
+        IrValue* items;
+        void* chars;
+    };
     size_t size, capacity;
     bool owned;
+    bool remembered; // Set while the list is in remembered set of exec (See exec_write_barrier)
+    bool written; // Set while the list is in write log of incremental collection
+    // Flags below are only changed by the program itself, never by garbage collector threads
+    bool wide : 1;
+    bool shared : 1; // Characters are shared with strings joined onto this one, so they are copied before being modified
+    bool tail : 1; // Characters past size are not used by other strings, so strings can be joined onto it in place
+    uint32_t hash; // Hash of string characters, 0 until it is computed by ir_string_hash. Reset when the string changes
 } IrList;
 
 typedef enum {
@@ -180,9 +226,10 @@ typedef enum {
     IR_TYPE_FLOAT,   // 64-bit float
     IR_TYPE_BOOL,    // Boolean, only can contain true or false
     IR_TYPE_LIST,    // Dynamic list, can contain values with different types
-    IR_TYPE_STRING,  // String type. Functionally identical to lists, except conversion instructions treat list as a string type
+    IR_TYPE_STRING,  // String type. List instructions work on strings too, but their items are always int codepoints
     IR_TYPE_FUNC,    // Pointer to native function
     IR_TYPE_LABEL,   // Pointer to label within bytecode
+    IR_TYPE_IMPORT,  // Label exported from other bytecode chunk. Only used in constants
 } IrValueType;
 
 struct IrConstValue {
@@ -194,6 +241,7 @@ struct IrConstValue {
         bool bool_val;
         IrFunction func_val;
         IrLabel label_val;
+        IrImport import_val;
         IrList* list_val;
     } as;
 };
@@ -241,6 +289,7 @@ typedef struct {
            commit_size,
            pos,
            commit_pos;
+    bool huge_pages; // See ir_arena_set_huge_pages
 } IrMemArena;
 
 typedef struct {
@@ -250,24 +299,54 @@ typedef struct {
     } hash_set;
     IrConstValueList list; // List of all constants that bytecode chunks can reference
     IrMemArena* arena; // Arena for all bytecode allocations
+    void* mapping; // Mapped bytecode file which loaded code and constants point into (See bytecode_load)
+    size_t mapping_size;
 } IrBytecodePool;
 
+// Source location of the code starting at pos, which lasts until the next entry. Locations are numbers given
+// by the compiler, IR_NO_LOCATION marks code which does not come from any source
+typedef struct {
+    uint32_t pos;
+    uint32_t location;
+} IrDebugEntry;
+
+typedef struct {
+    IrDebugEntry* items; // Sorted by pos
+    size_t size, capacity;
+} IrDebugInfo;
+
 typedef struct {
     const char* name;
     unsigned int version;
     IrOpcodes code;
     IrBytecodePool* pool;
     IrLabelList labels;
+    IrLabelList exports; // Labels that other bytecode chunks are allowed to call with IR_CALLX
+    IrDebugInfo debug; // See bytecode_set_location
 } IrBytecode;
 
+// Function that executes bytecode starting from pos, for example exec_run_bytecode.
+typedef bool (*IrNativeFunction)(IrExec* exec, IrBytecode* bc, size_t pos);
+
 typedef struct {
     IrBytecode* items;
     size_t size, capacity;
 } IrBytecodeChunks;
 
+typedef enum {
+    IR_CHUNK_DATA = 0, // Chunk without references to trace. Items of lists are traced together with the list
+    IR_CHUNK_LIST, // IrList with values as its items
+    IR_CHUNK_STRING, // IrList with characters as its items
+    IR_CHUNK_FREE, // Unused space left in the heap by parallel collection
+} IrChunkKind;
+
 typedef struct {
     void* copy_ptr;
-    size_t size;
+    uint32_t size;
+    // Set by garbage collector when copying the chunk. All lists in the old generation have their kind set,
+    // as they get there by being copied
+    uint32_t kind : 8;
+    uint32_t site : 24; // Allocation site recorded by heap profiler, 0 if it is not known (See exec_set_heap_profile)
     unsigned char data[];
 } IrHeapChunk;
 
@@ -276,6 +355,109 @@ typedef struct {
     size_t chunks_count, mem_max;
 } IrHeap;
 
+typedef struct {
+    IrList** items;
+    size_t size, capacity;
+} IrRememberedSet;
+
+typedef struct {
+    IrList* list; // Copy of the list in second_heap
+    size_t pos; // Index of the first value which is not traced yet
+} IrGrayList;
+
+typedef struct {
+    IrGrayList* items;
+    size_t size, capacity;
+} IrGrayStack;
+
+// Full collection which is done in steps while the program keeps running. Old chunks are copied to second_heap,
+// but the program continues using the originals until the collection finishes and the heaps are swapped
+typedef struct {
+    bool active;
+    int64_t pause; // Time in microseconds every step may take, 0 disables incremental collection
+    size_t live_size; // Size of the old generation after the last full collection
+    IrGrayStack gray; // Copied lists whose values still need to be traced
+    IrRememberedSet written; // Copied lists which were modified afterwards
+    IrRememberedSet large; // Copied lists with large items, which still reference the original values
+} IrIncrementalCollection;
+
+typedef struct {
+    IrMemArena** items;
+    size_t size, capacity;
+} IrArenaList;
+
+// Chunks too big to be copied around by the collector. Every one of them lives at the start of its own arena,
+// so it is never moved, can grow in place and is given back to the system as soon as it is found dead.
+// Full collections only trace through them and mark the ones they reach by pointing copy_ptr at the chunk itself
+typedef struct {
+    IrMemArena** items; // Sorted by address
+    size_t size, capacity;
+    size_t mem_size; // Size of all large chunks
+    size_t mem_max; // Full collection is done before mem_size grows past it
+    // Arenas of dead chunks, reused by new ones so that short lived large chunks do not have to map new memory
+    // every time. Only IR_LARGE_OBJECT_CACHE_SIZE bytes of them are kept
+    IrArenaList cache;
+    size_t cache_size;
+} IrLargeObjects;
+
+// Instruction allocating heap chunks, identified by its bytecode and source location
+typedef struct {
+    IrBytecode* bc; // NULL for chunks allocated outside of bytecode
+    uint32_t location;
+    // Live chunks of every kind allocated here, counted when the profile is written
+    size_t count[IR_CHUNK_FREE];
+    size_t bytes[IR_CHUNK_FREE];
+} IrProfileSite;
+
+typedef struct {
+    FILE* file;
+    size_t dumps;
+    struct {
+        IrProfileSite* items; // First site stands for chunks with unknown site
+        size_t size, capacity;
+    } sites;
+    struct {
+        uint32_t* items; // Indices of sites by bytecode and location, 0 marks empty bucket
+        size_t capacity;
+    } hash_table;
+    // Last looked up instruction, as allocations mostly repeat in loops
+    IrBytecode* last_bc;
+    size_t last_pos;
+    uint32_t last_site;
+} IrHeapProfile;
+
+// Number of times native function was run
+typedef struct {
+    IrRunFunction func;
+    const char* name; // Hint the function was resolved from, NULL if it was referenced by pointer
+    uint64_t calls;
+} IrFunctionStats;
+
+// Counters of the work done by exec (See exec_write_stats). Instructions are only counted by the interpreter,
+// and only get added up when bytecode returns. Functions run by translated code directly are not counted
+typedef struct {
+    uint64_t instructions;
+    uint64_t* opcodes; // Instructions by opcode, NULL unless enabled with exec_enable_stats
+    uint64_t calls; // Variable frames pushed, including the one of the entry point
+    size_t max_call_depth;
+    uint64_t allocations;
+    uint64_t allocated_bytes; // Also counts growth of chunks resized in place
+    uint64_t minor_collections;
+    uint64_t full_collections;
+    uint64_t copied_bytes; // Chunks copied by all collections
+    int64_t gc_pause_time; // Microseconds the program was stopped by garbage collection
+    int64_t gc_max_pause;
+    int64_t gc_idle_time; // Microseconds spent on collection while the program was waiting (See exec_collect_idle)
+    bool count_functions; // Set by exec_enable_stats
+    struct {
+        IrFunctionStats* items;
+        size_t size, capacity;
+    } functions;
+    // Last counted function, as run instructions mostly repeat in loops
+    IrRunFunction last_func;
+    size_t last_func_index;
+} IrExecStats;
+
 struct IrExec {
     IrBytecodeChunks chunks;
     IrValueList stack;
@@ -283,9 +465,33 @@ struct IrExec {
     IrVariableFrameList variables;
     char last_error[IR_LAST_ERROR_SIZE];
     IrRunFunctionResolver resolve_run_function;
-
+    const char* snapshot_path; // Where snapshot of the program is saved when requested, NULL if snapshots are disabled
+    void* context; // Data of the host which run functions can use, standard library keeps its StdContext here
+    int64_t fuel; // Decremented on every backward jump and call, exec_refuel is called when it reaches 0
+    int64_t fuel_budget; // Amount of fuel given on every refuel
+    IrFuelHandler fuel_handler;
+    bool interrupted; // Set by exec_interrupt, checked when refueling. Accessed atomically
+
+    // Heap is split into two generations. New chunks are allocated in the nursery, chunks which survive
+    // a minor collection are moved to survivors and the ones surviving the second one are promoted to the old
+    // generation in heap, which is only collected by full collections. Chunks too big for the nursery go to heap directly,
+    // and chunks of at least IR_LARGE_OBJECT_SIZE bytes go to the large object space
     IrHeap heap;
     IrHeap second_heap;
+    IrHeap nursery;
+    IrHeap survivors;
+    IrHeap second_survivors;
+    IrRememberedSet remembered; // Lists in the old generation which may reference young chunks
+    IrLargeObjects large; // Counted as part of the old generation
+    IrIncrementalCollection incremental;
+    size_t gc_threads; // Number of threads used by full collections (See exec_set_gc_threads)
+    bool gc_items_with_list; // See exec_set_gc_items_with_list
+    double gc_growth, gc_live_ratio; // See exec_set_gc_growth
+    IrHeapProfile* profile; // NULL unless heap profiling is enabled (See exec_set_heap_profile)
+    // Instruction which allocates the next chunks, set by the interpreter before instructions that may allocate
+    IrBytecode* alloc_bc;
+    size_t alloc_pos;
+    IrExecStats stats;
 };
 
 // Allocate new bytecode pool.
@@ -314,13 +520,31 @@ IrBytecode bytecode_new(const char* name, IrBytecodePool* pool);
 // The src bytecode should not be used after calling this function.
 void bytecode_join(IrBytecode* dst, IrBytecode* src);
 
+// Sets source location of all code in bytecode which does not have one yet. Compilers call it on the code of every
+// source element after compiling it, so that code of nested elements keeps their own location.
+// Locations are saved together with the code and are used to report where heap chunks are allocated.
+void bytecode_set_location(IrBytecode* bc, uint32_t location);
+
+// Returns source location of the instruction at pos, or IR_NO_LOCATION if it does not have one.
+uint32_t bytecode_get_location(IrBytecode* bc, size_t pos);
+
 // Print the bytecode contents to stdout.
+// The output can be assembled back into the same bytecode (See assembler.h).
 void bytecode_print(IrBytecode* bc);
 
+// Returns true if op is followed by a 3 byte constant id in the code.
+bool ir_op_has_immediate(IrOpcode op);
+
 // Appends named label to the end of bytecode.
 // The returned ConstId can be used to reference the label in other bytecode functions.
 ConstId bytecode_push_label(IrBytecode* bc, const char* name);
 
+// Marks the label as exported, so other bytecode chunks can call it through imports.
+void bytecode_export_label(IrBytecode* bc, ConstId label_id);
+
+// Finds exported label by name. Returns NULL if the bytecode does not export such label.
+IrLabel* bytecode_find_export(IrBytecode* bc, const char* label_name);
+
 // Appends the instruction to the end of bytecode.
 // The returned IrInstructionID can be used to reference the instruction in other bytecode functions.
 IrInstructionID bytecode_push_op(IrBytecode* bc, IrOpcode op);
@@ -331,6 +555,7 @@ IrInstructionID bytecode_push_op_float(IrBytecode* bc, IrOpcode op, double float
 IrInstructionID bytecode_push_op_bool(IrBytecode* bc, IrOpcode op, bool bool_val);
 IrInstructionID bytecode_push_op_func(IrBytecode* bc, IrOpcode op, IrFunction func_val);
 IrInstructionID bytecode_push_op_label(IrBytecode* bc, IrOpcode op, ConstId label_id);
+IrInstructionID bytecode_push_op_import(IrBytecode* bc, IrOpcode op, const char* module, const char* label);
 IrInstructionID bytecode_push_op_list(IrBytecode* bc, IrOpcode op, IrList* list_val);
 IrInstructionID bytecode_push_op_list_string(IrBytecode* bc, IrOpcode op, IrList* list_val);
 
@@ -347,12 +572,24 @@ IrList* bytecode_const_list_new(IrBytecodePool* pool);
 // Add value to immutable list.
 void bytecode_const_list_append(IrBytecodePool* pool, IrList* list, IrValue val);
 
+// Add character to immutable string, which is allocated with bytecode_const_list_new.
+void bytecode_const_string_append(IrBytecodePool* pool, IrList* string, uint32_t codepoint);
+
 // Save bytecode into file.
-void bytecode_save(IrBytecode* bc, const char* filepath);
+// Returns false if the file could not be written.
+bool bytecode_save(IrBytecode* bc, const char* filepath);
+
+// Same as bytecode_save, but writes bytecode at the current position of already opened file.
+bool bytecode_save_file(IrBytecode* bc, FILE* f);
 
 // Load bytecode from file.
+// Files saved with version 2 or later are mapped into memory and used in place, so loading does not depend
+// on code and constant size. The mapping is owned by the pool and released in bytecode_pool_free.
 bool bytecode_load(IrBytecodePool* pool, IrBytecode* bc, const char* filepath);
 
+// Load bytecode from memory buffer. The buffer is not referenced after this function returns.
+bool bytecode_load_memory(IrBytecodePool* pool, IrBytecode* bc, const void* data, size_t data_size);
+
 // Create a function value that needs to be resolved at runtime using hint string.
 // The exact hint string that needs to be passed depends on current runtime function resolver,
 // which can be defined in exec using exec_set_run_function_resolver function.
@@ -363,6 +600,9 @@ IrFunction ir_func_by_ptr(IrRunFunction func);
 
 // Allocate new execution engine that will execute the bytecode chunks.
 // See exec_add_bytecode and exec_run for getting your code to run.
+// memory_min and memory_max limit the old generation of the heap, which includes the large object space.
+// Young generation takes IR_NURSERY_SIZE bytes for each of its three spaces on top of that,
+// or a quarter of memory_max if it is smaller.
 IrExec exec_new(size_t memory_min, size_t memory_max);
 
 // Free the execution engine.
@@ -376,6 +616,12 @@ void exec_set_run_function_resolver(IrExec* exec, IrRunFunctionResolver resolver
 // Add bytecode chunk into exec for running the bytecode using exec_run function.
 void exec_add_bytecode(IrExec* exec, IrBytecode bc);
 
+// Resolves imports of all added bytecode chunks. Import module names are matched against chunk names
+// and labels are looked up in exports of that chunk.
+// Should be called after adding all chunks. Returns false if any import could not be resolved.
+// All chunks share globals, so linking also fails if an imported module uses global variables.
+bool exec_link(IrExec* exec);
+
 // Run the named bytecode chunk from specified label_name.
 // This functions returns true upon executing IR_RET instruction at top level,
 // and false if the running bytecode caused a runtime error which you can get by accessing exec.last_error property.
@@ -385,6 +631,65 @@ bool exec_run(IrExec* exec, const char* bc_name, const char* label_name);
 // Accepts the pos index in bytecode at which to start executing the code.
 bool exec_run_bytecode(IrExec* exec, IrBytecode* bc, size_t pos);
 
+// Same as exec_run_bytecode, but continues in the current variable frame instead of pushing a new one.
+// The frame is still popped on return. Used to continue execution restored by exec_load_snapshot.
+bool exec_resume_bytecode(IrExec* exec, IrBytecode* bc, size_t pos);
+
+// Sets the handler called every fuel_budget backward jumps and calls, which can be used to enforce time limits,
+// pause the program by blocking until it should continue or run other execs in between.
+// Handler can be NULL, in which case running out of fuel only checks for interruption.
+// Passing 0 to fuel_budget sets it to IR_DEFAULT_FUEL.
+void exec_set_fuel_handler(IrExec* exec, IrFuelHandler handler, int64_t fuel_budget);
+
+// Called by the interpreter and translated code when exec->fuel runs out. Refills the fuel and calls the fuel handler.
+// Returns false if the program should stop, with the error set.
+bool exec_refuel(IrExec* exec);
+
+// Uses one unit of fuel and refuels when it runs out. Returns false if the program should stop.
+// Fuel is accessed atomically because exec_interrupt can clear it from another thread. Relaxed loads and stores
+// compile to plain moves, and a decrement racing with exec_interrupt is caught by the interrupted flag on the next refuel
+static inline bool exec_use_fuel(IrExec* exec) {
+    int64_t fuel = __atomic_load_n(&exec->fuel, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&exec->fuel, fuel, __ATOMIC_RELAXED);
+    return fuel > 0 || exec_refuel(exec);
+}
+
+// Stops the running bytecode at the next backward jump or call, which then fails with "Execution was interrupted" error.
+// Can be called from another thread or signal handler, in which case the program might run until its current fuel
+// runs out. The flag stays set until cleared with exec_clear_interrupt.
+void exec_interrupt(IrExec* exec);
+void exec_clear_interrupt(IrExec* exec);
+
+// Same as exec_run, but the code is executed by func instead of the interpreter.
+// Used by ahead-of-time compiled programs, where func is the bytecode translated into C.
+bool exec_run_native(IrExec* exec, const char* bc_name, const char* label_name, IrNativeFunction func);
+
+// Executes single instruction which does not take immediate value and does not jump anywhere.
+// Only instructions not worth inlining are supported, which are comparisons with IR_EQ and IR_NEQ,
+// conversions to and from strings, any type conversions, IR_TYPEOF and list manipulation.
+// Returns false on runtime error.
+bool exec_op(IrExec* exec, IrOpcode op);
+
+// Runs native function as IR_RUN instruction would, resolving it first if needed.
+bool exec_run_function(IrExec* exec, IrFunction* func);
+
+// Calls imported label as IR_CALLX instruction would. The import should be resolved by exec_link beforehand.
+bool exec_call_import(IrExec* exec, IrImport* import);
+
+// Sets generic error message for func if it failed without setting the error by itself.
+void exec_set_function_error(IrExec* exec, IrFunction* func);
+
+// Pushes/pops variable frame. Every bytecode call gets its own variable frame.
+void exec_push_variable_stack(IrExec* exec);
+void exec_pop_variable_stack(IrExec* exec);
+
+// Access variables in current variable frame or global variables.
+// Storing variable past the end of the frame grows the frame with nothing values.
+IrValue exec_load_variable(IrExec* exec, int64_t pos);
+void exec_store_variable(IrExec* exec, int64_t pos, IrValue value);
+IrValue exec_load_global(IrExec* exec, int64_t pos);
+void exec_store_global(IrExec* exec, int64_t pos, IrValue value);
+
 // Prints the contents of exec stack for debugging purposes.
 void exec_print_stack(IrExec* exec);
 
@@ -392,11 +697,83 @@ void exec_print_stack(IrExec* exec);
 void exec_print_variables(IrExec* exec);
 
 // Triggers the garbage collection event in exec for debugging purposes.
+// exec_collect collects the whole heap, while exec_collect_minor only collects the young generation,
+// which turns into a full collection if the old generation has no space left for promoted chunks.
 void exec_collect(IrExec* exec);
+void exec_collect_minor(IrExec* exec);
+
+// Sets the time in microseconds incremental collection may take after every minor collection. Full collections are
+// then spread across many steps instead of stopping the program until the whole heap is copied.
+// Pass 0 to disable incremental collection, so that the full collection only happens when the heap is full.
+void exec_set_gc_pause(IrExec* exec, int64_t pause_us);
+
+// Sets the number of threads which copy the heap together during full collections that stop the program.
+// Pass 0 to use one thread per processor. Small heaps are always collected on the current thread.
+void exec_set_gc_threads(IrExec* exec, size_t threads);
+
+// Sets the layout of lists after collection. By default the heap is copied in breadth first order, so lists stored
+// together end up next to each other. When items_with_list is set, items of every list are copied right after
+// the list itself instead, which is faster for programs mostly going through items of lists one by one.
+void exec_set_gc_items_with_list(IrExec* exec, bool items_with_list);
+
+// Lets the old generation of the heap use huge pages once it gets big (See ir_arena_set_huge_pages).
+void exec_set_huge_pages(IrExec* exec, bool huge_pages);
+
+// Sets how the old generation of the heap grows between memory_min and memory_max passed to exec_new.
+// When the heap is still full after collection, its memory limit is multiplied by growth_factor.
+// After every full collection the limit is also raised until live data takes at most live_ratio of it, and
+// incremental collection is only started once live data takes less than live_ratio of the used memory.
+// Lower live_ratio means less frequent collections at the cost of memory. Pass 0 to either of them to use
+// IR_DEFAULT_GC_GROWTH or IR_DEFAULT_GC_LIVE_RATIO, growth_factor has to be above 1 and live_ratio below 1.
+void exec_set_gc_growth(IrExec* exec, double growth_factor, double live_ratio);
+
+// Enables heap profiling, which records the instruction allocating every heap chunk and writes a summary of
+// the live heap to the file at path after every full collection, so exec_collect can be called to write it on demand.
+// Instructions are mapped to source locations through bytecode debug info (See bytecode_set_location).
+// Every summary is a block of text lines:
+//
+//     heap NUMBER CHUNKS BYTES
+//     site LOCATION LISTS LIST_BYTES STRINGS STRING_BYTES ITEMS ITEM_BYTES BYTECODE_NAME
+//     ...
+//     end
+//
+// Items are chunks holding values of lists and characters of strings. Sites are sorted by their live bytes,
+// LOCATION is -1 and BYTECODE_NAME is ? when they are not known. Chunks allocated before profiling was enabled
+// have unknown site. Pass NULL to path to disable profiling. Returns false if the file could not be created.
+bool exec_set_heap_profile(IrExec* exec, const char* path);
+
+// Starts counting runs of every native function, and instructions executed by every opcode if opcodes is set.
+// Other counters in exec->stats are always kept.
+void exec_enable_stats(IrExec* exec, bool opcodes);
+
+// Writes counters of exec->stats to file, either as readable text or as JSON object.
+void exec_write_stats(IrExec* exec, FILE* file, bool json);
+
+// Lets exec do garbage collection work while the program waits for something, for at most time_us microseconds.
+// Returns the time in microseconds which was actually spent.
+int64_t exec_collect_idle(IrExec* exec, int64_t time_us);
+
+// Must be called after storing references to heap chunks into list, either as its items or as one of its values,
+// so that minor collections can find young chunks referenced from the old generation.
+void exec_write_barrier(IrExec* exec, IrList* list);
+
+// Saves heap, stack, globals and variables of exec together with bc into snapshot file, so that another
+// process can continue running bc from pos with exec_load_snapshot instead of repeating all the work done so far.
+// Snapshot can only be taken at the top level of the program, when exec has a single variable frame and
+// a single bytecode chunk. Returns false if any value references memory that can not be restored.
+bool exec_save_snapshot(IrExec* exec, IrBytecode* bc, size_t pos, const char* filepath);
+
+// Restores exec state saved with exec_save_snapshot. Bytecode embedded in the snapshot is loaded into empty pool,
+// which keeps the snapshot file mapped for its lifetime. Should be called on newly created exec with function
+// resolver already set. Execution is continued by calling exec_resume_bytecode with bc and pos.
+bool exec_load_snapshot(IrExec* exec, IrBytecodePool* pool, IrBytecode* bc, size_t* pos, const char* filepath);
 
 // Sets last error value in exec. Used when raising errors from run functions.
 void exec_set_error(IrExec* exec, const char* fmt, ...);
 
+// Integer exponentiation used by IR_POWI.
+int64_t ir_int_pow(int64_t base, int64_t exp);
+
 // Allocate memory using exec's garbage collector.
 // Note that any ir value that is neither in the exec stack nor in the exec variable stack
 // can get garbage collected after calling these functions.
@@ -449,15 +826,46 @@ size_t exec_pop_label(IrExec* exec);
 IrList* exec_pop_list(IrExec* exec);
 IrList* exec_pop_list_string(IrExec* exec);
 
-// Converts ascii string to list and pushes to stack
+// Converts UTF-8 string to string value and pushes to stack
 bool exec_push_string(IrExec* exec, const char* str);
 
-// Gets ascii buffer from string value
+// Pushes new string of size characters, which are left uninitialized and should be set with ir_string_copy.
+// Characters of the string can only hold codepoints up to 255 unless wide is set.
+// Returns the string or NULL if allocation failed
+IrList* exec_push_string_alloc(IrExec* exec, size_t size, bool wide);
+
+// Pushes string made of a single character. Strings of characters up to U+04FF are shared and can not be modified,
+// so pushing them does not allocate anything
+bool exec_push_string_char(IrExec* exec, uint32_t codepoint);
+
+// Pushes decimal representation of value. Same as with exec_push_string_char, strings of integers from 0 to 1023
+// are shared and pushing them does not allocate anything
+bool exec_push_string_int(IrExec* exec, int64_t value);
+
+// Pops two strings and pushes them joined together. Results of joining are given spare capacity, and strings
+// joined onto them are appended in place, so building a string by repeated joining takes linear time
+bool exec_string_join(IrExec* exec);
+
+// Gets UTF-8 buffer from string value. Text which does not fit into the buffer is cut off
 void exec_get_string(IrList* string, char* buf, size_t buf_len);
 
-// Pops ascii string from stack
+// Pops UTF-8 string from stack
 void exec_pop_string(IrExec* exec, char* buf, size_t buf_len);
 
+// Returns codepoint of character at index of string
+uint32_t ir_string_get(const IrList* string, size_t index);
+
+// Copies count characters from src starting at src_index into dst starting at dst_index. Strings may overlap.
+// dst has to be wide if src is wide
+void ir_string_copy(IrList* dst, size_t dst_index, const IrList* src, size_t src_index, size_t count);
+
+// Returns hash of string characters, which is computed on first use and kept in the string.
+// Strings with the same characters have the same hash, no matter if they are wide
+uint32_t ir_string_hash(IrList* string);
+
+// Compares contents of strings. Strings which both have their hash computed are only compared if the hashes match
+bool ir_string_equals(const IrList* left, const IrList* right);
+
 // Arena management functions
 #define ir_arena_append(arena, list, val) do { \
     if ((list).size >= (list).capacity) { \
@@ -474,9 +882,18 @@ void ir_arena_free(IrMemArena* arena);
 void* ir_arena_alloc(IrMemArena* arena, size_t size);
 void* ir_arena_alloc_packed(IrMemArena* arena, size_t size);
 void* ir_arena_realloc(IrMemArena* arena, void* ptr, size_t old_size, size_t new_size);
+// Resizes allocation without moving it, which is only possible for the last allocation in the arena.
+// Returns false if ptr is not the last allocation or there is not enough memory
+bool ir_arena_extend(IrMemArena* arena, void* ptr, size_t old_size, size_t new_size);
 void ir_arena_pop(IrMemArena* arena, size_t size);
 void ir_arena_pop_to(IrMemArena* arena, size_t pos);
 void ir_arena_clear(IrMemArena* arena);
+// Decommits memory past the current position or past keep_size if it is bigger, so that it is given back to the system.
+// Memory gets committed again when it is allocated
+void ir_arena_trim(IrMemArena* arena, size_t keep_size);
+// Lets the system back the arena with huge pages once it grows past IR_HUGE_PAGES_MIN_SIZE. This reduces TLB misses
+// when accessing big arenas, but small arenas would only waste memory on them
+void ir_arena_set_huge_pages(IrMemArena* arena, bool huge_pages);
 char* ir_arena_sprintf(IrMemArena* arena, size_t max_size, const char* fmt, ...);
 
 #endif // SCRAP_IR_H
@@ -489,11 +906,75 @@ char* ir_arena_sprintf(IrMemArena* arena, size_t max_size, const char* fmt, ...)
 #include <stdarg.h>
 #include <math.h>
 #include <errno.h>
+#include <pthread.h>
+#include <sched.h>
 
 #define IR_SAVE_MIN_VERSION 1
-#define IR_SAVE_MAX_VERSION 1
+#define IR_SAVE_MAX_VERSION 3
 #define IR_SAVE_IDENT "SCRAP_IR"
 
+// Version 2 of the save format is laid out so the file can be mapped into memory and used in place.
+// It starts with ident and version encoded the same way as in version 1 and padded to IR_SAVE_HEADER_SIZE bytes,
+// followed by IrSaveHeader and the table of sections. Every section is aligned to IR_SAVE_ALIGN bytes.
+// Constants are fixed size IrSaveConst records, which reference strings and list items in the data section
+// by offset. List items have the same layout as IrValue, so only constant records are relocated at load time,
+// while code, labels and contents of lists and strings are used directly from the file.
+// Everything is stored in byte order of the platform which saved the file.
+// Version 3 has the same layout, but characters of strings are stored packed the same way as in IrList, while
+// version 2 stores them as IrSaveValue items, which get packed when loading.
+#define IR_SAVE_HEADER_SIZE 16
+#define IR_SAVE_BYTE_ORDER 0x01020304
+#define IR_SAVE_ALIGN 8
+#define IR_SAVE_NULL_OFFSET ((uint64_t)-1)
+#define IR_SAVE_LIST_NESTED 1 // List items reference other lists, so the items need to be relocated when loading
+#define IR_SAVE_STRING_PACKED 2 // String characters are packed, one byte each unless IR_SAVE_STRING_WIDE is set
+#define IR_SAVE_STRING_WIDE 4
+
+typedef enum {
+    IR_SAVE_SECTION_CONSTS,  // IrSaveConst records
+    IR_SAVE_SECTION_DATA,    // Strings and list items referenced by constants
+    IR_SAVE_SECTION_CODE,    // Bytecode
+    IR_SAVE_SECTION_LABELS,  // uint64_t ids of label constants
+    IR_SAVE_SECTION_EXPORTS, // uint64_t ids of exported label constants
+    IR_SAVE_SECTION_DEBUG,   // IrDebugEntry records
+    IR_SAVE_SECTION_LAST,
+} IrSaveSectionKind;
+
+typedef struct {
+    uint32_t byte_order;
+    uint32_t sections_count;
+} IrSaveHeader;
+
+typedef struct {
+    uint32_t kind;
+    uint32_t reserved;
+    uint64_t offset, size;
+} IrSaveSection;
+
+typedef struct {
+    uint32_t type;
+    uint32_t flags;
+    uint64_t a; // Scalar value or offset into the data section
+    uint64_t b; // Item count of the list, position of the label or second offset into the data section
+} IrSaveConst;
+
+typedef struct {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t as; // Scalar value or offset of IrSaveList record
+} IrSaveValue;
+
+// Record in the data section which list items of list type point to
+typedef struct {
+    uint64_t offset, size, flags;
+} IrSaveList;
+
+typedef struct {
+    IrBytecodePool* pool;
+    const unsigned char* data; // Start of the data section
+    size_t data_size;
+} IrLoadData;
+
 #define KiB(n) ((size_t)(n) << 10)
 #define MiB(n) ((size_t)(n) << 20)
 #define GiB(n) ((size_t)(n) << 30)
@@ -548,6 +1029,218 @@ void* ir_plat_mem_reserve(size_t size);
 bool ir_plat_mem_commit(void* ptr, size_t size);
 bool ir_plat_mem_decommit(void* ptr, size_t size);
 bool ir_plat_mem_release(void* ptr, size_t size);
+// Hints the system to back the memory with huge pages, returns false if it is not supported
+bool ir_plat_mem_use_huge_pages(void* ptr, size_t size);
+void* ir_plat_file_map(const char* path, size_t* size);
+bool ir_plat_file_unmap(void* ptr, size_t size);
+// Returns monotonic time in microseconds
+int64_t ir_plat_get_time(void);
+size_t ir_plat_get_cpu_count(void);
+
+static size_t ir_string_char_size(const IrList* string) {
+    return string->wide ? sizeof(uint32_t) : sizeof(uint8_t);
+}
+
+uint32_t ir_string_get(const IrList* string, size_t index) {
+    if (string->wide) return ((const uint32_t*)string->chars)[index];
+    return ((const uint8_t*)string->chars)[index];
+}
+
+// Codepoint has to fit into characters of the string
+static void ir_string_set(IrList* string, size_t index, uint32_t codepoint) {
+    if (string->wide) {
+        ((uint32_t*)string->chars)[index] = codepoint;
+    } else {
+        ((uint8_t*)string->chars)[index] = codepoint;
+    }
+}
+
+void ir_string_copy(IrList* dst, size_t dst_index, const IrList* src, size_t src_index, size_t count) {
+    if (count == 0) return;
+    if (dst->wide == src->wide) {
+        size_t char_size = ir_string_char_size(dst);
+        memmove((uint8_t*)dst->chars + dst_index * char_size, (const uint8_t*)src->chars + src_index * char_size, count * char_size);
+        return;
+    }
+
+    IR_ASSERT(dst->wide);
+    uint32_t* dst_chars = (uint32_t*)dst->chars + dst_index;
+    const uint8_t* src_chars = (const uint8_t*)src->chars + src_index;
+    // Copying backwards keeps overlapping characters intact when widening string in place
+    for (size_t i = count; i > 0; i--) dst_chars[i - 1] = src_chars[i - 1];
+}
+
+// FNV-1a hash over codepoints. It is written as a macro, so that hashes of the character table can be computed at
+// compile time
+#define IR_STRING_HASH_BASIS 2166136261u
+#define IR_STRING_HASH_STEP(hash, codepoint) (((uint32_t)(hash) ^ (uint32_t)(codepoint)) * 16777619u)
+
+uint32_t ir_string_hash(IrList* string) {
+    if (string->hash) return string->hash;
+
+    uint32_t hash = IR_STRING_HASH_BASIS;
+    if (string->wide) {
+        const uint32_t* chars = string->chars;
+        for (size_t i = 0; i < string->size; i++) hash = IR_STRING_HASH_STEP(hash, chars[i]);
+    } else {
+        const uint8_t* chars = string->chars;
+        for (size_t i = 0; i < string->size; i++) hash = IR_STRING_HASH_STEP(hash, chars[i]);
+    }
+    // 0 is kept for hashes which were not computed yet
+    string->hash = hash ? hash : 1;
+    return string->hash;
+}
+
+bool ir_string_equals(const IrList* left, const IrList* right) {
+    if (left == right) return true;
+    if (left->size != right->size) return false;
+    if (left->hash && right->hash && left->hash != right->hash) return false;
+    if (left->size == 0) return true;
+    if (left->wide == right->wide) return !memcmp(left->chars, right->chars, left->size * ir_string_char_size(left));
+
+    for (size_t i = 0; i < left->size; i++) {
+        if (ir_string_get(left, i) != ir_string_get(right, i)) return false;
+    }
+    return true;
+}
+
+#define IR_REPEAT_4(f, n) f(n) f((n) + 1) f((n) + 2) f((n) + 3)
+#define IR_REPEAT_16(f, n) IR_REPEAT_4(f, n) IR_REPEAT_4(f, (n) + 4) IR_REPEAT_4(f, (n) + 8) IR_REPEAT_4(f, (n) + 12)
+#define IR_REPEAT_64(f, n) IR_REPEAT_16(f, n) IR_REPEAT_16(f, (n) + 16) IR_REPEAT_16(f, (n) + 32) IR_REPEAT_16(f, (n) + 48)
+#define IR_REPEAT_256(f, n) IR_REPEAT_64(f, n) IR_REPEAT_64(f, (n) + 64) IR_REPEAT_64(f, (n) + 128) IR_REPEAT_64(f, (n) + 192)
+#define IR_REPEAT_1024(f, n) IR_REPEAT_256(f, n) IR_REPEAT_256(f, (n) + 256) IR_REPEAT_256(f, (n) + 512) IR_REPEAT_256(f, (n) + 768)
+
+// Characters up to U+04FF cover Latin, Greek and Cyrillic scripts
+#define IR_CHAR_STRINGS_COUNT 0x500
+#define IR_INT_STRINGS_COUNT 1024
+
+#define IR_CHAR_CODE(n) (n),
+#define IR_CHAR_STRING(n) { .chars = &ir_char_bytes[n], .size = 1, .capacity = 1, .hash = IR_STRING_HASH_STEP(IR_STRING_HASH_BASIS, n) },
+#define IR_WIDE_CHAR_STRING(n) { .chars = &ir_wide_char_codes[(n) - UINT8_MAX - 1], .size = 1, .capacity = 1, .wide = true, .hash = IR_STRING_HASH_STEP(IR_STRING_HASH_BASIS, n) },
+
+// Digits of integers are stored right aligned in 4 bytes, and strings point past the leading zeros
+#define IR_INT_DIGIT(n, place) ('0' + (n) / (place) % 10)
+#define IR_INT_LENGTH(n) ((n) >= 1000 ? 4 : (n) >= 100 ? 3 : (n) >= 10 ? 2 : 1)
+#define IR_INT_HASH_STEP_IF(cond, hash, codepoint) ((cond) ? IR_STRING_HASH_STEP(hash, codepoint) : (hash))
+#define IR_INT_HASH(n) IR_STRING_HASH_STEP( \
+    IR_INT_HASH_STEP_IF((n) >= 10, \
+        IR_INT_HASH_STEP_IF((n) >= 100, \
+            IR_INT_HASH_STEP_IF((n) >= 1000, IR_STRING_HASH_BASIS, IR_INT_DIGIT(n, 1000)), \
+            IR_INT_DIGIT(n, 100)), \
+        IR_INT_DIGIT(n, 10)), \
+    IR_INT_DIGIT(n, 1))
+#define IR_INT_BYTES(n) { IR_INT_DIGIT(n, 1000), IR_INT_DIGIT(n, 100), IR_INT_DIGIT(n, 10), IR_INT_DIGIT(n, 1) },
+#define IR_INT_STRING(n) { .chars = &ir_int_bytes[n][4 - IR_INT_LENGTH(n)], .size = IR_INT_LENGTH(n), .capacity = IR_INT_LENGTH(n), .hash = IR_INT_HASH(n) },
+
+#define IR_HASH_3(a, b, c) IR_STRING_HASH_STEP(IR_STRING_HASH_STEP(IR_STRING_HASH_STEP(IR_STRING_HASH_BASIS, a), b), c)
+#define IR_HASH_4(a, b, c, d) IR_STRING_HASH_STEP(IR_HASH_3(a, b, c), d)
+#define IR_HASH_5(a, b, c, d, e) IR_STRING_HASH_STEP(IR_HASH_4(a, b, c, d), e)
+#define IR_HASH_7(a, b, c, d, e, f, g) IR_STRING_HASH_STEP(IR_STRING_HASH_STEP(IR_HASH_5(a, b, c, d, e), f), g)
+
+// Strings which are pushed instead of allocating new strings: every single character up to IR_CHAR_STRINGS_COUNT
+// (See exec_push_string_char), integers below IR_INT_STRINGS_COUNT (See exec_push_string_int) and the names of
+// booleans and nothing. They live outside of the heap and are not owned, so they are left alone by garbage
+// collection and can not be modified by list instructions, the same as constants. Their hashes are computed here,
+// as the tables are shared by all threads
+static uint8_t ir_char_bytes[UINT8_MAX + 1] = { IR_REPEAT_256(IR_CHAR_CODE, 0) };
+static uint32_t ir_wide_char_codes[IR_CHAR_STRINGS_COUNT - UINT8_MAX - 1] = {
+    IR_REPEAT_1024(IR_CHAR_CODE, 256)
+};
+static IrList ir_char_strings[IR_CHAR_STRINGS_COUNT] = {
+    IR_REPEAT_256(IR_CHAR_STRING, 0)
+    IR_REPEAT_1024(IR_WIDE_CHAR_STRING, 256)
+};
+
+static uint8_t ir_int_bytes[IR_INT_STRINGS_COUNT][4] = { IR_REPEAT_1024(IR_INT_BYTES, 0) };
+static IrList ir_int_strings[IR_INT_STRINGS_COUNT] = { IR_REPEAT_1024(IR_INT_STRING, 0) };
+
+static uint8_t ir_word_bytes[] = "falsetruenothing";
+static IrList ir_bool_strings[2] = {
+    { .chars = &ir_word_bytes[0], .size = 5, .capacity = 5, .hash = IR_HASH_5('f', 'a', 'l', 's', 'e') },
+    { .chars = &ir_word_bytes[5], .size = 4, .capacity = 4, .hash = IR_HASH_4('t', 'r', 'u', 'e') },
+};
+static IrList ir_nothing_string = {
+    .chars = &ir_word_bytes[9], .size = 7, .capacity = 7, .hash = IR_HASH_7('n', 'o', 't', 'h', 'i', 'n', 'g'),
+};
+
+#undef IR_HASH_7
+#undef IR_HASH_5
+#undef IR_HASH_4
+#undef IR_HASH_3
+#undef IR_INT_STRING
+#undef IR_INT_BYTES
+#undef IR_INT_HASH
+#undef IR_INT_HASH_STEP_IF
+#undef IR_INT_LENGTH
+#undef IR_INT_DIGIT
+#undef IR_WIDE_CHAR_STRING
+#undef IR_CHAR_STRING
+#undef IR_CHAR_CODE
+#undef IR_REPEAT_1024
+#undef IR_REPEAT_256
+#undef IR_REPEAT_64
+#undef IR_REPEAT_16
+#undef IR_REPEAT_4
+
+// Decodes UTF-8 sequence at *str and moves past it. Invalid sequences are decoded as '?' one byte at a time
+static uint32_t ir_utf8_decode(const char** str) {
+    const uint8_t* bytes = (const uint8_t*)*str;
+    uint32_t codepoint;
+    int size;
+
+    if (bytes[0] < 0x80) {
+        *str += 1;
+        return bytes[0];
+    } else if ((bytes[0] & 0xe0) == 0xc0) {
+        codepoint = bytes[0] & 0x1f;
+        size = 2;
+    } else if ((bytes[0] & 0xf0) == 0xe0) {
+        codepoint = bytes[0] & 0x0f;
+        size = 3;
+    } else if ((bytes[0] & 0xf8) == 0xf0) {
+        codepoint = bytes[0] & 0x07;
+        size = 4;
+    } else {
+        *str += 1;
+        return '?';
+    }
+
+    for (int i = 1; i < size; i++) {
+        // Also stops at the null terminator
+        if ((bytes[i] & 0xc0) != 0x80) {
+            *str += 1;
+            return '?';
+        }
+        codepoint = (codepoint << 6) | (bytes[i] & 0x3f);
+    }
+    *str += size;
+    return codepoint;
+}
+
+// Writes UTF-8 sequence of codepoint into buf, which needs space for 4 bytes. Returns size of the sequence
+static size_t ir_utf8_encode(uint32_t codepoint, char* buf) {
+    if (codepoint < 0x80) {
+        buf[0] = codepoint;
+        return 1;
+    } else if (codepoint < 0x800) {
+        buf[0] = 0xc0 | (codepoint >> 6);
+        buf[1] = 0x80 | (codepoint & 0x3f);
+        return 2;
+    } else if (codepoint < 0x10000) {
+        buf[0] = 0xe0 | (codepoint >> 12);
+        buf[1] = 0x80 | ((codepoint >> 6) & 0x3f);
+        buf[2] = 0x80 | (codepoint & 0x3f);
+        return 3;
+    } else if (codepoint < 0x110000) {
+        buf[0] = 0xf0 | (codepoint >> 18);
+        buf[1] = 0x80 | ((codepoint >> 12) & 0x3f);
+        buf[2] = 0x80 | ((codepoint >> 6) & 0x3f);
+        buf[3] = 0x80 | (codepoint & 0x3f);
+        return 4;
+    }
+    buf[0] = '?';
+    return 1;
+}
 
 size_t hash_value(IrConstValue value) {
     size_t hash = 0;
@@ -558,6 +1251,9 @@ size_t hash_value(IrConstValue value) {
     case IR_TYPE_INT: hash = value.as.int_val; break;
     case IR_TYPE_FLOAT: hash = *(size_t*)&value.as.float_val; break;
     case IR_TYPE_BOOL: hash = value.as.bool_val; break;
+    case IR_TYPE_STRING:
+        hash = value.as.list_val ? ir_string_hash(value.as.list_val) : 0x87654321;
+        break;
     case IR_TYPE_LIST: ;
         IrList* list = value.as.list_val;
         if (!list) {
@@ -587,6 +1283,16 @@ size_t hash_value(IrConstValue value) {
             hash = (hash << 1) ^ value.as.label_val.name[i];
         }
         break;
+    case IR_TYPE_IMPORT: ;
+        size_t module_size = strlen(value.as.import_val.module);
+        for (size_t i = 0; i < module_size; i++) {
+            hash = (hash << 1) ^ value.as.import_val.module[i];
+        }
+        size_t import_size = strlen(value.as.import_val.label);
+        for (size_t i = 0; i < import_size; i++) {
+            hash = (hash << 1) ^ value.as.import_val.label[i];
+        }
+        break;
     default:
         break;
     }
@@ -604,6 +1310,8 @@ bool value_equals(IrValue left, IrValue right) {
     case IR_TYPE_FLOAT: return left.as.float_val == right.as.float_val;
     case IR_TYPE_BOOL: return left.as.bool_val == right.as.bool_val;
     case IR_TYPE_STRING:
+        if (!left.as.list_val || !right.as.list_val) return left.as.list_val == right.as.list_val;
+        return ir_string_equals(left.as.list_val, right.as.list_val);
     case IR_TYPE_LIST: ;
         IrList* left_list = left.as.list_val;
         IrList* right_list = right.as.list_val;
@@ -617,6 +1325,7 @@ bool value_equals(IrValue left, IrValue right) {
         return true;
     case IR_TYPE_FUNC: return left.as.func_val == right.as.func_val;
     case IR_TYPE_LABEL: return left.as.label_val == right.as.label_val;
+    case IR_TYPE_IMPORT: return false;
     }
     return true;
 }
@@ -631,6 +1340,8 @@ bool const_value_equals(IrConstValue left, IrConstValue right) {
     case IR_TYPE_FLOAT: return left.as.float_val == right.as.float_val;
     case IR_TYPE_BOOL: return left.as.bool_val == right.as.bool_val;
     case IR_TYPE_STRING:
+        if (!left.as.list_val || !right.as.list_val) return left.as.list_val == right.as.list_val;
+        return ir_string_equals(left.as.list_val, right.as.list_val);
     case IR_TYPE_LIST: ;
         IrList* left_list = left.as.list_val;
         IrList* right_list = right.as.list_val;
@@ -651,6 +1362,9 @@ bool const_value_equals(IrConstValue left, IrConstValue right) {
         return true;
     case IR_TYPE_LABEL:
         return !strcmp(left.as.label_val.name, right.as.label_val.name);
+    case IR_TYPE_IMPORT:
+        return !strcmp(left.as.import_val.module, right.as.import_val.module) &&
+               !strcmp(left.as.import_val.label, right.as.import_val.label);
     }
     return true;
 }
@@ -667,10 +1381,36 @@ IrBytecodePool* bytecode_pool_new(IrMemArena* arena) {
 void bytecode_pool_free(IrBytecodePool* pool) {
     ir_list_free(pool->hash_set);
     ir_list_free(pool->list);
+    if (pool->mapping) ir_plat_file_unmap(pool->mapping, pool->mapping_size);
     ir_arena_free(pool->arena);
 }
 
+static void bytecode_pool_rehash(IrBytecodePool* pool, size_t capacity) {
+    pool->hash_set.capacity = capacity;
+    pool->hash_set.items = realloc(pool->hash_set.items, sizeof(*pool->hash_set.items) * pool->hash_set.capacity);
+    // This sets all buckets in hash set to -1 (empty)
+    memset(pool->hash_set.items, 0xff, sizeof(*pool->hash_set.items) * pool->hash_set.capacity);
+
+    for (size_t i = 0; i < pool->list.size; i++) {
+        size_t hash = hash_value(pool->list.items[i]) % pool->hash_set.capacity;
+        size_t idx = pool->hash_set.items[hash];
+        while (idx != (size_t)-1) {
+            hash++;
+            if (hash >= pool->hash_set.capacity) hash = 0;
+            idx = pool->hash_set.items[hash];
+        }
+        pool->hash_set.items[hash] = i;
+    }
+    pool->hash_set.size = pool->list.size;
+}
+
 size_t bytecode_pool_get(IrBytecodePool* pool, IrConstValue value) {
+    // Pools loaded from version 2 files build their hash set on first use
+    if (pool->hash_set.capacity == 0 && pool->list.size > 0) {
+        size_t capacity = 1024;
+        while (capacity < pool->list.size * 2) capacity *= 2;
+        bytecode_pool_rehash(pool, capacity);
+    }
     if (pool->hash_set.capacity == 0) return (size_t)-1;
 
     size_t hash = hash_value(value) % pool->hash_set.capacity;
@@ -687,23 +1427,9 @@ size_t bytecode_pool_get(IrBytecodePool* pool, IrConstValue value) {
 
 size_t bytecode_pool_insert(IrBytecodePool* pool, IrConstValue value) {
     if ((float)pool->hash_set.size / (float)pool->hash_set.capacity > 0.6 || pool->hash_set.capacity == 0) {
-        if (pool->hash_set.capacity == 0) pool->hash_set.capacity = 1024;
-        else pool->hash_set.capacity *= 2;
-
-        pool->hash_set.items = realloc(pool->hash_set.items, sizeof(*pool->hash_set.items) * pool->hash_set.capacity);
-        // This sets all buckets in hash set to -1 (empty)
-        memset(pool->hash_set.items, 0xff, sizeof(*pool->hash_set.items) * pool->hash_set.capacity);
-
-        for (size_t i = 0; i < pool->list.size; i++) {
-            size_t hash = hash_value(pool->list.items[i]) % pool->hash_set.capacity;
-            size_t idx = pool->hash_set.items[hash];
-            while (idx != (size_t)-1) {
-                hash++;
-                if (hash >= pool->hash_set.capacity) hash = 0;
-                idx = pool->hash_set.items[hash];
-            }
-            pool->hash_set.items[hash] = i;
-        }
+        size_t capacity = pool->hash_set.capacity == 0 ? 1024 : pool->hash_set.capacity * 2;
+        while (capacity < pool->list.size * 2) capacity *= 2;
+        bytecode_pool_rehash(pool, capacity);
     }
 
     size_t hash = hash_value(value) % pool->hash_set.capacity;
@@ -732,9 +1458,44 @@ IrBytecode bytecode_new(const char* name, IrBytecodePool* pool) {
         .code = (IrOpcodes) {0},
         .pool = pool,
         .labels = (IrLabelList) {0},
+        .exports = (IrLabelList) {0},
+        .debug = (IrDebugInfo) {0},
     };
 }
 
+// Appends debug entry, replacing the last one if it does not cover any code. Code before the first entry
+// has no location, so it is not recorded either
+static void bytecode_debug_append(IrMemArena* arena, IrDebugInfo* debug, size_t pos, uint32_t location) {
+    if (debug->size > 0 && debug->items[debug->size - 1].pos == pos) debug->size--;
+    if (debug->size > 0 ? debug->items[debug->size - 1].location == location : location == IR_NO_LOCATION) return;
+    ir_arena_append(arena, *debug, ((IrDebugEntry) { .pos = pos, .location = location }));
+}
+
+void bytecode_set_location(IrBytecode* bc, uint32_t location) {
+    if (bc->code.size == 0) return;
+
+    IrDebugInfo old_debug = bc->debug;
+    bc->debug = (IrDebugInfo) {0};
+    if (old_debug.size == 0 || old_debug.items[0].pos > 0) bytecode_debug_append(bc->pool->arena, &bc->debug, 0, location);
+    for (size_t i = 0; i < old_debug.size; i++) {
+        IrDebugEntry entry = old_debug.items[i];
+        bytecode_debug_append(bc->pool->arena, &bc->debug, entry.pos, entry.location == IR_NO_LOCATION ? location : entry.location);
+    }
+}
+
+uint32_t bytecode_get_location(IrBytecode* bc, size_t pos) {
+    size_t low = 0, high = bc->debug.size;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (bc->debug.items[mid].pos <= pos) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low == 0 ? IR_NO_LOCATION : bc->debug.items[low - 1].location;
+}
+
 void bytecode_join(IrBytecode* dst, IrBytecode* src) {
     IR_ASSERT(src->pool == dst->pool);
 
@@ -763,6 +1524,27 @@ void bytecode_join(IrBytecode* dst, IrBytecode* src) {
             ir_arena_append(arena, dst->labels, src->labels.items[i]);
         }
     }
+
+    // Exports reference label constants, which are already moved above
+    if (dst->exports.size == 0) {
+        dst->exports = src->exports;
+    } else {
+        for (size_t i = 0; i < src->exports.size; i++) {
+            ir_arena_append(arena, dst->exports, src->exports.items[i]);
+        }
+    }
+
+    if (src->debug.size == 0 && dst->debug.size == 0) return;
+    if (dst->debug.size == 0 && dst_size == 0) {
+        dst->debug = src->debug;
+    } else {
+        bytecode_debug_append(arena, &dst->debug, dst_size, IR_NO_LOCATION);
+        for (size_t i = 0; i < src->debug.size; i++) {
+            bytecode_debug_append(arena, &dst->debug, src->debug.items[i].pos + dst_size, src->debug.items[i].location);
+        }
+    }
+    // Code added after src does not get its location
+    bytecode_debug_append(arena, &dst->debug, dst->code.size, IR_NO_LOCATION);
 }
 
 IrInstructionID bytecode_push_op(IrBytecode* bc, IrOpcode op) {
@@ -792,12 +1574,27 @@ ConstId bytecode_push_label(IrBytecode* bc, const char* name) {
     return label;
 }
 
+void bytecode_export_label(IrBytecode* bc, ConstId label_id) {
+    IR_ASSERT(bc->pool->list.items[label_id].type == IR_TYPE_LABEL);
+    ir_arena_append(bc->pool->arena, bc->exports, label_id);
+}
+
 ConstId bytecode_push_constant(IrBytecode* bc, IrConstValue constant) {
     ConstId id = bytecode_pool_insert(bc->pool, constant);
     IR_ASSERT(id < 0x1000000);
     return id;
 }
 
+IrInstructionID bytecode_push_op_import(IrBytecode* bc, IrOpcode op, const char* module, const char* label) {
+    IrConstValue constant;
+    constant.type = IR_TYPE_IMPORT;
+    constant.as.import_val.module = module;
+    constant.as.import_val.label = label;
+    constant.as.import_val.chunk = (size_t)-1;
+    constant.as.import_val.pos = (size_t)-1;
+    return bytecode_push_op_const(bc, op, bytecode_push_constant(bc, constant));
+}
+
 #define _ir_make_bc_push_op(_name, _type, _valname, _irtype) \
     IrInstructionID _name(IrBytecode* bc, IrOpcode op, _type _valname) { \
         IrConstValue constant; \
@@ -851,6 +1648,24 @@ void bytecode_const_list_append(IrBytecodePool* pool, IrList* list, IrValue val)
     ir_arena_append(pool->arena, *list, val);
 }
 
+void bytecode_const_string_append(IrBytecodePool* pool, IrList* string, uint32_t codepoint) {
+    bool wide = string->wide || codepoint > UINT8_MAX;
+    if (string->size >= string->capacity || wide != string->wide) {
+        IrList old_string = *string;
+        if (string->size >= string->capacity) string->capacity = string->capacity == 0 ? 32 : string->capacity * 2;
+        string->wide = wide;
+
+        if (wide == old_string.wide) {
+            string->chars = ir_arena_realloc(pool->arena, old_string.chars, old_string.capacity * ir_string_char_size(&old_string), string->capacity * ir_string_char_size(string));
+        } else {
+            string->chars = ir_arena_alloc(pool->arena, string->capacity * ir_string_char_size(string));
+            ir_string_copy(string, 0, &old_string, 0, old_string.size);
+        }
+    }
+    ir_string_set(string, string->size++, codepoint);
+    string->hash = 0;
+}
+
 IrInstructionID bytecode_push_op_label(IrBytecode* bc, IrOpcode op, ConstId label_id) {
     IR_ASSERT(bc->pool->list.items[label_id].type == IR_TYPE_LABEL);
     return bytecode_push_op_const(bc, op, label_id);
@@ -952,15 +1767,13 @@ bool bytecode_load_value(IrSave* save, IrBytecodePool* pool, IrValue* value) {
         for (size_t i = 0; i < list_size; i++) {
             uint64_t val;
             if (!bytecode_load_varint(save, &val)) return false;
-            bytecode_const_list_append(pool, list, (IrValue) {
-                .type = IR_TYPE_INT,
-                .as.int_val = *(int64_t*)&val,
-            });
+            bytecode_const_string_append(pool, list, val);
         }
         value->as.list_val = list;
         break;
     case IR_TYPE_FUNC:
     case IR_TYPE_LABEL:
+    case IR_TYPE_IMPORT:
         assert(false && "TODO");
         break;
     }
@@ -1023,10 +1836,7 @@ bool bytecode_load_const_value(IrSave* save, IrBytecodePool* pool, IrConstValue*
         for (size_t i = 0; i < list_size; i++) {
             uint64_t val;
             if (!bytecode_load_varint(save, &val)) return false;
-            bytecode_const_list_append(pool, list, (IrValue) {
-                .type = IR_TYPE_INT,
-                .as.int_val = *(int64_t*)&val,
-            });
+            bytecode_const_string_append(pool, list, val);
         }
         value->as.list_val = list;
         break;
@@ -1057,105 +1867,391 @@ bool bytecode_load_const_value(IrSave* save, IrBytecodePool* pool, IrConstValue*
         value->as.label_val.name = label_str;
         value->as.label_val.pos = label_pos;
         break;
+    case IR_TYPE_IMPORT: ;
+        size_t module_size, import_size;
+        char *module, *import;
+
+        if (!bytecode_load_array(save, (void**)&module, sizeof(char), &module_size)) return false;
+        char* module_str = ir_arena_alloc(pool->arena, module_size + 1);
+        memcpy(module_str, module, module_size);
+        module_str[module_size] = 0;
+
+        if (!bytecode_load_array(save, (void**)&import, sizeof(char), &import_size)) return false;
+        char* import_str = ir_arena_alloc(pool->arena, import_size + 1);
+        memcpy(import_str, import, import_size);
+        import_str[import_size] = 0;
+
+        value->as.import_val.module = module_str;
+        value->as.import_val.label = import_str;
+        value->as.import_val.chunk = (size_t)-1;
+        value->as.import_val.pos = (size_t)-1;
+        break;
+    default:
+        printf("Invalid constant type: %d\n", type);
+        return false;
     }
 
     return true;
 }
 
-#define IR_LOAD_FAIL do { \
-    return_val = false; \
-    goto load_return; \
-} while (0)
-
-bool bytecode_load(IrBytecodePool* pool, IrBytecode* bc, const char* filepath) {
-    bool return_val = true;
-
-    if (pool->list.size > 0) return false;
-
-    FILE* f = fopen(filepath, "rb");
-    if (!f) return false;
-
-    fseek(f, 0, SEEK_END);
-    long file_size = ftell(f);
-    fseek(f, 0, SEEK_SET);
-
-    char* data = malloc(file_size);
-    file_size = fread(data, 1, file_size, f);
-
-    IrSave save = {
-        .ptr = data,
-        .pos = 0,
-        .size = file_size,
-    };
-
+static bool bytecode_load_header(IrSave* save, uint64_t* version) {
     size_t ident_size;
     char* ident;
 
-    if (!bytecode_load_array(&save, (void**)&ident, sizeof(char), &ident_size)) IR_LOAD_FAIL;
+    if (!bytecode_load_array(save, (void**)&ident, sizeof(char), &ident_size)) return false;
 
     if (strncmp(ident, IR_SAVE_IDENT, ident_size)) {
         printf("Invalid ident: %.*s\n", (int)ident_size, ident);
-        IR_LOAD_FAIL;
+        return false;
     }
 
-    uint64_t version;
-    if (!bytecode_load_varint(&save, &version)) IR_LOAD_FAIL;
+    if (!bytecode_load_varint(save, version)) return false;
 
-    if (version < IR_SAVE_MIN_VERSION || version > IR_SAVE_MAX_VERSION) {
-        printf("Invalid version: %lu. Supported bytecode versions: %d-%d\n", version, IR_SAVE_MIN_VERSION, IR_SAVE_MAX_VERSION);
-        IR_LOAD_FAIL;
+    if (*version < IR_SAVE_MIN_VERSION || *version > IR_SAVE_MAX_VERSION) {
+        printf("Invalid version: %lu. Supported bytecode versions: %d-%d\n", *version, IR_SAVE_MIN_VERSION, IR_SAVE_MAX_VERSION);
+        return false;
     }
+    return true;
+}
 
-    size_t pool_size;
-    if (!bytecode_load_varint(&save, &pool_size)) IR_LOAD_FAIL;
+// List items can only be used in place if IrSaveValue matches the IrValue layout, which also needs scalar
+// values of any size to start at the lowest address of the union
+static bool bytecode_load_items_native(void) {
+    uint16_t byte_order = 1;
+    return sizeof(IrValue) == sizeof(IrSaveValue) &&
+           offsetof(IrValue, as) == offsetof(IrSaveValue, as) &&
+           *(uint8_t*)&byte_order == 1;
+}
 
-    for (size_t i = 0; i < pool_size; i++) {
-        IrConstValue value;
-        if (!bytecode_load_const_value(&save, pool, &value)) IR_LOAD_FAIL;
-        bytecode_pool_insert(pool, value);
-    }
+static const char* bytecode_load_data_string(IrLoadData* load, uint64_t offset) {
+    if (offset >= load->data_size) return NULL;
+    if (!memchr(load->data + offset, 0, load->data_size - offset)) return NULL;
+    return (const char*)load->data + offset;
+}
 
-    size_t code_size;
-    void* code;
-    if (!bytecode_load_array(&save, &code, sizeof(unsigned char), &code_size)) IR_LOAD_FAIL;
+// Packed characters are used in place, while characters saved as IrSaveValue items by version 2 are packed into the pool
+static IrList* bytecode_load_data_chars(IrLoadData* load, uint64_t offset, uint64_t size, uint64_t flags) {
+    if (offset % IR_SAVE_ALIGN || offset > load->data_size) return NULL;
+    IrList* string = bytecode_const_list_new(load->pool);
 
-    void* code_ptr = ir_arena_alloc(pool->arena, code_size * sizeof(unsigned char));
-    memcpy(code_ptr, code, code_size * sizeof(unsigned char));
+    if (!(flags & IR_SAVE_STRING_PACKED)) {
+        if (size > (load->data_size - offset) / sizeof(IrSaveValue)) return NULL;
+        const IrSaveValue* items = (const IrSaveValue*)(load->data + offset);
+        for (size_t i = 0; i < size; i++) bytecode_const_string_append(load->pool, string, items[i].as);
+        return string;
+    }
 
-    size_t labels_size;
-    size_t* labels = bytecode_load_varint_array(&save, pool, &labels_size);
-    if (!labels) IR_LOAD_FAIL;
+    string->wide = flags & IR_SAVE_STRING_WIDE;
+    if (size > (load->data_size - offset) / ir_string_char_size(string)) return NULL;
+    string->chars = (void*)(load->data + offset);
+    string->size = size;
+    string->capacity = size;
+    return string;
+}
 
-    *bc = bytecode_new(NULL, pool);
+static IrList* bytecode_load_data_list(IrLoadData* load, uint64_t offset, uint64_t size, uint64_t flags) {
+    if (offset % IR_SAVE_ALIGN || offset > load->data_size) return NULL;
+    if (size > (load->data_size - offset) / sizeof(IrSaveValue)) return NULL;
+    const IrSaveValue* items = (const IrSaveValue*)(load->data + offset);
 
-    bc->version = version;
+    IrList* list = bytecode_const_list_new(load->pool);
+    list->size = size;
+    list->capacity = size;
 
-    bc->code.size = code_size;
-    bc->code.capacity = code_size;
-    bc->code.items = code_ptr;
+    if (!(flags & IR_SAVE_LIST_NESTED) && bytecode_load_items_native()) {
+        // Constant lists are never modified, so items can point straight into the file
+        list->items = (IrValue*)items;
+        return list;
+    }
 
-    bc->labels.size = labels_size;
-    bc->labels.capacity = labels_size;
-    bc->labels.items = labels;
+    list->items = ir_arena_alloc(load->pool->arena, sizeof(IrValue) * size);
+    for (size_t i = 0; i < size; i++) {
+        IrValue* value = &list->items[i];
+        value->type = items[i].type;
+
+        switch (value->type) {
+        case IR_TYPE_NOTHING: break;
+        case IR_TYPE_BYTE: value->as.byte_val = items[i].as; break;
+        case IR_TYPE_INT: value->as.int_val = (int64_t)items[i].as; break;
+        case IR_TYPE_FLOAT: memcpy(&value->as.float_val, &items[i].as, sizeof(double)); break;
+        case IR_TYPE_BOOL: value->as.bool_val = items[i].as; break;
+        case IR_TYPE_LIST:
+        case IR_TYPE_STRING: ;
+            uint64_t nested_offset = items[i].as;
+            if (nested_offset == IR_SAVE_NULL_OFFSET) {
+                value->as.list_val = NULL;
+                break;
+            }
+            if (nested_offset % IR_SAVE_ALIGN || nested_offset > load->data_size || load->data_size - nested_offset < sizeof(IrSaveList)) return NULL;
 
-load_return:
-    free(data);
-    fclose(f);
-    return return_val;
+            const IrSaveList* nested = (const IrSaveList*)(load->data + nested_offset);
+            if (value->type == IR_TYPE_STRING) {
+                value->as.list_val = bytecode_load_data_chars(load, nested->offset, nested->size, nested->flags);
+            } else {
+                value->as.list_val = bytecode_load_data_list(load, nested->offset, nested->size, nested->flags);
+            }
+            if (!value->as.list_val) return NULL;
+            break;
+        default:
+            return NULL;
+        }
+    }
+    return list;
 }
 
-void bytecode_save_varint(IrMemArena* save, uint64_t val) {
-    uint8_t buf[16];
-    size_t buf_size = 0;
-
-    do {
-        buf[15 - buf_size++] = val & 0x7f;
-        val >>= 7;
-    } while (val);
-
-    buf[15] |= 1 << 7;
+static bool bytecode_load_v2_const(IrLoadData* load, const IrSaveConst* record, IrConstValue* value) {
+    value->type = record->type;
 
-    uint8_t* ptr = ir_arena_alloc_packed(save, sizeof(uint8_t) * buf_size);
+    switch (value->type) {
+    case IR_TYPE_NOTHING: break;
+    case IR_TYPE_BYTE: value->as.byte_val = record->a; break;
+    case IR_TYPE_INT: value->as.int_val = (int64_t)record->a; break;
+    case IR_TYPE_FLOAT: memcpy(&value->as.float_val, &record->a, sizeof(double)); break;
+    case IR_TYPE_BOOL: value->as.bool_val = record->a; break;
+    case IR_TYPE_LIST:
+    case IR_TYPE_STRING:
+        if (record->a == IR_SAVE_NULL_OFFSET) {
+            value->as.list_val = NULL;
+            break;
+        }
+        if (value->type == IR_TYPE_STRING) {
+            value->as.list_val = bytecode_load_data_chars(load, record->a, record->b, record->flags);
+        } else {
+            value->as.list_val = bytecode_load_data_list(load, record->a, record->b, record->flags);
+        }
+        if (!value->as.list_val) return false;
+        break;
+    case IR_TYPE_FUNC:
+        value->as.func_val.hint = bytecode_load_data_string(load, record->a);
+        value->as.func_val.ptr = NULL;
+        if (!value->as.func_val.hint) return false;
+        break;
+    case IR_TYPE_LABEL:
+        value->as.label_val.name = bytecode_load_data_string(load, record->a);
+        value->as.label_val.pos = record->b;
+        if (!value->as.label_val.name) return false;
+        break;
+    case IR_TYPE_IMPORT:
+        value->as.import_val.module = bytecode_load_data_string(load, record->a);
+        value->as.import_val.label = bytecode_load_data_string(load, record->b);
+        value->as.import_val.chunk = (size_t)-1;
+        value->as.import_val.pos = (size_t)-1;
+        if (!value->as.import_val.module || !value->as.import_val.label) return false;
+        break;
+    default:
+        printf("Invalid constant type: %d\n", value->type);
+        return false;
+    }
+    return true;
+}
+
+static size_t* bytecode_load_v2_labels(IrBytecodePool* pool, const IrSaveSection* section, const unsigned char* data, size_t* count) {
+    *count = section->size / sizeof(uint64_t);
+    const uint64_t* ids = (const uint64_t*)(data + section->offset);
+
+    for (size_t i = 0; i < *count; i++) {
+        if (ids[i] >= pool->list.size || pool->list.items[ids[i]].type != IR_TYPE_LABEL) return NULL;
+    }
+    if (sizeof(size_t) == sizeof(uint64_t)) return (size_t*)ids;
+
+    size_t* labels = ir_arena_alloc(pool->arena, sizeof(size_t) * (*count));
+    for (size_t i = 0; i < *count; i++) labels[i] = ids[i];
+    return labels;
+}
+
+// Loads version 2 bytecode which keeps referencing data, so data should live as long as the pool
+static bool bytecode_load_v2(IrBytecodePool* pool, IrBytecode* bc, const unsigned char* data, size_t data_size, unsigned int version) {
+    if (data_size < IR_SAVE_HEADER_SIZE + sizeof(IrSaveHeader)) return false;
+
+    const IrSaveHeader* header = (const IrSaveHeader*)(data + IR_SAVE_HEADER_SIZE);
+    if (header->byte_order != IR_SAVE_BYTE_ORDER) {
+        printf("Bytecode was saved on platform with different byte order\n");
+        return false;
+    }
+    if (header->sections_count > (data_size - IR_SAVE_HEADER_SIZE - sizeof(IrSaveHeader)) / sizeof(IrSaveSection)) return false;
+
+    // Unknown sections are skipped to allow adding new ones without changing the version
+    const IrSaveSection* table = (const IrSaveSection*)(header + 1);
+    IrSaveSection sections[IR_SAVE_SECTION_LAST] = {0};
+    for (size_t i = 0; i < header->sections_count; i++) {
+        if (table[i].offset % IR_SAVE_ALIGN || table[i].offset > data_size || table[i].size > data_size - table[i].offset) {
+            printf("Section %zu is out of bounds\n", i);
+            return false;
+        }
+        if (table[i].kind < IR_SAVE_SECTION_LAST) sections[table[i].kind] = table[i];
+    }
+
+    IrLoadData load = {
+        .pool = pool,
+        .data = data + sections[IR_SAVE_SECTION_DATA].offset,
+        .data_size = sections[IR_SAVE_SECTION_DATA].size,
+    };
+
+    size_t consts_count = sections[IR_SAVE_SECTION_CONSTS].size / sizeof(IrSaveConst);
+    const IrSaveConst* consts = (const IrSaveConst*)(data + sections[IR_SAVE_SECTION_CONSTS].offset);
+
+    // Constants are put into the list directly, as the hash set for them is only needed when searching
+    // the pool and gets built on demand (See bytecode_pool_get)
+    pool->list.items = malloc(sizeof(IrConstValue) * MAX(consts_count, 1));
+    pool->list.capacity = MAX(consts_count, 1);
+    for (size_t i = 0; i < consts_count; i++) {
+        if (!bytecode_load_v2_const(&load, &consts[i], &pool->list.items[i])) return false;
+        pool->list.size++;
+    }
+
+    size_t labels_size, exports_size;
+    size_t* labels = bytecode_load_v2_labels(pool, &sections[IR_SAVE_SECTION_LABELS], data, &labels_size);
+    size_t* exports = bytecode_load_v2_labels(pool, &sections[IR_SAVE_SECTION_EXPORTS], data, &exports_size);
+    if (!labels || !exports) return false;
+
+    *bc = bytecode_new(NULL, pool);
+
+    bc->version = version;
+
+    bc->code.size = sections[IR_SAVE_SECTION_CODE].size;
+    bc->code.capacity = bc->code.size;
+    bc->code.items = (unsigned char*)data + sections[IR_SAVE_SECTION_CODE].offset;
+
+    bc->labels.size = labels_size;
+    bc->labels.capacity = labels_size;
+    bc->labels.items = labels;
+
+    bc->exports.size = exports_size;
+    bc->exports.capacity = exports_size;
+    bc->exports.items = exports;
+
+    bc->debug.size = sections[IR_SAVE_SECTION_DEBUG].size / sizeof(IrDebugEntry);
+    bc->debug.capacity = bc->debug.size;
+    bc->debug.items = (IrDebugEntry*)(data + sections[IR_SAVE_SECTION_DEBUG].offset);
+
+    return true;
+}
+
+#define IR_LOAD_FAIL do { \
+    return_val = false; \
+    goto load_return; \
+} while (0)
+
+bool bytecode_load_memory(IrBytecodePool* pool, IrBytecode* bc, const void* data, size_t data_size) {
+    bool return_val = true;
+
+    if (pool->list.size > 0) return false;
+
+    IrSave save = {
+        .ptr = (void*)data,
+        .pos = 0,
+        .size = data_size,
+    };
+
+    uint64_t version;
+    if (!bytecode_load_header(&save, &version)) IR_LOAD_FAIL;
+
+    if (version >= 2) {
+        // The buffer is not referenced after returning, so keep a copy of it in the pool to use it in place
+        void* data_copy = ir_arena_alloc(pool->arena, data_size);
+        if (!data_copy) IR_LOAD_FAIL;
+        memcpy(data_copy, data, data_size);
+        if (!bytecode_load_v2(pool, bc, data_copy, data_size, version)) IR_LOAD_FAIL;
+        goto load_return;
+    }
+
+    size_t pool_size;
+    if (!bytecode_load_varint(&save, &pool_size)) IR_LOAD_FAIL;
+
+    for (size_t i = 0; i < pool_size; i++) {
+        IrConstValue value;
+        if (!bytecode_load_const_value(&save, pool, &value)) IR_LOAD_FAIL;
+        bytecode_pool_insert(pool, value);
+    }
+
+    size_t code_size;
+    void* code;
+    if (!bytecode_load_array(&save, &code, sizeof(unsigned char), &code_size)) IR_LOAD_FAIL;
+
+    void* code_ptr = ir_arena_alloc(pool->arena, code_size * sizeof(unsigned char));
+    memcpy(code_ptr, code, code_size * sizeof(unsigned char));
+
+    size_t labels_size;
+    size_t* labels = bytecode_load_varint_array(&save, pool, &labels_size);
+    if (!labels) IR_LOAD_FAIL;
+
+    // Export table was appended to the end of version 1 format, so files saved before it was added
+    // just have no exports, and older loaders ignore it
+    size_t exports_size = 0;
+    size_t* exports = NULL;
+    if (save.pos < save.size) {
+        exports = bytecode_load_varint_array(&save, pool, &exports_size);
+        if (!exports) IR_LOAD_FAIL;
+    }
+
+    *bc = bytecode_new(NULL, pool);
+
+    bc->version = version;
+
+    bc->code.size = code_size;
+    bc->code.capacity = code_size;
+    bc->code.items = code_ptr;
+
+    bc->labels.size = labels_size;
+    bc->labels.capacity = labels_size;
+    bc->labels.items = labels;
+
+    bc->exports.size = exports_size;
+    bc->exports.capacity = exports_size;
+    bc->exports.items = exports;
+
+load_return:
+    return return_val;
+}
+
+bool bytecode_load(IrBytecodePool* pool, IrBytecode* bc, const char* filepath) {
+    if (pool->list.size > 0) return false;
+
+    size_t file_size;
+    void* data = ir_plat_file_map(filepath, &file_size);
+    if (!data) return false;
+
+    IrSave save = {
+        .ptr = data,
+        .pos = 0,
+        .size = file_size,
+    };
+
+    uint64_t version;
+    if (!bytecode_load_header(&save, &version)) {
+        ir_plat_file_unmap(data, file_size);
+        return false;
+    }
+
+    if (version >= 2) {
+        // Mapping is kept for the lifetime of the pool, so pages of the file are loaded only when used
+        // and shared between all processes running the same bytecode
+        if (!bytecode_load_v2(pool, bc, data, file_size, version)) {
+            ir_plat_file_unmap(data, file_size);
+            return false;
+        }
+        pool->mapping = data;
+        pool->mapping_size = file_size;
+        return true;
+    }
+
+    bool return_val = bytecode_load_memory(pool, bc, data, file_size);
+    ir_plat_file_unmap(data, file_size);
+    return return_val;
+}
+
+void bytecode_save_varint(IrMemArena* save, uint64_t val) {
+    uint8_t buf[16];
+    size_t buf_size = 0;
+
+    do {
+        buf[15 - buf_size++] = val & 0x7f;
+        val >>= 7;
+    } while (val);
+
+    buf[15] |= 1 << 7;
+
+    uint8_t* ptr = ir_arena_alloc_packed(save, sizeof(uint8_t) * buf_size);
     memcpy(ptr, buf + 16 - buf_size, sizeof(uint8_t) * buf_size);
 }
 
@@ -1176,118 +2272,210 @@ void bytecode_save_array(IrMemArena* save, const void* data, size_t data_size, s
     }
 }
 
-void bytecode_save_varint_array(IrMemArena* save, const size_t* data, size_t count) {
-    bytecode_save_varint(save, count);
+static size_t bytecode_save_pos(IrMemArena* save) {
+    return save->pos - IR_ARENA_BASE_POS;
+}
 
-    if (count == 0) return;
+static void bytecode_save_align(IrMemArena* save, size_t align) {
+    static const unsigned char zeros[IR_SAVE_HEADER_SIZE] = {0};
+    size_t pos = bytecode_save_pos(save);
+    size_t padding = IR_ALIGN_UP_POW2(pos, align) - pos;
+    if (padding > 0) bytecode_save_raw(save, zeros, padding);
+}
 
-    assert(data != NULL);
-    for (size_t i = 0; i < count; i++) {
-        bytecode_save_varint(save, data[i]);
-    }
+static uint64_t bytecode_save_data_string(IrMemArena* data, const char* str) {
+    assert(str != NULL);
+    uint64_t offset = bytecode_save_pos(data);
+    bytecode_save_raw(data, str, strlen(str) + 1);
+    bytecode_save_align(data, IR_SAVE_ALIGN);
+    return offset;
 }
 
-void bytecode_save_value(IrMemArena* save, IrValue value) {
-    bytecode_save_varint(save, value.type);
+// Writes list items or string characters into the data section. Lists inside the list are written before it
+// and referenced through IrSaveList records, so the items of every list stay contiguous
+static uint64_t bytecode_save_data_list(IrMemArena* data, IrList* list, bool is_string, uint64_t* flags) {
+    uint64_t* nested = NULL;
+    *flags = 0;
+
+    if (is_string) {
+        uint64_t offset = bytecode_save_pos(data);
+        *flags = IR_SAVE_STRING_PACKED | (list->wide ? IR_SAVE_STRING_WIDE : 0);
+        if (list->size > 0) {
+            bytecode_save_raw(data, list->chars, list->size * ir_string_char_size(list));
+            bytecode_save_align(data, IR_SAVE_ALIGN);
+        }
+        return offset;
+    }
 
-    IrList* list;
+    for (size_t i = 0; i < list->size; i++) {
+        IrValue val = list->items[i];
+        if (val.type != IR_TYPE_LIST && val.type != IR_TYPE_STRING) continue;
 
-    switch (value.type) {
-    case IR_TYPE_NOTHING: break;
-    case IR_TYPE_BYTE: bytecode_save_varint(save, value.as.byte_val); break;
-    case IR_TYPE_INT: bytecode_save_varint(save, *(uint64_t*)&value.as.int_val); break;
-    case IR_TYPE_FLOAT: bytecode_save_raw(save, &value.as.float_val, sizeof(double)); break;
-    case IR_TYPE_BOOL: bytecode_save_varint(save, value.as.bool_val); break;
-    case IR_TYPE_LIST:
-        list = value.as.list_val;
-        assert(list != NULL);
-        bytecode_save_varint(save, list->size);
-        for (size_t i = 0; i < list->size; i++) {
-            bytecode_save_value(save, list->items[i]);
+        if (!nested) nested = malloc(sizeof(uint64_t) * list->size);
+        *flags |= IR_SAVE_LIST_NESTED;
+
+        if (!val.as.list_val) {
+            nested[i] = IR_SAVE_NULL_OFFSET;
+            continue;
         }
-        break;
-    case IR_TYPE_STRING:
-        list = value.as.list_val;
-        bytecode_save_varint(save, list->size);
-        for (size_t i = 0; i < list->size; i++) {
-            IrValue val = list->items[i];
-            if (val.type != IR_TYPE_INT && val.type != IR_TYPE_BYTE) val.as.int_val = '?';
-            bytecode_save_varint(save, *(uint64_t*)&val.as.int_val);
+
+        IrSaveList record = { .size = val.as.list_val->size };
+        record.offset = bytecode_save_data_list(data, val.as.list_val, val.type == IR_TYPE_STRING, &record.flags);
+        nested[i] = bytecode_save_pos(data);
+        bytecode_save_raw(data, &record, sizeof(record));
+    }
+
+    uint64_t offset = bytecode_save_pos(data);
+    for (size_t i = 0; i < list->size; i++) {
+        IrValue val = list->items[i];
+        IrSaveValue record = { .type = val.type };
+
+        switch (val.type) {
+        case IR_TYPE_NOTHING: break;
+        case IR_TYPE_BYTE: record.as = val.as.byte_val; break;
+        case IR_TYPE_INT: record.as = (uint64_t)val.as.int_val; break;
+        case IR_TYPE_FLOAT: memcpy(&record.as, &val.as.float_val, sizeof(double)); break;
+        case IR_TYPE_BOOL: record.as = val.as.bool_val; break;
+        case IR_TYPE_LIST:
+        case IR_TYPE_STRING:
+            record.as = nested[i];
+            break;
+        case IR_TYPE_FUNC:
+        case IR_TYPE_LABEL:
+        case IR_TYPE_IMPORT:
+            assert(false && "TODO");
+            break;
         }
-        break;
-    case IR_TYPE_FUNC:
-    case IR_TYPE_LABEL:
-        assert(false && "TODO");
-        break;
+        bytecode_save_raw(data, &record, sizeof(record));
     }
-}
 
-void bytecode_save_const_value(IrMemArena* save, IrConstValue value) {
-    bytecode_save_varint(save, value.type);
+    free(nested);
+    return offset;
+}
 
-    IrList* list;
+static IrSaveConst bytecode_save_const(IrMemArena* data, IrConstValue value) {
+    IrSaveConst record = { .type = value.type };
+    uint64_t flags;
 
     switch (value.type) {
     case IR_TYPE_NOTHING: break;
-    case IR_TYPE_BYTE: bytecode_save_varint(save, value.as.byte_val); break;
-    case IR_TYPE_INT: bytecode_save_varint(save, *(uint64_t*)&value.as.int_val); break;
-    case IR_TYPE_FLOAT: bytecode_save_raw(save, &value.as.float_val, sizeof(double)); break;
-    case IR_TYPE_BOOL: bytecode_save_varint(save, value.as.bool_val); break;
+    case IR_TYPE_BYTE: record.a = value.as.byte_val; break;
+    case IR_TYPE_INT: record.a = (uint64_t)value.as.int_val; break;
+    case IR_TYPE_FLOAT: memcpy(&record.a, &value.as.float_val, sizeof(double)); break;
+    case IR_TYPE_BOOL: record.a = value.as.bool_val; break;
     case IR_TYPE_LIST:
-        list = value.as.list_val;
-        if (!list) {
-            bytecode_save_varint(save, -1);
-            break;
-        }
-
-        bytecode_save_varint(save, list->size);
-        for (size_t i = 0; i < list->size; i++) {
-            bytecode_save_value(save, list->items[i]);
-        }
-        break;
     case IR_TYPE_STRING:
-        list = value.as.list_val;
-        bytecode_save_varint(save, list->size);
-        for (size_t i = 0; i < list->size; i++) {
-            IrValue val = list->items[i];
-            if (val.type != IR_TYPE_INT && val.type != IR_TYPE_BYTE) val.as.int_val = '?';
-            bytecode_save_varint(save, *(uint64_t*)&val.as.int_val);
+        if (!value.as.list_val) {
+            record.a = IR_SAVE_NULL_OFFSET;
+            break;
         }
+        record.a = bytecode_save_data_list(data, value.as.list_val, value.type == IR_TYPE_STRING, &flags);
+        record.b = value.as.list_val->size;
+        record.flags = flags;
         break;
     case IR_TYPE_FUNC:
-        assert(value.as.func_val.hint != NULL);
-        bytecode_save_array(save, value.as.func_val.hint, sizeof(char), strlen(value.as.func_val.hint));
+        record.a = bytecode_save_data_string(data, value.as.func_val.hint);
         break;
     case IR_TYPE_LABEL:
-        assert(value.as.label_val.name != NULL);
-        bytecode_save_array(save, value.as.label_val.name, sizeof(char), strlen(value.as.label_val.name));
-        bytecode_save_varint(save, value.as.label_val.pos);
+        record.a = bytecode_save_data_string(data, value.as.label_val.name);
+        record.b = value.as.label_val.pos;
+        break;
+    case IR_TYPE_IMPORT:
+        record.a = bytecode_save_data_string(data, value.as.import_val.module);
+        record.b = bytecode_save_data_string(data, value.as.import_val.label);
         break;
     }
+    return record;
 }
 
-void bytecode_save(IrBytecode* bc, const char* filepath) {
-    FILE* f = fopen(filepath, "wb");
-    if (!f) return;
+static void bytecode_save_section(IrMemArena* save, IrSaveSection* section, IrSaveSectionKind kind, const void* data, size_t size) {
+    bytecode_save_align(save, IR_SAVE_ALIGN);
+    section->kind = kind;
+    section->reserved = 0;
+    section->offset = bytecode_save_pos(save);
+    section->size = size;
+    if (size > 0) bytecode_save_raw(save, data, size);
+}
+
+static void bytecode_save_label_section(IrMemArena* save, IrSaveSection* section, IrSaveSectionKind kind, IrLabelList* labels) {
+    bytecode_save_align(save, IR_SAVE_ALIGN);
+    section->kind = kind;
+    section->reserved = 0;
+    section->offset = bytecode_save_pos(save);
+    section->size = labels->size * sizeof(uint64_t);
+    for (size_t i = 0; i < labels->size; i++) {
+        uint64_t id = labels->items[i];
+        bytecode_save_raw(save, &id, sizeof(id));
+    }
+}
 
+bool bytecode_save_file(IrBytecode* bc, FILE* f) {
     IrMemArena* save = ir_arena_new(GiB(4), KiB(512));
+    IrMemArena* consts = ir_arena_new(GiB(4), KiB(512));
+    IrMemArena* data = ir_arena_new(GiB(4), KiB(512));
+
+    for (size_t i = 0; i < bc->pool->list.size; i++) {
+        IrSaveConst record = bytecode_save_const(data, bc->pool->list.items[i]);
+        bytecode_save_raw(consts, &record, sizeof(record));
+    }
 
     bytecode_save_array(save, IR_SAVE_IDENT, sizeof(char), sizeof(IR_SAVE_IDENT) - 1);
     bytecode_save_varint(save, IR_SAVE_MAX_VERSION);
+    bytecode_save_align(save, IR_SAVE_HEADER_SIZE);
 
-    bytecode_save_varint(save, bc->pool->list.size);
-    for (size_t i = 0; i < bc->pool->list.size; i++) {
-        bytecode_save_const_value(save, bc->pool->list.items[i]);
-    }
+    IrSaveHeader header = {
+        .byte_order = IR_SAVE_BYTE_ORDER,
+        .sections_count = IR_SAVE_SECTION_LAST,
+    };
+    bytecode_save_raw(save, &header, sizeof(header));
+    // Arena memory does not move, so the section table can be filled in while writing sections
+    IrSaveSection* sections = ir_arena_alloc_packed(save, sizeof(IrSaveSection) * IR_SAVE_SECTION_LAST);
+
+    bytecode_save_section(save, &sections[IR_SAVE_SECTION_CONSTS], IR_SAVE_SECTION_CONSTS, consts + 1, bytecode_save_pos(consts));
+    bytecode_save_section(save, &sections[IR_SAVE_SECTION_DATA], IR_SAVE_SECTION_DATA, data + 1, bytecode_save_pos(data));
+    bytecode_save_section(save, &sections[IR_SAVE_SECTION_CODE], IR_SAVE_SECTION_CODE, bc->code.items, bc->code.size);
+    bytecode_save_label_section(save, &sections[IR_SAVE_SECTION_LABELS], IR_SAVE_SECTION_LABELS, &bc->labels);
+    bytecode_save_label_section(save, &sections[IR_SAVE_SECTION_EXPORTS], IR_SAVE_SECTION_EXPORTS, &bc->exports);
+    bytecode_save_section(save, &sections[IR_SAVE_SECTION_DEBUG], IR_SAVE_SECTION_DEBUG, bc->debug.items, bc->debug.size * sizeof(IrDebugEntry));
+
+    size_t save_size = bytecode_save_pos(save);
+    bool ok = fwrite(save + 1, 1, save_size, f) == save_size;
+
+    ir_arena_free(data);
+    ir_arena_free(consts);
+    ir_arena_free(save);
+    return ok;
+}
 
-    bytecode_save_array(save, bc->code.items, sizeof(unsigned char), bc->code.size);
-    bytecode_save_varint_array(save, bc->labels.items, bc->labels.size);
+bool bytecode_save(IrBytecode* bc, const char* filepath) {
+#ifdef _WIN32
+    FILE* f = fopen(filepath, "wb");
+    if (!f) return false;
 
-    fwrite(save + 1, 1, save->pos - IR_ARENA_BASE_POS, f);
+    bool ok = bytecode_save_file(bc, f);
+    if (fclose(f)) ok = false;
+    return ok;
+#else
+    // Running programs keep their bytecode file mapped (See bytecode_load), so the file is replaced
+    // with a new one instead of being overwritten in place
+    size_t path_size = strlen(filepath) + sizeof(".tmp");
+    char* tmp_path = malloc(path_size);
+    snprintf(tmp_path, path_size, "%s.tmp", filepath);
+
+    FILE* f = fopen(tmp_path, "wb");
+    if (!f) {
+        free(tmp_path);
+        return false;
+    }
 
-    ir_arena_free(save);
+    bool ok = bytecode_save_file(bc, f);
+    if (fclose(f)) ok = false;
+    if (ok) ok = !rename(tmp_path, filepath);
+    if (!ok) remove(tmp_path);
 
-    fclose(f);
+    free(tmp_path);
+    return ok;
+#endif
 }
 
 IrFunction ir_func_by_hint(const char* hint) {
@@ -1298,62 +2486,181 @@ IrFunction ir_func_by_ptr(IrRunFunction func) {
     return (IrFunction) { .hint = NULL, .ptr = func };
 }
 
+// Printed bytecode is also the input format of the assembler (See assembler.c), so everything here should be
+// printed in the way it can be read back. Names containing special characters are quoted
+static bool ir_print_is_plain_name(const char* name) {
+    if (!*name) return false;
+    for (const char* str = name; *str; str++) {
+        if ((unsigned char)*str <= ' ' || strchr("<>:;\"\\", *str)) return false;
+    }
+    return true;
+}
+
+static void ir_print_char(int64_t codepoint) {
+    switch (codepoint) {
+    case '"': printf("\\\""); return;
+    case '\\': printf("\\\\"); return;
+    case '\n': printf("\\n"); return;
+    case '\t': printf("\\t"); return;
+    case '\r': printf("\\r"); return;
+    }
+
+    if (codepoint < 0x20 || codepoint == 0x7f || codepoint > 0x10ffff || (codepoint >= 0xd800 && codepoint <= 0xdfff)) {
+        printf("\\u{%llx}", (unsigned long long)codepoint);
+    } else if (codepoint < 0x80) {
+        printf("%c", (int)codepoint);
+    } else if (codepoint < 0x800) {
+        printf("%c%c", (int)(0xc0 | (codepoint >> 6)), (int)(0x80 | (codepoint & 0x3f)));
+    } else if (codepoint < 0x10000) {
+        printf("%c%c%c", (int)(0xe0 | (codepoint >> 12)), (int)(0x80 | ((codepoint >> 6) & 0x3f)), (int)(0x80 | (codepoint & 0x3f)));
+    } else {
+        printf("%c%c%c%c", (int)(0xf0 | (codepoint >> 18)), (int)(0x80 | ((codepoint >> 12) & 0x3f)), (int)(0x80 | ((codepoint >> 6) & 0x3f)), (int)(0x80 | (codepoint & 0x3f)));
+    }
+}
+
+static void ir_print_name(const char* name) {
+    if (ir_print_is_plain_name(name)) {
+        printf("%s", name);
+        return;
+    }
+
+    printf("\"");
+    for (const char* str = name; *str; str++) {
+        unsigned char ch = *str;
+        // Bytes of UTF-8 sequences are printed as is
+        if (ch >= 0x80) {
+            printf("%c", ch);
+        } else {
+            ir_print_char(ch);
+        }
+    }
+    printf("\"");
+}
+
+static void ir_print_float(double value) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.17g", value);
+    // Floats should not be confused with ints when read back
+    printf("%s%s", buf, strpbrk(buf, ".eEin") ? "" : ".0");
+}
+
+static void ir_print_string(IrList* list) {
+    printf("\"");
+    for (size_t i = 0; list && i < list->size; i++) ir_print_char(ir_string_get(list, i));
+    printf("\"");
+}
+
+static void ir_print_list(IrList* list) {
+    printf("[");
+    for (size_t i = 0; list && i < list->size; i++) {
+        if (i > 0) printf(", ");
+
+        IrValue val = list->items[i];
+        switch (val.type) {
+        case IR_TYPE_NOTHING: printf("nothing"); break;
+        case IR_TYPE_BYTE: printf("byte(%d)", val.as.byte_val); break;
+        case IR_TYPE_INT: printf("%lld", (long long)val.as.int_val); break;
+        case IR_TYPE_FLOAT: ir_print_float(val.as.float_val); break;
+        case IR_TYPE_BOOL: printf("%s", val.as.bool_val ? "true" : "false"); break;
+        case IR_TYPE_STRING: ir_print_string(val.as.list_val); break;
+        case IR_TYPE_LIST: ir_print_list(val.as.list_val); break;
+        default: printf("inval"); break;
+        }
+    }
+    printf("]");
+}
+
+static void ir_print_label(IrLabel* label) {
+    printf("<");
+    ir_print_name(label->name);
+    printf(">\n");
+}
+
+static void ir_print_func(const char* op_name, IrFunction func) {
+    if (func.hint) {
+        printf("%s ", op_name);
+        ir_print_name(func.hint);
+        if (func.ptr) printf(" ; %p", func.ptr);
+        printf("\n");
+    } else if (func.ptr) {
+        printf("%s inval ; %p\n", op_name, func.ptr);
+    } else {
+        printf("%s inval\n", op_name);
+    }
+}
+
 #define GET_LABEL(idx) (pool_list.items[bc->labels.items[(idx)]].as.label_val)
+bool ir_op_has_immediate(IrOpcode op) {
+    switch (op) {
+    case IR_PUSHI:
+    case IR_PUSHF:
+    case IR_PUSHB:
+    case IR_PUSHL:
+    case IR_PUSHA:
+    case IR_PUSHLB:
+    case IR_PUSHFN:
+    case IR_POPC:
+    case IR_LOAD:
+    case IR_STORE:
+    case IR_GLOAD:
+    case IR_GSTORE:
+    case IR_JMP:
+    case IR_IF:
+    case IR_IFNOT:
+    case IR_CALL:
+    case IR_RUN:
+    case IR_CALLX:
+        return true;
+    default:
+        return false;
+    }
+}
+
 void bytecode_print(IrBytecode* bc) {
     size_t i         = 0,
            label_num = 0,
            op_count  = 0;
-    IrFunction func;
+    IrConstValue* value;
 
     IrConstValueList pool_list = bc->pool->list;
 
     printf("; === Bytecode %s ===\n", bc->name ? bc->name : "*Unnamed*");
-    while (i < bc->code.size) {
+    for (size_t j = 0; j < bc->exports.size; j++) {
+        printf(".export ");
+        ir_print_name(pool_list.items[bc->exports.items[j]].as.label_val.name);
+        printf("\n");
+    }
+
+    // Labels at the end of the code are printed too, as jumps can point there
+    while (i <= bc->code.size) {
         if (label_num < bc->labels.size) {
             while (label_num < bc->labels.size && GET_LABEL(label_num).pos < i) label_num++;
             while (label_num < bc->labels.size && GET_LABEL(label_num).pos == i) {
-                printf("%s:\n", GET_LABEL(label_num).name);
+                ir_print_name(GET_LABEL(label_num).name);
+                printf(":\n");
                 label_num++;
             }
         }
+        if (i == bc->code.size) break;
 
         printf("    ");
 
-        IrList* list;
-
-        static_assert(IR_LAST == 82, "Exhaustive opcode in exec_run_bytecode");
+        static_assert(IR_LAST == 83, "Exhaustive opcode in exec_run_bytecode");
         switch (bc->code.items[i]) {
         case IR_PUSHL:
-            CHECK_IMMEDIATE;
-            list = pool_list.items[CODE_IMMEDIATE].as.list_val;
-            if (list) {
-                printf("pushl (%p, %zu/%zu)\n", list, list->size, list->capacity);
-            } else {
-                printf("pushl\n");
-            }
-            i += 3;
-            break;
         case IR_PUSHA:
             CHECK_IMMEDIATE;
-            list = pool_list.items[CODE_IMMEDIATE].as.list_val;
-            if (list) {
-                printf("pusha (%p, %zu/%zu) \"", list, list->size, list->capacity);
-                for (size_t j = 0; j < list->size; j++) {
-                    if (j > 30) {
-                        printf("...");
-                        break;
-                    }
-                    IrValue c = list->items[j];
-                    switch (c.type) {
-                    case IR_TYPE_INT: printf("%lc", c.as.int_val); break;
-                    case IR_TYPE_BYTE: printf("%c", c.as.byte_val); break;
-                    default: printf("?"); break;
-                    }
+            value = &pool_list.items[CODE_IMMEDIATE];
+            printf("%s", bc->code.items[i] == IR_PUSHL ? "pushl" : "pusha");
+            if (value->as.list_val) {
+                printf(" ");
+                if (value->type == IR_TYPE_STRING) {
+                    ir_print_string(value->as.list_val);
+                } else {
+                    ir_print_list(value->as.list_val);
                 }
-                printf("\"\n");
-            } else {
-                printf("pusha\n");
             }
+            printf("\n");
             i += 3;
             break;
         case IR_ILLEGAL: printf("inval\n"); break;
@@ -1423,12 +2730,14 @@ void bytecode_print(IrBytecode* bc) {
         case IR_DYNRUN: printf("dynrun\n"); break;
         case IR_PUSHI:
             CHECK_IMMEDIATE;
-            printf("pushi %ld\n", pool_list.items[CODE_IMMEDIATE].as.int_val);
+            printf("pushi %lld\n", (long long)pool_list.items[CODE_IMMEDIATE].as.int_val);
             i += 3;
             break;
         case IR_PUSHF:
             CHECK_IMMEDIATE;
-            printf("pushf %g\n", pool_list.items[CODE_IMMEDIATE].as.float_val);
+            printf("pushf ");
+            ir_print_float(pool_list.items[CODE_IMMEDIATE].as.float_val);
+            printf("\n");
             i += 3;
             break;
         case IR_PUSHB:
@@ -1438,88 +2747,76 @@ void bytecode_print(IrBytecode* bc) {
             break;
         case IR_PUSHLB:
             CHECK_IMMEDIATE;
-            printf("pushlb <%s>\n", pool_list.items[CODE_IMMEDIATE].as.label_val.name);
+            printf("pushlb ");
+            ir_print_label(&pool_list.items[CODE_IMMEDIATE].as.label_val);
             i += 3;
             break;
         case IR_PUSHFN:
             CHECK_IMMEDIATE;
-            func = pool_list.items[CODE_IMMEDIATE].as.func_val;
-            if (func.ptr) {
-                if (func.hint) {
-                    printf("pushfn \"%s\" (%p)\n", func.hint, func.ptr);
-                } else {
-                    printf("pushfn (%p)\n", func.ptr);
-                }
-            } else {
-                if (func.hint) {
-                    printf("pushfn \"%s\"\n", func.hint);
-                } else {
-                    printf("pushfn inval\n");
-                }
-            }
+            ir_print_func("pushfn", pool_list.items[CODE_IMMEDIATE].as.func_val);
             i += 3;
             break;
         case IR_POPC:
             CHECK_IMMEDIATE;
-            printf("popc %ld\n", pool_list.items[CODE_IMMEDIATE].as.int_val);
+            printf("popc %lld\n", (long long)pool_list.items[CODE_IMMEDIATE].as.int_val);
             i += 3;
             break;
         case IR_LOAD:
             CHECK_IMMEDIATE;
-            printf("load %ld\n", pool_list.items[CODE_IMMEDIATE].as.int_val);
+            printf("load %lld\n", (long long)pool_list.items[CODE_IMMEDIATE].as.int_val);
             i += 3;
             break;
         case IR_STORE:
             CHECK_IMMEDIATE;
-            printf("store %ld\n", pool_list.items[CODE_IMMEDIATE].as.int_val);
+            printf("store %lld\n", (long long)pool_list.items[CODE_IMMEDIATE].as.int_val);
             i += 3;
             break;
         case IR_GLOAD:
             CHECK_IMMEDIATE;
-            printf("gload %ld\n", pool_list.items[CODE_IMMEDIATE].as.int_val);
+            printf("gload %lld\n", (long long)pool_list.items[CODE_IMMEDIATE].as.int_val);
             i += 3;
             break;
         case IR_GSTORE:
             CHECK_IMMEDIATE;
-            printf("gstore %ld\n", pool_list.items[CODE_IMMEDIATE].as.int_val);
+            printf("gstore %lld\n", (long long)pool_list.items[CODE_IMMEDIATE].as.int_val);
             i += 3;
             break;
         case IR_JMP:
             CHECK_IMMEDIATE;
-            printf("jmp <%s>\n", pool_list.items[CODE_IMMEDIATE].as.label_val.name);
+            printf("jmp ");
+            ir_print_label(&pool_list.items[CODE_IMMEDIATE].as.label_val);
             i += 3;
             break;
         case IR_IF:
             CHECK_IMMEDIATE;
-            printf("if <%s>\n", pool_list.items[CODE_IMMEDIATE].as.label_val.name);
+            printf("if ");
+            ir_print_label(&pool_list.items[CODE_IMMEDIATE].as.label_val);
             i += 3;
             break;
         case IR_IFNOT:
             CHECK_IMMEDIATE;
-            printf("ifnot <%s>\n", pool_list.items[CODE_IMMEDIATE].as.label_val.name);
+            printf("ifnot ");
+            ir_print_label(&pool_list.items[CODE_IMMEDIATE].as.label_val);
             i += 3;
             break;
         case IR_CALL:
             CHECK_IMMEDIATE;
-            printf("call <%s>\n", pool_list.items[CODE_IMMEDIATE].as.label_val.name);
+            printf("call ");
+            ir_print_label(&pool_list.items[CODE_IMMEDIATE].as.label_val);
+            i += 3;
+            break;
+        case IR_CALLX:
+            CHECK_IMMEDIATE;
+            printf("callx <");
+            ir_print_name(pool_list.items[CODE_IMMEDIATE].as.import_val.module);
+            printf(":");
+            ir_print_name(pool_list.items[CODE_IMMEDIATE].as.import_val.label);
+            printf(">\n");
             i += 3;
             break;
         case IR_RUN:
             CHECK_IMMEDIATE;
-            func = pool_list.items[CODE_IMMEDIATE].as.func_val;
-            if (func.ptr) {
-                if (func.hint) {
-                    printf("run \"%s\" (%p)\n", func.hint, func.ptr);
-                } else {
-                    printf("run (%p)\n", func.ptr);
-                }
-            } else {
-                if (func.hint) {
-                    printf("run \"%s\"\n", func.hint);
-                } else {
-                    printf("run inval\n");
-                }
-            }
+            ir_print_func("run", pool_list.items[CODE_IMMEDIATE].as.func_val);
             i += 3;
             break;
         default: printf("unknown\n"); break;
@@ -1544,13 +2841,205 @@ static void* exec_heap_malloc(IrHeap* heap, size_t size) {
     return ptr;
 }
 
-static bool exec_heap_copy_chunk(IrExec* exec, void** ref_data) {
+static inline bool exec_heap_contains(IrHeap* heap, void* ptr) {
+    return (unsigned char*)ptr >= (unsigned char*)heap->mem + IR_ARENA_BASE_POS &&
+           (unsigned char*)ptr < (unsigned char*)heap->mem + heap->mem->pos;
+}
+
+static void exec_heap_clear(IrHeap* heap) {
+    ir_arena_clear(heap->mem);
+    heap->chunks_count = 0;
+}
+
+static bool exec_heap_is_young(IrExec* exec, void* ptr) {
+    return exec_heap_contains(&exec->nursery, ptr) ||
+           exec_heap_contains(&exec->survivors, ptr) ||
+           exec_heap_contains(&exec->second_survivors, ptr);
+}
+
+// Amount of memory the old generation should keep free, so that every young chunk can be promoted into it
+static size_t exec_young_capacity(IrExec* exec) {
+    return (exec->nursery.mem_max - IR_ARENA_BASE_POS) + (exec->survivors.mem_max - IR_ARENA_BASE_POS);
+}
+
+// Heap and large object space share the reserved memory of the heap. Their limits are kept below it by the size of
+// the young generation, so that full collection can always move young chunks into the old generation
+static size_t exec_heap_max_size(IrExec* exec) {
+    return exec->heap.mem->reserve_size - exec_young_capacity(exec) - exec->large.mem_size;
+}
+
+static size_t exec_large_max_size(IrExec* exec) {
+    return exec->heap.mem->reserve_size - (exec->heap.mem->pos - IR_ARENA_BASE_POS) - exec_young_capacity(exec);
+}
+
+// Raises memory limit by the growth factor, capped at max_size
+static size_t exec_grow_limit(IrExec* exec, size_t limit, size_t max_size) {
+    double new_limit = limit * exec->gc_growth;
+    if (new_limit >= max_size) return max_size;
+    return MAX((size_t)new_limit, limit + 1);
+}
+
+// Raises memory limits after full collection, so that live data takes at most gc_live_ratio of them.
+// Otherwise heaps mostly filled with live data would be collected again as soon as they get a little bigger
+static void exec_fit_live_size(IrExec* exec) {
+    size_t heap_live = exec->heap.mem->pos - IR_ARENA_BASE_POS;
+    size_t heap_target = IR_ARENA_BASE_POS + (size_t)(heap_live / exec->gc_live_ratio);
+    exec->heap.mem_max = MAX(exec->heap.mem_max, MIN(heap_target, exec_heap_max_size(exec)));
+
+    size_t large_target = exec->large.mem_size / exec->gc_live_ratio;
+    exec->large.mem_max = MAX(exec->large.mem_max, MIN(large_target, exec_large_max_size(exec)));
+}
+
+static IrHeapChunk* exec_large_chunk(IrMemArena* arena) {
+    return (IrHeapChunk*)((unsigned char*)arena + IR_ARENA_BASE_POS);
+}
+
+// Returns the arena of large chunk containing ptr, or NULL if ptr is not in the large object space
+static IrMemArena* exec_large_find(IrLargeObjects* large, void* ptr) {
+    size_t low = 0, high = large->size;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if ((unsigned char*)large->items[mid] + large->items[mid]->pos <= (unsigned char*)ptr) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == large->size || (unsigned char*)ptr < (unsigned char*)exec_large_chunk(large->items[low])) return NULL;
+    return large->items[low];
+}
+
+static void exec_large_mark(IrLargeObjects* large, void* ptr) {
+    IrMemArena* arena = exec_large_find(large, ptr);
+    if (!arena) return;
+    // Parallel collection can mark the same chunk from multiple threads
+    IrHeapChunk* chunk = exec_large_chunk(arena);
+    __atomic_store_n(&chunk->copy_ptr, chunk, __ATOMIC_RELAXED);
+}
+
+// Takes the smallest cached arena which fits chunk_size, or returns NULL if there is none
+static IrMemArena* exec_large_reuse(IrLargeObjects* large, size_t chunk_size) {
+    size_t best = large->cache.size;
+    for (size_t i = 0; i < large->cache.size; i++) {
+        if (large->cache.items[i]->reserve_size < IR_ARENA_BASE_POS + chunk_size) continue;
+        if (best == large->cache.size || large->cache.items[i]->reserve_size < large->cache.items[best]->reserve_size) best = i;
+    }
+    if (best == large->cache.size) return NULL;
+
+    IrMemArena* arena = large->cache.items[best];
+    large->cache.items[best] = large->cache.items[--large->cache.size];
+    large->cache_size -= arena->commit_pos;
+    ir_arena_clear(arena);
+    return arena;
+}
+
+// Allocates large chunk in its own arena, which reserves twice as much memory so that growing lists can be extended
+// in place at least once. Memory limit is checked by the caller
+static IrHeapChunk* exec_large_malloc(IrExec* exec, size_t chunk_size) {
+    IrLargeObjects* large = &exec->large;
+    IrMemArena* arena = exec_large_reuse(large, chunk_size);
+    if (!arena) {
+        arena = ir_arena_new(IR_ARENA_BASE_POS + chunk_size * 2, IR_ARENA_BASE_POS + chunk_size);
+        if (!arena) return NULL;
+        if (exec->heap.mem->huge_pages) ir_arena_set_huge_pages(arena, true);
+    }
+    IrHeapChunk* chunk = ir_arena_alloc(arena, chunk_size);
+    if (!chunk) {
+        ir_arena_free(arena);
+        return NULL;
+    }
+
+    ir_list_append(*large, arena);
+    size_t i = large->size - 1;
+    for (; i > 0 && large->items[i - 1] > arena; i--) large->items[i] = large->items[i - 1];
+    large->items[i] = arena;
+    large->mem_size += chunk_size;
+    return chunk;
+}
+
+static bool exec_large_extend(IrExec* exec, IrHeapChunk* chunk, size_t new_size) {
+    IrLargeObjects* large = &exec->large;
+    IrMemArena* arena = exec_large_find(large, chunk);
+    if (!arena || large->mem_size - chunk->size + new_size > large->mem_max) return false;
+    if (!ir_arena_extend(arena, chunk->data, chunk->size, new_size)) return false;
+    large->mem_size = large->mem_size - chunk->size + new_size;
+    chunk->size = new_size;
+    return true;
+}
+
+// Keeps arena of dead chunk in the cache if there is space left, otherwise frees it
+static void exec_large_release(IrLargeObjects* large, IrMemArena* arena) {
+    large->mem_size -= sizeof(IrHeapChunk) + exec_large_chunk(arena)->size;
+    if (large->cache_size + arena->commit_pos > IR_LARGE_OBJECT_CACHE_SIZE) {
+        ir_arena_free(arena);
+        return;
+    }
+    ir_list_append(large->cache, arena);
+    large->cache_size += arena->commit_pos;
+}
+
+static void exec_large_free(IrExec* exec, IrMemArena* arena) {
+    IrLargeObjects* large = &exec->large;
+    size_t i = 0;
+    while (large->items[i] != arena) i++;
+    memmove(large->items + i, large->items + i + 1, (large->size - i - 1) * sizeof(*large->items));
+    large->size--;
+    exec_large_release(large, arena);
+}
+
+// Frees large chunks which were not marked by full collection and clears the marks of the rest.
+// Returns the number of bytes freed
+static size_t exec_large_sweep(IrExec* exec) {
+    IrLargeObjects* large = &exec->large;
+    size_t old_size = large->mem_size;
+    size_t kept = 0;
+    for (size_t i = 0; i < large->size; i++) {
+        IrMemArena* arena = large->items[i];
+        IrHeapChunk* chunk = exec_large_chunk(arena);
+        if (chunk->copy_ptr) {
+            chunk->copy_ptr = NULL;
+            large->items[kept++] = arena;
+        } else {
+            exec_large_release(large, arena);
+        }
+    }
+    large->size = kept;
+    return old_size - large->mem_size;
+}
+
+typedef enum {
+    IR_COLLECT_FULL,
+    IR_COLLECT_MINOR,
+    // Step of incremental full collection. Only old chunks are copied and nothing the program can see is modified,
+    // so references to young chunks and references from roots are left as they are
+    IR_COLLECT_INCREMENTAL,
+} IrCollectMode;
+
+static IrChunkKind exec_value_chunk_kind(IrValue* value) {
+    return value->type == IR_TYPE_LIST ? IR_CHUNK_LIST : IR_CHUNK_STRING;
+}
+
+// Moves the chunk referenced by ref_data out of the collected space and updates the reference.
+// Full collections move chunks of every space into second_heap. Minor collections only move young chunks:
+// the ones from nursery go to second_survivors and the ones from survivors get promoted to heap.
+// Large chunks are only marked by full collections, as they stay where they are.
+// kind is recorded in the copy, so that it can be scanned later without knowing what referenced it.
+// Returns true if the chunk was moved just now
+static bool exec_heap_copy_chunk(IrExec* exec, void** ref_data, IrCollectMode mode, IrChunkKind kind) {
     if (*ref_data == NULL) return false;
 
     IrHeapChunk* chunk = (*(IrHeapChunk**)ref_data) - 1;
-    if ((void*)chunk < (void*)exec->heap.mem ||
-        (void*)chunk >= (void*)exec->heap.mem + exec->heap.mem->pos)
-    {
+    IrHeap* dest;
+    if (exec_heap_contains(&exec->nursery, chunk)) {
+        if (mode == IR_COLLECT_INCREMENTAL) return false;
+        dest = mode == IR_COLLECT_MINOR ? &exec->second_survivors : &exec->second_heap;
+    } else if (exec_heap_contains(&exec->survivors, chunk)) {
+        if (mode == IR_COLLECT_INCREMENTAL) return false;
+        dest = mode == IR_COLLECT_MINOR ? &exec->heap : &exec->second_heap;
+    } else if (mode != IR_COLLECT_MINOR && exec_heap_contains(&exec->heap, chunk)) {
+        dest = &exec->second_heap;
+    } else {
+        if (mode != IR_COLLECT_MINOR && exec->large.size > 0) exec_large_mark(&exec->large, chunk);
         return false;
     }
 
@@ -1559,249 +3048,1849 @@ static bool exec_heap_copy_chunk(IrExec* exec, void** ref_data) {
         return false;
     }
 
-    IrHeapChunk* new_chunk = exec_heap_malloc(&exec->second_heap, sizeof(IrHeapChunk) + chunk->size);
+    IrHeapChunk* new_chunk = exec_heap_malloc(dest, sizeof(IrHeapChunk) + chunk->size);
+    // Survivor space has the same size as the nursery, but promote the chunk anyway in case it does not fit
+    if (!new_chunk && dest == &exec->second_survivors) new_chunk = exec_heap_malloc(&exec->heap, sizeof(IrHeapChunk) + chunk->size);
     if (!new_chunk) return false;
 
     memcpy(new_chunk, chunk, sizeof(IrHeapChunk) + chunk->size);
     new_chunk->copy_ptr = NULL;
+    new_chunk->kind = kind;
 
     chunk->copy_ptr = new_chunk->data;
     *ref_data = (void*)new_chunk->data;
     return true;
 }
 
-static void exec_heap_copy_value(IrExec* exec, IrValue* value) {
-    switch (value->type) {
-    case IR_TYPE_STRING: ;
-        if (!exec_heap_copy_chunk(exec, (void**)&value->as.list_val)) break;
-        if (!exec_heap_copy_chunk(exec, (void**)&value->as.list_val->items)) break;
-        break;
-    case IR_TYPE_LIST: ;
-        if (!exec_heap_copy_chunk(exec, (void**)&value->as.list_val)) break;
+// Copies list referenced by value without looking into it, its contents are copied later when the copy is scanned.
+// Returns true if value references young chunk after being copied
+static bool exec_heap_copy_value(IrExec* exec, IrValue* value, IrCollectMode mode) {
+    if (value->type != IR_TYPE_STRING && value->type != IR_TYPE_LIST) return false;
 
-        if (!exec_heap_copy_chunk(exec, (void**)&value->as.list_val->items)) break;
-        for (size_t i = 0; i < value->as.list_val->size; i++) {
-            exec_heap_copy_value(exec, &value->as.list_val->items[i]);
-        }
-        break;
-    default:
-        break;
+    if (exec_heap_copy_chunk(exec, (void**)&value->as.list_val, mode, exec_value_chunk_kind(value)) && exec->gc_items_with_list) {
+        exec_heap_copy_chunk(exec, (void**)&value->as.list_val->items, mode, IR_CHUNK_DATA);
     }
+    return mode == IR_COLLECT_MINOR && exec_heap_is_young(exec, value->as.list_val);
 }
 
-void exec_collect(IrExec* exec) {
-    ir_arena_clear(exec->second_heap.mem);
-    exec->second_heap.chunks_count = 0;
-    exec->second_heap.mem_max = exec->heap.mem_max;
+// Copies items of the list and lists referenced by its values, if the list is not a string.
+// Returns true if the list still references young chunks afterwards
+static bool exec_heap_scan_list(IrExec* exec, IrList* list, bool is_list, IrCollectMode mode) {
+    if (!list->items) return false;
+
+    exec_heap_copy_chunk(exec, (void**)&list->items, mode, IR_CHUNK_DATA);
+    bool references_young = mode == IR_COLLECT_MINOR && exec_heap_is_young(exec, list->items);
+    if (!is_list) return references_young;
+
+    for (size_t i = 0; i < list->size; i++) {
+        if (exec_heap_copy_value(exec, &list->items[i], mode)) references_young = true;
+    }
+    return references_young;
+}
+
+// Scans chunks copied into heap since *scan_pos and moves *scan_pos to the end of the heap. Scanning copies more
+// chunks to the end of the heap, so this is repeated until nothing new gets copied. This way the heap is traversed
+// in breadth first order, without recursion. Returns true if any chunk was scanned
+static bool exec_heap_scan(IrExec* exec, IrHeap* heap, size_t* scan_pos, IrCollectMode mode) {
+    bool scanned = false;
+    // Chunks start at aligned positions, while end of the heap is not aligned after allocating string characters
+    while ((*scan_pos = IR_ALIGN_UP_POW2(*scan_pos, IR_ARENA_ALIGN)) < heap->mem->pos) {
+        IrHeapChunk* chunk = (IrHeapChunk*)((unsigned char*)heap->mem + *scan_pos);
+        *scan_pos = IR_ALIGN_UP_POW2(*scan_pos + sizeof(IrHeapChunk) + chunk->size, IR_ARENA_ALIGN);
+        scanned = true;
+        if (chunk->kind != IR_CHUNK_LIST && chunk->kind != IR_CHUNK_STRING) continue;
+
+        // Items are traced even if they were not moved, because old items of a young list are not remembered
+        IrList* list = (IrList*)chunk->data;
+        if (exec_heap_scan_list(exec, list, chunk->kind == IR_CHUNK_LIST, mode) && heap == &exec->heap) {
+            list->remembered = true;
+            ir_list_append(exec->remembered, list);
+        }
+    }
+    return scanned;
+}
 
+static void exec_heap_copy_roots(IrExec* exec, IrCollectMode mode) {
     // Copy stack values
     for (size_t i = 0; i < exec->stack.size; i++) {
-        exec_heap_copy_value(exec, &exec->stack.items[i]);
+        exec_heap_copy_value(exec, &exec->stack.items[i], mode);
     }
 
     // Copy variable values
     for (size_t i = 0; i < exec->variables.size; i++) {
         IrValueList* frame = &exec->variables.items[i];
         for (size_t j = 0; j < frame->size; j++) {
-            exec_heap_copy_value(exec, &frame->items[j]);
+            exec_heap_copy_value(exec, &frame->items[j], mode);
         }
     }
 
+    // Globals live outside of the heap, so they are scanned on every collection instead of going through write barrier
     for (size_t i = 0; i < exec->globals.size; i++) {
-        exec_heap_copy_value(exec, &exec->globals.items[i]);
+        exec_heap_copy_value(exec, &exec->globals.items[i], mode);
     }
+}
 
-    size_t memory_freed = exec->heap.mem->pos - exec->second_heap.mem->pos;
-    size_t chunks_deleted = exec->heap.chunks_count - exec->second_heap.chunks_count;
+// Incremental collection copies old lists while the program keeps using the originals, so it has to know about
+// every change made to a list after it was copied, even if no references were stored into it
+static void exec_log_write(IrExec* exec, IrList* list) {
+    if (!exec->incremental.active || list->written || !exec_heap_contains(&exec->heap, list)) return;
+    if (!((IrHeapChunk*)list - 1)->copy_ptr) return;
+    list->written = true;
+    ir_list_append(exec->incremental.written, list);
+}
 
-    IrHeap temp_heap = exec->heap;
-    exec->heap = exec->second_heap;
-    exec->second_heap = temp_heap;
+// Repeats write of size bytes at offset of data chunk in its copy, if incremental collection has already copied it
+static void exec_heap_sync_data(IrExec* exec, void* data, size_t offset, size_t size) {
+    if (size == 0 || !exec->incremental.active) return;
+    IrHeapChunk* chunk = (IrHeapChunk*)data - 1;
+    if (!exec_heap_contains(&exec->heap, chunk) || !chunk->copy_ptr) return;
+    memcpy((unsigned char*)chunk->copy_ptr + offset, (unsigned char*)data + offset, size);
+}
 
-#ifdef DEBUG
-    printf("exec_collect: %zu bytes freed, %zu chunks deleted\n", memory_freed, chunks_deleted);
-#endif
+void exec_write_barrier(IrExec* exec, IrList* list) {
+    exec_log_write(exec, list);
+    if (list->remembered || !exec_heap_contains(&exec->heap, list)) return;
+    list->remembered = true;
+    ir_list_append(exec->remembered, list);
 }
 
-void* exec_malloc(IrExec* exec, size_t size) {
-    if (size == 0) return NULL;
+// Copies old list referenced by value during incremental collection. Only the copy in second_heap is updated,
+// lists still need to be traced are pushed to the gray stack
+static void exec_heap_shade_value(IrExec* exec, IrValue* value) {
+    if (value->type != IR_TYPE_STRING && value->type != IR_TYPE_LIST) return;
+    if (!exec_heap_copy_chunk(exec, (void**)&value->as.list_val, IR_COLLECT_INCREMENTAL, exec_value_chunk_kind(value))) return;
+
+    IrList* list = value->as.list_val;
+    list->remembered = false;
+    list->written = false;
+    if (!list->items) return;
+
+    exec_heap_copy_chunk(exec, (void**)&list->items, IR_COLLECT_INCREMENTAL, IR_CHUNK_DATA);
+    if (value->type != IR_TYPE_LIST) return;
+    if (exec_large_find(&exec->large, list->items)) {
+        ir_list_append(exec->incremental.large, list);
+    } else if (!exec_heap_contains(&exec->second_heap, list->items)) {
+        // Young items are going to be moved by minor collections, so they can only be traced when the collection finishes.
+        // The original list references young chunk, so it is remembered and gets traced there anyway
+        return;
+    }
 
-    const size_t chunk_size = sizeof(IrHeapChunk) + size;
-    IrHeapChunk* chunk = exec_heap_malloc(&exec->heap, chunk_size);
-    if (chunk == NULL) {
-        exec_collect(exec);
+    IrGrayList gray = { .list = list, .pos = 0 };
+    ir_list_append(exec->incremental.gray, gray);
+}
 
-        chunk = exec_heap_malloc(&exec->heap, chunk_size);
-        if (chunk == NULL) {
-            while (exec->heap.mem->pos + chunk_size > exec->heap.mem_max && exec->heap.mem_max < exec->heap.mem->reserve_size) {
-                exec->heap.mem_max = MIN(exec->heap.mem_max * 2, exec->heap.mem->reserve_size);
-            }
-#ifdef DEBUG
-            printf("exec_malloc: raising memory limit to %zu bytes\n", exec->heap.mem_max);
-#endif
-            chunk = exec_heap_malloc(&exec->heap, chunk_size);
+// Traces values of copied list from begin to end. Large items are shared by the copy and the original list,
+// which the program is still using, so their values are only updated when the collection finishes
+static void exec_heap_shade_items(IrExec* exec, IrList* list, size_t begin, size_t end) {
+    if (!exec_large_find(&exec->large, list->items)) {
+        for (size_t i = begin; i < end; i++) exec_heap_shade_value(exec, &list->items[i]);
+        return;
+    }
 
-            if (chunk == NULL) {
-                exec_set_error(exec, "Heap out of memory. Tried to allocate %zu bytes but only %zu bytes were free", chunk_size, exec->heap.mem->reserve_size - exec->heap.mem->pos);
-                return NULL;
-            }
-        }
+    for (size_t i = begin; i < end; i++) {
+        IrValue value = list->items[i];
+        exec_heap_shade_value(exec, &value);
     }
+}
 
-    chunk->copy_ptr = NULL;
-    chunk->size = size;
-    return chunk->data;
+// Brings copy of the list up to date with the original before finishing incremental collection
+static void exec_heap_resync_list(IrExec* exec, IrList* list) {
+    IrHeapChunk* chunk = (IrHeapChunk*)list - 1;
+    // Lists which were not copied yet will be copied with their current contents if they are still reachable
+    if (!chunk->copy_ptr) return;
+
+    IrList* copy = chunk->copy_ptr;
+    *copy = *list;
+    if (exec_heap_contains(&exec->heap, list->items)) {
+        IrHeapChunk* items_chunk = (IrHeapChunk*)list->items - 1;
+        if (items_chunk->copy_ptr) {
+            memcpy(items_chunk->copy_ptr, list->items, items_chunk->size);
+            copy->items = items_chunk->copy_ptr;
+        }
+    }
+    exec_heap_scan_list(exec, copy, chunk->kind == IR_CHUNK_LIST, IR_COLLECT_FULL);
 }
 
-void* exec_realloc(IrExec* exec, void* ptr, size_t new_size) {
-    if (!ptr) return exec_malloc(exec, new_size);
-    if (new_size == 0) return NULL;
+// Parallel collection splits full collection between several threads. Every worker claims roots in blocks, copies
+// chunks into its own allocation buffer taken from second_heap and keeps lists whose values still need to be traced
+// in its own deque, which other workers steal from when they run out of work. Chunks are claimed by installing
+// copy_ptr with compare and swap, so that every chunk is copied exactly once
 
-    IrHeapChunk* old_chunk = (IrHeapChunk*)ptr - 1;
+// Parallel collection is only worth starting threads for when this much memory is used
+#define IR_PARALLEL_GC_MIN_SIZE (4 * 1024 * 1024)
+// Size of allocation buffers workers take from second_heap
+#define IR_PARALLEL_GC_TLAB_SIZE (64 * 1024)
+// Number of roots each worker claims at once
+#define IR_PARALLEL_GC_ROOTS_BLOCK 64
+// Number of values in one work item, longer lists are split into multiple items so that workers can share them
+#define IR_PARALLEL_GC_SPLIT 512
 
-    const size_t new_chunk_size = sizeof(IrHeapChunk) + new_size;
-    IrHeapChunk* new_chunk = exec_heap_malloc(&exec->heap, new_chunk_size);
-    if (new_chunk == NULL) {
-        // Avoid losing ptr value by copying chunk contents into temporary block
-        IrHeapChunk* new_old_chunk = malloc(sizeof(IrHeapChunk) + old_chunk->size);
-        memcpy(new_old_chunk, old_chunk, sizeof(IrHeapChunk) + old_chunk->size);
-        old_chunk = new_old_chunk;
+typedef struct {
+    IrList* list; // Copy of the list in second_heap
+    size_t begin, end;
+} IrGcWork;
 
-        exec_collect(exec);
+typedef struct {
+    IrGcWork* items;
+    size_t size, capacity;
+    size_t top; // Owner pushes and pops items at the end, while other workers steal them from top
+    pthread_mutex_t lock;
+} IrGcDeque;
 
-        new_chunk = exec_heap_malloc(&exec->heap, new_chunk_size);
-        if (new_chunk == NULL) {
-            while (exec->heap.mem->pos + new_chunk_size > exec->heap.mem_max && exec->heap.mem_max < exec->heap.mem->reserve_size) {
-                exec->heap.mem_max = MIN(exec->heap.mem_max * 2, exec->heap.mem->reserve_size);
-            }
-#ifdef DEBUG
-            printf("exec_realloc: raising memory limit to %zu bytes\n", exec->heap.mem_max);
-#endif
-            new_chunk = exec_heap_malloc(&exec->heap, new_chunk_size);
+typedef struct IrGcCollection IrGcCollection;
 
-            if (new_chunk == NULL) {
-                exec_set_error(exec, "Heap out of memory. Tried to allocate %zu bytes but only %zu bytes were free", new_chunk_size, exec->heap.mem_max - exec->heap.mem->pos);
-                free(new_old_chunk);
-                return NULL;
-            }
+typedef struct {
+    IrGcCollection* gc;
+    IrGcDeque deque;
+    unsigned char* tlab;
+    size_t tlab_left;
+    size_t chunks_count;
+    size_t index;
+    pthread_t thread;
+} IrGcWorker;
+
+struct IrGcCollection {
+    IrExec* exec;
+    IrGcWorker* workers;
+    size_t workers_count;
+    IrValue** roots;
+    size_t roots_count;
+    size_t next_root; // Accessed atomically
+    int active_workers; // Accessed atomically. Collection is done once every worker is out of work
+    pthread_mutex_t heap_lock; // Protects second_heap from concurrent allocations
+};
+
+static void exec_gc_deque_push(IrGcDeque* deque, IrGcWork work) {
+    pthread_mutex_lock(&deque->lock);
+    ir_list_append(*deque, work);
+    pthread_mutex_unlock(&deque->lock);
+}
+
+static bool exec_gc_deque_pop(IrGcDeque* deque, IrGcWork* work, bool steal) {
+    pthread_mutex_lock(&deque->lock);
+    bool found = deque->top < deque->size;
+    if (found) *work = steal ? deque->items[deque->top++] : deque->items[--deque->size];
+    if (deque->top == deque->size) deque->top = deque->size = 0;
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+// Fills the rest of allocation buffer with an empty chunk, so that the heap can still be walked chunk by chunk
+static void exec_gc_worker_retire_tlab(IrGcWorker* worker) {
+    if (worker->tlab_left > 0) {
+        IrHeapChunk* filler = (IrHeapChunk*)worker->tlab;
+        filler->copy_ptr = NULL;
+        filler->size = worker->tlab_left - sizeof(IrHeapChunk);
+        filler->kind = IR_CHUNK_FREE;
+        filler->site = 0;
+    }
+    worker->tlab = NULL;
+    worker->tlab_left = 0;
+}
+
+static void* exec_gc_shared_malloc(IrGcCollection* gc, size_t size) {
+    pthread_mutex_lock(&gc->heap_lock);
+    void* ptr = ir_arena_alloc(gc->exec->second_heap.mem, size);
+    pthread_mutex_unlock(&gc->heap_lock);
+    return ptr;
+}
+
+static IrHeapChunk* exec_gc_worker_malloc(IrGcWorker* worker, size_t size) {
+    size = IR_ALIGN_UP_POW2(size, IR_ARENA_ALIGN);
+    // Rest of the buffer must either be empty or big enough to hold the filler chunk
+    bool fits = size == worker->tlab_left || size + sizeof(IrHeapChunk) <= worker->tlab_left;
+    if (!fits) {
+        // Chunks which do not fit are allocated directly unless the buffer is almost used up,
+        // so that at most 1/16 of every buffer is wasted
+        if (worker->tlab_left >= IR_PARALLEL_GC_TLAB_SIZE / 16 || size > IR_PARALLEL_GC_TLAB_SIZE / 4) {
+            return exec_gc_shared_malloc(worker->gc, size);
         }
+        exec_gc_worker_retire_tlab(worker);
+        worker->tlab = exec_gc_shared_malloc(worker->gc, IR_PARALLEL_GC_TLAB_SIZE);
+        if (!worker->tlab) return NULL;
+        worker->tlab_left = IR_PARALLEL_GC_TLAB_SIZE;
     }
 
-    new_chunk->copy_ptr = NULL;
-    new_chunk->size = new_size;
+    IrHeapChunk* chunk = (IrHeapChunk*)worker->tlab;
+    worker->tlab += size;
+    worker->tlab_left -= size;
+    return chunk;
+}
 
-    memcpy(new_chunk->data, old_chunk->data, old_chunk->size);
+static bool exec_gc_is_collected(IrExec* exec, void* ptr) {
+    return exec_heap_contains(&exec->heap, ptr) || exec_heap_contains(&exec->nursery, ptr) || exec_heap_contains(&exec->survivors, ptr);
+}
 
-    if ((IrHeapChunk*)ptr - 1 != old_chunk) free(old_chunk);
-    return new_chunk->data;
+// Same as exec_heap_copy_chunk in IR_COLLECT_FULL mode, except that multiple workers can race to copy the same chunk.
+// Large object space is not modified during the collection, so it is searched without locking
+static bool exec_gc_worker_copy_chunk(IrGcWorker* worker, void** ref_data, IrChunkKind kind) {
+    if (*ref_data == NULL) return false;
+
+    IrHeapChunk* chunk = (*(IrHeapChunk**)ref_data) - 1;
+    IrExec* exec = worker->gc->exec;
+    if (!exec_gc_is_collected(exec, chunk)) {
+        if (exec->large.size > 0) exec_large_mark(&exec->large, chunk);
+        return false;
+    }
+
+    void* copy_ptr = __atomic_load_n(&chunk->copy_ptr, __ATOMIC_ACQUIRE);
+    if (copy_ptr) {
+        *ref_data = copy_ptr;
+        return false;
+    }
+
+    IrHeapChunk* new_chunk = exec_gc_worker_malloc(worker, sizeof(IrHeapChunk) + chunk->size);
+    if (!new_chunk) return false;
+    new_chunk->copy_ptr = NULL;
+    new_chunk->size = chunk->size;
+    new_chunk->kind = kind;
+    new_chunk->site = chunk->site;
+    memcpy(new_chunk->data, chunk->data, chunk->size);
+
+    if (!__atomic_compare_exchange_n(&chunk->copy_ptr, &copy_ptr, new_chunk->data, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        // Another worker copied the chunk first. If the copy is the last thing in the buffer, it can be given back,
+        // otherwise it stays in the heap as garbage
+        size_t size = IR_ALIGN_UP_POW2(sizeof(IrHeapChunk) + chunk->size, IR_ARENA_ALIGN);
+        if ((unsigned char*)new_chunk + size == worker->tlab) {
+            worker->tlab -= size;
+            worker->tlab_left += size;
+        } else {
+            new_chunk->kind = IR_CHUNK_FREE;
+        }
+        *ref_data = copy_ptr;
+        return false;
+    }
+
+    worker->chunks_count++;
+    *ref_data = new_chunk->data;
+    return true;
 }
 
-static void exec_heap_free(IrHeap* heap) {
-    if (heap->mem) {
-        ir_arena_free(heap->mem);
-        heap->mem = NULL;
+static void exec_gc_worker_copy_value(IrGcWorker* worker, IrValue* value) {
+    if (value->type != IR_TYPE_STRING && value->type != IR_TYPE_LIST) return;
+    if (!exec_gc_worker_copy_chunk(worker, (void**)&value->as.list_val, exec_value_chunk_kind(value))) return;
+
+    IrList* list = value->as.list_val;
+    if (!list->items) return;
+    // Items which were already copied are traced by the worker which copied them
+    bool items_collected = exec_gc_is_collected(worker->gc->exec, list->items);
+    if (!exec_gc_worker_copy_chunk(worker, (void**)&list->items, IR_CHUNK_DATA) && items_collected) return;
+    if (value->type != IR_TYPE_LIST) return;
+
+    for (size_t i = 0; i < list->size; i += IR_PARALLEL_GC_SPLIT) {
+        IrGcWork work = { .list = list, .begin = i, .end = MIN(i + IR_PARALLEL_GC_SPLIT, list->size) };
+        exec_gc_deque_push(&worker->deque, work);
     }
 }
 
-static IrHeap exec_heap_new(size_t memory_min, size_t memory_max) {
-    IrHeap heap = {0};
-    if (memory_max == 0 || memory_min > memory_max) return heap;
-    heap.mem = ir_arena_new(memory_max, memory_min);
-    heap.mem_max = memory_min;
-    return heap;
+static bool exec_gc_worker_steal(IrGcWorker* worker, IrGcWork* work) {
+    IrGcCollection* gc = worker->gc;
+    for (size_t i = 1; i < gc->workers_count; i++) {
+        IrGcWorker* victim = &gc->workers[(worker->index + i) % gc->workers_count];
+        if (exec_gc_deque_pop(&victim->deque, work, true)) return true;
+    }
+    return false;
 }
 
-IrExec exec_new(size_t memory_min, size_t memory_max) {
-    IrExec exec = {0};
+static void* exec_gc_worker_run(void* data) {
+    IrGcWorker* worker = data;
+    IrGcCollection* gc = worker->gc;
 
-    IrHeap heap = exec_heap_new(memory_min, memory_max);
-    IrHeap second_heap = exec_heap_new(memory_min, memory_max);
+    size_t root;
+    while ((root = __atomic_fetch_add(&gc->next_root, IR_PARALLEL_GC_ROOTS_BLOCK, __ATOMIC_RELAXED)) < gc->roots_count) {
+        size_t roots_end = MIN(root + IR_PARALLEL_GC_ROOTS_BLOCK, gc->roots_count);
+        for (; root < roots_end; root++) exec_gc_worker_copy_value(worker, gc->roots[root]);
+    }
 
-    exec.heap = heap;
-    exec.second_heap = second_heap;
-    return exec;
+    IrGcWork work;
+    while (true) {
+        while (exec_gc_deque_pop(&worker->deque, &work, false)) {
+            for (size_t i = work.begin; i < work.end; i++) exec_gc_worker_copy_value(worker, &work.list->items[i]);
+        }
+
+        // Only workers with work can create more of it, so once none of them is active the collection is done
+        __atomic_fetch_sub(&gc->active_workers, 1, __ATOMIC_SEQ_CST);
+        bool stolen = false;
+        while (!stolen && __atomic_load_n(&gc->active_workers, __ATOMIC_SEQ_CST) > 0) {
+            __atomic_fetch_add(&gc->active_workers, 1, __ATOMIC_SEQ_CST);
+            stolen = exec_gc_worker_steal(worker, &work);
+            if (!stolen) {
+                __atomic_fetch_sub(&gc->active_workers, 1, __ATOMIC_SEQ_CST);
+                sched_yield();
+            }
+        }
+        if (!stolen) break;
+
+        for (size_t i = work.begin; i < work.end; i++) exec_gc_worker_copy_value(worker, &work.list->items[i]);
+    }
+
+    exec_gc_worker_retire_tlab(worker);
+    return NULL;
 }
 
-void exec_free(IrExec* exec) {
-    ir_list_free(exec->chunks);
-    ir_list_free(exec->stack);
-    ir_list_free(exec->globals);
+// Copies roots into second_heap using multiple threads. Returns false if the collection should be done
+// on the current thread instead
+static bool exec_collect_parallel(IrExec* exec) {
+    if (exec->gc_threads < 2) return false;
+
+    size_t used_size = (exec->heap.mem->pos - IR_ARENA_BASE_POS) + (exec->nursery.mem->pos - IR_ARENA_BASE_POS) + (exec->survivors.mem->pos - IR_ARENA_BASE_POS);
+    if (used_size < IR_PARALLEL_GC_MIN_SIZE) return false;
+    // Allocation buffers waste some memory, so make sure everything still fits in second_heap
+    size_t needed_size = used_size + used_size / 16 + exec->gc_threads * IR_PARALLEL_GC_TLAB_SIZE;
+    if (exec->second_heap.mem->pos + needed_size > exec->second_heap.mem->reserve_size) return false;
+
+    IrGcCollection gc = {
+        .exec = exec,
+        .workers = calloc(exec->gc_threads, sizeof(IrGcWorker)),
+        .workers_count = exec->gc_threads,
+        .active_workers = 1,
+    };
+    pthread_mutex_init(&gc.heap_lock, NULL);
 
+    gc.roots = malloc(sizeof(IrValue*) * MAX(exec->stack.size + exec->globals.size, 1));
+    for (size_t i = 0; i < exec->stack.size; i++) gc.roots[gc.roots_count++] = &exec->stack.items[i];
+    for (size_t i = 0; i < exec->globals.size; i++) gc.roots[gc.roots_count++] = &exec->globals.items[i];
     for (size_t i = 0; i < exec->variables.size; i++) {
-        ir_list_free(exec->variables.items[i]);
+        IrValueList* frame = &exec->variables.items[i];
+        gc.roots = realloc(gc.roots, sizeof(IrValue*) * (gc.roots_count + frame->size + 1));
+        for (size_t j = 0; j < frame->size; j++) gc.roots[gc.roots_count++] = &frame->items[j];
+    }
+
+    for (size_t i = 0; i < gc.workers_count; i++) {
+        gc.workers[i].gc = &gc;
+        gc.workers[i].index = i;
+        pthread_mutex_init(&gc.workers[i].deque.lock, NULL);
+    }
+
+    // Workers which failed to start just leave their share to the others, as roots are claimed on demand
+    size_t started = 1;
+    for (size_t i = 1; i < gc.workers_count; i++) {
+        __atomic_fetch_add(&gc.active_workers, 1, __ATOMIC_SEQ_CST);
+        if (pthread_create(&gc.workers[i].thread, NULL, exec_gc_worker_run, &gc.workers[i])) {
+            __atomic_fetch_sub(&gc.active_workers, 1, __ATOMIC_SEQ_CST);
+            break;
+        }
+        started++;
+    }
+    exec_gc_worker_run(&gc.workers[0]);
+
+    // Finished workers can still be trying to steal from the others, so deques are only freed after all of them stop
+    for (size_t i = 1; i < started; i++) pthread_join(gc.workers[i].thread, NULL);
+    for (size_t i = 0; i < gc.workers_count; i++) {
+        exec->second_heap.chunks_count += gc.workers[i].chunks_count;
+        pthread_mutex_destroy(&gc.workers[i].deque.lock);
+        ir_list_free(gc.workers[i].deque);
     }
-    ir_list_free(exec->variables);
 
 #ifdef DEBUG
-    printf("exec_free: %zu bytes allocated, %zu chunks created\n", exec->heap.mem->pos, exec->heap.chunks_count);
+    printf("exec_collect_parallel: %zu roots copied by %zu threads\n", gc.roots_count, started);
 #endif
-    exec_heap_free(&exec->heap);
-    exec_heap_free(&exec->second_heap);
-}
 
-void exec_set_run_function_resolver(IrExec* exec, IrRunFunctionResolver resolver) {
-    exec->resolve_run_function = resolver;
+    pthread_mutex_destroy(&gc.heap_lock);
+    free(gc.roots);
+    free(gc.workers);
+    return true;
 }
 
-void exec_add_bytecode(IrExec* exec, IrBytecode bc) {
-    ir_list_append(exec->chunks, bc);
+// Gives memory of the idle semispace back to the system. Next collection is expected to copy about as much as survived
+// this one, so a bit more than that is kept. The rest is only decommitted once there is a lot of it, so that heaps
+// changing their size do not commit and decommit the same memory on every collection
+static void exec_heap_trim(IrExec* exec) {
+    exec_heap_clear(&exec->second_heap);
+    size_t keep_size = exec->heap.mem->pos + exec->heap.mem->pos / 2;
+    if (exec->second_heap.mem->commit_pos <= keep_size * 2) return;
+    ir_arena_trim(exec->second_heap.mem, keep_size);
 }
 
-IrBytecode* exec_find_bytecode(IrExec* exec, const char* bc_name) {
-    for (size_t i = 0; i < exec->chunks.size; i++) {
-        if (!strcmp(exec->chunks.items[i].name, bc_name)) return &exec->chunks.items[i];
-    }
-    return NULL;
+static size_t exec_profile_hash(IrBytecode* bc, uint32_t location) {
+    return ((uintptr_t)bc >> 4) * 31 + location;
 }
 
-IrLabel* bytecode_find_label(IrBytecode* bc, const char* label_name) {
-    IrConstValue label;
-    label.type = IR_TYPE_LABEL;
-    label.as.label_val.name = label_name;
+static void exec_profile_rehash(IrHeapProfile* profile) {
+    free(profile->hash_table.items);
+    profile->hash_table.capacity = profile->hash_table.capacity == 0 ? 1024 : profile->hash_table.capacity * 2;
+    profile->hash_table.items = calloc(profile->hash_table.capacity, sizeof(*profile->hash_table.items));
 
-    ConstId id = bytecode_pool_get(bc->pool, label);
-    if (id == (size_t)-1) return NULL;
-    return &bc->pool->list.items[id].as.label_val;
+    size_t mask = profile->hash_table.capacity - 1;
+    for (size_t i = 1; i < profile->sites.size; i++) {
+        size_t hash = exec_profile_hash(profile->sites.items[i].bc, profile->sites.items[i].location) & mask;
+        while (profile->hash_table.items[hash]) hash = (hash + 1) & mask;
+        profile->hash_table.items[hash] = i;
+    }
 }
 
-bool exec_run(IrExec* exec, const char* bc_name, const char* label_name) {
-    IrBytecode* bc = exec_find_bytecode(exec, bc_name);
-    if (!bc) {
-        exec_set_error(exec, "Bytecode with name \"%s\" is not found", bc_name);
-        return false;
+// Returns allocation site of the instruction which is currently allocating
+static uint32_t exec_profile_site(IrExec* exec) {
+    IrHeapProfile* profile = exec->profile;
+    if (!exec->alloc_bc) return 0;
+    if (exec->alloc_bc == profile->last_bc && exec->alloc_pos == profile->last_pos) return profile->last_site;
+
+    uint32_t location = bytecode_get_location(exec->alloc_bc, exec->alloc_pos);
+    if (profile->sites.size * 2 >= profile->hash_table.capacity) exec_profile_rehash(profile);
+
+    size_t mask = profile->hash_table.capacity - 1;
+    size_t hash = exec_profile_hash(exec->alloc_bc, location) & mask;
+    uint32_t site;
+    while ((site = profile->hash_table.items[hash])) {
+        IrProfileSite* item = &profile->sites.items[site];
+        if (item->bc == exec->alloc_bc && item->location == location) break;
+        hash = (hash + 1) & mask;
     }
 
-    IrLabel* label = bytecode_find_label(bc, label_name);
-    if (!label) {
-        exec_set_error(exec, "Label with name \"%s\" is not found in bytecode \"%s\"", label_name, bc_name);
-        return false;
+    if (!site && profile->sites.size < IR_PROFILE_MAX_SITES) {
+        site = profile->sites.size;
+        ir_list_append(profile->sites, ((IrProfileSite) { .bc = exec->alloc_bc, .location = location }));
+        profile->hash_table.items[hash] = site;
     }
 
-    return exec_run_bytecode(exec, bc, label->pos);
+    profile->last_bc = exec->alloc_bc;
+    profile->last_pos = exec->alloc_pos;
+    profile->last_site = site;
+    return site;
 }
 
-void exec_push_variable_stack(IrExec* exec) {
-    ir_list_append(exec->variables, (IrValueList) {0});
+static void exec_profile_count(IrHeapProfile* profile, IrHeapChunk* chunk, size_t* chunks, size_t* bytes) {
+    if (chunk->kind == IR_CHUNK_FREE) return;
+    IrProfileSite* site = &profile->sites.items[chunk->site < profile->sites.size ? chunk->site : 0];
+    site->count[chunk->kind]++;
+    site->bytes[chunk->kind] += sizeof(IrHeapChunk) + chunk->size;
+    (*chunks)++;
+    *bytes += sizeof(IrHeapChunk) + chunk->size;
 }
 
-void exec_pop_variable_stack(IrExec* exec) {
-    ir_list_free(exec->variables.items[exec->variables.size - 1]);
-    exec->variables.size--;
+static size_t exec_profile_site_bytes(const IrProfileSite* site) {
+    return site->bytes[IR_CHUNK_DATA] + site->bytes[IR_CHUNK_LIST] + site->bytes[IR_CHUNK_STRING];
 }
 
-void exec_push_value(IrExec* exec, IrValue value) {
-    ir_list_append(exec->stack, value);
+static int exec_profile_site_compare(const void* a, const void* b) {
+    size_t left = exec_profile_site_bytes(*(IrProfileSite* const*)a);
+    size_t right = exec_profile_site_bytes(*(IrProfileSite* const*)b);
+    return left < right ? 1 : left > right ? -1 : 0;
 }
 
-#define _ir_make_push(_name, _type, _valname, _irtype) \
-void _name(IrExec* exec, _type _valname) { \
-    IrValue val; \
-    val.type = _irtype; \
-    val.as._valname = _valname; \
-    exec_push_value(exec, val); \
-}
+// Writes summary of the live heap into the profile. Should be called right after full collection,
+// when all live chunks are in the heap and the large object space
+static void exec_profile_dump(IrExec* exec) {
+    IrHeapProfile* profile = exec->profile;
+    size_t chunks = 0, bytes = 0;
+
+    size_t pos = IR_ARENA_BASE_POS;
+    while (pos < exec->heap.mem->pos) {
+        IrHeapChunk* chunk = (IrHeapChunk*)((unsigned char*)exec->heap.mem + pos);
+        pos = IR_ALIGN_UP_POW2(pos + sizeof(IrHeapChunk) + chunk->size, IR_ARENA_ALIGN);
+        exec_profile_count(profile, chunk, &chunks, &bytes);
+    }
+    for (size_t i = 0; i < exec->large.size; i++) {
+        exec_profile_count(profile, exec_large_chunk(exec->large.items[i]), &chunks, &bytes);
+    }
 
-_ir_make_push(exec_push_int, int64_t, int_val, IR_TYPE_INT)
+    IrProfileSite** sites = malloc(sizeof(IrProfileSite*) * profile->sites.size);
+    size_t sites_count = 0;
+    for (size_t i = 0; i < profile->sites.size; i++) {
+        if (exec_profile_site_bytes(&profile->sites.items[i]) > 0) sites[sites_count++] = &profile->sites.items[i];
+    }
+    qsort(sites, sites_count, sizeof(IrProfileSite*), exec_profile_site_compare);
+
+    fprintf(profile->file, "heap %zu %zu %zu\n", ++profile->dumps, chunks, bytes);
+    for (size_t i = 0; i < sites_count; i++) {
+        IrProfileSite* site = sites[i];
+        fprintf(
+            profile->file, "site %lld %zu %zu %zu %zu %zu %zu %s\n",
+            site->location == IR_NO_LOCATION ? -1LL : (long long)site->location,
+            site->count[IR_CHUNK_LIST], site->bytes[IR_CHUNK_LIST],
+            site->count[IR_CHUNK_STRING], site->bytes[IR_CHUNK_STRING],
+            site->count[IR_CHUNK_DATA], site->bytes[IR_CHUNK_DATA],
+            site->bc && site->bc->name ? site->bc->name : "?"
+        );
+        memset(site->count, 0, sizeof(site->count));
+        memset(site->bytes, 0, sizeof(site->bytes));
+    }
+    fprintf(profile->file, "end\n");
+    fflush(profile->file);
+    free(sites);
+}
+
+static void exec_collect_finish(IrExec* exec) {
+    size_t old_size = (exec->heap.mem->pos - IR_ARENA_BASE_POS) + (exec->nursery.mem->pos - IR_ARENA_BASE_POS) + (exec->survivors.mem->pos - IR_ARENA_BASE_POS);
+    size_t old_chunks = exec->heap.chunks_count + exec->nursery.chunks_count + exec->survivors.chunks_count;
+
+    IrIncrementalCollection* incremental = &exec->incremental;
+    bool was_active = incremental->active;
+    size_t scan_pos = IR_ARENA_BASE_POS;
+    if (was_active) {
+        while (incremental->gray.size > 0) {
+            IrGrayList gray = incremental->gray.items[--incremental->gray.size];
+            exec_heap_shade_items(exec, gray.list, gray.pos, gray.list->size);
+        }
+        // Copies made so far are already traced, and may still reference young chunks at their old location
+        scan_pos = exec->second_heap.mem->pos;
+
+        // Flags are cleared first, so that lists copied from now on do not carry them into second_heap
+        for (size_t i = 0; i < exec->remembered.size; i++) exec->remembered.items[i]->remembered = false;
+        for (size_t i = 0; i < incremental->written.size; i++) incremental->written.items[i]->written = false;
+
+        // Copies of lists referencing young chunks still reference them at their old location,
+        // while copies of modified lists miss the changes
+        for (size_t i = 0; i < exec->remembered.size; i++) exec_heap_resync_list(exec, exec->remembered.items[i]);
+        for (size_t i = 0; i < incremental->written.size; i++) exec_heap_resync_list(exec, incremental->written.items[i]);
+        // Large items still reference original chunks, which are about to be freed
+        for (size_t i = 0; i < incremental->large.size; i++) exec_heap_scan_list(exec, incremental->large.items[i], true, IR_COLLECT_FULL);
+
+        incremental->written.size = 0;
+        incremental->large.size = 0;
+        incremental->active = false;
+    } else {
+        // Everything ends up in the old generation, so nothing needs to be remembered anymore
+        for (size_t i = 0; i < exec->remembered.size; i++) exec->remembered.items[i]->remembered = false;
+
+        exec_heap_clear(&exec->second_heap);
+        exec->second_heap.mem_max = exec->second_heap.mem->reserve_size;
+    }
+    exec->remembered.size = 0;
+
+    // Incremental collection has already copied most of the heap, so what is left is not worth parallelizing
+    if (was_active || !exec_collect_parallel(exec)) {
+        exec_heap_copy_roots(exec, IR_COLLECT_FULL);
+        exec_heap_scan(exec, &exec->second_heap, &scan_pos, IR_COLLECT_FULL);
+    }
+    exec->stats.full_collections++;
+    exec->stats.copied_bytes += exec->second_heap.mem->pos - IR_ARENA_BASE_POS;
+
+    size_t large_count = exec->large.size;
+    size_t memory_freed = old_size - (exec->second_heap.mem->pos - IR_ARENA_BASE_POS) + exec_large_sweep(exec);
+    size_t chunks_deleted = old_chunks - exec->second_heap.chunks_count + large_count - exec->large.size;
+
+    // Young chunks are moved together with the old ones, so the limit of second_heap is only applied afterwards
+    exec->second_heap.mem_max = exec->heap.mem_max;
+    exec_heap_clear(&exec->nursery);
+    exec_heap_clear(&exec->survivors);
+
+    IrHeap temp_heap = exec->heap;
+    exec->heap = exec->second_heap;
+    exec->second_heap = temp_heap;
+    incremental->live_size = exec->heap.mem->pos - IR_ARENA_BASE_POS + exec->large.mem_size;
+    exec_fit_live_size(exec);
+    exec_heap_trim(exec);
+    if (exec->profile) exec_profile_dump(exec);
+
+#ifdef DEBUG
+    printf("exec_collect: %zu bytes freed, %zu chunks deleted\n", memory_freed, chunks_deleted);
+#else
+    (void) memory_freed;
+    (void) chunks_deleted;
+#endif
+}
+
+// Adds the time since start_time to the time the program was stopped by garbage collection
+static void exec_stats_add_pause(IrExec* exec, int64_t start_time) {
+    int64_t pause = ir_plat_get_time() - start_time;
+    exec->stats.gc_pause_time += pause;
+    exec->stats.gc_max_pause = MAX(exec->stats.gc_max_pause, pause);
+}
+
+void exec_collect(IrExec* exec) {
+    int64_t start_time = ir_plat_get_time();
+    exec_collect_finish(exec);
+    exec_stats_add_pause(exec, start_time);
+}
+
+// Starts incremental collection by copying old lists referenced from roots. Roots themselves are only updated when
+// the collection finishes, as the program continues using original lists until then
+static void exec_collect_start(IrExec* exec) {
+    exec_heap_clear(&exec->second_heap);
+    exec->second_heap.mem_max = exec->second_heap.mem->reserve_size;
+    exec->incremental.active = true;
+
+    for (size_t i = 0; i < exec->stack.size; i++) {
+        IrValue value = exec->stack.items[i];
+        exec_heap_shade_value(exec, &value);
+    }
+
+    for (size_t i = 0; i < exec->variables.size; i++) {
+        IrValueList* frame = &exec->variables.items[i];
+        for (size_t j = 0; j < frame->size; j++) {
+            IrValue value = frame->items[j];
+            exec_heap_shade_value(exec, &value);
+        }
+    }
+
+    for (size_t i = 0; i < exec->globals.size; i++) {
+        IrValue value = exec->globals.items[i];
+        exec_heap_shade_value(exec, &value);
+    }
+}
+
+// Number of values traced between checking the time spent in incremental collection step
+#define IR_COLLECT_STEP_VALUES 256
+
+// Runs incremental collection until time_us microseconds pass. New collection is started when the old generation
+// grew enough since the last one. When idle is set, any growth is enough as the program has nothing to do anyway
+static void exec_collect_step(IrExec* exec, int64_t time_us, bool idle) {
+    IrIncrementalCollection* incremental = &exec->incremental;
+    int64_t start_time = ir_plat_get_time();
+
+    if (!incremental->active) {
+        size_t used_size = exec->heap.mem->pos - IR_ARENA_BASE_POS + exec->large.mem_size;
+        if (used_size < incremental->live_size + exec_young_capacity(exec)) return;
+        // Collection copies all live chunks, so it is only started once there is at least as much garbage to free
+        if (!idle && (used_size * exec->gc_live_ratio < incremental->live_size || used_size < (exec->heap.mem_max - IR_ARENA_BASE_POS) / 2)) return;
+        exec_collect_start(exec);
+    }
+
+    while (incremental->gray.size > 0) {
+        if (ir_plat_get_time() - start_time >= time_us) return;
+
+        // Long lists are traced in parts, so that the step does not take too long
+        IrGrayList* gray = &incremental->gray.items[incremental->gray.size - 1];
+        IrList* list = gray->list;
+        size_t pos = gray->pos;
+        size_t end = MIN(list->size, pos + IR_COLLECT_STEP_VALUES);
+        gray->pos = end;
+        if (end == list->size) incremental->gray.size--;
+
+        exec_heap_shade_items(exec, list, pos, end);
+    }
+
+    exec_collect_finish(exec);
+}
+
+int64_t exec_collect_idle(IrExec* exec, int64_t time_us) {
+    int64_t start_time = ir_plat_get_time();
+    exec_collect_step(exec, time_us, true);
+    int64_t time = ir_plat_get_time() - start_time;
+    exec->stats.gc_idle_time += time;
+    return time;
+}
+
+void exec_set_gc_pause(IrExec* exec, int64_t pause_us) {
+    exec->incremental.pause = MAX(pause_us, 0);
+}
+
+void exec_set_huge_pages(IrExec* exec, bool huge_pages) {
+    ir_arena_set_huge_pages(exec->heap.mem, huge_pages);
+    ir_arena_set_huge_pages(exec->second_heap.mem, huge_pages);
+}
+
+void exec_set_gc_items_with_list(IrExec* exec, bool items_with_list) {
+    exec->gc_items_with_list = items_with_list;
+}
+
+void exec_set_gc_threads(IrExec* exec, size_t threads) {
+    exec->gc_threads = threads > 0 ? threads : ir_plat_get_cpu_count();
+}
+
+void exec_set_gc_growth(IrExec* exec, double growth_factor, double live_ratio) {
+    exec->gc_growth = growth_factor > 1.0 ? growth_factor : IR_DEFAULT_GC_GROWTH;
+    exec->gc_live_ratio = live_ratio > 0.0 && live_ratio < 1.0 ? live_ratio : IR_DEFAULT_GC_LIVE_RATIO;
+}
+
+bool exec_set_heap_profile(IrExec* exec, const char* path) {
+    if (exec->profile) {
+        fclose(exec->profile->file);
+        ir_list_free(exec->profile->sites);
+        free(exec->profile->hash_table.items);
+        free(exec->profile);
+        exec->profile = NULL;
+    }
+    if (!path) return true;
+
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        exec_set_error(exec, "Failed to create heap profile %s: %s", path, strerror(errno));
+        return false;
+    }
+
+    IrHeapProfile* profile = calloc(1, sizeof(IrHeapProfile));
+    profile->file = file;
+    ir_list_append(profile->sites, ((IrProfileSite) { .bc = NULL, .location = IR_NO_LOCATION }));
+    exec->profile = profile;
+    // Sites are not recorded while the profiler is off, so drop whatever was left from an earlier session
+    exec->alloc_bc = NULL;
+    return true;
+}
+
+void exec_collect_minor(IrExec* exec) {
+    size_t young_size = (exec->nursery.mem->pos - IR_ARENA_BASE_POS) + (exec->survivors.mem->pos - IR_ARENA_BASE_POS);
+    // Every young chunk may end up being promoted, so the old generation must be able to fit all of them
+    if (exec->heap.mem->pos + young_size > exec->heap.mem_max) {
+        exec_collect_finish(exec);
+        return;
+    }
+
+    size_t old_size = exec->heap.mem->pos;
+    exec_heap_clear(&exec->second_survivors);
+
+    // Remembered lists are roots for the minor collection. Lists which stop referencing young chunks are dropped from
+    // the set, while lists promoted during the collection are appended to it by exec_heap_scan
+    size_t remembered_count = exec->remembered.size;
+    size_t remembered_kept = 0;
+    for (size_t i = 0; i < remembered_count; i++) {
+        IrList* list = exec->remembered.items[i];
+        // References to young chunks are about to change, which copies made by incremental collection need to know
+        exec_log_write(exec, list);
+        if (exec_heap_scan_list(exec, list, ((IrHeapChunk*)list - 1)->kind == IR_CHUNK_LIST, IR_COLLECT_MINOR)) {
+            exec->remembered.items[remembered_kept++] = list;
+        } else {
+            list->remembered = false;
+        }
+    }
+
+    exec_heap_copy_roots(exec, IR_COLLECT_MINOR);
+
+    // Copied chunks go either to survivors or to the old generation, so both of them are scanned
+    size_t survivors_scan_pos = IR_ARENA_BASE_POS;
+    size_t heap_scan_pos = old_size;
+    while (exec_heap_scan(exec, &exec->second_survivors, &survivors_scan_pos, IR_COLLECT_MINOR) |
+           exec_heap_scan(exec, &exec->heap, &heap_scan_pos, IR_COLLECT_MINOR));
+
+    if (remembered_count > remembered_kept) {
+        memmove(exec->remembered.items + remembered_kept, exec->remembered.items + remembered_count, (exec->remembered.size - remembered_count) * sizeof(*exec->remembered.items));
+    }
+    exec->remembered.size -= remembered_count - remembered_kept;
+    exec->stats.minor_collections++;
+    exec->stats.copied_bytes += (exec->heap.mem->pos - old_size) + (exec->second_survivors.mem->pos - IR_ARENA_BASE_POS);
+
+#ifdef DEBUG
+    printf("exec_collect_minor: %zu bytes promoted, %zu bytes survived, %zu lists remembered\n", exec->heap.mem->pos - old_size, exec->second_survivors.mem->pos - IR_ARENA_BASE_POS, exec->remembered.size);
+#endif
+
+    exec_heap_clear(&exec->nursery);
+    exec_heap_clear(&exec->survivors);
+
+    IrHeap temp_heap = exec->survivors;
+    exec->survivors = exec->second_survivors;
+    exec->second_survivors = temp_heap;
+}
+
+#define IR_SNAPSHOT_MAGIC "SCRAPSNP"
+#define IR_SNAPSHOT_VERSION 6
+
+// Snapshot file starts with this header, followed by constant addresses, sizes of large chunks, stack, globals and
+// variable frame values, heap contents, contents of large chunks and bytecode in version 2 format at bytecode_offset.
+// Values and heap are stored as is, so pointers in them still refer to memory of the process which saved the snapshot
+// until they are relocated. Addresses of large chunks are stored after the constant ones and relocated the same way
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t pos;
+    uint64_t heap_base, heap_size, heap_chunks_count, heap_mem_max;
+    uint64_t large_count, large_size, large_mem_max;
+    uint64_t addrs_count, stack_size, globals_size, variables_size;
+    uint64_t bytecode_offset, bytecode_size;
+} IrSnapshotHeader;
+
+typedef struct {
+    uint64_t* items;
+    size_t size, capacity;
+} IrSnapshotAddrs;
+
+typedef struct {
+    uint64_t old_addr, new_addr;
+} IrSnapshotAddr;
+
+// Heap pointers are moved by the difference between heap bases, while pointers to constants
+// and functions are looked up in the table of their old addresses sorted by old_addr
+typedef struct {
+    uintptr_t old_base, new_base;
+    size_t heap_size;
+    IrSnapshotAddr* addrs;
+    size_t addrs_count;
+} IrSnapshotReloc;
+
+static void exec_snapshot_list_addrs(IrSnapshotAddrs* addrs, IrList* list) {
+    for (size_t i = 0; i < list->size; i++) {
+        IrValue* item = &list->items[i];
+        if (item->type != IR_TYPE_LIST && item->type != IR_TYPE_STRING) continue;
+
+        ir_list_append(*addrs, (uint64_t)(uintptr_t)item->as.list_val);
+        if (item->type == IR_TYPE_LIST && item->as.list_val) exec_snapshot_list_addrs(addrs, item->as.list_val);
+    }
+}
+
+// Collects addresses of constant lists and functions which values can point to. Saving and loading processes
+// walk the same constants in the same order, so addresses at the same index refer to the same constant
+static void exec_snapshot_const_addrs(IrExec* exec, IrBytecodePool* pool, IrSnapshotAddrs* addrs, bool resolve) {
+    for (size_t i = 0; i < pool->list.size; i++) {
+        IrConstValue* value = &pool->list.items[i];
+        switch (value->type) {
+        case IR_TYPE_LIST:
+        case IR_TYPE_STRING:
+            ir_list_append(*addrs, (uint64_t)(uintptr_t)value->as.list_val);
+            if (value->type == IR_TYPE_LIST && value->as.list_val) exec_snapshot_list_addrs(addrs, value->as.list_val);
+            break;
+        case IR_TYPE_FUNC:
+            if (resolve && !value->as.func_val.ptr && value->as.func_val.hint && exec->resolve_run_function) {
+                value->as.func_val.ptr = exec->resolve_run_function(exec, value->as.func_val.hint);
+            }
+            ir_list_append(*addrs, (uint64_t)(uintptr_t)value->as.func_val.ptr);
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Shared strings are not in the pool, but they are found the same way as constants
+    for (size_t i = 0; i < IR_CHAR_STRINGS_COUNT; i++) ir_list_append(*addrs, (uint64_t)(uintptr_t)&ir_char_strings[i]);
+    for (size_t i = 0; i < IR_INT_STRINGS_COUNT; i++) ir_list_append(*addrs, (uint64_t)(uintptr_t)&ir_int_strings[i]);
+    ir_list_append(*addrs, (uint64_t)(uintptr_t)&ir_bool_strings[0]);
+    ir_list_append(*addrs, (uint64_t)(uintptr_t)&ir_bool_strings[1]);
+    ir_list_append(*addrs, (uint64_t)(uintptr_t)&ir_nothing_string);
+}
+
+static int exec_snapshot_addr_compare(const void* left, const void* right) {
+    uint64_t left_addr = ((const IrSnapshotAddr*)left)->old_addr;
+    uint64_t right_addr = ((const IrSnapshotAddr*)right)->old_addr;
+    return (left_addr > right_addr) - (left_addr < right_addr);
+}
+
+static bool exec_snapshot_reloc_addr(IrSnapshotReloc* reloc, uintptr_t addr, uintptr_t* out) {
+    if (addr == 0) {
+        *out = 0;
+        return true;
+    }
+
+    if (addr >= reloc->old_base && addr < reloc->old_base + reloc->heap_size) {
+        *out = addr - reloc->old_base + reloc->new_base;
+        return true;
+    }
+
+    size_t low = 0, high = reloc->addrs_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (reloc->addrs[mid].old_addr < addr) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == reloc->addrs_count || reloc->addrs[low].old_addr != addr) return false;
+
+    *out = reloc->addrs[low].new_addr;
+    return true;
+}
+
+static bool exec_snapshot_reloc_value(IrExec* exec, IrSnapshotReloc* reloc, IrValue* value) {
+    uintptr_t addr;
+
+    switch (value->type) {
+    case IR_TYPE_FUNC:
+        if (!exec_snapshot_reloc_addr(reloc, (uintptr_t)value->as.func_val, &addr)) {
+            exec_set_error(exec, "Snapshot can not refer to function %p which is not a constant", (void*)(uintptr_t)value->as.func_val);
+            return false;
+        }
+        value->as.func_val = (IrRunFunction)addr;
+        return true;
+    case IR_TYPE_LIST:
+    case IR_TYPE_STRING: ;
+        if (!exec_snapshot_reloc_addr(reloc, (uintptr_t)value->as.list_val, &addr)) {
+            exec_set_error(exec, "Snapshot can not refer to list %p which is neither on the heap nor a constant", value->as.list_val);
+            return false;
+        }
+        value->as.list_val = (IrList*)addr;
+        if (addr < reloc->new_base || addr >= reloc->new_base + reloc->heap_size) return true;
+
+        // Chunks are marked the same way as during garbage collection, so lists referenced multiple times are only
+        // relocated once. The marks are cleared by exec_snapshot_clear_marks afterwards
+        IrHeapChunk* chunk = (IrHeapChunk*)addr - 1;
+        if (chunk->copy_ptr) return true;
+        chunk->copy_ptr = chunk;
+
+        IrList* list = value->as.list_val;
+        if (!exec_snapshot_reloc_addr(reloc, (uintptr_t)list->items, &addr)) {
+            exec_set_error(exec, "Snapshot can not refer to list items %p which are not on the heap", list->items);
+            return false;
+        }
+        list->items = (IrValue*)addr;
+
+        if (value->type == IR_TYPE_STRING) return true;
+        for (size_t i = 0; i < list->size; i++) {
+            if (!exec_snapshot_reloc_value(exec, reloc, &list->items[i])) return false;
+        }
+        return true;
+    default:
+        return true;
+    }
+}
+
+// Sites are cleared when loading, since they refer to the heap profile of the process which saved the snapshot.
+// When saving they are kept, so the running program does not lose its heap profile
+static void exec_snapshot_clear_marks(uintptr_t base, size_t size, bool clear_sites) {
+    size_t offset = 0;
+    while (offset < size) {
+        IrHeapChunk* chunk = (IrHeapChunk*)(base + offset);
+        chunk->copy_ptr = NULL;
+        if (clear_sites) chunk->site = 0;
+        offset = IR_ALIGN_UP_POW2(offset + sizeof(IrHeapChunk) + chunk->size, IR_ARENA_ALIGN);
+    }
+}
+
+// Relocates all values reachable from exec roots. old_addrs and new_addrs hold addresses of the same constants
+static bool exec_snapshot_relocate(IrExec* exec, uintptr_t old_base, size_t heap_size, uint64_t* old_addrs, uint64_t* new_addrs, size_t addrs_count, bool loading) {
+    IrSnapshotReloc reloc = {
+        .old_base = old_base,
+        .new_base = (uintptr_t)exec->heap.mem + IR_ARENA_BASE_POS,
+        .heap_size = heap_size,
+        .addrs = malloc(sizeof(IrSnapshotAddr) * MAX(addrs_count, 1)),
+        .addrs_count = 0,
+    };
+
+    for (size_t i = 0; i < addrs_count; i++) {
+        if (old_addrs[i] == 0) continue;
+        reloc.addrs[reloc.addrs_count++] = (IrSnapshotAddr) { .old_addr = old_addrs[i], .new_addr = new_addrs[i] };
+    }
+    qsort(reloc.addrs, reloc.addrs_count, sizeof(IrSnapshotAddr), exec_snapshot_addr_compare);
+
+    bool ok = true;
+    for (size_t i = 0; ok && i < exec->stack.size; i++) {
+        ok = exec_snapshot_reloc_value(exec, &reloc, &exec->stack.items[i]);
+    }
+
+    for (size_t i = 0; ok && i < exec->variables.size; i++) {
+        IrValueList* frame = &exec->variables.items[i];
+        for (size_t j = 0; ok && j < frame->size; j++) {
+            ok = exec_snapshot_reloc_value(exec, &reloc, &frame->items[j]);
+        }
+    }
+
+    for (size_t i = 0; ok && i < exec->globals.size; i++) {
+        ok = exec_snapshot_reloc_value(exec, &reloc, &exec->globals.items[i]);
+    }
+
+    exec_snapshot_clear_marks(reloc.new_base, heap_size, loading);
+    free(reloc.addrs);
+    return ok;
+}
+
+static bool exec_snapshot_write_values(FILE* f, IrValue* values, size_t count) {
+    return count == 0 || fwrite(values, sizeof(IrValue), count, f) == count;
+}
+
+bool exec_save_snapshot(IrExec* exec, IrBytecode* bc, size_t pos, const char* filepath) {
+    if (exec->variables.size != 1) {
+        exec_set_error(exec, "Snapshot can only be taken outside of custom blocks");
+        return false;
+    }
+
+    if (exec->chunks.size != 1) {
+        exec_set_error(exec, "Snapshot can not be taken in programs linked with other modules");
+        return false;
+    }
+
+    // After collecting garbage the heap only contains reachable chunks laid out one after another
+    exec_collect(exec);
+
+    uintptr_t heap_base = (uintptr_t)exec->heap.mem + IR_ARENA_BASE_POS;
+    size_t heap_size = exec->heap.mem->pos - IR_ARENA_BASE_POS;
+
+    IrSnapshotAddrs addrs = {0};
+    exec_snapshot_const_addrs(exec, bc->pool, &addrs, false);
+
+    size_t large_size = 0;
+    for (size_t i = 0; i < exec->large.size; i++) {
+        IrHeapChunk* chunk = exec_large_chunk(exec->large.items[i]);
+        ir_list_append(addrs, (uint64_t)(uintptr_t)chunk->data);
+        large_size += chunk->size;
+    }
+
+    // Relocating values onto the same addresses changes nothing, but checks that the loading process
+    // will be able to relocate every pointer
+    if (!exec_snapshot_relocate(exec, heap_base, heap_size, addrs.items, addrs.items, addrs.size, false)) {
+        ir_list_free(addrs);
+        return false;
+    }
+
+    IrValueList* frame = &exec->variables.items[0];
+    IrSnapshotHeader header = {
+        .magic = IR_SNAPSHOT_MAGIC,
+        .version = IR_SNAPSHOT_VERSION,
+        .byte_order = IR_SAVE_BYTE_ORDER,
+        .pos = pos,
+        .heap_base = heap_base,
+        .heap_size = heap_size,
+        .heap_chunks_count = exec->heap.chunks_count,
+        .heap_mem_max = exec->heap.mem_max,
+        .large_count = exec->large.size,
+        .large_size = large_size,
+        .large_mem_max = exec->large.mem_max,
+        .addrs_count = addrs.size,
+        .stack_size = exec->stack.size,
+        .globals_size = exec->globals.size,
+        .variables_size = frame->size,
+    };
+    header.bytecode_offset = IR_ALIGN_UP_POW2(sizeof(header) + (addrs.size + exec->large.size) * sizeof(uint64_t) +
+                                              (exec->stack.size + exec->globals.size + frame->size) * sizeof(IrValue) +
+                                              heap_size + large_size, IR_SAVE_ALIGN);
+
+    FILE* f = fopen(filepath, "wb");
+    if (!f) {
+        exec_set_error(exec, "Failed to create snapshot file %s: %s", filepath, strerror(errno));
+        ir_list_free(addrs);
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    if (ok && addrs.size > 0) ok = fwrite(addrs.items, sizeof(uint64_t), addrs.size, f) == addrs.size;
+    for (size_t i = 0; ok && i < exec->large.size; i++) {
+        uint64_t size = exec_large_chunk(exec->large.items[i])->size;
+        ok = fwrite(&size, sizeof(size), 1, f) == 1;
+    }
+    if (ok) ok = exec_snapshot_write_values(f, exec->stack.items, exec->stack.size);
+    if (ok) ok = exec_snapshot_write_values(f, exec->globals.items, exec->globals.size);
+    if (ok) ok = exec_snapshot_write_values(f, frame->items, frame->size);
+    if (ok && heap_size > 0) ok = fwrite((void*)heap_base, 1, heap_size, f) == heap_size;
+    for (size_t i = 0; ok && i < exec->large.size; i++) {
+        IrHeapChunk* chunk = exec_large_chunk(exec->large.items[i]);
+        ok = fwrite(chunk->data, 1, chunk->size, f) == chunk->size;
+    }
+
+    static const unsigned char padding[IR_SAVE_ALIGN] = {0};
+    if (ok) {
+        size_t padding_size = header.bytecode_offset - ftell(f);
+        if (padding_size > 0) ok = fwrite(padding, 1, padding_size, f) == padding_size;
+    }
+    if (ok) ok = bytecode_save_file(bc, f);
+
+    // Header is written again now that the size of the bytecode is known
+    if (ok) {
+        header.bytecode_size = ftell(f) - header.bytecode_offset;
+        ok = !fseek(f, 0, SEEK_SET) && fwrite(&header, sizeof(header), 1, f) == 1;
+    }
+
+    if (fclose(f)) ok = false;
+    ir_list_free(addrs);
+
+    if (!ok) {
+        exec_set_error(exec, "Failed to write snapshot file %s", filepath);
+        remove(filepath);
+    }
+    return ok;
+}
+
+static void exec_snapshot_read_values(IrValueList* list, const IrValue* values, size_t count) {
+    list->size = 0;
+    for (size_t i = 0; i < count; i++) ir_list_append(*list, values[i]);
+}
+
+bool exec_load_snapshot(IrExec* exec, IrBytecodePool* pool, IrBytecode* bc, size_t* pos, const char* filepath) {
+    if (pool->list.size > 0) {
+        exec_set_error(exec, "Snapshot can only be loaded into empty bytecode pool");
+        return false;
+    }
+
+    size_t file_size;
+    unsigned char* data = ir_plat_file_map(filepath, &file_size);
+    if (!data) {
+        exec_set_error(exec, "Failed to open snapshot file %s", filepath);
+        return false;
+    }
+
+    const IrSnapshotHeader* header = (const IrSnapshotHeader*)data;
+    if (file_size < sizeof(IrSnapshotHeader) || memcmp(header->magic, IR_SNAPSHOT_MAGIC, sizeof(header->magic))) {
+        exec_set_error(exec, "%s is not a snapshot file", filepath);
+        ir_plat_file_unmap(data, file_size);
+        return false;
+    }
+
+    if (header->version != IR_SNAPSHOT_VERSION || header->byte_order != IR_SAVE_BYTE_ORDER) {
+        exec_set_error(exec, "Snapshot %s was saved by incompatible runtime", filepath);
+        ir_plat_file_unmap(data, file_size);
+        return false;
+    }
+
+    uint64_t values_count = header->stack_size + header->globals_size + header->variables_size;
+    uint64_t data_end = sizeof(IrSnapshotHeader) + (header->addrs_count + header->large_count) * sizeof(uint64_t) +
+                        values_count * sizeof(IrValue) + header->heap_size + header->large_size;
+    if (header->addrs_count > file_size || header->large_count > header->addrs_count || values_count > file_size ||
+        header->heap_size > file_size || header->large_size > file_size ||
+        data_end > header->bytecode_offset || header->bytecode_offset % IR_SAVE_ALIGN ||
+        header->bytecode_offset > file_size || header->bytecode_size > file_size - header->bytecode_offset)
+    {
+        exec_set_error(exec, "Snapshot %s is corrupted", filepath);
+        ir_plat_file_unmap(data, file_size);
+        return false;
+    }
+
+    if (header->heap_size > exec->heap.mem->reserve_size - IR_ARENA_BASE_POS) {
+        exec_set_error(exec, "Snapshot heap of %lu bytes does not fit into %zu bytes of memory", header->heap_size, exec->heap.mem->reserve_size);
+        ir_plat_file_unmap(data, file_size);
+        return false;
+    }
+
+    IrSave save = {
+        .ptr = data + header->bytecode_offset,
+        .pos = 0,
+        .size = header->bytecode_size,
+    };
+    uint64_t version;
+    if (!bytecode_load_header(&save, &version) || version < 2 ||
+        !bytecode_load_v2(pool, bc, data + header->bytecode_offset, header->bytecode_size, version))
+    {
+        exec_set_error(exec, "Failed to load bytecode from snapshot %s", filepath);
+        ir_plat_file_unmap(data, file_size);
+        return false;
+    }
+
+    // Bytecode is used in place, so the pool takes the ownership of the mapping
+    pool->mapping = data;
+    pool->mapping_size = file_size;
+
+    const uint64_t* old_addrs = (const uint64_t*)(header + 1);
+    const uint64_t* large_sizes = old_addrs + header->addrs_count;
+    const IrValue* values = (const IrValue*)(large_sizes + header->large_count);
+    const unsigned char* heap_data = (const unsigned char*)(values + values_count);
+    const unsigned char* large_data = heap_data + header->heap_size;
+
+    // Snapshot heap is loaded as the old generation, so nothing can be left in the young one
+    exec->remembered.size = 0;
+    exec_heap_clear(&exec->nursery);
+    exec_heap_clear(&exec->survivors);
+    exec->incremental.active = false;
+    exec->incremental.gray.size = 0;
+    exec->incremental.written.size = 0;
+    exec->incremental.large.size = 0;
+
+    ir_arena_clear(exec->heap.mem);
+    void* heap_ptr = ir_arena_alloc(exec->heap.mem, header->heap_size);
+    if (!heap_ptr) {
+        exec_set_error(exec, "Failed to allocate %lu bytes for snapshot heap", header->heap_size);
+        return false;
+    }
+    memcpy(heap_ptr, heap_data, header->heap_size);
+    exec->heap.chunks_count = header->heap_chunks_count;
+    exec->heap.mem_max = MIN(MAX(exec->heap.mem_max, header->heap_mem_max), exec->heap.mem->reserve_size);
+
+    exec_snapshot_read_values(&exec->stack, values, header->stack_size);
+    exec_snapshot_read_values(&exec->globals, values + header->stack_size, header->globals_size);
+    exec_push_variable_stack(exec);
+    exec_snapshot_read_values(&exec->variables.items[exec->variables.size - 1], values + header->stack_size + header->globals_size, header->variables_size);
+
+    IrSnapshotAddrs new_addrs = {0};
+    exec_snapshot_const_addrs(exec, pool, &new_addrs, true);
+    if (new_addrs.size != header->addrs_count - header->large_count) {
+        exec_set_error(exec, "Snapshot %s does not match its bytecode", filepath);
+        ir_list_free(new_addrs);
+        return false;
+    }
+
+    uint64_t large_offset = 0;
+    for (size_t i = 0; i < header->large_count; i++) {
+        if (large_sizes[i] > UINT32_MAX || large_sizes[i] > header->large_size - large_offset) {
+            exec_set_error(exec, "Snapshot %s is corrupted", filepath);
+            ir_list_free(new_addrs);
+            return false;
+        }
+
+        IrHeapChunk* chunk = exec_large_malloc(exec, sizeof(IrHeapChunk) + large_sizes[i]);
+        if (!chunk) {
+            exec_set_error(exec, "Failed to allocate %lu bytes for snapshot large object", large_sizes[i]);
+            ir_list_free(new_addrs);
+            return false;
+        }
+        chunk->copy_ptr = NULL;
+        chunk->size = large_sizes[i];
+        chunk->kind = IR_CHUNK_DATA;
+        chunk->site = 0;
+        memcpy(chunk->data, large_data + large_offset, large_sizes[i]);
+        large_offset += large_sizes[i];
+        ir_list_append(new_addrs, (uint64_t)(uintptr_t)chunk->data);
+    }
+    exec->large.mem_max = MIN(MAX(exec->large.mem_max, header->large_mem_max), exec->heap.mem->reserve_size);
+
+    bool ok = exec_snapshot_relocate(exec, header->heap_base, header->heap_size, (uint64_t*)old_addrs, new_addrs.items, new_addrs.size, true);
+    ir_list_free(new_addrs);
+    if (!ok) return false;
+
+    *pos = header->pos;
+    return true;
+}
+
+// List headers always start in the nursery, so that they get their kind before reaching the old generation
+static bool exec_heap_is_young_size(IrExec* exec, size_t chunk_size) {
+    return chunk_size <= MAX((exec->nursery.mem_max - IR_ARENA_BASE_POS) / 8, sizeof(IrHeapChunk) + sizeof(IrList));
+}
+
+// Allocates chunk without collecting garbage. Small chunks are bump allocated in the nursery, while bigger ones
+// go straight to the old generation to avoid copying them around. Returns NULL if there is not enough space
+static IrHeapChunk* exec_heap_try_malloc(IrExec* exec, size_t chunk_size) {
+    if (chunk_size >= IR_LARGE_OBJECT_SIZE) {
+        if (exec->large.mem_size + chunk_size > exec->large.mem_max) return NULL;
+        return exec_large_malloc(exec, chunk_size);
+    }
+    if (exec_heap_is_young_size(exec, chunk_size)) return exec_heap_malloc(&exec->nursery, chunk_size);
+    return exec_heap_malloc(&exec->heap, chunk_size);
+}
+
+// Resizes the last chunk allocated in the heap in place. Lists which are appended to in a loop are usually the last
+// thing allocated, so they can grow without leaving dead copies behind. Chunks copied by incremental collection
+// are never resized, as their copy would no longer match them
+static bool exec_heap_extend(IrHeap* heap, IrHeapChunk* chunk, size_t new_size) {
+    if (chunk->copy_ptr || !exec_heap_contains(heap, chunk)) return false;
+    if (heap->mem->pos - chunk->size + new_size > heap->mem_max) return false;
+    if (!ir_arena_extend(heap->mem, chunk->data, chunk->size, new_size)) return false;
+    chunk->size = new_size;
+    return true;
+}
+
+// Large object space has its own limit, which is raised the same way as the heap one
+static IrHeapChunk* exec_large_collect_malloc(IrExec* exec, size_t chunk_size) {
+    exec_collect(exec);
+
+    IrLargeObjects* large = &exec->large;
+    size_t max_size = exec_large_max_size(exec);
+    if (large->mem_size + chunk_size > large->mem_max) {
+        while (large->mem_size + chunk_size > large->mem_max && large->mem_max < max_size) {
+            large->mem_max = exec_grow_limit(exec, large->mem_max, max_size);
+        }
+#ifdef DEBUG
+        printf("exec_large_collect_malloc: raising memory limit to %zu bytes\n", large->mem_max);
+#endif
+        if (large->mem_size + chunk_size > large->mem_max) {
+            exec_set_error(exec, "Heap out of memory. Tried to allocate %zu bytes but only %zu bytes were free", chunk_size, large->mem_size < max_size ? max_size - large->mem_size : 0);
+            return NULL;
+        }
+    }
+
+    IrHeapChunk* chunk = exec_large_malloc(exec, chunk_size);
+    if (!chunk) exec_set_error(exec, "Failed to allocate %zu bytes for large object", chunk_size);
+    return chunk;
+}
+
+static IrHeapChunk* exec_heap_collect_malloc(IrExec* exec, size_t chunk_size) {
+    if (chunk_size >= IR_LARGE_OBJECT_SIZE) return exec_large_collect_malloc(exec, chunk_size);
+
+    bool young = exec_heap_is_young_size(exec, chunk_size);
+    if (young) {
+        int64_t start_time = ir_plat_get_time();
+        exec_collect_minor(exec);
+        // Minor collections happen often enough to do incremental collection steps after them
+        if (exec->incremental.pause > 0) exec_collect_step(exec, exec->incremental.pause, false);
+        exec_stats_add_pause(exec, start_time);
+    } else {
+        exec_collect(exec);
+    }
+
+    // After small allocation the old generation should be able to fit the whole young generation, otherwise every
+    // following minor collection would turn into a full one
+    IrHeap* heap = &exec->heap;
+    size_t needed_size = young ? exec_young_capacity(exec) : chunk_size;
+    size_t max_size = exec_heap_max_size(exec);
+    if (heap->mem->pos + needed_size > heap->mem_max) {
+        while (heap->mem->pos + needed_size > heap->mem_max && heap->mem_max < max_size) {
+            heap->mem_max = exec_grow_limit(exec, heap->mem_max, max_size);
+        }
+#ifdef DEBUG
+        printf("exec_heap_collect_malloc: raising memory limit to %zu bytes\n", heap->mem_max);
+#endif
+        if (heap->mem->pos + needed_size > heap->mem_max) {
+            exec_set_error(exec, "Heap out of memory. Tried to allocate %zu bytes but only %zu bytes were free", chunk_size, heap->mem->pos < max_size ? max_size - heap->mem->pos : 0);
+            return NULL;
+        }
+    }
+
+    return exec_heap_malloc(young ? &exec->nursery : heap, chunk_size);
+}
+
+void* exec_malloc(IrExec* exec, size_t size) {
+    if (size == 0) return NULL;
+    if (size > UINT32_MAX) {
+        exec_set_error(exec, "Tried to allocate %zu bytes, but heap chunks can not be bigger than %u bytes", size, UINT32_MAX);
+        return NULL;
+    }
+
+    const size_t chunk_size = sizeof(IrHeapChunk) + size;
+    IrHeapChunk* chunk = exec_heap_try_malloc(exec, chunk_size);
+    if (chunk == NULL) {
+        chunk = exec_heap_collect_malloc(exec, chunk_size);
+        if (chunk == NULL) return NULL;
+    }
+
+    chunk->copy_ptr = NULL;
+    chunk->size = size;
+    chunk->kind = IR_CHUNK_DATA;
+    chunk->site = exec->profile ? exec_profile_site(exec) : 0;
+    exec->stats.allocations++;
+    exec->stats.allocated_bytes += size;
+    return chunk->data;
+}
+
+void* exec_realloc(IrExec* exec, void* ptr, size_t new_size) {
+    if (!ptr) return exec_malloc(exec, new_size);
+    if (new_size == 0) return NULL;
+    if (new_size > UINT32_MAX) {
+        exec_set_error(exec, "Tried to allocate %zu bytes, but heap chunks can not be bigger than %u bytes", new_size, UINT32_MAX);
+        return NULL;
+    }
+
+    IrHeapChunk* old_chunk = (IrHeapChunk*)ptr - 1;
+    size_t old_size = old_chunk->size;
+
+    const size_t new_chunk_size = sizeof(IrHeapChunk) + new_size;
+    IrMemArena* old_large = exec_large_find(&exec->large, old_chunk);
+    // Chunks which outgrow the nursery or the heap are moved to the next space instead
+    bool extended = false;
+    if (old_large) {
+        extended = exec_large_extend(exec, old_chunk, new_size);
+    } else if (new_chunk_size < IR_LARGE_OBJECT_SIZE) {
+        extended = (exec_heap_is_young_size(exec, new_chunk_size) && exec_heap_extend(&exec->nursery, old_chunk, new_size)) ||
+                   exec_heap_extend(&exec->heap, old_chunk, new_size);
+    }
+    if (extended) {
+        if (new_size > old_size) exec->stats.allocated_bytes += new_size - old_size;
+        return ptr;
+    }
+
+    IrHeapChunk* new_chunk = exec_heap_try_malloc(exec, new_chunk_size);
+    if (new_chunk == NULL) {
+        if (old_large) {
+            // Large chunk is not moved by the collection, it only has to survive it to be freed afterwards
+            old_chunk->copy_ptr = old_chunk;
+        } else {
+            // Avoid losing ptr value by copying chunk contents into temporary block
+            IrHeapChunk* new_old_chunk = malloc(sizeof(IrHeapChunk) + old_chunk->size);
+            memcpy(new_old_chunk, old_chunk, sizeof(IrHeapChunk) + old_chunk->size);
+            old_chunk = new_old_chunk;
+        }
+
+        new_chunk = exec_heap_collect_malloc(exec, new_chunk_size);
+        if (new_chunk == NULL) {
+            if ((IrHeapChunk*)ptr - 1 != old_chunk) free(old_chunk);
+            return NULL;
+        }
+    }
+
+    new_chunk->copy_ptr = NULL;
+    new_chunk->size = new_size;
+    new_chunk->kind = old_chunk->kind;
+    new_chunk->site = exec->profile ? exec_profile_site(exec) : 0;
+    exec->stats.allocations++;
+    exec->stats.allocated_bytes += new_size;
+
+    memcpy(new_chunk->data, old_chunk->data, MIN(old_chunk->size, new_size));
+
+    if ((IrHeapChunk*)ptr - 1 != old_chunk) free(old_chunk);
+    // Old items are only referenced by the list being resized, unless incremental collection has copied the list
+    if (old_large && !exec->incremental.active) exec_large_free(exec, old_large);
+    return new_chunk->data;
+}
+
+static void exec_heap_free(IrHeap* heap) {
+    if (heap->mem) {
+        ir_arena_free(heap->mem);
+        heap->mem = NULL;
+    }
+}
+
+static IrHeap exec_heap_new(size_t memory_min, size_t memory_max) {
+    IrHeap heap = {0};
+    if (memory_max == 0 || memory_min > memory_max) return heap;
+    heap.mem = ir_arena_new(memory_max, memory_min);
+    heap.mem_max = memory_min;
+    return heap;
+}
+
+IrExec exec_new(size_t memory_min, size_t memory_max) {
+    IrExec exec = {0};
+    exec.fuel = exec.fuel_budget = IR_DEFAULT_FUEL;
+    exec.incremental.pause = IR_DEFAULT_GC_PAUSE;
+    exec.gc_threads = 1;
+    exec.gc_growth = IR_DEFAULT_GC_GROWTH;
+    exec.gc_live_ratio = IR_DEFAULT_GC_LIVE_RATIO;
+
+    IrHeap heap = exec_heap_new(memory_min, memory_max);
+    IrHeap second_heap = exec_heap_new(memory_min, memory_max);
+
+    exec.heap = heap;
+    exec.second_heap = second_heap;
+    exec.large.mem_max = memory_min;
+
+    size_t nursery_size = MIN(IR_NURSERY_SIZE, memory_max / 4);
+    exec.nursery = exec_heap_new(nursery_size, nursery_size);
+    exec.survivors = exec_heap_new(nursery_size, nursery_size);
+    exec.second_survivors = exec_heap_new(nursery_size, nursery_size);
+    // Arena rounds its size up to the page size, so the whole reserved memory can be used
+    if (exec.nursery.mem) exec.nursery.mem_max = exec.nursery.mem->reserve_size;
+    if (exec.survivors.mem) exec.survivors.mem_max = exec.survivors.mem->reserve_size;
+    if (exec.second_survivors.mem) exec.second_survivors.mem_max = exec.second_survivors.mem->reserve_size;
+
+    if (!exec.heap.mem || !exec.second_heap.mem || !exec.nursery.mem || !exec.survivors.mem || !exec.second_survivors.mem) {
+        exec_set_error(&exec, "Failed to reserve %zu bytes of memory for the heap", memory_max);
+    }
+    return exec;
+}
+
+void exec_free(IrExec* exec) {
+    ir_list_free(exec->chunks);
+    ir_list_free(exec->stack);
+    ir_list_free(exec->globals);
+    ir_list_free(exec->remembered);
+    ir_list_free(exec->incremental.gray);
+    ir_list_free(exec->incremental.written);
+    ir_list_free(exec->incremental.large);
+
+    for (size_t i = 0; i < exec->variables.size; i++) {
+        ir_list_free(exec->variables.items[i]);
+    }
+    ir_list_free(exec->variables);
+
+#ifdef DEBUG
+    printf("exec_free: %zu bytes allocated, %zu chunks created\n", exec->heap.mem->pos, exec->heap.chunks_count);
+#endif
+    exec_heap_free(&exec->heap);
+    exec_heap_free(&exec->second_heap);
+    exec_heap_free(&exec->nursery);
+    exec_heap_free(&exec->survivors);
+    exec_heap_free(&exec->second_survivors);
+
+    for (size_t i = 0; i < exec->large.size; i++) ir_arena_free(exec->large.items[i]);
+    for (size_t i = 0; i < exec->large.cache.size; i++) ir_arena_free(exec->large.cache.items[i]);
+    ir_list_free(exec->large);
+    ir_list_free(exec->large.cache);
+    exec_set_heap_profile(exec, NULL);
+    ir_list_free(exec->stats.functions);
+    free(exec->stats.opcodes);
+}
+
+void exec_enable_stats(IrExec* exec, bool opcodes) {
+    exec->stats.count_functions = true;
+    // Every byte gets a counter, as illegal opcodes are executed too before failing
+    if (opcodes && !exec->stats.opcodes) exec->stats.opcodes = calloc(UINT8_MAX + 1, sizeof(*exec->stats.opcodes));
+}
+
+// Names of opcodes as printed by bytecode_print
+static const char* ir_opcode_names[IR_LAST] = {
+    [IR_ILLEGAL] = "inval",
+    [IR_PUSHN]   = "pushn",
+    [IR_PUSHI]   = "pushi",
+    [IR_PUSHF]   = "pushf",
+    [IR_PUSHB]   = "pushb",
+    [IR_PUSHL]   = "pushl",
+    [IR_PUSHA]   = "pusha",
+    [IR_PUSHLB]  = "pushlb",
+    [IR_PUSHFN]  = "pushfn",
+    [IR_POP]     = "pop",
+    [IR_POPC]    = "popc",
+    [IR_DUP]     = "dup",
+    [IR_LOAD]    = "load",
+    [IR_STORE]   = "store",
+    [IR_GLOAD]   = "gload",
+    [IR_GSTORE]  = "gstore",
+    [IR_ADDI]    = "addi",
+    [IR_SUBI]    = "subi",
+    [IR_MULI]    = "muli",
+    [IR_DIVI]    = "divi",
+    [IR_MODI]    = "modi",
+    [IR_POWI]    = "powi",
+    [IR_NOTI]    = "noti",
+    [IR_ANDI]    = "andi",
+    [IR_ORI]     = "ori",
+    [IR_XORI]    = "xori",
+    [IR_ADDF]    = "addf",
+    [IR_SUBF]    = "subf",
+    [IR_MULF]    = "mulf",
+    [IR_DIVF]    = "divf",
+    [IR_MODF]    = "modf",
+    [IR_POWF]    = "powf",
+    [IR_NOT]     = "not",
+    [IR_AND]     = "and",
+    [IR_OR]      = "or",
+    [IR_XOR]     = "xor",
+    [IR_LESSI]   = "lessi",
+    [IR_MOREI]   = "morei",
+    [IR_LESSF]   = "lessf",
+    [IR_MOREF]   = "moref",
+    [IR_LESSEQI] = "lesseqi",
+    [IR_MOREEQI] = "moreeqi",
+    [IR_LESSEQF] = "lesseqf",
+    [IR_MOREEQF] = "moreeqf",
+    [IR_EQ]      = "eq",
+    [IR_NEQ]     = "neq",
+    [IR_ITOF]    = "itof",
+    [IR_ITOB]    = "itob",
+    [IR_ITOA]    = "itoa",
+    [IR_FTOI]    = "ftoi",
+    [IR_FTOB]    = "ftob",
+    [IR_FTOA]    = "ftoa",
+    [IR_BTOI]    = "btoi",
+    [IR_BTOF]    = "btof",
+    [IR_BTOA]    = "btoa",
+    [IR_ATOI]    = "atoi",
+    [IR_ATOF]    = "atof",
+    [IR_ATOB]    = "atob",
+    [IR_LTOA]    = "ltoa",
+    [IR_NTOA]    = "ntoa",
+    [IR_TOI]     = "toi",
+    [IR_TOF]     = "tof",
+    [IR_TOB]     = "tob",
+    [IR_TOA]     = "toa",
+    [IR_TOL]     = "tol",
+    [IR_TYPEOF]  = "typeof",
+    [IR_ADDL]    = "addl",
+    [IR_INDEXL]  = "indexl",
+    [IR_SETL]    = "setl",
+    [IR_INSERTL] = "insertl",
+    [IR_DELL]    = "dell",
+    [IR_LENL]    = "lenl",
+    [IR_JMP]     = "jmp",
+    [IR_IF]      = "if",
+    [IR_IFNOT]   = "ifnot",
+    [IR_CALL]    = "call",
+    [IR_RUN]     = "run",
+    [IR_DYNJMP]  = "dynjmp",
+    [IR_DYNIF]   = "dynif",
+    [IR_DYNCALL] = "dyncall",
+    [IR_DYNRUN]  = "dynrun",
+    [IR_RET]     = "ret",
+    [IR_CALLX]   = "callx",
+};
+
+static int exec_function_stats_compare(const void* a, const void* b) {
+    uint64_t left = ((const IrFunctionStats*)a)->calls;
+    uint64_t right = ((const IrFunctionStats*)b)->calls;
+    return left < right ? 1 : left > right ? -1 : 0;
+}
+
+static void exec_write_json_string(FILE* file, const char* str) {
+    fputc('"', file);
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\') {
+            fprintf(file, "\\%c", *str);
+        } else if ((unsigned char)*str < 0x20) {
+            fprintf(file, "\\u%04x", *str);
+        } else {
+            fputc(*str, file);
+        }
+    }
+    fputc('"', file);
+}
+
+void exec_write_stats(IrExec* exec, FILE* file, bool json) {
+    IrExecStats* stats = &exec->stats;
+    qsort(stats->functions.items, stats->functions.size, sizeof(*stats->functions.items), exec_function_stats_compare);
+    stats->last_func = NULL;
+
+    if (json) {
+        fprintf(file, "{\"instructions\": %lu, \"calls\": %lu, \"max_call_depth\": %zu, ", stats->instructions, stats->calls, stats->max_call_depth);
+        fprintf(file, "\"allocations\": %lu, \"allocated_bytes\": %lu, ", stats->allocations, stats->allocated_bytes);
+        fprintf(file, "\"minor_collections\": %lu, \"full_collections\": %lu, \"copied_bytes\": %lu, ", stats->minor_collections, stats->full_collections, stats->copied_bytes);
+        fprintf(file, "\"gc_pause_us\": %ld, \"gc_max_pause_us\": %ld, \"gc_idle_us\": %ld", stats->gc_pause_time, stats->gc_max_pause, stats->gc_idle_time);
+
+        if (stats->count_functions) {
+            fprintf(file, ", \"functions\": {");
+            for (size_t i = 0; i < stats->functions.size; i++) {
+                IrFunctionStats* func = &stats->functions.items[i];
+                if (i > 0) fprintf(file, ", ");
+                if (func->name) {
+                    exec_write_json_string(file, func->name);
+                } else {
+                    fprintf(file, "\"%p\"", (void*)func->func);
+                }
+                fprintf(file, ": %lu", func->calls);
+            }
+            fprintf(file, "}");
+        }
+
+        if (stats->opcodes) {
+            fprintf(file, ", \"opcodes\": {");
+            bool first = true;
+            for (int i = 0; i <= UINT8_MAX; i++) {
+                if (stats->opcodes[i] == 0) continue;
+                if (!first) fprintf(file, ", ");
+                fprintf(file, "\"%s\": %lu", i < IR_LAST && ir_opcode_names[i] ? ir_opcode_names[i] : "inval", stats->opcodes[i]);
+                first = false;
+            }
+            fprintf(file, "}");
+        }
+        fprintf(file, "}\n");
+        return;
+    }
+
+    fprintf(file, "=== Runtime stats ===\n");
+    fprintf(file, "Instructions:      %lu\n", stats->instructions);
+    fprintf(file, "Calls:             %lu (max depth %zu)\n", stats->calls, stats->max_call_depth);
+    fprintf(file, "Allocations:       %lu (%lu bytes)\n", stats->allocations, stats->allocated_bytes);
+    fprintf(file, "Collections:       %lu minor, %lu full (%lu bytes copied)\n", stats->minor_collections, stats->full_collections, stats->copied_bytes);
+    fprintf(file, "GC pauses:         %.3f ms (max %.3f ms)\n", stats->gc_pause_time / 1000.0, stats->gc_max_pause / 1000.0);
+    fprintf(file, "GC while idle:     %.3f ms\n", stats->gc_idle_time / 1000.0);
+
+    if (stats->count_functions && stats->functions.size > 0) {
+        fprintf(file, "Functions run:\n");
+        for (size_t i = 0; i < stats->functions.size; i++) {
+            IrFunctionStats* func = &stats->functions.items[i];
+            if (func->name) {
+                fprintf(file, "    %-24s %lu\n", func->name, func->calls);
+            } else {
+                fprintf(file, "    %-24p %lu\n", (void*)func->func, func->calls);
+            }
+        }
+    }
+
+    if (stats->opcodes) {
+        fprintf(file, "Instructions by opcode:\n");
+        for (int i = 0; i <= UINT8_MAX; i++) {
+            if (stats->opcodes[i] == 0) continue;
+            fprintf(file, "    %-24s %lu\n", i < IR_LAST && ir_opcode_names[i] ? ir_opcode_names[i] : "inval", stats->opcodes[i]);
+        }
+    }
+}
+
+void exec_set_run_function_resolver(IrExec* exec, IrRunFunctionResolver resolver) {
+    exec->resolve_run_function = resolver;
+}
+
+void exec_set_fuel_handler(IrExec* exec, IrFuelHandler handler, int64_t fuel_budget) {
+    exec->fuel_handler = handler;
+    exec->fuel_budget = fuel_budget > 0 ? fuel_budget : IR_DEFAULT_FUEL;
+    __atomic_store_n(&exec->fuel, exec->fuel_budget, __ATOMIC_RELAXED);
+}
+
+bool exec_refuel(IrExec* exec) {
+    __atomic_store_n(&exec->fuel, exec->fuel_budget, __ATOMIC_RELAXED);
+    if (__atomic_load_n(&exec->interrupted, __ATOMIC_RELAXED)) {
+        exec_set_error(exec, "Execution was interrupted");
+        return false;
+    }
+    if (!exec->fuel_handler) return true;
+
+    exec->last_error[0] = 0;
+    if (exec->fuel_handler(exec)) return true;
+    if (exec->last_error[0] == 0) exec_set_error(exec, "Execution was stopped by fuel handler");
+    return false;
+}
+
+void exec_interrupt(IrExec* exec) {
+    __atomic_store_n(&exec->interrupted, true, __ATOMIC_RELAXED);
+    __atomic_store_n(&exec->fuel, 0, __ATOMIC_RELAXED);
+}
+
+void exec_clear_interrupt(IrExec* exec) {
+    __atomic_store_n(&exec->interrupted, false, __ATOMIC_RELAXED);
+}
+
+void exec_add_bytecode(IrExec* exec, IrBytecode bc) {
+    ir_list_append(exec->chunks, bc);
+}
+
+IrBytecode* exec_find_bytecode(IrExec* exec, const char* bc_name) {
+    for (size_t i = 0; i < exec->chunks.size; i++) {
+        if (!strcmp(exec->chunks.items[i].name, bc_name)) return &exec->chunks.items[i];
+    }
+    return NULL;
+}
+
+IrLabel* bytecode_find_export(IrBytecode* bc, const char* label_name) {
+    for (size_t i = 0; i < bc->exports.size; i++) {
+        IrLabel* label = &bc->pool->list.items[bc->exports.items[i]].as.label_val;
+        if (!strcmp(label->name, label_name)) return label;
+    }
+    return NULL;
+}
+
+static bool bytecode_uses_globals(IrBytecode* bc) {
+    for (size_t i = 0; i < bc->code.size; i++) {
+        IrOpcode op = bc->code.items[i];
+        if (op == IR_GLOAD || op == IR_GSTORE) return true;
+        if (ir_op_has_immediate(op)) i += 3;
+    }
+    return false;
+}
+
+bool exec_link(IrExec* exec) {
+    for (size_t i = 0; i < exec->chunks.size; i++) {
+        IrBytecodePool* pool = exec->chunks.items[i].pool;
+
+        for (size_t j = 0; j < pool->list.size; j++) {
+            if (pool->list.items[j].type != IR_TYPE_IMPORT) continue;
+            IrImport* import = &pool->list.items[j].as.import_val;
+
+            IrBytecode* module = exec_find_bytecode(exec, import->module);
+            if (!module) {
+                exec_set_error(exec, "Module \"%s\" required by bytecode \"%s\" is not found", import->module, exec->chunks.items[i].name);
+                return false;
+            }
+
+            IrLabel* label = bytecode_find_export(module, import->label);
+            if (!label) {
+                exec_set_error(exec, "Label with name \"%s\" is not exported from module \"%s\"", import->label, import->module);
+                return false;
+            }
+
+            // Global slots are numbered per chunk, so globals of a module would overwrite the ones of the main chunk
+            if (module != &exec->chunks.items[i] && bytecode_uses_globals(module)) {
+                exec_set_error(exec, "Module \"%s\" uses global variables, which are not supported in modules", import->module);
+                return false;
+            }
+
+            import->chunk = module - exec->chunks.items;
+            import->pos = label->pos;
+        }
+    }
+    return true;
+}
+
+bool exec_call_import(IrExec* exec, IrImport* import) {
+    if (import->chunk >= exec->chunks.size) {
+        exec_set_error(exec, "Call to unresolved label \"%s\" from module \"%s\"", import->label, import->module);
+        return false;
+    }
+    // Chunk is referenced by index, as exec->chunks may be reallocated after linking
+    return exec_run_bytecode(exec, &exec->chunks.items[import->chunk], import->pos);
+}
+
+IrLabel* bytecode_find_label(IrBytecode* bc, const char* label_name) {
+    // Searching through labels of the bytecode instead of the pool hash set, because building the hash set
+    // for freshly loaded pool would need to read every constant
+    for (size_t i = 0; i < bc->labels.size; i++) {
+        IrLabel* label = &bc->pool->list.items[bc->labels.items[i]].as.label_val;
+        if (!strcmp(label->name, label_name)) return label;
+    }
+    return NULL;
+}
+
+bool exec_run(IrExec* exec, const char* bc_name, const char* label_name) {
+    return exec_run_native(exec, bc_name, label_name, exec_run_bytecode);
+}
+
+bool exec_run_native(IrExec* exec, const char* bc_name, const char* label_name, IrNativeFunction func) {
+    IrBytecode* bc = exec_find_bytecode(exec, bc_name);
+    if (!bc) {
+        exec_set_error(exec, "Bytecode with name \"%s\" is not found", bc_name);
+        return false;
+    }
+
+    IrLabel* label = bytecode_find_label(bc, label_name);
+    if (!label) {
+        exec_set_error(exec, "Label with name \"%s\" is not found in bytecode \"%s\"", label_name, bc_name);
+        return false;
+    }
+
+    return func(exec, bc, label->pos);
+}
+
+void exec_push_variable_stack(IrExec* exec) {
+    ir_list_append(exec->variables, (IrValueList) {0});
+    exec->stats.calls++;
+    exec->stats.max_call_depth = MAX(exec->stats.max_call_depth, exec->variables.size);
+}
+
+void exec_pop_variable_stack(IrExec* exec) {
+    ir_list_free(exec->variables.items[exec->variables.size - 1]);
+    exec->variables.size--;
+}
+
+void exec_push_value(IrExec* exec, IrValue value) {
+    ir_list_append(exec->stack, value);
+}
+
+#define _ir_make_push(_name, _type, _valname, _irtype) \
+void _name(IrExec* exec, _type _valname) { \
+    IrValue val; \
+    val.type = _irtype; \
+    val.as._valname = _valname; \
+    exec_push_value(exec, val); \
+}
+
+_ir_make_push(exec_push_int, int64_t, int_val, IR_TYPE_INT)
 _ir_make_push(exec_push_float, double, float_val, IR_TYPE_FLOAT)
 _ir_make_push(exec_push_bool, bool, bool_val, IR_TYPE_BOOL)
 _ir_make_push(exec_push_func, IrRunFunction, func_val, IR_TYPE_FUNC)
@@ -1843,129 +4932,784 @@ IrValue exec_pop_value(IrExec* exec) {
     return exec->stack.items[--exec->stack.size];
 }
 
-void exec_pop_multiple(IrExec* exec, size_t count) {
-    IR_ASSERT(exec->stack.size >= count);
-    exec->stack.size -= count;
-}
+void exec_pop_multiple(IrExec* exec, size_t count) {
+    IR_ASSERT(exec->stack.size >= count);
+    exec->stack.size -= count;
+}
+
+void exec_dup_value(IrExec* exec) {
+    exec_push_value(exec, exec_get_value(exec));
+}
+
+#define _ir_make_pop(_name, _type, _valname, _irtype) \
+_type _name(IrExec* exec) { \
+    IR_ASSERT(exec->stack.size > 0); \
+    IrValue val = exec_pop_value(exec); \
+    IR_ASSERT(val.type == _irtype); \
+    return val.as._valname; \
+}
+
+_ir_make_pop(exec_pop_int, int64_t, int_val, IR_TYPE_INT)
+_ir_make_pop(exec_pop_float, double, float_val, IR_TYPE_FLOAT)
+_ir_make_pop(exec_pop_bool, bool, bool_val, IR_TYPE_BOOL)
+_ir_make_pop(exec_pop_func, IrRunFunction, func_val, IR_TYPE_FUNC)
+_ir_make_pop(exec_pop_label, size_t, label_val, IR_TYPE_LABEL)
+_ir_make_pop(exec_pop_list, IrList*, list_val, IR_TYPE_LIST)
+_ir_make_pop(exec_pop_list_string, IrList*, list_val, IR_TYPE_STRING)
+
+#undef _ir_make_pop
+
+IrList* exec_list_new(IrExec* exec) {
+    IrList* list = exec_malloc(exec, sizeof(IrList));
+    if (!list) return NULL;
+    memset(list, 0, sizeof(IrList));
+    list->owned = true;
+    return list;
+}
+
+static IrList* exec_push_string_capacity(IrExec* exec, size_t size, size_t capacity, bool wide) {
+    IrList* string = exec_list_new(exec);
+    if (!string) return NULL;
+    exec_push_list_string(exec, string);
+    if (capacity == 0) return string;
+
+    void* chars = exec_malloc(exec, capacity * (wide ? sizeof(uint32_t) : sizeof(uint8_t)));
+    if (!chars) return NULL;
+
+    string = exec_get_list_string(exec);
+    string->chars = chars;
+    string->size = size;
+    string->capacity = capacity;
+    string->wide = wide;
+    exec_write_barrier(exec, string);
+    return string;
+}
+
+IrList* exec_push_string_alloc(IrExec* exec, size_t size, bool wide) {
+    return exec_push_string_capacity(exec, size, size, wide);
+}
+
+bool exec_push_string_char(IrExec* exec, uint32_t codepoint) {
+    if (codepoint < IR_CHAR_STRINGS_COUNT) {
+        exec_push_list_string(exec, &ir_char_strings[codepoint]);
+        return true;
+    }
+
+    IrList* string = exec_push_string_alloc(exec, 1, true);
+    if (!string) return false;
+    ir_string_set(string, 0, codepoint);
+    return true;
+}
+
+bool exec_push_string_int(IrExec* exec, int64_t value) {
+    if (value >= 0 && value < IR_INT_STRINGS_COUNT) {
+        exec_push_list_string(exec, &ir_int_strings[value]);
+        return true;
+    }
+
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%lld", (long long)value);
+    return exec_push_string(exec, buf);
+}
+
+// %g prints integral floats the same way as integers, except for negative zero
+static bool exec_push_string_float(IrExec* exec, double value) {
+    if (value >= 0 && value < IR_INT_STRINGS_COUNT && value == (int64_t)value && !signbit(value)) {
+        exec_push_list_string(exec, &ir_int_strings[(int64_t)value]);
+        return true;
+    }
+
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%g", value);
+    return exec_push_string(exec, buf);
+}
+
+bool exec_push_string(IrExec* exec, const char* str) {
+    size_t size = 0;
+    bool ascii = true, wide = false;
+    for (const char* ch = str; *ch; size++) {
+        if ((unsigned char)*ch >= 0x80) ascii = false;
+        if (ir_utf8_decode(&ch) > UINT8_MAX) wide = true;
+    }
+    if (size == 1) return exec_push_string_char(exec, ir_utf8_decode(&str));
+
+    IrList* string = exec_push_string_alloc(exec, size, wide);
+    if (!string) return false;
+
+    if (ascii) {
+        if (size > 0) memcpy(string->chars, str, size);
+        return true;
+    }
+    size_t i = 0;
+    for (const char* ch = str; *ch; i++) ir_string_set(string, i, ir_utf8_decode(&ch));
+    return true;
+}
+
+bool exec_string_join(IrExec* exec) {
+    IrList* right = exec_pop_list_string(exec);
+    IrList* left = exec_get_list_string(exec);
+    IR_ASSERT(left  != NULL);
+    IR_ASSERT(right != NULL);
+
+    size_t size = left->size + right->size;
+    bool wide = left->wide || right->wide;
+
+    if (left->tail && wide == left->wide && size <= left->capacity) {
+        // Left string keeps seeing only its own characters, while the result takes over the rest of the buffer
+        ir_string_copy(left, left->size, right, 0, right->size);
+        exec_heap_sync_data(exec, left->chars, left->size * ir_string_char_size(left), right->size * ir_string_char_size(left));
+        left->shared = true;
+        left->tail = false;
+        exec_log_write(exec, left);
+
+        IrList* string = exec_list_new(exec);
+        if (!string) return false;
+        left = exec_pop_list_string(exec);
+
+        string->chars = left->chars;
+        string->size = size;
+        string->capacity = left->capacity;
+        string->wide = wide;
+        string->shared = true;
+        string->tail = true;
+        exec_write_barrier(exec, string);
+        exec_push_list_string(exec, string);
+        return true;
+    }
+
+    // Strings made by joining are likely to be joined onto again, so they get twice the capacity they need
+    size_t capacity = left->tail ? size * 2 : size;
+    exec_push_list_string(exec, right);
+    if (!exec_push_string_capacity(exec, size, capacity, wide)) return false;
+
+    IrList* string = exec_pop_list_string(exec);
+    right = exec_pop_list_string(exec);
+    left  = exec_pop_list_string(exec);
+
+    ir_string_copy(string, 0, left, 0, left->size);
+    ir_string_copy(string, left->size, right, 0, right->size);
+    string->tail = true;
+    exec_push_list_string(exec, string);
+    return true;
+}
+
+void exec_get_string(IrList* string, char* buf, size_t buf_len) {
+    IR_ASSERT(string != NULL);
+
+    size_t len = 0;
+    for (size_t i = 0; i < string->size; i++) {
+        char sequence[4];
+        size_t sequence_size = ir_utf8_encode(ir_string_get(string, i), sequence);
+        if (len + sequence_size >= buf_len) break;
+        memcpy(buf + len, sequence, sequence_size);
+        len += sequence_size;
+    }
+    buf[len] = '\0';
+}
+
+void exec_pop_string(IrExec* exec, char* buf, size_t buf_len) {
+    IrList* list = exec_pop_list_string(exec);
+    exec_get_string(list, buf, buf_len);
+}
+
+int64_t ir_int_pow(int64_t base, int64_t exp) {
+    if (exp == 0) return 1;
+
+    int64_t result = 1;
+    while (exp) {
+        if (exp & 1) result *= base;
+        exp >>= 1;
+        base *= base;
+    }
+    return result;
+}
+
+#define IR_EXEC_FAIL do { \
+    return_val = false; \
+    goto exec_return; \
+} while (0)
+
+// Every loop and recursion goes through a backward jump or a call, so metering them is enough to stop any program
+#define IR_EXEC_USE_FUEL do { \
+    if (!exec_use_fuel(exec)) IR_EXEC_FAIL; \
+} while (0)
+
+// Records the current instruction as allocation site for the heap profiler (See exec_set_heap_profile)
+#define IR_EXEC_SET_ALLOC_SITE do { \
+    if (exec->profile) { \
+        exec->alloc_bc = bc; \
+        exec->alloc_pos = i; \
+    } \
+} while (0)
+#define IR_STRING_BUF_LEN 64
+
+IrValue exec_load_variable(IrExec* exec, int64_t pos) {
+    IR_ASSERT(exec->variables.size > 0);
+    IrValueList* variable_frame = &exec->variables.items[exec->variables.size - 1];
+    IR_ASSERT(pos >= 0);
+    IR_ASSERT((size_t)pos < variable_frame->size);
+    return variable_frame->items[pos];
+}
+
+void exec_store_variable(IrExec* exec, int64_t pos, IrValue value) {
+    IR_ASSERT(exec->variables.size > 0);
+    IrValueList* variable_frame = &exec->variables.items[exec->variables.size - 1];
+    IR_ASSERT(pos >= 0);
+
+    if ((size_t)pos >= variable_frame->size) {
+        while ((size_t)pos > variable_frame->size) {
+            ir_list_append(*variable_frame, (IrValue) {0});
+        }
+        ir_list_append(*variable_frame, value);
+    } else {
+        variable_frame->items[pos] = value;
+    }
+}
+
+IrValue exec_load_global(IrExec* exec, int64_t pos) {
+    IR_ASSERT(pos >= 0);
+    IR_ASSERT((size_t)pos < exec->globals.size);
+    return exec->globals.items[pos];
+}
+
+void exec_store_global(IrExec* exec, int64_t pos, IrValue value) {
+    IR_ASSERT(pos >= 0);
+
+    if ((size_t)pos >= exec->globals.size) {
+        while ((size_t)pos > exec->globals.size) {
+            ir_list_append(exec->globals, (IrValue) {0});
+        }
+        ir_list_append(exec->globals, value);
+    } else {
+        exec->globals.items[pos] = value;
+    }
+}
+
+static void exec_stats_count_function(IrExec* exec, IrRunFunction func, const char* name) {
+    IrExecStats* stats = &exec->stats;
+    if (func != stats->last_func) {
+        size_t i = 0;
+        while (i < stats->functions.size && stats->functions.items[i].func != func) i++;
+        if (i == stats->functions.size) {
+            ir_list_append(stats->functions, ((IrFunctionStats) { .func = func, .name = name, .calls = 0 }));
+        }
+        stats->last_func = func;
+        stats->last_func_index = i;
+    }
+    stats->functions.items[stats->last_func_index].calls++;
+}
+
+void exec_set_function_error(IrExec* exec, IrFunction* func) {
+    if (exec->last_error[0] != 0) return;
+    if (func->hint) {
+        exec_set_error(exec, "Unknown error from function \"%s\"", func->hint);
+    } else {
+        exec_set_error(exec, "Unknown error from function %p", func->ptr);
+    }
+}
+
+bool exec_run_function(IrExec* exec, IrFunction* func) {
+    if (!func->ptr) {
+        if (!exec->resolve_run_function) {
+            exec_set_error(exec, "Called run instruction, but no run function resolver has been attached");
+            return false;
+        }
+        func->ptr = exec->resolve_run_function(exec, func->hint);
+        if (!func->ptr) {
+            exec_set_error(exec, "Function \"%s\" does not exist at runtime", func->hint);
+            return false;
+        }
+    }
+    if (exec->stats.count_functions) exec_stats_count_function(exec, func->ptr, func->hint);
+    if (!func->ptr(exec)) {
+        exec_set_function_error(exec, func);
+        return false;
+    }
+    return true;
+}
+
+// Character stored by list instructions into strings
+static uint32_t exec_value_codepoint(IrValue value) {
+    switch (value.type) {
+    case IR_TYPE_INT: return value.as.int_val;
+    case IR_TYPE_BYTE: return value.as.byte_val;
+    default: return '?';
+    }
+}
+
+// Makes room for size characters in string on top of the stack, widening its characters if wide is set.
+// Shared characters are copied, so that the string can be modified without affecting other strings.
+// Returns the string, which might have been moved by allocation, or NULL if allocation failed
+static IrList* exec_string_reserve(IrExec* exec, size_t size, bool wide) {
+    IrList* string = exec_get_list_string(exec);
+    wide = wide || string->wide;
+    if (size <= string->capacity && wide == string->wide && !string->shared) return string;
+
+    size_t capacity = string->capacity;
+    while (capacity < size) capacity = capacity == 0 ? 4 : capacity * 2;
+
+    void* chars;
+    if (wide == string->wide && !string->shared) {
+        chars = exec_realloc(exec, string->chars, capacity * ir_string_char_size(string));
+        if (!chars) return NULL;
+        string = exec_get_list_string(exec);
+    } else {
+        chars = exec_malloc(exec, capacity * (wide ? sizeof(uint32_t) : sizeof(uint8_t)));
+        if (!chars) return NULL;
+        string = exec_get_list_string(exec);
+        IrList copy = *string;
+        copy.chars = chars;
+        copy.wide = wide;
+        ir_string_copy(&copy, 0, string, 0, string->size);
+        string->wide = wide;
+        string->shared = false;
+    }
+    string->chars = chars;
+    string->capacity = capacity;
+    exec_write_barrier(exec, string);
+    return string;
+}
+
+static bool exec_values_equal(IrValue left, IrValue right) {
+    if (left.type != right.type) return false;
+
+    switch (left.type) {
+    case IR_TYPE_NOTHING: return true;
+    case IR_TYPE_BYTE: return left.as.byte_val == right.as.byte_val;
+    case IR_TYPE_INT: return left.as.int_val == right.as.int_val;
+    case IR_TYPE_FLOAT: return left.as.float_val == right.as.float_val;
+    case IR_TYPE_BOOL: return left.as.bool_val == right.as.bool_val;
+    case IR_TYPE_LIST: return left.as.list_val == right.as.list_val;
+    case IR_TYPE_STRING: ;
+        IrList* left_string = left.as.list_val;
+        IrList* right_string = right.as.list_val;
+        // Strings compared with a constant are usually compared with many of them, like commands matched against
+        // every known keyword. Hashes are kept in the strings, so after the first comparison characters are only
+        // compared with constants which have the same hash. Two other strings are likely compared only once, so
+        // hashing them would only make comparison slower
+        if (left_string != right_string && left_string->size == right_string->size && (!left_string->owned || !right_string->owned)) {
+            ir_string_hash(left_string);
+            ir_string_hash(right_string);
+        }
+        return ir_string_equals(left_string, right_string);
+    case IR_TYPE_FUNC: return left.as.func_val == right.as.func_val;
+    case IR_TYPE_LABEL: return left.as.label_val == right.as.label_val;
+    case IR_TYPE_IMPORT: return false;
+    }
+    return false;
+}
+
+bool exec_op(IrExec* exec, IrOpcode op) {
+    bool return_val = true;
+
+    char string_buf[IR_STRING_BUF_LEN];
+
+    int64_t left_int;
+    double  left_float;
+    bool    left_bool;
+    IrValue left_value, right_value;
+    IrList* list;
+
+    switch (op) {
+    case IR_EQ:
+    case IR_NEQ:
+        right_value = exec_pop_value(exec);
+        left_value  = exec_pop_value(exec);
+        exec_push_bool(exec, exec_values_equal(left_value, right_value) == (op == IR_EQ));
+        break;
+    case IR_ITOA:
+        left_int = exec_pop_int(exec);
+        if (!exec_push_string_int(exec, left_int)) IR_EXEC_FAIL;
+        break;
+    case IR_FTOA:
+        left_float = exec_pop_float(exec);
+        if (!exec_push_string_float(exec, left_float)) IR_EXEC_FAIL;
+        break;
+    case IR_BTOA:
+        left_bool = exec_pop_bool(exec);
+        exec_push_list_string(exec, &ir_bool_strings[left_bool]);
+        break;
+    case IR_NTOA:
+        exec_pop_value(exec);
+        exec_push_list_string(exec, &ir_nothing_string);
+        break;
+    case IR_LTOA:
+        list = exec_pop_list(exec);
+        IR_ASSERT(list != NULL);
+        if (list->size == 0) {
+            snprintf(string_buf, IR_STRING_BUF_LEN, "[List: Empty]");
+        } else {
+            snprintf(string_buf, IR_STRING_BUF_LEN, "[List: %p, %zu/%zu]", list, list->size, list->capacity);
+        }
+        if (!exec_push_string(exec, string_buf)) IR_EXEC_FAIL;
+        break;
+
+    case IR_ATOI:
+        exec_pop_string(exec, string_buf, IR_STRING_BUF_LEN);
+        exec_push_int(exec, atol(string_buf));
+        break;
+    case IR_ATOF:
+        exec_pop_string(exec, string_buf, IR_STRING_BUF_LEN);
+        exec_push_float(exec, atof(string_buf));
+        break;
+    case IR_ATOB:
+        exec_pop_string(exec, string_buf, IR_STRING_BUF_LEN);
+        exec_push_bool(exec, string_buf[0] != '\0' ? true : false);
+        break;
+
+    case IR_TOI:
+        left_value = exec_pop_value(exec);
+        switch (left_value.type) {
+        case IR_TYPE_INT:   exec_push_int(exec, left_value.as.int_val); break;
+        case IR_TYPE_FLOAT: exec_push_int(exec, left_value.as.float_val); break;
+        case IR_TYPE_BOOL:  exec_push_int(exec, left_value.as.bool_val); break;
+        case IR_TYPE_BYTE:  exec_push_int(exec, left_value.as.byte_val); break;
+        case IR_TYPE_STRING:
+            exec_get_string(left_value.as.list_val, string_buf, IR_STRING_BUF_LEN);
+            exec_push_int(exec, atol(string_buf));
+            break;
+        case IR_TYPE_NOTHING: exec_push_int(exec, 0); break;
+        default:
+            exec_set_error(exec, "Invalid type passed to toi");
+            IR_EXEC_FAIL;
+            break;
+        }
+        break;
+    case IR_TOF:
+        left_value = exec_pop_value(exec);
+        switch (left_value.type) {
+        case IR_TYPE_INT:   exec_push_float(exec, left_value.as.int_val); break;
+        case IR_TYPE_FLOAT: exec_push_float(exec, left_value.as.float_val); break;
+        case IR_TYPE_BOOL:  exec_push_float(exec, left_value.as.bool_val); break;
+        case IR_TYPE_BYTE:  exec_push_float(exec, left_value.as.byte_val); break;
+        case IR_TYPE_STRING:
+            exec_get_string(left_value.as.list_val, string_buf, IR_STRING_BUF_LEN);
+            exec_push_float(exec, atof(string_buf));
+            break;
+        case IR_TYPE_NOTHING: exec_push_float(exec, 0.0); break;
+        default:
+            exec_set_error(exec, "Invalid type passed to tof");
+            IR_EXEC_FAIL;
+            break;
+        }
+        break;
+    case IR_TOB:
+        left_value = exec_pop_value(exec);
+        switch (left_value.type) {
+        case IR_TYPE_INT:   exec_push_bool(exec, left_value.as.int_val != 0); break;
+        case IR_TYPE_FLOAT: exec_push_bool(exec, left_value.as.float_val != 0); break;
+        case IR_TYPE_BOOL:  exec_push_bool(exec, left_value.as.bool_val); break;
+        case IR_TYPE_BYTE:  exec_push_bool(exec, left_value.as.byte_val != 0); break;
+        case IR_TYPE_STRING:
+            exec_get_string(left_value.as.list_val, string_buf, IR_STRING_BUF_LEN);
+            exec_push_bool(exec, string_buf[0] != '\0' ? true : false);
+            break;
+        case IR_TYPE_NOTHING: exec_push_bool(exec, false); break;
+        default:
+            exec_set_error(exec, "Invalid type passed to tob");
+            IR_EXEC_FAIL;
+            break;
+        }
+        break;
+    case IR_TOA:
+        left_value = exec_pop_value(exec);
+        switch (left_value.type) {
+        case IR_TYPE_INT:
+            if (!exec_push_string_int(exec, left_value.as.int_val)) IR_EXEC_FAIL;
+            break;
+        case IR_TYPE_FLOAT:
+            if (!exec_push_string_float(exec, left_value.as.float_val)) IR_EXEC_FAIL;
+            break;
+        case IR_TYPE_BOOL:
+            exec_push_list_string(exec, &ir_bool_strings[left_value.as.bool_val]);
+            break;
+        case IR_TYPE_BYTE:
+            if (!exec_push_string_int(exec, left_value.as.byte_val)) IR_EXEC_FAIL;
+            break;
+        case IR_TYPE_STRING:
+            exec_push_value(exec, left_value);
+            break;
+        case IR_TYPE_LIST:
+            list = left_value.as.list_val;
+            IR_ASSERT(list != NULL);
+            if (list->size == 0) {
+                snprintf(string_buf, IR_STRING_BUF_LEN, "[List: Empty]");
+            } else {
+                snprintf(string_buf, IR_STRING_BUF_LEN, "[List: %p, %zu/%zu]", list, list->size, list->capacity);
+            }
+            if (!exec_push_string(exec, string_buf)) IR_EXEC_FAIL;
+            break;
+        case IR_TYPE_NOTHING:
+            if (!exec_push_string(exec, "nothing")) IR_EXEC_FAIL;
+            break;
+        default:
+            exec_set_error(exec, "Invalid type passed to toa");
+            IR_EXEC_FAIL;
+            break;
+        }
+        break;
+    case IR_TOL:
+        left_value = exec_pop_value(exec);
+        switch (left_value.type) {
+        case IR_TYPE_LIST: exec_push_value(exec, left_value); break;
+        default:
+            exec_set_error(exec, "Invalid type passed to tol");
+            IR_EXEC_FAIL;
+            break;
+        }
+        break;
+    case IR_TYPEOF:
+        left_value = exec_pop_value(exec);
+        switch (left_value.type) {
+        case IR_TYPE_NOTHING:
+            if (!exec_push_string(exec, "nothing")) IR_EXEC_FAIL;
+            break;
+        case IR_TYPE_BYTE:
+            if (!exec_push_string(exec, "byte")) IR_EXEC_FAIL;
+            break;
+        case IR_TYPE_INT:
+            if (!exec_push_string(exec, "integer")) IR_EXEC_FAIL;
+            break;
+        case IR_TYPE_FLOAT:
+            if (!exec_push_string(exec, "float")) IR_EXEC_FAIL;
+            break;
+        case IR_TYPE_BOOL:
+            if (!exec_push_string(exec, "bool")) IR_EXEC_FAIL;
+            break;
+        case IR_TYPE_LIST:
+            if (!exec_push_string(exec, "list")) IR_EXEC_FAIL;
+            break;
+        case IR_TYPE_STRING:
+            if (!exec_push_string(exec, "str")) IR_EXEC_FAIL;
+            break;
+        case IR_TYPE_FUNC:
+            if (!exec_push_string(exec, "func")) IR_EXEC_FAIL;
+            break;
+        case IR_TYPE_LABEL:
+            if (!exec_push_string(exec, "label")) IR_EXEC_FAIL;
+            break;
+        default:
+            assert(false && "Unhandled ir type in IR_TYPEOF");
+            break;
+        }
+        break;
+    case IR_ADDL: ;
+        left_value = exec_pop_value(exec);
+        right_value = exec_get_value(exec);
+        IR_ASSERT(right_value.type == IR_TYPE_STRING || right_value.type == IR_TYPE_LIST);
+        list = right_value.as.list_val;
+        IR_ASSERT(list != NULL);
+
+        if (!list->owned) {
+            exec_set_error(exec, "Attempt to modify constant list %p", list);
+            IR_EXEC_FAIL;
+        }
+
+        if (right_value.type == IR_TYPE_STRING) {
+            uint32_t codepoint = exec_value_codepoint(left_value);
+            list = exec_string_reserve(exec, list->size + 1, codepoint > UINT8_MAX);
+            if (!list) IR_EXEC_FAIL;
+            ir_string_set(list, list->size++, codepoint);
+            list->hash = 0;
+            exec_log_write(exec, list);
+            exec_pop_value(exec);
+            break;
+        }
 
-void exec_dup_value(IrExec* exec) {
-    exec_push_value(exec, exec_get_value(exec));
-}
+        if (list->size >= list->capacity) {
+            if (list->capacity == 0) list->capacity = 4;
+            else list->capacity *= 2;
+            // Push value back to avoid it being freed by gc
+            exec_push_value(exec, left_value);
+            void* items = exec_realloc(exec, list->items, list->capacity * sizeof(*list->items));
+            if (!items) IR_EXEC_FAIL;
+            left_value = exec_pop_value(exec);
+            right_value = exec_get_value(exec);
+            list = right_value.as.list_val;
+            list->items = items;
+            exec_write_barrier(exec, list);
+        }
+        list->items[list->size++] = left_value;
+        if (left_value.type == IR_TYPE_LIST || left_value.type == IR_TYPE_STRING) exec_write_barrier(exec, list);
+        else exec_log_write(exec, list);
+        exec_pop_value(exec);
+        break;
+    case IR_INDEXL:
+        left_int = exec_pop_int(exec);
 
-#define _ir_make_pop(_name, _type, _valname, _irtype) \
-_type _name(IrExec* exec) { \
-    IR_ASSERT(exec->stack.size > 0); \
-    IrValue val = exec_pop_value(exec); \
-    IR_ASSERT(val.type == _irtype); \
-    return val.as._valname; \
-}
+        right_value = exec_pop_value(exec);
+        IR_ASSERT(right_value.type == IR_TYPE_STRING || right_value.type == IR_TYPE_LIST);
+        list = right_value.as.list_val;
+        IR_ASSERT(list != NULL);
 
-_ir_make_pop(exec_pop_int, int64_t, int_val, IR_TYPE_INT)
-_ir_make_pop(exec_pop_float, double, float_val, IR_TYPE_FLOAT)
-_ir_make_pop(exec_pop_bool, bool, bool_val, IR_TYPE_BOOL)
-_ir_make_pop(exec_pop_func, IrRunFunction, func_val, IR_TYPE_FUNC)
-_ir_make_pop(exec_pop_label, size_t, label_val, IR_TYPE_LABEL)
-_ir_make_pop(exec_pop_list, IrList*, list_val, IR_TYPE_LIST)
-_ir_make_pop(exec_pop_list_string, IrList*, list_val, IR_TYPE_STRING)
+        if (left_int < 1 || (size_t)left_int > list->size) {
+            exec_set_error(exec, "Out of bounds list access. Tried to index value %ld with list of size %zu", left_int, list->size);
+            IR_EXEC_FAIL;
+        } else if (right_value.type == IR_TYPE_STRING) {
+            exec_push_int(exec, ir_string_get(list, left_int - 1));
+        } else {
+            exec_push_value(exec, list->items[left_int - 1]);
+        }
+        break;
+    case IR_SETL:
+        left_value = exec_pop_value(exec);
+        left_int = exec_pop_int(exec);
 
-#undef _ir_make_pop
+        right_value = exec_pop_value(exec);
+        IR_ASSERT(right_value.type == IR_TYPE_STRING || right_value.type == IR_TYPE_LIST);
+        list = right_value.as.list_val;
+        IR_ASSERT(list != NULL);
 
-IrList* exec_list_new(IrExec* exec) {
-    IrList* list = exec_malloc(exec, sizeof(IrList));
-    if (!list) return NULL;
-    memset(list, 0, sizeof(IrList));
-    list->owned = true;
-    return list;
-}
+        if (!list->owned) {
+            exec_set_error(exec, "Attemt to modify constant list %p", list);
+            IR_EXEC_FAIL;
+        }
+        if (left_int < 1 || (size_t)left_int > list->size) {
+            exec_set_error(exec, "Out of bounds list access. Tried to set value at index %ld with list of size %zu", left_int, list->size);
+            IR_EXEC_FAIL;
+        }
+        if (right_value.type == IR_TYPE_STRING) {
+            uint32_t codepoint = exec_value_codepoint(left_value);
+            if ((codepoint > UINT8_MAX && !list->wide) || list->shared) {
+                exec_push_value(exec, right_value);
+                list = exec_string_reserve(exec, list->size, codepoint > UINT8_MAX);
+                if (!list) IR_EXEC_FAIL;
+                exec_pop_value(exec);
+            }
+            ir_string_set(list, left_int - 1, codepoint);
+            list->hash = 0;
+            exec_log_write(exec, list);
+            break;
+        }
+        list->items[left_int - 1] = left_value;
+        if (left_value.type == IR_TYPE_LIST || left_value.type == IR_TYPE_STRING) exec_write_barrier(exec, list);
+        else exec_log_write(exec, list);
+        break;
+    case IR_INSERTL:
+        left_value = exec_pop_value(exec);
+        left_int = exec_pop_int(exec);
 
-// NOTE: This only accepts ascii text
-bool exec_push_string(IrExec* exec, const char* str) {
-    IrList* list = exec_list_new(exec);
-    if (!list) return false;
-    exec_push_list_string(exec, list);
+        right_value = exec_get_value(exec);
+        IR_ASSERT(right_value.type == IR_TYPE_STRING || right_value.type == IR_TYPE_LIST);
+        list = right_value.as.list_val;
+        IR_ASSERT(list != NULL);
 
-    size_t str_len = strlen(str);
-    list->size = str_len;
-    list->capacity = str_len;
+        if (!list->owned) {
+            exec_set_error(exec, "Attemt to modify constant list %p", list);
+            IR_EXEC_FAIL;
+        }
 
-    void* items = exec_realloc(exec, list->items, list->capacity * sizeof(*list->items));
-    if (!items) return false;
+        if (left_int < 1 || (size_t)left_int > list->size + 1) {
+            exec_set_error(exec, "Out of bounds list access. Tried to insert value at index %ld with list of size %zu", left_int, list->size);
+            IR_EXEC_FAIL;
+        }
 
-    list = exec_get_list_string(exec);
-    list->items = items;
+        if (right_value.type == IR_TYPE_STRING) {
+            uint32_t codepoint = exec_value_codepoint(left_value);
+            list = exec_string_reserve(exec, list->size + 1, codepoint > UINT8_MAX);
+            if (!list) IR_EXEC_FAIL;
+            ir_string_copy(list, left_int, list, left_int - 1, list->size - (left_int - 1));
+            list->size++;
+            ir_string_set(list, left_int - 1, codepoint);
+            list->hash = 0;
+            exec_log_write(exec, list);
+            exec_pop_value(exec);
+            break;
+        }
 
-    for (size_t i = 0; i < str_len; i++) {
-        IrValue val;
-        val.type = IR_TYPE_INT;
-        val.as.int_val = str[i];
-        list->items[i] = val;
-    }
-    return true;
-}
+        if (list->size >= list->capacity) {
+            if (list->capacity == 0) list->capacity = 4;
+            else list->capacity *= 2;
+            // Push value back to avoid it being freed by gc
+            exec_push_value(exec, left_value);
+            void* items = exec_realloc(exec, list->items, list->capacity * sizeof(*list->items));
+            if (!items) IR_EXEC_FAIL;
+            left_value = exec_pop_value(exec);
+            right_value = exec_get_value(exec);
+            list = right_value.as.list_val;
+            list->items = items;
+            exec_write_barrier(exec, list);
+        }
+        memmove(list->items + left_int, list->items + left_int - 1, (list->size - (left_int - 1)) * sizeof(IrValue));
+        list->size++;
+        list->items[left_int - 1] = left_value;
+        if (left_value.type == IR_TYPE_LIST || left_value.type == IR_TYPE_STRING) exec_write_barrier(exec, list);
+        else exec_log_write(exec, list);
+        exec_pop_value(exec);
+        break;
+    case IR_DELL:
+        left_int = exec_pop_int(exec);
 
-void exec_get_string(IrList* string, char* buf, size_t buf_len) {
-    IR_ASSERT(string != NULL);
+        right_value = exec_pop_value(exec);
+        IR_ASSERT(right_value.type == IR_TYPE_STRING || right_value.type == IR_TYPE_LIST);
+        list = right_value.as.list_val;
+        IR_ASSERT(list != NULL);
 
-    size_t i;
-    for (i = 0; i < string->size && i < buf_len - 1; i++) {
-        IrValue value = string->items[i];
-        switch (value.type) {
-        case IR_TYPE_INT:
-        case IR_TYPE_BYTE:
-            buf[i] = value.as.byte_val;
-            break;
-        default:
-            buf[i] = '?';
-            break;
+        if (!list->owned) {
+            exec_set_error(exec, "Attemt to modify constant list %p", list);
+            IR_EXEC_FAIL;
+        }
+        if (left_int < 1 || (size_t)left_int > list->size) {
+            exec_set_error(exec, "Out of bounds list access. Tried to delete value at index %ld with list of size %zu", left_int, list->size);
+            IR_EXEC_FAIL;
+        }
+        if (right_value.type == IR_TYPE_STRING) {
+            if (list->shared) {
+                exec_push_value(exec, right_value);
+                list = exec_string_reserve(exec, list->size, false);
+                if (!list) IR_EXEC_FAIL;
+                exec_pop_value(exec);
+            }
+            ir_string_copy(list, left_int - 1, list, left_int, list->size - left_int);
+            list->hash = 0;
+        } else {
+            memmove(list->items + left_int - 1, list->items + left_int, (list->size - (left_int - 1) - 1) * sizeof(IrValue));
         }
+        list->size--;
+        exec_log_write(exec, list);
+        break;
+    case IR_LENL:
+        right_value = exec_pop_value(exec);
+        IR_ASSERT(right_value.type == IR_TYPE_STRING || right_value.type == IR_TYPE_LIST);
+        list = right_value.as.list_val;
+        IR_ASSERT(list != NULL);
+
+        exec_push_int(exec, list->size);
+        break;
+    default:
+        exec_set_error(exec, "Op %d cannot be executed outside of bytecode", op);
+        IR_EXEC_FAIL;
     }
-    buf[i] = '\0';
-}
 
-void exec_pop_string(IrExec* exec, char* buf, size_t buf_len) {
-    IrList* list = exec_pop_list_string(exec);
-    exec_get_string(list, buf, buf_len);
+exec_return:
+    return return_val;
 }
 
-int64_t ir_int_pow(int64_t base, int64_t exp) {
-    if (exp == 0) return 1;
-
-    int64_t result = 1;
-    while (exp) {
-        if (exp & 1) result *= base;
-        exp >>= 1;
-        base *= base;
-    }
-    return result;
+bool exec_run_bytecode(IrExec* exec, IrBytecode* bc, size_t pos) {
+    exec_push_variable_stack(exec);
+    return exec_resume_bytecode(exec, bc, pos);
 }
 
-#define IR_EXEC_FAIL do { \
-    return_val = false; \
-    goto exec_return; \
-} while (0)
-#define IR_STRING_BUF_LEN 64
-
-bool exec_run_bytecode(IrExec* exec, IrBytecode* bc, size_t pos) {
+bool exec_resume_bytecode(IrExec* exec, IrBytecode* bc, size_t pos) {
     bool return_val = true;
-    exec_push_variable_stack(exec);
 
     IrConstValueList pool_list = bc->pool->list;
 
-    IrValueList* variable_frame;
-    int64_t variable_frame_pos;
-
-    char string_buf[IR_STRING_BUF_LEN];
-
     int64_t left_int,   right_int;
     double  left_float, right_float;
     bool    left_bool,  right_bool;
-    IrValue left_value, right_value;
     IrList* list;
     size_t label_pos;
-    IrFunction* func;
+
+    // Counted locally, as the counter in exec would have to be reloaded after every function call
+    uint64_t instructions = 0;
+    uint64_t* opcodes = exec->stats.opcodes;
 
     for (size_t i = pos; i < bc->code.size; i++) {
-        static_assert(IR_LAST == 82, "Exhaustive opcode in exec_run_bytecode");
+        instructions++;
+        if (opcodes) opcodes[bc->code.items[i]]++;
+
+        static_assert(IR_LAST == 83, "Exhaustive opcode in exec_run_bytecode");
         switch (bc->code.items[i]) {
         case IR_PUSHN: exec_push_nothing(exec); break;
         case IR_PUSHI:
@@ -1995,51 +5739,19 @@ bool exec_run_bytecode(IrExec* exec, IrBytecode* bc, size_t pos) {
             break;
         case IR_DUP: exec_dup_value(exec); break;
         case IR_LOAD:
-            IR_ASSERT(exec->variables.size > 0);
-            variable_frame = &exec->variables.items[exec->variables.size - 1];
-            variable_frame_pos = pool_list.items[CODE_IMMEDIATE].as.int_val;
-            IR_ASSERT(variable_frame_pos >= 0);
-            IR_ASSERT((size_t)variable_frame_pos < variable_frame->size);
-            exec_push_value(exec, variable_frame->items[variable_frame_pos]);
+            exec_push_value(exec, exec_load_variable(exec, pool_list.items[CODE_IMMEDIATE].as.int_val));
             i += 3;
             break;
         case IR_STORE:
-            IR_ASSERT(exec->variables.size > 0);
-            variable_frame = &exec->variables.items[exec->variables.size - 1];
-            variable_frame_pos = pool_list.items[CODE_IMMEDIATE].as.int_val;
-            IR_ASSERT(variable_frame_pos >= 0);
-
-            left_value = exec_pop_value(exec);
-            if ((size_t)variable_frame_pos >= variable_frame->size) {
-                while ((size_t)variable_frame_pos > variable_frame->size) {
-                    ir_list_append(*variable_frame, (IrValue) {0});
-                }
-                ir_list_append(*variable_frame, left_value);
-            } else {
-                variable_frame->items[variable_frame_pos] = left_value;
-            }
+            exec_store_variable(exec, pool_list.items[CODE_IMMEDIATE].as.int_val, exec_pop_value(exec));
             i += 3;
             break;
         case IR_GLOAD:
-            variable_frame_pos = pool_list.items[CODE_IMMEDIATE].as.int_val;
-            IR_ASSERT(variable_frame_pos >= 0);
-            IR_ASSERT((size_t)variable_frame_pos < exec->globals.size);
-            exec_push_value(exec, exec->globals.items[variable_frame_pos]);
+            exec_push_value(exec, exec_load_global(exec, pool_list.items[CODE_IMMEDIATE].as.int_val));
             i += 3;
             break;
         case IR_GSTORE:
-            variable_frame_pos = pool_list.items[CODE_IMMEDIATE].as.int_val;
-            IR_ASSERT(variable_frame_pos >= 0);
-
-            left_value = exec_pop_value(exec);
-            if ((size_t)variable_frame_pos >= exec->globals.size) {
-                while ((size_t)variable_frame_pos > exec->globals.size) {
-                    ir_list_append(exec->globals, (IrValue) {0});
-                }
-                ir_list_append(exec->globals, left_value);
-            } else {
-                exec->globals.items[variable_frame_pos] = left_value;
-            }
+            exec_store_global(exec, pool_list.items[CODE_IMMEDIATE].as.int_val, exec_pop_value(exec));
             i += 3;
             break;
         case IR_ADDI:
@@ -2130,312 +5842,66 @@ bool exec_run_bytecode(IrExec* exec, IrBytecode* bc, size_t pos) {
             left_bool = exec_pop_bool(exec);
             exec_push_bool(exec, left_bool && right_bool);
             break;
-        case IR_OR:
-            right_bool = exec_pop_bool(exec);
-            left_bool = exec_pop_bool(exec);
-            exec_push_bool(exec, left_bool || right_bool);
-            break;
-        case IR_XOR:
-            right_bool = exec_pop_bool(exec);
-            left_bool = exec_pop_bool(exec);
-            exec_push_bool(exec, left_bool != right_bool);
-            break;
-        case IR_LESSI:
-            right_int = exec_pop_int(exec);
-            left_int = exec_pop_int(exec);
-            exec_push_bool(exec, left_int < right_int);
-            break;
-        case IR_MOREI:
-            right_int = exec_pop_int(exec);
-            left_int = exec_pop_int(exec);
-            exec_push_bool(exec, left_int > right_int);
-            break;
-        case IR_LESSEQI:
-            right_int = exec_pop_int(exec);
-            left_int = exec_pop_int(exec);
-            exec_push_bool(exec, left_int <= right_int);
-            break;
-        case IR_MOREEQI:
-            right_int = exec_pop_int(exec);
-            left_int = exec_pop_int(exec);
-            exec_push_bool(exec, left_int >= right_int);
-            break;
-        case IR_LESSF:
-            right_float = exec_pop_float(exec);
-            left_float  = exec_pop_float(exec);
-            exec_push_bool(exec, left_float < right_float);
-            break;
-        case IR_MOREF:
-            right_float = exec_pop_float(exec);
-            left_float  = exec_pop_float(exec);
-            exec_push_bool(exec, left_float > right_float);
-            break;
-        case IR_LESSEQF:
-            right_float = exec_pop_float(exec);
-            left_float  = exec_pop_float(exec);
-            exec_push_bool(exec, left_float <= right_float);
-            break;
-        case IR_MOREEQF:
-            right_float = exec_pop_float(exec);
-            left_float  = exec_pop_float(exec);
-            exec_push_bool(exec, left_float >= right_float);
-            break;
-        case IR_EQ:
-            right_value = exec_pop_value(exec);
-            left_value  = exec_pop_value(exec);
-            if (left_value.type != right_value.type) {
-                exec_push_bool(exec, false);
-                break;
-            }
-
-            switch (left_value.type) {
-            case IR_TYPE_NOTHING: exec_push_bool(exec, true); break;
-            case IR_TYPE_BYTE: exec_push_bool(exec, left_value.as.byte_val == right_value.as.byte_val); break;
-            case IR_TYPE_INT: exec_push_bool(exec, left_value.as.int_val == right_value.as.int_val); break;
-            case IR_TYPE_FLOAT: exec_push_bool(exec, left_value.as.float_val == right_value.as.float_val); break;
-            case IR_TYPE_BOOL: exec_push_bool(exec, left_value.as.bool_val == right_value.as.bool_val); break;
-            case IR_TYPE_LIST: exec_push_bool(exec, left_value.as.list_val == right_value.as.list_val); break;
-            case IR_TYPE_STRING:
-                if (left_value.as.list_val->size != right_value.as.list_val->size) {
-                    exec_push_bool(exec, false);
-                    break;
-                }
-                for (size_t i = 0; i < left_value.as.list_val->size; i++) {
-                    if (left_value.as.list_val->items[i].as.int_val != right_value.as.list_val->items[i].as.int_val) {
-                        exec_push_bool(exec, false);
-                        break;
-                    }
-                }
-                exec_push_bool(exec, true);
-                break;
-            case IR_TYPE_FUNC: exec_push_bool(exec, left_value.as.func_val == right_value.as.func_val); break;
-            case IR_TYPE_LABEL: exec_push_bool(exec, left_value.as.label_val == right_value.as.label_val); break;
-            }
-            break;
-        case IR_NEQ:
-            right_value = exec_pop_value(exec);
-            left_value  = exec_pop_value(exec);
-            if (left_value.type != right_value.type) {
-                exec_push_bool(exec, true);
-                break;
-            }
-
-            switch (left_value.type) {
-            case IR_TYPE_NOTHING: exec_push_bool(exec, false); break;
-            case IR_TYPE_BYTE: exec_push_bool(exec, left_value.as.byte_val != right_value.as.byte_val); break;
-            case IR_TYPE_INT: exec_push_bool(exec, left_value.as.int_val != right_value.as.int_val); break;
-            case IR_TYPE_FLOAT: exec_push_bool(exec, left_value.as.float_val != right_value.as.float_val); break;
-            case IR_TYPE_BOOL: exec_push_bool(exec, left_value.as.bool_val != right_value.as.bool_val); break;
-            case IR_TYPE_LIST: exec_push_bool(exec, left_value.as.list_val != right_value.as.list_val); break;
-            case IR_TYPE_STRING:
-                if (left_value.as.list_val->size != right_value.as.list_val->size) {
-                    exec_push_bool(exec, true);
-                    break;
-                }
-                for (size_t i = 0; i < left_value.as.list_val->size; i++) {
-                    if (left_value.as.list_val->items[i].as.int_val != right_value.as.list_val->items[i].as.int_val) {
-                        exec_push_bool(exec, true);
-                        break;
-                    }
-                }
-                exec_push_bool(exec, false);
-                break;
-            case IR_TYPE_FUNC: exec_push_bool(exec, left_value.as.func_val != right_value.as.func_val); break;
-            case IR_TYPE_LABEL: exec_push_bool(exec, left_value.as.label_val != right_value.as.label_val); break;
-            }
-            break;
-        case IR_ITOF: exec_push_float(exec, exec_pop_int(exec)); break;
-        case IR_ITOB: exec_push_bool(exec, exec_pop_int(exec) != 0); break;
-        case IR_ITOA:
-            left_int = exec_pop_int(exec);
-            snprintf(string_buf, IR_STRING_BUF_LEN, "%ld", left_int);
-            if (!exec_push_string(exec, string_buf)) IR_EXEC_FAIL;
-            break;
-        case IR_FTOI: exec_push_int(exec, exec_pop_float(exec)); break;
-        case IR_FTOB: exec_push_bool(exec, exec_pop_float(exec) != 0); break;
-        case IR_FTOA:
-            left_float = exec_pop_float(exec);
-            snprintf(string_buf, IR_STRING_BUF_LEN, "%g", left_float);
-            if (!exec_push_string(exec, string_buf)) IR_EXEC_FAIL;
-            break;
-        case IR_BTOI: exec_push_int(exec, exec_pop_bool(exec)); break;
-        case IR_BTOF: exec_push_float(exec, exec_pop_bool(exec)); break;
-        case IR_BTOA:
-            left_bool = exec_pop_bool(exec);
-            snprintf(string_buf, IR_STRING_BUF_LEN, "%s", left_bool ? "true" : "false");
-            if (!exec_push_string(exec, string_buf)) IR_EXEC_FAIL;
-            break;
-        case IR_NTOA:
-            exec_pop_value(exec);
-            exec_push_string(exec, "nothing");
-            break;
-        case IR_LTOA:
-            list = exec_pop_list(exec);
-            IR_ASSERT(list != NULL);
-            if (list->size == 0) {
-                snprintf(string_buf, IR_STRING_BUF_LEN, "[List: Empty]");
-            } else {
-                snprintf(string_buf, IR_STRING_BUF_LEN, "[List: %p, %zu/%zu]", list, list->size, list->capacity);
-            }
-            if (!exec_push_string(exec, string_buf)) IR_EXEC_FAIL;
+        case IR_OR:
+            right_bool = exec_pop_bool(exec);
+            left_bool = exec_pop_bool(exec);
+            exec_push_bool(exec, left_bool || right_bool);
             break;
-
-        case IR_ATOI:
-            exec_pop_string(exec, string_buf, IR_STRING_BUF_LEN);
-            exec_push_int(exec, atol(string_buf));
+        case IR_XOR:
+            right_bool = exec_pop_bool(exec);
+            left_bool = exec_pop_bool(exec);
+            exec_push_bool(exec, left_bool != right_bool);
             break;
-        case IR_ATOF:
-            exec_pop_string(exec, string_buf, IR_STRING_BUF_LEN);
-            exec_push_float(exec, atof(string_buf));
+        case IR_LESSI:
+            right_int = exec_pop_int(exec);
+            left_int = exec_pop_int(exec);
+            exec_push_bool(exec, left_int < right_int);
             break;
-        case IR_ATOB:
-            exec_pop_string(exec, string_buf, IR_STRING_BUF_LEN);
-            exec_push_bool(exec, string_buf[0] != '\0' ? true : false);
+        case IR_MOREI:
+            right_int = exec_pop_int(exec);
+            left_int = exec_pop_int(exec);
+            exec_push_bool(exec, left_int > right_int);
             break;
-
-        case IR_TOI:
-            left_value = exec_pop_value(exec);
-            switch (left_value.type) {
-            case IR_TYPE_INT:   exec_push_int(exec, left_value.as.int_val); break;
-            case IR_TYPE_FLOAT: exec_push_int(exec, left_value.as.float_val); break;
-            case IR_TYPE_BOOL:  exec_push_int(exec, left_value.as.bool_val); break;
-            case IR_TYPE_BYTE:  exec_push_int(exec, left_value.as.byte_val); break;
-            case IR_TYPE_STRING:
-                exec_get_string(left_value.as.list_val, string_buf, IR_STRING_BUF_LEN);
-                exec_push_int(exec, atol(string_buf));
-                break;
-            case IR_TYPE_NOTHING: exec_push_int(exec, 0); break;
-            default:
-                exec_set_error(exec, "Invalid type passed to toi");
-                IR_EXEC_FAIL;
-                break;
-            }
+        case IR_LESSEQI:
+            right_int = exec_pop_int(exec);
+            left_int = exec_pop_int(exec);
+            exec_push_bool(exec, left_int <= right_int);
             break;
-        case IR_TOF:
-            left_value = exec_pop_value(exec);
-            switch (left_value.type) {
-            case IR_TYPE_INT:   exec_push_float(exec, left_value.as.int_val); break;
-            case IR_TYPE_FLOAT: exec_push_float(exec, left_value.as.float_val); break;
-            case IR_TYPE_BOOL:  exec_push_float(exec, left_value.as.bool_val); break;
-            case IR_TYPE_BYTE:  exec_push_float(exec, left_value.as.byte_val); break;
-            case IR_TYPE_STRING:
-                exec_get_string(left_value.as.list_val, string_buf, IR_STRING_BUF_LEN);
-                exec_push_float(exec, atof(string_buf));
-                break;
-            case IR_TYPE_NOTHING: exec_push_float(exec, 0.0); break;
-            default:
-                exec_set_error(exec, "Invalid type passed to tof");
-                IR_EXEC_FAIL;
-                break;
-            }
+        case IR_MOREEQI:
+            right_int = exec_pop_int(exec);
+            left_int = exec_pop_int(exec);
+            exec_push_bool(exec, left_int >= right_int);
             break;
-        case IR_TOB:
-            left_value = exec_pop_value(exec);
-            switch (left_value.type) {
-            case IR_TYPE_INT:   exec_push_bool(exec, left_value.as.int_val != 0); break;
-            case IR_TYPE_FLOAT: exec_push_bool(exec, left_value.as.float_val != 0); break;
-            case IR_TYPE_BOOL:  exec_push_bool(exec, left_value.as.bool_val); break;
-            case IR_TYPE_BYTE:  exec_push_bool(exec, left_value.as.byte_val != 0); break;
-            case IR_TYPE_STRING:
-                exec_get_string(left_value.as.list_val, string_buf, IR_STRING_BUF_LEN);
-                exec_push_bool(exec, string_buf[0] != '\0' ? true : false);
-                break;
-            case IR_TYPE_NOTHING: exec_push_bool(exec, false); break;
-            default:
-                exec_set_error(exec, "Invalid type passed to tob");
-                IR_EXEC_FAIL;
-                break;
-            }
+        case IR_LESSF:
+            right_float = exec_pop_float(exec);
+            left_float  = exec_pop_float(exec);
+            exec_push_bool(exec, left_float < right_float);
             break;
-        case IR_TOA:
-            left_value = exec_pop_value(exec);
-            switch (left_value.type) {
-            case IR_TYPE_INT:
-                snprintf(string_buf, IR_STRING_BUF_LEN, "%ld", left_value.as.int_val);
-                if (!exec_push_string(exec, string_buf)) IR_EXEC_FAIL;
-                break;
-            case IR_TYPE_FLOAT:
-                snprintf(string_buf, IR_STRING_BUF_LEN, "%g", left_value.as.float_val);
-                if (!exec_push_string(exec, string_buf)) IR_EXEC_FAIL;
-                break;
-            case IR_TYPE_BOOL:
-                snprintf(string_buf, IR_STRING_BUF_LEN, "%s", left_value.as.bool_val ? "true" : "false");
-                if (!exec_push_string(exec, string_buf)) IR_EXEC_FAIL;
-                break;
-            case IR_TYPE_BYTE:
-                snprintf(string_buf, IR_STRING_BUF_LEN, "%d", left_value.as.byte_val);
-                if (!exec_push_string(exec, string_buf)) IR_EXEC_FAIL;
-                break;
-            case IR_TYPE_STRING:
-                exec_push_value(exec, left_value);
-                break;
-            case IR_TYPE_LIST:
-                list = left_value.as.list_val;
-                IR_ASSERT(list != NULL);
-                if (list->size == 0) {
-                    snprintf(string_buf, IR_STRING_BUF_LEN, "[List: Empty]");
-                } else {
-                    snprintf(string_buf, IR_STRING_BUF_LEN, "[List: %p, %zu/%zu]", list, list->size, list->capacity);
-                }
-                if (!exec_push_string(exec, string_buf)) IR_EXEC_FAIL;
-                break;
-            case IR_TYPE_NOTHING:
-                if (!exec_push_string(exec, "nothing")) IR_EXEC_FAIL;
-                break;
-            default:
-                exec_set_error(exec, "Invalid type passed to toa");
-                IR_EXEC_FAIL;
-                break;
-            }
+        case IR_MOREF:
+            right_float = exec_pop_float(exec);
+            left_float  = exec_pop_float(exec);
+            exec_push_bool(exec, left_float > right_float);
             break;
-        case IR_TOL:
-            left_value = exec_pop_value(exec);
-            switch (left_value.type) {
-            case IR_TYPE_LIST: exec_push_value(exec, left_value); break;
-            default:
-                exec_set_error(exec, "Invalid type passed to tol");
-                IR_EXEC_FAIL;
-                break;
-            }
+        case IR_LESSEQF:
+            right_float = exec_pop_float(exec);
+            left_float  = exec_pop_float(exec);
+            exec_push_bool(exec, left_float <= right_float);
             break;
-        case IR_TYPEOF:
-            left_value = exec_pop_value(exec);
-            switch (left_value.type) {
-            case IR_TYPE_NOTHING:
-                if (!exec_push_string(exec, "nothing")) IR_EXEC_FAIL;
-                break;
-            case IR_TYPE_BYTE:
-                if (!exec_push_string(exec, "byte")) IR_EXEC_FAIL;
-                break;
-            case IR_TYPE_INT:
-                if (!exec_push_string(exec, "integer")) IR_EXEC_FAIL;
-                break;
-            case IR_TYPE_FLOAT:
-                if (!exec_push_string(exec, "float")) IR_EXEC_FAIL;
-                break;
-            case IR_TYPE_BOOL:
-                if (!exec_push_string(exec, "bool")) IR_EXEC_FAIL;
-                break;
-            case IR_TYPE_LIST:
-                if (!exec_push_string(exec, "list")) IR_EXEC_FAIL;
-                break;
-            case IR_TYPE_STRING:
-                if (!exec_push_string(exec, "str")) IR_EXEC_FAIL;
-                break;
-            case IR_TYPE_FUNC:
-                if (!exec_push_string(exec, "func")) IR_EXEC_FAIL;
-                break;
-            case IR_TYPE_LABEL:
-                if (!exec_push_string(exec, "label")) IR_EXEC_FAIL;
-                break;
-            default:
-                assert(false && "Unhandled ir type in IR_TYPEOF");
-                break;
-            }
+        case IR_MOREEQF:
+            right_float = exec_pop_float(exec);
+            left_float  = exec_pop_float(exec);
+            exec_push_bool(exec, left_float >= right_float);
             break;
+        case IR_ITOF: exec_push_float(exec, exec_pop_int(exec)); break;
+        case IR_ITOB: exec_push_bool(exec, exec_pop_int(exec) != 0); break;
+        case IR_FTOI: exec_push_int(exec, exec_pop_float(exec)); break;
+        case IR_FTOB: exec_push_bool(exec, exec_pop_float(exec) != 0); break;
+        case IR_BTOI: exec_push_int(exec, exec_pop_bool(exec)); break;
+        case IR_BTOF: exec_push_float(exec, exec_pop_bool(exec)); break;
         case IR_PUSHL:
             list = (IrList*)pool_list.items[CODE_IMMEDIATE].as.list_val;
             if (!list) {
+                IR_EXEC_SET_ALLOC_SITE;
                 list = exec_list_new(exec);
                 if (!list) IR_EXEC_FAIL;
             }
@@ -2445,138 +5911,50 @@ bool exec_run_bytecode(IrExec* exec, IrBytecode* bc, size_t pos) {
         case IR_PUSHA:
             list = (IrList*)pool_list.items[CODE_IMMEDIATE].as.list_val;
             if (!list) {
+                IR_EXEC_SET_ALLOC_SITE;
                 list = exec_list_new(exec);
                 if (!list) IR_EXEC_FAIL;
             }
             exec_push_list_string(exec, list);
             i += 3;
             break;
-        case IR_ADDL: ;
-            left_value = exec_pop_value(exec);
-            right_value = exec_get_value(exec);
-            IR_ASSERT(right_value.type == IR_TYPE_STRING || right_value.type == IR_TYPE_LIST);
-            list = right_value.as.list_val;
-            IR_ASSERT(list != NULL);
-
-            if (!list->owned) {
-                exec_set_error(exec, "Attempt to modify constant list %p", list);
-                IR_EXEC_FAIL;
-            }
-
-            if (list->size >= list->capacity) {
-                if (list->capacity == 0) list->capacity = 4;
-                else list->capacity *= 2;
-                void* items = exec_realloc(exec, list->items, list->capacity * sizeof(*list->items));
-                if (!items) IR_EXEC_FAIL;
-                right_value = exec_get_value(exec);
-                list = right_value.as.list_val;
-                list->items = items;
-            }
-            list->items[list->size++] = left_value;
-            exec_pop_value(exec);
-            break;
+        case IR_EQ:
+        case IR_NEQ:
+        case IR_ITOA:
+        case IR_FTOA:
+        case IR_BTOA:
+        case IR_NTOA:
+        case IR_LTOA:
+        case IR_ATOI:
+        case IR_ATOF:
+        case IR_ATOB:
+        case IR_TOI:
+        case IR_TOF:
+        case IR_TOB:
+        case IR_TOA:
+        case IR_TOL:
+        case IR_TYPEOF:
+        case IR_ADDL:
         case IR_INDEXL:
-            left_int = exec_pop_int(exec);
-
-            right_value = exec_pop_value(exec);
-            IR_ASSERT(right_value.type == IR_TYPE_STRING || right_value.type == IR_TYPE_LIST);
-            list = right_value.as.list_val;
-            IR_ASSERT(list != NULL);
-
-            if (left_int < 1 || (size_t)left_int > list->size) {
-                exec_set_error(exec, "Out of bounds list access. Tried to index value %ld with list of size %zu", left_int, list->size);
-                IR_EXEC_FAIL;
-            } else {
-                exec_push_value(exec, list->items[left_int - 1]);
-            }
-            break;
         case IR_SETL:
-            left_value = exec_pop_value(exec);
-            left_int = exec_pop_int(exec);
-
-            right_value = exec_pop_value(exec);
-            IR_ASSERT(right_value.type == IR_TYPE_STRING || right_value.type == IR_TYPE_LIST);
-            list = right_value.as.list_val;
-            IR_ASSERT(list != NULL);
-
-            if (!list->owned) {
-                exec_set_error(exec, "Attemt to modify constant list %p", list);
-                IR_EXEC_FAIL;
-            }
-            if (left_int < 1 || (size_t)left_int > list->size) {
-                exec_set_error(exec, "Out of bounds list access. Tried to set value at index %ld with list of size %zu", left_int, list->size);
-                IR_EXEC_FAIL;
-            }
-            list->items[left_int - 1] = left_value;
-            break;
         case IR_INSERTL:
-            left_value = exec_pop_value(exec);
-            left_int = exec_pop_int(exec);
-
-            right_value = exec_get_value(exec);
-            IR_ASSERT(right_value.type == IR_TYPE_STRING || right_value.type == IR_TYPE_LIST);
-            list = right_value.as.list_val;
-            IR_ASSERT(list != NULL);
-
-            if (!list->owned) {
-                exec_set_error(exec, "Attemt to modify constant list %p", list);
-                IR_EXEC_FAIL;
-            }
-
-            if (left_int < 1 || (size_t)left_int > list->size + 1) {
-                exec_set_error(exec, "Out of bounds list access. Tried to insert value at index %ld with list of size %zu", left_int, list->size);
-                IR_EXEC_FAIL;
-            }
-
-            if (list->size >= list->capacity) {
-                if (list->capacity == 0) list->capacity = 4;
-                else list->capacity *= 2;
-                void* items = exec_realloc(exec, list->items, list->capacity * sizeof(*list->items));
-                if (!items) IR_EXEC_FAIL;
-                right_value = exec_get_value(exec);
-                list = right_value.as.list_val;
-                list->items = items;
-            }
-            memmove(list->items + left_int, list->items + left_int - 1, (list->size - (left_int - 1)) * sizeof(IrValue));
-            list->size++;
-            list->items[left_int - 1] = left_value;
-            exec_pop_value(exec);
-            break;
         case IR_DELL:
-            left_int = exec_pop_int(exec);
-
-            right_value = exec_pop_value(exec);
-            IR_ASSERT(right_value.type == IR_TYPE_STRING || right_value.type == IR_TYPE_LIST);
-            list = right_value.as.list_val;
-            IR_ASSERT(list != NULL);
-
-            if (!list->owned) {
-                exec_set_error(exec, "Attemt to modify constant list %p", list);
-                IR_EXEC_FAIL;
-            }
-            if (left_int < 1 || (size_t)left_int > list->size) {
-                exec_set_error(exec, "Out of bounds list access. Tried to delete value at index %ld with list of size %zu", left_int, list->size);
-                IR_EXEC_FAIL;
-            }
-            memmove(list->items + left_int - 1, list->items + left_int, (list->size - (left_int - 1) - 1) * sizeof(IrValue));
-            list->size--;
-            break;
         case IR_LENL:
-            right_value = exec_pop_value(exec);
-            IR_ASSERT(right_value.type == IR_TYPE_STRING || right_value.type == IR_TYPE_LIST);
-            list = right_value.as.list_val;
-            IR_ASSERT(list != NULL);
-
-            exec_push_int(exec, list->size);
+            IR_EXEC_SET_ALLOC_SITE;
+            if (!exec_op(exec, bc->code.items[i])) IR_EXEC_FAIL;
             break;
 
         case IR_JMP:
-            i = pool_list.items[CODE_IMMEDIATE].as.label_val.pos - 1;
+            label_pos = pool_list.items[CODE_IMMEDIATE].as.label_val.pos;
+            if (label_pos <= i) IR_EXEC_USE_FUEL;
+            i = label_pos - 1;
             break;
         case IR_IF:
             left_bool = exec_pop_bool(exec);
             if (left_bool) {
-                i = pool_list.items[CODE_IMMEDIATE].as.label_val.pos - 1;
+                label_pos = pool_list.items[CODE_IMMEDIATE].as.label_val.pos;
+                if (label_pos <= i) IR_EXEC_USE_FUEL;
+                i = label_pos - 1;
             } else {
                 i += 3;
             }
@@ -2584,52 +5962,43 @@ bool exec_run_bytecode(IrExec* exec, IrBytecode* bc, size_t pos) {
         case IR_IFNOT:
             left_bool = exec_pop_bool(exec);
             if (!left_bool) {
-                i = pool_list.items[CODE_IMMEDIATE].as.label_val.pos - 1;
+                label_pos = pool_list.items[CODE_IMMEDIATE].as.label_val.pos;
+                if (label_pos <= i) IR_EXEC_USE_FUEL;
+                i = label_pos - 1;
             } else {
                 i += 3;
             }
             break;
         case IR_CALL:
+            IR_EXEC_USE_FUEL;
             if (!exec_run_bytecode(exec, bc, pool_list.items[CODE_IMMEDIATE].as.label_val.pos)) IR_EXEC_FAIL;
             i += 3;
             break;
-        case IR_RUN: ;
-            func = &pool_list.items[CODE_IMMEDIATE].as.func_val;
-            if (!func->ptr) {
-                if (!exec->resolve_run_function) {
-                    exec_set_error(exec, "Called run instruction, but no run function resolver has been attached");
-                    IR_EXEC_FAIL;
-                }
-                func->ptr = exec->resolve_run_function(exec, func->hint);
-                if (!func->ptr) {
-                    exec_set_error(exec, "Function \"%s\" does not exist at runtime", func->hint);
-                    IR_EXEC_FAIL;
-                }
-            }
-            if (!func->ptr(exec)) {
-                if (exec->last_error[0] == 0) {
-                    if (func->hint) {
-                        exec_set_error(exec, "Unknown error from function \"%s\"", func->hint);
-                    } else {
-                        exec_set_error(exec, "Unknown error from function %p", func->ptr);
-                    }
-                }
-                IR_EXEC_FAIL;
-            }
+        case IR_CALLX:
+            IR_EXEC_USE_FUEL;
+            if (!exec_call_import(exec, &pool_list.items[CODE_IMMEDIATE].as.import_val)) IR_EXEC_FAIL;
+            i += 3;
+            break;
+        case IR_RUN:
+            IR_EXEC_SET_ALLOC_SITE;
+            if (!exec_run_function(exec, &pool_list.items[CODE_IMMEDIATE].as.func_val)) IR_EXEC_FAIL;
             i += 3;
             break;
         case IR_DYNJMP:
             label_pos = exec_pop_label(exec);
+            if (label_pos <= i) IR_EXEC_USE_FUEL;
             i = label_pos - 1;
             break;
         case IR_DYNIF:
             label_pos = exec_pop_label(exec);
             left_bool = exec_pop_bool(exec);
             if (left_bool) {
+                if (label_pos <= i) IR_EXEC_USE_FUEL;
                 i = label_pos - 1;
             }
             break;
         case IR_DYNCALL:
+            IR_EXEC_USE_FUEL;
             label_pos = exec_pop_label(exec);
             if (!exec_run_bytecode(exec, bc, label_pos)) IR_EXEC_FAIL;
             break;
@@ -2639,6 +6008,7 @@ bool exec_run_bytecode(IrExec* exec, IrBytecode* bc, size_t pos) {
                 exec_set_error(exec, "Resolving funcs in dynrun instruction is not allowed");
                 IR_EXEC_FAIL;
             }
+            if (exec->stats.count_functions) exec_stats_count_function(exec, func, NULL);
             if (!func(exec)) IR_EXEC_FAIL;
             break;
         case IR_RET:
@@ -2651,6 +6021,7 @@ bool exec_run_bytecode(IrExec* exec, IrBytecode* bc, size_t pos) {
     }
 
 exec_return:
+    exec->stats.instructions += instructions;
     exec_pop_variable_stack(exec);
     return return_val;
 }
@@ -2695,6 +6066,9 @@ void exec_print_value(IrValue* value) {
     case IR_TYPE_LABEL:
         printf("label %zu", value->as.label_val);
         break;
+    case IR_TYPE_IMPORT:
+        printf("import");
+        break;
     }
 }
 
@@ -2744,6 +6118,7 @@ IrMemArena* ir_arena_new(size_t reserve_size, size_t commit_size) {
     arena->commit_size = commit_size;
     arena->pos = IR_ARENA_BASE_POS;
     arena->commit_pos = commit_size;
+    arena->huge_pages = false;
 
     return arena;
 }
@@ -2764,25 +6139,43 @@ char* ir_arena_sprintf(IrMemArena* arena, size_t max_size, const char* fmt, ...)
     return str;
 }
 
-void* ir_arena_alloc_packed(IrMemArena* arena, size_t size) {
-    size_t old_pos = arena->pos;
-    size_t new_pos = old_pos + size;
+static bool ir_arena_commit(IrMemArena* arena, size_t new_pos) {
+    size_t new_commit_pos = new_pos;
+    new_commit_pos += arena->commit_size - 1;
+    new_commit_pos -= new_commit_pos % arena->commit_size;
+    new_commit_pos = MIN(new_commit_pos, arena->reserve_size);
 
-    if (new_pos > arena->reserve_size) { return NULL; }
+    unsigned char* mem = (unsigned char*)arena + arena->commit_pos;
+    size_t commit_size = new_commit_pos - arena->commit_pos;
+
+    if (!ir_plat_mem_commit(mem, commit_size)) return false;
 
-    if (new_pos > arena->commit_pos) {
-        size_t new_commit_pos = new_pos;
-        new_commit_pos += arena->commit_size - 1;
-        new_commit_pos -= new_commit_pos % arena->commit_size;
-        new_commit_pos = MIN(new_commit_pos, arena->reserve_size);
+    bool crossed_huge_size = arena->commit_pos < IR_HUGE_PAGES_MIN_SIZE && new_commit_pos >= IR_HUGE_PAGES_MIN_SIZE;
+    arena->commit_pos = new_commit_pos;
+    if (arena->huge_pages && crossed_huge_size) ir_arena_set_huge_pages(arena, true);
+    return true;
+}
 
-        unsigned char* mem = (unsigned char*)arena + arena->commit_pos;
-        size_t commit_size = new_commit_pos - arena->commit_pos;
+void ir_arena_set_huge_pages(IrMemArena* arena, bool huge_pages) {
+    arena->huge_pages = huge_pages;
+    if (!huge_pages || arena->commit_pos < IR_HUGE_PAGES_MIN_SIZE) return;
+    // Committing whole huge pages at once lets the system use them right away
+    if (ir_plat_mem_use_huge_pages(arena, arena->reserve_size)) arena->commit_size = IR_ALIGN_UP_POW2(arena->commit_size, IR_HUGE_PAGE_SIZE);
+}
 
-        if (!ir_plat_mem_commit(mem, commit_size)) return NULL;
+void ir_arena_trim(IrMemArena* arena, size_t keep_size) {
+    size_t new_commit_pos = IR_ALIGN_UP_POW2(MAX(MAX(arena->pos, keep_size), arena->commit_size), ir_plat_get_pagesize());
+    if (new_commit_pos >= arena->commit_pos) return;
+    if (!ir_plat_mem_decommit((unsigned char*)arena + new_commit_pos, arena->commit_pos - new_commit_pos)) return;
+    arena->commit_pos = new_commit_pos;
+}
 
-        arena->commit_pos = new_commit_pos;
-    }
+void* ir_arena_alloc_packed(IrMemArena* arena, size_t size) {
+    size_t old_pos = arena->pos;
+    size_t new_pos = old_pos + size;
+
+    if (new_pos > arena->reserve_size) { return NULL; }
+    if (new_pos > arena->commit_pos && !ir_arena_commit(arena, new_pos)) return NULL;
 
     arena->pos = new_pos;
 
@@ -2796,20 +6189,7 @@ void* ir_arena_alloc(IrMemArena* arena, size_t size) {
     size_t new_pos = pos_aligned + size;
 
     if (new_pos > arena->reserve_size) { return NULL; }
-
-    if (new_pos > arena->commit_pos) {
-        size_t new_commit_pos = new_pos;
-        new_commit_pos += arena->commit_size - 1;
-        new_commit_pos -= new_commit_pos % arena->commit_size;
-        new_commit_pos = MIN(new_commit_pos, arena->reserve_size);
-
-        unsigned char* mem = (unsigned char*)arena + arena->commit_pos;
-        size_t commit_size = new_commit_pos - arena->commit_pos;
-
-        if (!ir_plat_mem_commit(mem, commit_size)) return NULL;
-
-        arena->commit_pos = new_commit_pos;
-    }
+    if (new_pos > arena->commit_pos && !ir_arena_commit(arena, new_pos)) return NULL;
 
     arena->pos = new_pos;
 
@@ -2820,12 +6200,24 @@ void* ir_arena_alloc(IrMemArena* arena, size_t size) {
 
 void* ir_arena_realloc(IrMemArena* arena, void* ptr, size_t old_size, size_t new_size) {
     if (!ptr || old_size == 0) return ir_arena_alloc(arena, new_size);
+    if (ir_arena_extend(arena, ptr, old_size, new_size)) return ptr;
 
     void* ret = ir_arena_alloc(arena, new_size);
     memcpy(ret, ptr, old_size);
     return ret;
 }
 
+bool ir_arena_extend(IrMemArena* arena, void* ptr, size_t old_size, size_t new_size) {
+    if ((unsigned char*)ptr + old_size != (unsigned char*)arena + arena->pos) return false;
+
+    size_t new_pos = arena->pos - old_size + new_size;
+    if (new_pos > arena->reserve_size) return false;
+    if (new_pos > arena->commit_pos && !ir_arena_commit(arena, new_pos)) return false;
+
+    arena->pos = new_pos;
+    return true;
+}
+
 void ir_arena_pop(IrMemArena* arena, size_t size) {
     size = MIN(size, arena->pos - IR_ARENA_BASE_POS);
     arena->pos -= size;
@@ -2868,10 +6260,61 @@ bool ir_plat_mem_release(void* ptr, size_t size) {
     return VirtualFree(ptr, size, MEM_RELEASE);
 }
 
+bool ir_plat_mem_use_huge_pages(void* ptr, size_t size) {
+    // Large pages on Windows need to be allocated upfront with a special privilege, so they are not used
+    (void) ptr;
+    (void) size;
+    return false;
+}
+
+void* ir_plat_file_map(const char* path, size_t* size) {
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping) return NULL;
+
+    // The view keeps the mapping alive by itself
+    void* out = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!out) return NULL;
+
+    *size = file_size.QuadPart;
+    return out;
+}
+
+bool ir_plat_file_unmap(void* ptr, size_t size) {
+    (void) size;
+    return UnmapViewOfFile(ptr);
+}
+
+size_t ir_plat_get_cpu_count(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return MAX(info.dwNumberOfProcessors, 1);
+}
+
+int64_t ir_plat_get_time(void) {
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart / frequency.QuadPart * 1000000 + counter.QuadPart % frequency.QuadPart * 1000000 / frequency.QuadPart;
+}
+
 #else
 
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 
 unsigned long ir_plat_get_pagesize(void) {
     return sysconf(_SC_PAGESIZE);
@@ -2896,6 +6339,49 @@ bool ir_plat_mem_release(void* ptr, size_t size) {
     return !munmap(ptr, size);
 }
 
+bool ir_plat_mem_use_huge_pages(void* ptr, size_t size) {
+#ifdef MADV_HUGEPAGE
+    return !madvise(ptr, size, MADV_HUGEPAGE);
+#else
+    (void) ptr;
+    (void) size;
+    return false;
+#endif
+}
+
+void* ir_plat_file_map(const char* path, size_t* size) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    void* out = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (out == MAP_FAILED) return NULL;
+
+    *size = st.st_size;
+    return out;
+}
+
+bool ir_plat_file_unmap(void* ptr, size_t size) {
+    return !munmap(ptr, size);
+}
+
+size_t ir_plat_get_cpu_count(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? count : 1;
+}
+
+int64_t ir_plat_get_time(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (int64_t)time.tv_sec * 1000000 + time.tv_nsec / 1000;
+}
+
 #endif // _WIN32
 
 
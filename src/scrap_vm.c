@@ -0,0 +1,182 @@
+// Scrap is a project that allows anyone to build software using simple, block based interface.
+//
+// Copyright (C) 2024-2026 Grisshink
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+
+#include "scrap_vm.h"
+#include "std.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define KiB(n) ((size_t)(n) << 10)
+#define GiB(n) ((size_t)(n) << 30)
+
+typedef struct {
+    const char* name;
+    IrRunFunction func;
+} ScrapVmFunction;
+
+typedef struct {
+    ScrapVmFunction* items;
+    size_t size, capacity;
+} ScrapVmFunctionList;
+
+struct ScrapVm {
+    IrExec exec; // Should stay the first member, see scrap_vm_from_exec
+    IrBytecodePool* pool;
+    ScrapVmFunctionList functions;
+    void* user_data;
+    bool loaded;
+};
+
+static IrRunFunction scrap_vm_resolve_function(IrExec* exec, const char* hint) {
+    ScrapVm* vm = scrap_vm_from_exec(exec);
+    for (size_t i = 0; i < vm->functions.size; i++) {
+        if (!strcmp(vm->functions.items[i].name, hint)) return vm->functions.items[i].func;
+    }
+    return std_resolve_function(exec, hint);
+}
+
+ScrapVm* scrap_vm_new(size_t memory_min, size_t memory_max) {
+    if (memory_min == 0) memory_min = SCRAP_VM_DEFAULT_MEMORY_MIN;
+    if (memory_max == 0) memory_max = memory_min > SCRAP_VM_DEFAULT_MEMORY_MAX ? memory_min : SCRAP_VM_DEFAULT_MEMORY_MAX;
+
+    ScrapVm* vm = calloc(1, sizeof(ScrapVm));
+    if (!vm) return NULL;
+
+    vm->exec = exec_new(memory_min, memory_max);
+    if (!vm->exec.heap.mem || !vm->exec.second_heap.mem || !vm->exec.nursery.mem || !vm->exec.survivors.mem || !vm->exec.second_survivors.mem) {
+        exec_free(&vm->exec);
+        free(vm);
+        return NULL;
+    }
+
+    vm->exec.context = std_context_new();
+    // Instances are meant to be small, so the bytecode arena only commits a little memory at a time
+    IrMemArena* arena = ir_arena_new(GiB(1), KiB(64));
+    if (!vm->exec.context || !arena) {
+        if (vm->exec.context) std_context_free(vm->exec.context);
+        if (arena) ir_arena_free(arena);
+        exec_free(&vm->exec);
+        free(vm);
+        return NULL;
+    }
+
+    vm->pool = bytecode_pool_new(arena);
+    exec_set_run_function_resolver(&vm->exec, scrap_vm_resolve_function);
+    return vm;
+}
+
+void scrap_vm_free(ScrapVm* vm) {
+    bytecode_pool_free(vm->pool);
+    std_context_free(vm->exec.context);
+    exec_free(&vm->exec);
+    free(vm);
+}
+
+static bool scrap_vm_add_bytecode(ScrapVm* vm, IrBytecode bc) {
+    bc.name = "main";
+    exec_add_bytecode(&vm->exec, bc);
+    vm->loaded = true;
+    return true;
+}
+
+bool scrap_vm_load_file(ScrapVm* vm, const char* path) {
+    if (vm->loaded) {
+        exec_set_error(&vm->exec, "Bytecode is already loaded");
+        return false;
+    }
+
+    IrBytecode bc;
+    if (!bytecode_load(vm->pool, &bc, path)) {
+        exec_set_error(&vm->exec, "Failed to load bytecode from %s", path);
+        return false;
+    }
+    return scrap_vm_add_bytecode(vm, bc);
+}
+
+bool scrap_vm_load_memory(ScrapVm* vm, const void* data, size_t data_size) {
+    if (vm->loaded) {
+        exec_set_error(&vm->exec, "Bytecode is already loaded");
+        return false;
+    }
+
+    IrBytecode bc;
+    if (!bytecode_load_memory(vm->pool, &bc, data, data_size)) {
+        exec_set_error(&vm->exec, "Failed to load bytecode");
+        return false;
+    }
+    return scrap_vm_add_bytecode(vm, bc);
+}
+
+void scrap_vm_register_function(ScrapVm* vm, const char* name, IrRunFunction func) {
+    size_t name_size = strlen(name) + 1;
+    char* name_alloc = ir_arena_alloc(vm->pool->arena, name_size);
+    memcpy(name_alloc, name, name_size);
+
+    ScrapVmFunction function = {
+        .name = name_alloc,
+        .func = func,
+    };
+    ir_arena_append(vm->pool->arena, vm->functions, function);
+}
+
+bool scrap_vm_run(ScrapVm* vm, const char* label) {
+    if (!vm->loaded) {
+        exec_set_error(&vm->exec, "No bytecode is loaded");
+        return false;
+    }
+    exec_clear_interrupt(&vm->exec);
+    return exec_run(&vm->exec, "main", label ? label : "entry");
+}
+
+const char* scrap_vm_last_error(ScrapVm* vm) {
+    return vm->exec.last_error;
+}
+
+void scrap_vm_set_io(ScrapVm* vm, FILE* input, FILE* output) {
+    StdContext* context = vm->exec.context;
+    context->input = input;
+    context->output = output;
+}
+
+void scrap_vm_set_fuel_handler(ScrapVm* vm, IrFuelHandler handler, int64_t fuel_budget) {
+    exec_set_fuel_handler(&vm->exec, handler, fuel_budget);
+}
+
+void scrap_vm_interrupt(ScrapVm* vm) {
+    exec_interrupt(&vm->exec);
+}
+
+void scrap_vm_set_user_data(ScrapVm* vm, void* user_data) {
+    vm->user_data = user_data;
+}
+
+void* scrap_vm_get_user_data(ScrapVm* vm) {
+    return vm->user_data;
+}
+
+IrExec* scrap_vm_exec(ScrapVm* vm) {
+    return &vm->exec;
+}
+
+ScrapVm* scrap_vm_from_exec(IrExec* exec) {
+    return (ScrapVm*)exec;
+}
@@ -0,0 +1,106 @@
+// Scrap is a project that allows anyone to build software using simple, block based interface.
+//
+// Copyright (C) 2024-2026 Grisshink
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+
+// Embeddable Scrap virtual machine. Every ScrapVm is an independent instance with its own bytecode, heap
+// and standard library state, so any number of them can be created in one process. Different instances
+// can run in different threads at the same time, but a single instance should only be used by one thread.
+//
+// The library is built with `make libscrapvm.a` or `make libscrapvm.so` and does not depend on raylib.
+// Programs using it should link with the dependencies listed in SCRAP_VM_LDFLAGS.
+//
+// Example:
+//
+//     ScrapVm* vm = scrap_vm_new(0, 0);
+//     if (!scrap_vm_load_file(vm, "program.scrb")) ...
+//     if (!scrap_vm_run(vm, NULL)) printf("Error: %s\n", scrap_vm_last_error(vm));
+//     scrap_vm_free(vm);
+//
+// Native functions receive the IrExec of the instance and use exec_pop_*/exec_push_* functions from scrap_ir.h
+// to take arguments and return values. They return false on error, after setting it with exec_set_error.
+
+#ifndef SCRAP_VM_H
+#define SCRAP_VM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "scrap_ir.h"
+
+#ifdef __APPLE__
+#define SCRAP_VM_LDFLAGS "-lffi -lm -lpthread -lintl"
+#else
+#define SCRAP_VM_LDFLAGS "-lffi -lm -lpthread -ldl"
+#endif
+
+// Default heap limits used when 0 is passed to scrap_vm_new
+#define SCRAP_VM_DEFAULT_MEMORY_MIN ((size_t)1 << 20)
+#define SCRAP_VM_DEFAULT_MEMORY_MAX ((size_t)1 << 30)
+
+typedef struct ScrapVm ScrapVm;
+
+// Creates new instance. The heap of the program starts at memory_min bytes and is allowed to grow up to memory_max,
+// which is only reserved and not allocated upfront. Returns NULL on failure.
+ScrapVm* scrap_vm_new(size_t memory_min, size_t memory_max);
+
+// Frees the instance together with loaded bytecode and everything allocated by the program.
+void scrap_vm_free(ScrapVm* vm);
+
+// Loads bytecode produced by `scrap -compile`. Only one bytecode can be loaded into an instance.
+bool scrap_vm_load_file(ScrapVm* vm, const char* path);
+bool scrap_vm_load_memory(ScrapVm* vm, const void* data, size_t data_size);
+
+// Makes func available to the program under the name, which is the hint of IR_RUN instruction.
+// Registered functions are looked up before the standard library, so they can also replace standard functions,
+// for example std_term_print_str and std_term_println_str to capture the output of the program.
+// Should be called before scrap_vm_run.
+void scrap_vm_register_function(ScrapVm* vm, const char* name, IrRunFunction func);
+
+// Runs the loaded bytecode from the label. Passing NULL runs the program from its start, same as `scrap -run`.
+// Returns false on runtime error, which can be read with scrap_vm_last_error.
+bool scrap_vm_run(ScrapVm* vm, const char* label);
+
+const char* scrap_vm_last_error(ScrapVm* vm);
+
+// Redirects terminal input and output of the program, which are stdin and stdout by default.
+// Files are not closed by the instance. When input is not stdin, reading it does not switch terminal modes.
+void scrap_vm_set_io(ScrapVm* vm, FILE* input, FILE* output);
+
+// Sets the function called every fuel_budget backward jumps and calls of the program (See exec_set_fuel_handler).
+// It can stop the program by returning false, which can be used for time limits, or block to pause it.
+void scrap_vm_set_fuel_handler(ScrapVm* vm, IrFuelHandler handler, int64_t fuel_budget);
+
+// Stops scrap_vm_run running in another thread, which then returns false (See exec_interrupt).
+// Running the instance again clears the interruption.
+void scrap_vm_interrupt(ScrapVm* vm);
+
+// Pointer which native functions can get back with scrap_vm_get_user_data.
+void scrap_vm_set_user_data(ScrapVm* vm, void* user_data);
+void* scrap_vm_get_user_data(ScrapVm* vm);
+
+// Returns the execution engine of the instance, which can be used to push arguments before calling a label.
+IrExec* scrap_vm_exec(ScrapVm* vm);
+
+// Returns the instance which exec belongs to. Can be used inside of native functions.
+ScrapVm* scrap_vm_from_exec(IrExec* exec);
+
+#endif // SCRAP_VM_H
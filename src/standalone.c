@@ -0,0 +1,48 @@
+// Scrap is a project that allows anyone to build software using simple, block based interface.
+//
+// Copyright (C) 2024-2026 Grisshink
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+// Entry point of the standalone runtime. This binary does not depend on raylib or any editor code,
+// exported executables are copies of it with project bytecode appended at the end (See runtime_export)
+
+#include "runtime.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <mach-o/dyld.h>
+#endif
+
+int main(int argc, char** argv) {
+    (void) argc;
+
+#ifdef _WIN32
+    char exe_path[MAX_PATH];
+    if (!GetModuleFileNameA(NULL, exe_path, MAX_PATH)) return runtime_run_embedded(argv[0]);
+    return runtime_run_embedded(exe_path);
+#elif defined(__APPLE__)
+    char exe_path[4096];
+    uint32_t exe_path_size = sizeof(exe_path);
+    if (_NSGetExecutablePath(exe_path, &exe_path_size)) return runtime_run_embedded(argv[0]);
+    return runtime_run_embedded(exe_path);
+#else
+    (void) argv;
+    return runtime_run_embedded("/proc/self/exe");
+#endif
+}
@@ -41,37 +41,10 @@
 #include <dlfcn.h>
 #endif
 
-#define RPRAND_IMPLEMENTATION
-#define RPRANDAPI static __attribute__ ((unused))
-#include "../external/rprand.h"
-
 #define KiB(n) ((size_t)(n) << 10)
 #define MiB(n) ((size_t)(n) << 20)
 #define GiB(n) ((size_t)(n) << 30)
 
-typedef struct {
-    char* name;
-#ifdef _WIN32
-    HMODULE handle;
-#else
-    void* handle;
-#endif
-} StdLibrary;
-
-typedef struct {
-    StdLibrary* items;
-    size_t size, capacity;
-} StdLibraryList;
-
-static int cursor_x = 0;
-static int cursor_y = 0;
-static bool cursor_dirty = false;
-static StdColor clear_color = {0};
-static StdColor bg_color = {0};
-static IrMemArena* std_arena;
-static StdSymbolList loaded_symbols;
-static StdLibraryList loaded_libs;
-
 // NOTE: Shamelessly stolen from raylib codebase ;)
 // Get next codepoint in a UTF-8 encoded text, scanning until '\0' is found
 // When an invalid UTF-8 byte is encountered we exit as soon as possible and a '?'(0x3f) codepoint is returned
@@ -203,9 +176,9 @@ static int get_codepoint(const char *text, int *codepoint_size) {
 
 // NOTE: Shamelessly stolen from raylib codebase ;)
 // Encode codepoint into utf8 text (char array length returned as parameter)
-// NOTE: It uses a static array to store UTF-8 bytes
+// NOTE: It uses a static array to store UTF-8 bytes, which is separate for every thread
 const char *codepoint_to_utf8(int codepoint, int *utf8_size) {
-    static char utf8[6] = { 0 };
+    static _Thread_local char utf8[6] = { 0 };
     int size = 0;   // Byte size of codepoint
 
     if (codepoint <= 0x7f) {
@@ -260,9 +233,9 @@ STD_MATH_FUNC(atan)
 
 #undef STD_MATH_FUNC
 
-static StdLibrary* std_load_library(const char* name) {
-    for (size_t i = 0; i < loaded_libs.size; i++) {
-        if (!strcmp(loaded_libs.items[i].name, name)) return &loaded_libs.items[i];
+static StdLibrary* std_load_library(StdContext* context, const char* name) {
+    for (size_t i = 0; i < context->loaded_libs.size; i++) {
+        if (!strcmp(context->loaded_libs.items[i].name, name)) return &context->loaded_libs.items[i];
     }
 
 #ifdef _WIN32
@@ -280,16 +253,52 @@ static StdLibrary* std_load_library(const char* name) {
 #endif
 
     size_t lib_name_size = strlen(name) + 1;
-    char* name_alloc = ir_arena_alloc(std_arena, lib_name_size);
+    char* name_alloc = ir_arena_alloc(context->arena, lib_name_size);
     memcpy(name_alloc, name, lib_name_size);
 
     StdLibrary lib = {
         .name = name_alloc,
-        .handle = handle,
+        .handle = (void*)handle,
     };
 
-    ir_arena_append(std_arena, loaded_libs, lib);
-    return &loaded_libs.items[loaded_libs.size - 1];
+    ir_arena_append(context->arena, context->loaded_libs, lib);
+    return &context->loaded_libs.items[context->loaded_libs.size - 1];
+}
+
+// Xoshiro128** generator seeded with SplitMix64, same as in rprand
+static uint64_t std_random_splitmix64(StdContext* context) {
+    uint64_t z = (context->random_seed += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+static void std_random_set_seed(StdContext* context, uint64_t seed) {
+    context->random_seed = seed;
+    context->random_state[0] = (uint32_t)(std_random_splitmix64(context) & 0xffffffff);
+    context->random_state[1] = (uint32_t)((std_random_splitmix64(context) & 0xffffffff00000000) >> 32);
+    context->random_state[2] = (uint32_t)(std_random_splitmix64(context) & 0xffffffff);
+    context->random_state[3] = (uint32_t)((std_random_splitmix64(context) & 0xffffffff00000000) >> 32);
+}
+
+static inline uint32_t std_random_rotate_left(const uint32_t x, int k) {
+    return (x << k) | (x >> (32 - k));
+}
+
+static uint32_t std_random_next(StdContext* context) {
+    uint32_t* state = context->random_state;
+    const uint32_t result = std_random_rotate_left(state[1] * 5, 7) * 9;
+    const uint32_t t = state[1] << 9;
+
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+
+    state[2] ^= t;
+
+    state[3] = std_random_rotate_left(state[3], 11);
+    return result;
 }
 
 void std_init(void) {
@@ -315,9 +324,48 @@ void std_init(void) {
 
     SetConsoleOutputCP(65001);
 #endif
-    rprand_set_seed(time(NULL));
+}
+
+StdContext* std_context_new(void) {
+    StdContext* context = calloc(1, sizeof(StdContext));
+    if (!context) return NULL;
 
-    std_arena = ir_arena_new(GiB(1), KiB(512));
+    context->arena = ir_arena_new(GiB(1), KiB(64));
+    if (!context->arena) {
+        free(context);
+        return NULL;
+    }
+
+    context->input = stdin;
+    context->output = stdout;
+
+    // Contexts created at the same time should still produce different numbers
+    std_random_set_seed(context, time(NULL) ^ (uintptr_t)context);
+    return context;
+}
+
+void std_context_free(StdContext* context) {
+    for (size_t i = 0; i < context->loaded_libs.size; i++) {
+        StdLibrary* lib = &context->loaded_libs.items[i];
+        // Empty name refers to the program itself, which should not be closed
+        if (lib->name[0] == 0) continue;
+#ifdef _WIN32
+        FreeLibrary((HMODULE)lib->handle);
+#else
+        dlclose(lib->handle);
+#endif
+    }
+
+    ir_arena_free(context->arena);
+    free(context);
+}
+
+void std_reseed(StdContext* context) {
+#ifdef _WIN32
+    std_random_set_seed(context, time(NULL) ^ GetCurrentProcessId());
+#else
+    std_random_set_seed(context, time(NULL) ^ getpid());
+#endif
 }
 
 static bool std_get_data_type(const char* str, StdType* type) {
@@ -348,6 +396,8 @@ static bool std_get_data_type(const char* str, StdType* type) {
 }
 
 bool std_register_foreign(IrExec* exec) {
+    StdContext* context = exec->context;
+
     // Example of symbol signature: "InitWindow void int int str"
     IrList* symbol_list = exec_pop_list_string(exec);
     IrList* lib_name    = exec_pop_list_string(exec);
@@ -358,7 +408,7 @@ bool std_register_foreign(IrExec* exec) {
     exec_get_string(symbol_list, symbol_sig, 512);
     exec_get_string(lib_name, library_name, 512);
 
-    StdLibrary* lib = std_load_library(library_name);
+    StdLibrary* lib = std_load_library(context, library_name);
     if (!lib) {
         exec_set_error(exec, "std_register_foreign: Error loading library \"%s\"", library_name);
         return false;
@@ -374,7 +424,7 @@ bool std_register_foreign(IrExec* exec) {
     }
 
 #ifdef _WIN32
-    symbol.addr = GetProcAddress(lib->handle, symbol_name);
+    symbol.addr = GetProcAddress((HMODULE)lib->handle, symbol_name);
     if (!symbol.addr) {
         exec_set_error(exec, "std_register_foreign: GetProcAddress Error: %d", GetLastError());
         return false;
@@ -418,22 +468,24 @@ bool std_register_foreign(IrExec* exec) {
             return false;
         }
 
-        ir_arena_append(std_arena, symbol.args, arg_type);
+        ir_arena_append(context->arena, symbol.args, arg_type);
     }
 
-    ir_arena_append(std_arena, loaded_symbols, symbol);
+    ir_arena_append(context->arena, context->loaded_symbols, symbol);
 
     return true;
 }
 
 bool std_run_foreign(IrExec* exec) {
+    StdContext* context = exec->context;
+
     int64_t symbol_index = exec_pop_int(exec);
-    if (symbol_index < 0 || (size_t)symbol_index >= loaded_symbols.size) {
+    if (symbol_index < 0 || (size_t)symbol_index >= context->loaded_symbols.size) {
         exec_set_error(exec, "std_run_foreign: symbol index %ld out of range", symbol_index);
         return false;
     }
 
-    StdSymbol* symbol = &loaded_symbols.items[symbol_index];
+    StdSymbol* symbol = &context->loaded_symbols.items[symbol_index];
 
     ffi_cif cif;
 
@@ -460,8 +512,10 @@ bool std_run_foreign(IrExec* exec) {
         }
 
         if (value_list[i].type == IR_TYPE_STRING) {
-            char* buf = malloc(value_list[i].as.list_val->size + 1);
-            exec_get_string(value_list[i].as.list_val, buf, value_list[i].as.list_val->size + 1);
+            // Every character takes up to 4 bytes in UTF-8
+            size_t buf_size = value_list[i].as.list_val->size * 4 + 1;
+            char* buf = malloc(buf_size);
+            exec_get_string(value_list[i].as.list_val, buf, buf_size);
             value_list[i].as.list_val = (IrList*)buf;
         }
 
@@ -518,6 +572,9 @@ bool std_sleep(IrExec* exec) {
     double secs = exec_pop_float(exec);
 
     if (secs < 0) return true;
+    // Part of the waiting time is spent collecting garbage, so that collection does not have to pause the program later
+    secs -= exec_collect_idle(exec, secs < 1.0 ? secs * 1e6 : 1e6) / 1e6;
+    if (secs <= 0) return true;
 #ifdef _WIN32
     Sleep(secs * 1000);
 #else
@@ -546,7 +603,7 @@ bool std_random_float(IrExec* exec) {
         min = temp;
     }
 
-    double val = (double)rprand_xoshiro() / (double)UINT32_MAX;
+    double val = (double)std_random_next(exec->context) / (double)UINT32_MAX;
     exec_push_float(exec, val * (max - min) + min);
     return true;
 }
@@ -556,43 +613,19 @@ bool std_random_int(IrExec* exec) {
     int64_t min = exec_pop_int(exec);
 
     if (min > max) {
-        exec_push_int(exec, rprand_get_value(max, min));
-    } else {
-        exec_push_int(exec, rprand_get_value(min, max));
+        int64_t temp = max;
+        max = min;
+        min = temp;
     }
+
+    // Range is limited to int, same as it was with rprand_get_value
+    int value = std_random_next(exec->context) % (abs((int)max - (int)min) + 1) + (int)min;
+    exec_push_int(exec, value);
     return true;
 }
 
 bool std_string_join(IrExec* exec) {
-    IrList* right = exec_pop_list_string(exec);
-    IrList* left  = exec_pop_list_string(exec);
-    IR_ASSERT(left  != NULL);
-    IR_ASSERT(right != NULL);
-
-    // Push lists back to avoid them being freed by gc
-    exec_push_list_string(exec, left);
-    exec_push_list_string(exec, right);
-
-    IrList* new_list = exec_list_new(exec);
-    exec_push_list_string(exec, new_list);
-
-    new_list->capacity = left->size + right->size;
-
-    void* items = exec_malloc(exec, new_list->capacity * sizeof(*new_list->items));
-    if (!items) return false;
-
-    new_list = exec_pop_list_string(exec);
-    right = exec_pop_list_string(exec);
-    left  = exec_pop_list_string(exec);
-
-    new_list->items = items;
-
-    memcpy(new_list->items, left->items, left->size * sizeof(*left->items));
-    memcpy(new_list->items + left->size, right->items, right->size * sizeof(*right->items));
-    new_list->size = left->size + right->size;
-    exec_push_list_string(exec, new_list);
-
-    return true;
+    return exec_string_join(exec);
 }
 
 bool std_string_substring(IrExec* exec) {
@@ -603,43 +636,57 @@ bool std_string_substring(IrExec* exec) {
     start = MAX(start, 1);
     end = MIN(end, (int64_t)str->size);
     if (start > end || start > (int64_t)str->size || end < 1) {
-        IrList* new_list = exec_list_new(exec);
-        memset(new_list, 0, sizeof(IrList));
-        exec_push_list_string(exec, new_list);
-        return true;
+        return exec_push_string_alloc(exec, 0, false) != NULL;
     }
 
-    exec_push_list_string(exec, str);
-
-    IrList* new_list = exec_list_new(exec);
-    exec_push_list_string(exec, new_list);
+    if (start == end) return exec_push_string_char(exec, ir_string_get(str, start - 1));
 
-    new_list->capacity = end - start + 1;
+    exec_push_list_string(exec, str);
 
-    void* items = exec_malloc(exec, new_list->capacity * sizeof(*new_list->items));
-    if (!items) return false;
+    if (!exec_push_string_alloc(exec, end - start + 1, str->wide)) return false;
 
-    new_list = exec_pop_list_string(exec);
+    IrList* new_list = exec_pop_list_string(exec);
     str = exec_pop_list_string(exec);
 
-    new_list->items = items;
-
-    memcpy(new_list->items, str->items + start - 1, (end - start + 1) * sizeof(*str->items));
+    ir_string_copy(new_list, 0, str, start - 1, new_list->size);
     exec_push_list_string(exec, new_list);
-    new_list->size = new_list->capacity;
 
     return true;
 }
 
+bool std_string_letter_in(IrExec* exec) {
+    int64_t index = exec_pop_int(exec);
+    IrList* str = exec_pop_list_string(exec);
+
+    if (index < 1 || (size_t)index > str->size) {
+        exec_set_error(exec, "Out of bounds list access. Tried to index value %ld with list of size %zu", index, str->size);
+        return false;
+    }
+    return exec_push_string_char(exec, ir_string_get(str, index - 1));
+}
+
+bool std_string_chr(IrExec* exec) {
+    return exec_push_string_char(exec, exec_pop_int(exec));
+}
+
 bool std_gc_collect(IrExec* exec) {
     exec_collect(exec);
     return true;
 }
 
+// Saves the program state to be continued from the label on the stack. Does nothing unless the runtime
+// was started with a snapshot path (See exec_save_snapshot)
+bool std_snapshot(IrExec* exec) {
+    size_t pos = exec_pop_label(exec);
+    if (!exec->snapshot_path) return true;
+    return exec_save_snapshot(exec, &exec->chunks.items[0], pos, exec->snapshot_path);
+}
+
 void test_cancel(void) {}
 
 bool std_refresh_cursor_pos(IrExec* exec) {
-    if (!cursor_dirty) return true;
+    StdContext* context = exec->context;
+    if (!context->cursor_dirty) return true;
 
 #ifdef _WIN32
     POINT pos;
@@ -648,9 +695,9 @@ bool std_refresh_cursor_pos(IrExec* exec) {
         return false;
     }
 
-    cursor_x = pos.x;
-    cursor_y = pos.y;
-    cursor_dirty = false;
+    context->cursor_x = pos.x;
+    context->cursor_y = pos.y;
+    context->cursor_dirty = false;
 #else
     struct termios term_old_attrs;
     struct termios term_new_attrs;
@@ -670,8 +717,8 @@ bool std_refresh_cursor_pos(IrExec* exec) {
         return false;
     }
 
-    printf("\033[6n"); // Device status report
-    fflush(stdout);
+    fprintf(context->output, "\033[6n"); // Device status report
+    fflush(context->output);
 
     char buf[256];
     ssize_t buf_size = read(0, buf, 255);
@@ -695,58 +742,61 @@ bool std_refresh_cursor_pos(IrExec* exec) {
     long y_val = strtol(buf + 2, &next_arg, 10);
     long x_val = strtol(next_arg + 1, NULL, 10);
 
-    cursor_x = x_val - 1;
-    cursor_y = y_val - 1;
-    cursor_dirty = false;
+    context->cursor_x = x_val - 1;
+    context->cursor_y = y_val - 1;
+    context->cursor_dirty = false;
 #endif // _WIN32
 
     return true;
 }
 
 bool std_term_print_str(IrExec* exec) {
+    StdContext* context = exec->context;
     IrList* list = exec_pop_list_string(exec);
     if (!list) return false;
     for (size_t i = 0; i < list->size; i++) {
-        IrValue c = list->items[i];
-        switch (c.type) {
-        case IR_TYPE_INT: printf("%lc", (wint_t)c.as.int_val); break;
-        case IR_TYPE_BYTE: printf("%c", c.as.byte_val); break;
-        default: printf("?"); break;
+        uint32_t c = ir_string_get(list, i);
+        if (c < 0x80) {
+            fputc(c, context->output);
+        } else {
+            fprintf(context->output, "%lc", (wint_t)c);
         }
     }
-    cursor_dirty = true;
-    fflush(stdout);
+    context->cursor_dirty = true;
+    fflush(context->output);
     return true;
 }
 
 bool std_term_println_str(IrExec* exec) {
     if (!std_term_print_str(exec)) return false;
-    printf("\n");
+    fprintf(((StdContext*)exec->context)->output, "\n");
     return true;
 }
 
 bool std_term_set_fg_color(IrExec* exec) {
+    StdContext* context = exec->context;
     int32_t color_val = exec_pop_int(exec);
     StdColor color = *(StdColor*)&color_val;
     // ESC[38;2;⟨r⟩;⟨g⟩;⟨b⟩m Select RGB foreground color
-    printf("\033[38;2;%d;%d;%dm", color.r, color.g, color.b);
-    fflush(stdout);
+    fprintf(context->output, "\033[38;2;%d;%d;%dm", color.r, color.g, color.b);
+    fflush(context->output);
     return true;
 }
 
 bool std_term_set_bg_color(IrExec* exec) {
+    StdContext* context = exec->context;
     int32_t color_val = exec_pop_int(exec);
     StdColor color = *(StdColor*)&color_val;
     // ESC[48;2;⟨r⟩;⟨g⟩;⟨b⟩m Select RGB background color
-    printf("\033[48;2;%d;%d;%dm", color.r, color.g, color.b);
-    bg_color = color;
-    fflush(stdout);
+    fprintf(context->output, "\033[48;2;%d;%d;%dm", color.r, color.g, color.b);
+    context->bg_color = color;
+    fflush(context->output);
     return true;
 }
 
 bool std_term_set_clear_color(IrExec* exec) {
     int32_t color_val = exec_pop_int(exec);
-    clear_color = *(StdColor*)&color_val;
+    ((StdContext*)exec->context)->clear_color = *(StdColor*)&color_val;
     return true;
 }
 
@@ -790,27 +840,27 @@ bool std_term_cursor_max_x(IrExec* exec) {
 
 bool std_term_cursor_x(IrExec* exec) {
     if (!std_refresh_cursor_pos(exec)) return false;
-    exec_push_int(exec, cursor_x);
+    exec_push_int(exec, ((StdContext*)exec->context)->cursor_x);
     return true;
 }
 
 bool std_term_cursor_y(IrExec* exec) {
     if (!std_refresh_cursor_pos(exec)) return false;
-    exec_push_int(exec, cursor_y);
+    exec_push_int(exec, ((StdContext*)exec->context)->cursor_y);
     return true;
 }
 
 bool std_term_clear(IrExec* exec) {
-    (void) exec;
+    StdContext* context = exec->context;
     // ESC[48;2;⟨r⟩;⟨g⟩;⟨b⟩m Select RGB background color
-    printf("\033[48;2;%d;%d;%dm", clear_color.r, clear_color.g, clear_color.b);
-    printf("\033[2J");
+    fprintf(context->output, "\033[48;2;%d;%d;%dm", context->clear_color.r, context->clear_color.g, context->clear_color.b);
+    fprintf(context->output, "\033[2J");
     // ESC[48;2;⟨r⟩;⟨g⟩;⟨b⟩m Select RGB background color
-    printf("\033[48;2;%d;%d;%dm", bg_color.r, bg_color.g, bg_color.b);
-    cursor_x = 0;
-    cursor_y = 0;
-    cursor_dirty = false;
-    fflush(stdout);
+    fprintf(context->output, "\033[48;2;%d;%d;%dm", context->bg_color.r, context->bg_color.g, context->bg_color.b);
+    context->cursor_x = 0;
+    context->cursor_y = 0;
+    context->cursor_dirty = false;
+    fflush(context->output);
     return true;
 }
 
@@ -820,73 +870,85 @@ bool std_term_set_cursor(IrExec* exec) {
     x = MAX(x, 0);
     y = MAX(y, 0);
 
-    cursor_x = x;
-    cursor_y = y;
-    cursor_dirty = false;
-    printf("\033[%ld;%ldH", y + 1, x + 1);
-    fflush(stdout);
+    StdContext* context = exec->context;
+    context->cursor_x = x;
+    context->cursor_y = y;
+    context->cursor_dirty = false;
+    fprintf(context->output, "\033[%ld;%ldH", y + 1, x + 1);
+    fflush(context->output);
     return true;
 }
 
 bool std_term_get_char(IrExec* exec) {
+    StdContext* context = exec->context;
+    // Terminal mode is only switched when reading from the console, not when input is redirected
+    bool is_console = context->input == stdin;
+
 #ifdef _WIN32
     DWORD old_mode, new_mode;
 
     HANDLE stdin_handle = GetStdHandle(STD_INPUT_HANDLE);
-    GetConsoleMode(stdin_handle, &old_mode);
+    if (is_console) {
+        GetConsoleMode(stdin_handle, &old_mode);
 
-    new_mode = old_mode;
-    new_mode &= ~ENABLE_LINE_INPUT;
-    SetConsoleMode(stdin_handle, new_mode);
+        new_mode = old_mode;
+        new_mode &= ~ENABLE_LINE_INPUT;
+        SetConsoleMode(stdin_handle, new_mode);
+    }
 #else
     struct termios term_old_attrs;
     struct termios term_new_attrs;
 
-    if (tcgetattr(0, &term_old_attrs) == -1) {
-        exec_set_error(exec, "tcgetattr: %s", strerror(errno));
-        return false;
-    }
+    if (is_console) {
+        if (tcgetattr(0, &term_old_attrs) == -1) {
+            exec_set_error(exec, "tcgetattr: %s", strerror(errno));
+            return false;
+        }
 
-    term_new_attrs = term_old_attrs;
-    term_new_attrs.c_lflag &= ~ICANON;
-    term_new_attrs.c_lflag &= ~ECHO;
+        term_new_attrs = term_old_attrs;
+        term_new_attrs.c_lflag &= ~ICANON;
+        term_new_attrs.c_lflag &= ~ECHO;
 
-    if (tcsetattr(0, TCSANOW, &term_new_attrs) == -1) {
-        exec_set_error(exec, "tcsetattr: %s", strerror(errno));
-        return false;
+        if (tcsetattr(0, TCSANOW, &term_new_attrs) == -1) {
+            exec_set_error(exec, "tcsetattr: %s", strerror(errno));
+            return false;
+        }
     }
 #endif
 
     char input[10];
-    input[0] = (char)getchar();
+    input[0] = (char)fgetc(context->input);
 
     int mb_size = leading_ones(input[0]);
 
     if (mb_size == 0) mb_size = 1;
-    for (int i = 1; i < mb_size && i < 10; i++) input[i] = (char)getchar();
+    for (int i = 1; i < mb_size && i < 10; i++) input[i] = (char)fgetc(context->input);
     input[mb_size] = 0;
 
 #ifdef _WIN32
-    SetConsoleMode(stdin_handle, old_mode);
+    if (is_console) SetConsoleMode(stdin_handle, old_mode);
 #else
-    if (tcsetattr(0, TCSANOW, &term_old_attrs) == -1) {
+    if (is_console && tcsetattr(0, TCSANOW, &term_old_attrs) == -1) {
         exec_set_error(exec, "tcsetattr: %s", strerror(errno));
         return false;
     }
 #endif
 
-    cursor_dirty = true;
+    context->cursor_dirty = true;
     exec_push_int(exec, get_codepoint(input, &mb_size));
     return true;
 }
 
 bool std_term_get_input(IrExec* exec) {
+    StdContext* context = exec->context;
     char* string_buf = vector_create();
     char last_char = 0;
     char buf[256];
 
     while (last_char != '\n') {
-        if (!fgets(buf, 256, stdin)) {
+        if (!fgets(buf, 256, context->input)) {
+            // Last line of redirected input might not end with a newline
+            if (feof(context->input)) break;
             exec_set_error(exec, "Error getting input: %s", strerror(errno));
             vector_free(string_buf);
             return false;
@@ -900,84 +962,75 @@ bool std_term_get_input(IrExec* exec) {
     }
     vector_add(&string_buf, 0);
 
-    IrList* list = exec_list_new(exec);
-    exec_push_list_string(exec, list);
-
-    size_t char_count = 0;
-    int mb_size = 0;
-    for (char* str = string_buf; *str; str += mb_size) {
-        get_codepoint(str, &mb_size);
-        char_count++;
-    }
-
-    list->size = char_count;
-    list->capacity = char_count;
-
-    IrValue* items = exec_malloc(exec, list->capacity * sizeof(*list->items));
-    list->items = items;
-
-    char_count = 0;
-    for (char* str = string_buf; *str; str += mb_size) {
-        list->items[char_count] = (IrValue) {
-            .type = IR_TYPE_INT,
-            .as.int_val = get_codepoint(str, &mb_size),
-        };
-        char_count++;
-    }
-
+    bool pushed = exec_push_string(exec, string_buf);
     vector_free(string_buf);
+    if (!pushed) return false;
 
-    cursor_dirty = true;
+    context->cursor_dirty = true;
     return true;
 }
 
-#define STD_FUNC(_f) { #_f, _f }
+#define STD_FUNC(_f) { #_f, #_f, _f }
+#define STD_MATH_FUNC_ENTRY(_f) { #_f, "std_" #_f, std_##_f }
+
+static struct {
+    char* name;
+    char* symbol; // Name of the C function, used for emitting direct calls in ahead-of-time compiled code
+    IrRunFunction func;
+} std_funcs[] = {
+    STD_FUNC(std_random_int),
+    STD_FUNC(std_random_float),
+    STD_FUNC(std_sleep),
+    STD_FUNC(std_unix_time),
+    STD_FUNC(std_term_print_str),
+    STD_FUNC(std_term_println_str),
+    STD_FUNC(std_term_get_input),
+    STD_FUNC(std_term_get_char),
+    STD_FUNC(std_term_set_cursor),
+    STD_FUNC(std_term_cursor_x),
+    STD_FUNC(std_term_cursor_y),
+    STD_FUNC(std_term_cursor_max_x),
+    STD_FUNC(std_term_cursor_max_y),
+    STD_FUNC(std_term_set_fg_color),
+    STD_FUNC(std_term_set_bg_color),
+    STD_FUNC(std_term_set_clear_color),
+    STD_FUNC(std_term_clear),
+    STD_FUNC(std_color_to_string),
+    STD_FUNC(std_string_to_color),
+    STD_FUNC(std_string_join),
+    STD_FUNC(std_string_substring),
+    STD_FUNC(std_string_letter_in),
+    STD_FUNC(std_string_chr),
+    STD_FUNC(std_gc_collect),
+    STD_FUNC(std_snapshot),
+    STD_FUNC(std_register_foreign),
+    STD_FUNC(std_run_foreign),
+    STD_MATH_FUNC_ENTRY(sqrt),
+    STD_MATH_FUNC_ENTRY(round),
+    STD_MATH_FUNC_ENTRY(floor),
+    STD_MATH_FUNC_ENTRY(ceil),
+    STD_MATH_FUNC_ENTRY(sin),
+    STD_MATH_FUNC_ENTRY(cos),
+    STD_MATH_FUNC_ENTRY(tan),
+    STD_MATH_FUNC_ENTRY(asin),
+    STD_MATH_FUNC_ENTRY(acos),
+    STD_MATH_FUNC_ENTRY(atan),
+    { NULL, NULL, NULL },
+};
+
 IrRunFunction std_resolve_function(IrExec* exec, const char* hint) {
     (void) exec;
 
-    struct {
-        char* name;
-        IrRunFunction func;
-    } funcs[] = {
-        STD_FUNC(std_random_int),
-        STD_FUNC(std_random_float),
-        STD_FUNC(std_sleep),
-        STD_FUNC(std_unix_time),
-        STD_FUNC(std_term_print_str),
-        STD_FUNC(std_term_println_str),
-        STD_FUNC(std_term_get_input),
-        STD_FUNC(std_term_get_char),
-        STD_FUNC(std_term_set_cursor),
-        STD_FUNC(std_term_cursor_x),
-        STD_FUNC(std_term_cursor_y),
-        STD_FUNC(std_term_cursor_max_x),
-        STD_FUNC(std_term_cursor_max_y),
-        STD_FUNC(std_term_set_fg_color),
-        STD_FUNC(std_term_set_bg_color),
-        STD_FUNC(std_term_set_clear_color),
-        STD_FUNC(std_term_clear),
-        STD_FUNC(std_color_to_string),
-        STD_FUNC(std_string_to_color),
-        STD_FUNC(std_string_join),
-        STD_FUNC(std_string_substring),
-        STD_FUNC(std_gc_collect),
-        STD_FUNC(std_register_foreign),
-        STD_FUNC(std_run_foreign),
-        { "sqrt",  std_sqrt  },
-        { "round", std_round },
-        { "floor", std_floor },
-        { "ceil",  std_ceil  },
-        { "sin",   std_sin   },
-        { "cos",   std_cos   },
-        { "tan",   std_tan   },
-        { "asin",  std_asin  },
-        { "acos",  std_acos  },
-        { "atan",  std_atan  },
-        { NULL,    NULL      },
-    };
+    for (size_t i = 0; std_funcs[i].name != NULL; i++) {
+        if (!strcmp(hint, std_funcs[i].name)) return std_funcs[i].func;
+    }
+
+    return NULL;
+}
 
-    for (size_t i = 0; funcs[i].name != NULL; i++) {
-        if (!strcmp(hint, funcs[i].name)) return funcs[i].func;
+const char* std_function_symbol(const char* hint) {
+    for (size_t i = 0; std_funcs[i].name != NULL; i++) {
+        if (!strcmp(hint, std_funcs[i].name)) return std_funcs[i].symbol;
     }
 
     return NULL;
@@ -22,6 +22,7 @@
 #define SCRAP_STD_H
 
 #include <stdbool.h>
+#include <stdio.h>
 #include <ffi.h>
 
 #include "scrap_ir.h"
@@ -52,8 +53,45 @@ typedef struct {
     size_t size, capacity;
 } StdSymbolList;
 
+typedef struct {
+    char* name;
+    void* handle;
+} StdLibrary;
+
+typedef struct {
+    StdLibrary* items;
+    size_t size, capacity;
+} StdLibraryList;
+
+// State of the standard library. Every exec running std functions needs its own context stored in exec.context,
+// so independent execs do not share anything and can run in different threads
+typedef struct {
+    FILE* input; // Where terminal functions read from and write to, stdin and stdout by default
+    FILE* output;
+    int cursor_x, cursor_y;
+    bool cursor_dirty;
+    StdColor clear_color;
+    StdColor bg_color;
+    uint64_t random_seed;
+    uint32_t random_state[4];
+    IrMemArena* arena;
+    StdSymbolList loaded_symbols;
+    StdLibraryList loaded_libs;
+} StdContext;
+
 IrRunFunction std_resolve_function(IrExec* exec, const char* hint);
+// Returns name of the C function implementing run function with this hint or NULL if there is no such function.
+// All such functions have IrRunFunction signature
+const char* std_function_symbol(const char* hint);
 
+// Sets up the process for running programs, like the console on Windows. Should be called once before creating contexts
 void std_init(void);
 
+StdContext* std_context_new(void);
+// Closes all foreign libraries loaded by the program
+void std_context_free(StdContext* context);
+
+// Should be called in a process forked from already initialized runtime, so it would not share random state with its siblings
+void std_reseed(StdContext* context);
+
 #endif // SCRAP_STD_H
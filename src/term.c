@@ -38,6 +38,7 @@
 #include <utmp.h>
 #include <signal.h>
 #include <sys/wait.h>
+#include <sys/socket.h>
 #endif
 
 #define TERM_BLACK (TermColor) { 0x00, 0x00, 0x00, 0xff }
@@ -55,6 +56,10 @@ typedef struct {
 #else
     int master_fd, slave_fd;
     pid_t pid;
+
+    // Control socket and pid of the zygote runtime process
+    int zygote_fd;
+    pid_t zygote_pid;
 #endif
 } TermPty;
 
@@ -622,6 +627,20 @@ bool term_run_process(char* command, char* error, size_t error_len) {
     return true;
 }
 
+bool term_start_zygote(const char* exe_path) {
+    // Windows can't fork, so processes are always started with term_run_process
+    (void) exe_path;
+    return false;
+}
+
+bool term_run_zygote(char* bytecode_path, RuntimeGcConfig gc, const char* heap_profile_path, char* error, size_t error_len) {
+    (void) bytecode_path;
+    (void) gc;
+    (void) heap_profile_path;
+    snprintf(error, error_len, gettext("Runtime process is not supported on this platform"));
+    return false;
+}
+
 void term_stop_process(void) {
     if (!term.process_running) return;
     TermPty* pty = term.pty;
@@ -675,6 +694,29 @@ static void child_handler(int sig) {
     // Noop: This handler is only needed to unblock the pselect call in term_wait_for_output function
 }
 
+static bool process_check_status(int status, char* error, size_t error_len) {
+    if (WIFEXITED(status)) {
+        int exit_code = WEXITSTATUS(status);
+        if (exit_code == 0) {
+            return true;
+        } else {
+            snprintf(error, error_len, gettext("Command exited with exit code: %d"), exit_code);
+            return false;
+        }
+    } else if (WIFSIGNALED(status)) {
+        int signum = WTERMSIG(status);
+        if (signum == SIGTERM) {
+            return true;
+        } else {
+            snprintf(error, error_len, gettext("Command signaled with signal %s"), sig_to_str(signum));
+            return false;
+        }
+    } else {
+        snprintf(error, error_len, gettext("Received unknown child status :/"));
+        return false;
+    }
+}
+
 static size_t next_arg(char* cmd, size_t i, char** out_arg) {
     *out_arg = NULL;
 
@@ -700,6 +742,7 @@ static size_t next_arg(char* cmd, size_t i, char** out_arg) {
 
 static TermPty* pty_new(void) {
     TermPty pty_val = {0};
+    pty_val.zygote_fd = -1;
 
     if (openpty(&pty_val.master_fd, &pty_val.slave_fd, NULL, NULL, NULL) == -1) {
         scrap_log(LOG_ERROR, "openpty: %s", strerror(errno));
@@ -837,32 +880,136 @@ bool term_run_process(char* command, char* error, size_t error_len) {
         void* val;
         (void) val;
         pthread_join(term_read_thread, &val);
-        
-        if (WIFEXITED(status)) {
-            int exit_code = WEXITSTATUS(status);
-            if (exit_code == 0) {
-                return true;
-            } else {
-                snprintf(error, error_len, gettext("Command exited with exit code: %d"), exit_code);
-                return false;
-            }
-        } else if (WIFSIGNALED(status)) {
-            int signum = WTERMSIG(status);
-            if (signum == SIGTERM) {
-                return true;
-            } else {
-                snprintf(error, error_len, gettext("Command signaled with signal %s"), sig_to_str(signum));
-                return false;
-            }
-        } else {
-            snprintf(error, error_len, gettext("Received unknown child status :/"));
-            return false;
-        }
+
+        return process_check_status(status, error, error_len);
     }
 
     return true;
 }
 
+static void zygote_close(TermPty* pty) {
+    term.zygote_running = false;
+    if (pty->zygote_fd == -1) return;
+
+    close(pty->zygote_fd);
+    pty->zygote_fd = -1;
+
+    // Zygote exits by itself when the control socket is closed, but it may still wait for its child
+    kill(pty->zygote_pid, SIGTERM);
+    waitpid(pty->zygote_pid, NULL, 0);
+}
+
+static bool zygote_recv(int fd, int* out) {
+    ssize_t n;
+    do {
+        n = recv(fd, out, sizeof(*out), 0);
+    } while (n == -1 && errno == EINTR);
+    return n == sizeof(*out);
+}
+
+bool term_start_zygote(const char* exe_path) {
+    TermPty* pty = term.pty;
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) == -1) {
+        scrap_log(LOG_ERROR, "socketpair: %s", strerror(errno));
+        return false;
+    }
+    // Don't leak editor end of the socket into processes started with term_run_process
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        scrap_log(LOG_ERROR, "fork: %s", strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+
+    if (pid == 0) {
+        close(fds[0]);
+        login_tty(pty->slave_fd);
+
+        char fd_str[16];
+        snprintf(fd_str, sizeof(fd_str), "%d", fds[1]);
+        execl(exe_path, exe_path, "-zygote", fd_str, (char*)NULL);
+        perror("execl");
+        exit(1);
+    }
+
+    close(fds[1]);
+    pty->zygote_fd = fds[0];
+    pty->zygote_pid = pid;
+
+    // Zygote reports when it finishes initializing the runtime. If it fails to start we'll know it here
+    int ready;
+    if (!zygote_recv(pty->zygote_fd, &ready)) {
+        scrap_log(LOG_ERROR, "[TERM] Zygote runtime process failed to start");
+        zygote_close(pty);
+        return false;
+    }
+    term.zygote_running = true;
+
+    scrap_log(LOG_INFO, "[TERM] Started zygote runtime process with pid %d", pid);
+    return true;
+}
+
+bool term_run_zygote(char* bytecode_path, RuntimeGcConfig gc, const char* heap_profile_path, char* error, size_t error_len) {
+    TermPty* pty = term.pty;
+
+    TermZygoteRequest request = {0};
+    if (strlen(bytecode_path) >= TERM_ZYGOTE_PATH_SIZE || (heap_profile_path && strlen(heap_profile_path) >= TERM_ZYGOTE_PATH_SIZE)) {
+        snprintf(error, error_len, gettext("Bytecode path is too long"));
+        return false;
+    }
+    strcpy(request.bytecode_path, bytecode_path);
+    request.gc = gc;
+    if (heap_profile_path) strcpy(request.heap_profile_path, heap_profile_path);
+
+    int pid;
+    if (send(pty->zygote_fd, &request, sizeof(request), MSG_NOSIGNAL) != sizeof(request) || !zygote_recv(pty->zygote_fd, &pid)) {
+        snprintf(error, error_len, gettext("Lost connection to runtime process"));
+        zygote_close(pty);
+        return false;
+    }
+
+    if (pid < 0) {
+        snprintf(error, error_len, gettext("Failed to fork a process: %s"), strerror(-pid));
+        return false;
+    }
+
+    pty->pid = pid;
+
+    pthread_t term_read_thread;
+    if (pthread_create(&term_read_thread, NULL, term_thread_entry, NULL)) {
+        snprintf(error, error_len, gettext("Could not create terminal input thread"));
+        return false;
+    }
+
+    term.process_running = true;
+
+    int status;
+    bool status_received = zygote_recv(pty->zygote_fd, &status);
+
+    term.process_running = false;
+
+    pthread_cancel(term_read_thread);
+
+    void* val;
+    (void) val;
+    pthread_join(term_read_thread, &val);
+
+    if (!status_received) {
+        // Zygote died while running the program, so the child was orphaned. Make sure it does not outlive us
+        kill(pid, SIGKILL);
+        snprintf(error, error_len, gettext("Lost connection to runtime process"));
+        zygote_close(pty);
+        return false;
+    }
+
+    return process_check_status(status, error, error_len);
+}
+
 void term_stop_process(void) {
     TermPty* pty = term.pty;
     if (kill(pty->pid, SIGTERM) == -1) {
@@ -871,6 +1018,8 @@ void term_stop_process(void) {
 }
 
 static void pty_free(TermPty* pty) {
+    zygote_close(pty);
+
     if (pty->master_fd != -1) {
         if (close(pty->master_fd) == -1) scrap_log(LOG_ERROR, "close: %s", strerror(errno));
         pty->master_fd = -1;
@@ -22,11 +22,13 @@
 #define TERM_H
 
 #include "thread.h"
+#include "runtime.h"
 
 #include <semaphore.h>
 #include <stdbool.h>
 
 #define TERM_INPUT_BUF_SIZE 256
+#define TERM_ZYGOTE_PATH_SIZE 4096
 
 typedef struct {
     unsigned char r, g, b, a;
@@ -70,6 +72,15 @@ typedef struct {
     int args_size;
 } TermPrintState;
 
+// Request sent from the editor to the zygote runtime process through the control socket.
+// Zygote replies with the pid of the forked child (or negative errno if fork failed)
+// and then with its wait status once the child terminates
+typedef struct {
+    char bytecode_path[TERM_ZYGOTE_PATH_SIZE];
+    RuntimeGcConfig gc; // Garbage collector settings of the project
+    char heap_profile_path[TERM_ZYGOTE_PATH_SIZE]; // Empty if heap profiling is disabled
+} TermZygoteRequest;
+
 typedef struct {
     MeasureTextSliceFunc measure_text;
     void* font;
@@ -90,6 +101,7 @@ typedef struct {
     // Opaque: Corresponds to TermPty type in term.c
     void* pty;
     bool process_running;
+    bool zygote_running;
 
     char* output_buf;
 
@@ -121,6 +133,9 @@ void term_free(void);
 void term_restart(void);
 void term_flush_input(void);
 bool term_run_process(char* command, char* error, size_t error_len);
+bool term_start_zygote(const char* exe_path);
+// heap_profile_path may be NULL, which disables heap profiling (See runtime_set_heap_profile)
+bool term_run_zygote(char* bytecode_path, RuntimeGcConfig gc, const char* heap_profile_path, char* error, size_t error_len);
 void term_stop_process(void);
 
 #endif // TERM_H
@@ -26,6 +26,12 @@
 #include <signal.h>
 #include <string.h>
 #include <errno.h>
+#include <stdio.h>
+
+typedef struct {
+    size_t location;
+    size_t bytes;
+} HeapProfileSite;
 
 size_t blockdef_register(Vm* vm, Blockdef* blockdef) {
     if (!blockdef->func) scrap_log(LOG_WARNING, "[VM] Block \"%s\" has not defined its implementation!", blockdef->id);
@@ -136,6 +142,7 @@ Vm vm_new(void) {
         .compiler_error = compiler_error_new(1024),
         .error_lines = vector_create(),
         .start_timeout = -1,
+        .heap_profile_blocks = vector_create(),
     };
     return vm;
 }
@@ -155,6 +162,7 @@ void vm_free(Vm* vm) {
 
     for (size_t i = 0; i < vector_size(vm->error_lines); i++) vector_free(vm->error_lines[i]);
     vector_free(vm->error_lines);
+    vector_free(vm->heap_profile_blocks);
 
     for (ssize_t i = (ssize_t)vector_size(vm->blockdefs) - 1; i >= 0 ; i--) {
         blockdef_unregister(vm, i);
@@ -166,6 +174,10 @@ bool vm_start(void) {
     if (thread_is_running(&vm.thread)) return false;
 
     vm.code = editor.code;
+    vm.build_executable = false;
+    vm.heap_profile = project_config.heap_profile;
+    vector_clear(vm.heap_profile_blocks);
+    vm.heap_profile_max = 0;
 
     for (size_t i = 0; i < vector_size(editor.tabs); i++) {
         if (find_panel(editor.tabs[i].root_panel, PANEL_TERM)) {
@@ -188,6 +200,14 @@ bool vm_start(void) {
     return false;
 }
 
+bool vm_build(void) {
+    if (thread_is_running(&vm.thread)) return false;
+    bool ret = vm_start();
+    vm.build_executable = true;
+    vm.heap_profile = false;
+    return ret;
+}
+
 bool vm_stop(void) {
     if (!thread_is_running(&vm.thread)) return false;
     if (term.process_running) {
@@ -206,7 +226,7 @@ void vm_handle_running_thread(void) {
     if (thread_return != THREAD_RETURN_RUNNING) {
         switch (thread_return) {
         case THREAD_RETURN_SUCCESS:
-            actionbar_show(gettext("Vm executed successfully"));
+            actionbar_show(vm.build_executable ? gettext("Build succeeded!") : gettext("Vm executed successfully"));
             break;
         case THREAD_RETURN_FAILURE:
             actionbar_show(gettext("Vm shitted and died :("));
@@ -217,6 +237,7 @@ void vm_handle_running_thread(void) {
         default:
             break;
         }
+        if (vm.heap_profile) vm_load_heap_profile(HEAP_PROFILE_PATH);
 
         size_t i = 0;
         while (vm.compiler_error.buf[i]) {
@@ -239,3 +260,76 @@ void vm_handle_running_thread(void) {
         if (vector_size(vm.error_lines) > 0) ui.render_surface_needs_redraw = true;
     }
 }
+
+static void heap_profile_add_block(Block* block, void* data) {
+    vector_add((Block***)data, block);
+}
+
+static int heap_profile_block_compare(const void* a, const void* b) {
+    const HeapProfileBlock* left = a;
+    const HeapProfileBlock* right = b;
+    if (left->block == right->block) return 0;
+    return left->block < right->block ? -1 : 1;
+}
+
+// Loads the biggest live heap from heap profile written by the runtime (See exec_set_heap_profile).
+// Sites are found by the numbers compiler gives to blocks as their locations (See compiler_compile)
+void vm_load_heap_profile(const char* path) {
+    vector_clear(vm.heap_profile_blocks);
+    vm.heap_profile_max = 0;
+
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        scrap_log(LOG_WARNING, "[VM] Failed to open heap profile %s: %s", path, strerror(errno));
+        return;
+    }
+
+    HeapProfileSite* peak = vector_create();
+    HeapProfileSite* current = vector_create();
+    size_t peak_bytes = 0, current_bytes = 0;
+
+    char line[1024];
+    char name[1024];
+    long long location;
+    size_t lists, list_bytes, strings, string_bytes, items, item_bytes;
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, "heap %*s %*s %zu", &current_bytes) == 1) {
+            vector_clear(current);
+        } else if (sscanf(line, "site %lld %zu %zu %zu %zu %zu %zu %1023s", &location, &lists, &list_bytes, &strings, &string_bytes, &items, &item_bytes, name) == 8) {
+            // Modules number their blocks on their own, so only blocks of the project can be found
+            if (location < 0 || strcmp(name, "main")) continue;
+            vector_add(&current, ((HeapProfileSite) { .location = location, .bytes = list_bytes + string_bytes + item_bytes }));
+        } else if (!strncmp(line, "end", 3) && current_bytes >= peak_bytes) {
+            HeapProfileSite* temp = peak;
+            peak = current;
+            current = temp;
+            peak_bytes = current_bytes;
+        }
+    }
+    fclose(file);
+
+    Block** blocks = vector_create();
+    for (size_t i = 0; i < vector_size(editor.code); i++) {
+        blockchain_walk(editor.code[i].chain, heap_profile_add_block, &blocks);
+    }
+
+    for (size_t i = 0; i < vector_size(peak); i++) {
+        if (peak[i].location >= vector_size(blocks)) continue;
+        vector_add(&vm.heap_profile_blocks, ((HeapProfileBlock) { .block = blocks[peak[i].location], .bytes = peak[i].bytes }));
+        if (peak[i].bytes > vm.heap_profile_max) vm.heap_profile_max = peak[i].bytes;
+    }
+    qsort(vm.heap_profile_blocks, vector_size(vm.heap_profile_blocks), sizeof(HeapProfileBlock), heap_profile_block_compare);
+    scrap_log(LOG_INFO, "[VM] Loaded heap profile with %zu bytes held by %zu blocks", peak_bytes, vector_size(vm.heap_profile_blocks));
+
+    vector_free(blocks);
+    vector_free(current);
+    vector_free(peak);
+    ui.render_surface_needs_redraw = true;
+}
+
+// Returns live memory allocated by block in the loaded heap profile
+size_t vm_get_heap_profile_bytes(Block* block) {
+    HeapProfileBlock key = { .block = block };
+    HeapProfileBlock* found = bsearch(&key, vm.heap_profile_blocks, vector_size(vm.heap_profile_blocks), sizeof(HeapProfileBlock), heap_profile_block_compare);
+    return found ? found->bytes : 0;
+}
@@ -144,7 +144,7 @@ static bool settings_on_toggle_button_click(void) {
 }
 
 static bool project_settings_on_build_button_click(void) {
-    vm_start();
+    vm_build();
     gui_window_hide();
     return true;
 }
@@ -700,6 +700,32 @@ void draw_project_settings_window(void) {
             draw_text_input(&project_config.linker_name, gettext("name"), &linker_name_scroll, true, false);
         end_setting();
 
+        begin_setting(gettext("Initial heap size (MiB)"), false);
+            draw_slider(1, 256, &project_config.heap_size);
+        end_setting();
+
+        begin_setting(gettext("Heap size limit (MiB)"), false);
+            draw_slider(16, 4096, &project_config.heap_limit);
+        end_setting();
+
+        begin_setting(gettext("Heap growth (%)"), false);
+            draw_slider(110, 400, &project_config.gc_growth);
+        end_setting();
+
+        begin_setting(gettext("Live data before collection (%)"), false);
+            draw_slider(10, 90, &project_config.gc_live_ratio);
+        end_setting();
+
+        begin_setting(gettext("Highlight blocks holding memory"), false);
+            gui_element_begin(gui);
+                gui_set_grow(gui, DIRECTION_HORIZONTAL);
+                gui_set_grow(gui, DIRECTION_VERTICAL);
+                gui_set_direction(gui, DIRECTION_HORIZONTAL);
+
+                draw_toggle(&project_config.heap_profile);
+            gui_element_end(gui);
+        end_setting();
+
         gui_grow(gui, DIRECTION_VERTICAL);
 
         gui_element_begin(gui);